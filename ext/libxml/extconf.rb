@@ -68,5 +68,33 @@ unless have_header("zlib.h")
   message "zlib not found: building without compression support\n"
 end
 
+# Optional native threads for batch parsing and validation; defines HAVE_PTHREAD_H if available.
+unless have_header("pthread.h")
+  message "pthread not found: batch operations will run on a single thread\n"
+end
+
+# Optional memory mapped file input; defines HAVE_SYS_MMAN_H if available.
+unless have_header("sys/mman.h")
+  message "sys/mman.h not found: building without memory mapped input\n"
+end
+
+# Ruby's digest API, used to hash canonical output natively; defines HAVE_RUBY_DIGEST_H if available.
+unless have_header("ruby/digest.h")
+  message "ruby/digest.h not found: building without native c14n digests\n"
+end
+
+# Allocated block sizes, used to track libxml's memory; defines HAVE_MALLOC_USABLE_SIZE or HAVE_MALLOC_SIZE if available.
+unless have_func("malloc_usable_size", "malloc.h") || have_func("malloc_size", "malloc/malloc.h")
+  message "malloc block sizes not available: building without memory tracking\n"
+end
+
+# Aligned chunks for arena-backed documents; defines HAVE_POSIX_MEMALIGN if available.
+unless have_func("posix_memalign", "stdlib.h")
+  message "posix_memalign not found: building without document arenas\n"
+end
+
+# Deduplicated frozen strings (Ruby 3.0+), used for names in SAX callbacks; defines HAVE_RB_ENC_INTERNED_STR if available.
+have_func("rb_enc_interned_str", "ruby/encoding.h")
+
 create_header()
 create_makefile('libxml_ruby')
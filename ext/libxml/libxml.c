@@ -11,14 +11,9 @@ VALUE mLibXML;
 
 static void rxml_init_memory(void)
 {
- /* Disable for now - broke attributes. 
-  xmlGcMemSetup(
-      (xmlFreeFunc)ruby_xfree,
-      (xmlMallocFunc)ruby_xmalloc,
-      (xmlMallocFunc)ruby_xmalloc,
-      (xmlReallocFunc)ruby_xrealloc,
-      (xmlStrdupFunc)ruby_strdup
-  );*/
+  /* Track libxml's allocations, see ruby_xml_memory.c.  Ruby's allocator
+     is not used since libxml allocates memory without holding the GVL. */
+  rxml_memory_install();
 }
 
 void Init_libxml_ruby(void)
@@ -40,12 +35,14 @@ void Init_libxml_ruby(void)
  * copyright and distribution information.
  */
 
+  // The allocator must be replaced before libxml allocates anything
+  rxml_init_memory();
+
   // Seutp for threading. http://xmlsoft.org/threads.html
   xmlInitParser();
 
   mLibXML = rb_define_module("LibXML");
 
-  rxml_init_memory();
   rxml_init_xml();
   rxml_init_io();
   rxml_init_error();
@@ -53,6 +50,7 @@ void Init_libxml_ruby(void)
   rxml_init_parser();
   rxml_init_parser_context();
   rxml_init_parser_options();
+  rxml_init_parser_dictionary();
   rxml_init_node();
   rxml_init_attributes();
   rxml_init_attr();
@@ -62,6 +60,7 @@ void Init_libxml_ruby(void)
   rxml_init_namespace();
   rxml_init_sax_parser();
   rxml_init_sax2_handler();
+  rxml_init_sax_attributes();
   rxml_init_xinclude();
   rxml_init_xpath();
   rxml_init_xpath_object();
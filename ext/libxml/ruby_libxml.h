@@ -8,6 +8,8 @@
 #include "ruby_xml_version.h"
 #include "ruby_xml.h"
 #include "ruby_xml_io.h"
+#include "ruby_xml_gvl.h"
+#include "ruby_xml_memory.h"
 #include "ruby_xml_error.h"
 #include "ruby_xml_encoding.h"
 #include "ruby_xml_attributes.h"
@@ -20,6 +22,7 @@
 #include "ruby_xml_parser.h"
 #include "ruby_xml_parser_options.h"
 #include "ruby_xml_parser_context.h"
+#include "ruby_xml_parser_dictionary.h"
 #include "ruby_xml_html_parser.h"
 #include "ruby_xml_html_parser_options.h"
 #include "ruby_xml_html_parser_context.h"
@@ -27,6 +30,7 @@
 #include "ruby_xml_writer.h"
 #include "ruby_xml_sax2_handler.h"
 #include "ruby_xml_sax_parser.h"
+#include "ruby_xml_sax_attributes.h"
 #include "ruby_xml_writer.h"
 #include "ruby_xml_xinclude.h"
 #include "ruby_xml_xpath.h"
@@ -493,19 +493,51 @@ static VALUE rxml_memory_dump(VALUE self)
  * call-seq:
  *    XML.memory_used -> num_bytes
  *
- * Perform a parser memory dump (requires memory debugging
- * support in libxml).
+ * Returns the number of bytes currently allocated by libxml.  This
+ * requires memory debugging support in libxml or memory tracking
+ * (see XML.allocation_stats).
  */
 static VALUE rxml_memory_used(VALUE self)
 {
 #ifdef DEBUG_MEMORY_LOCATION
   return(INT2NUM(xmlMemUsed()));
 #else
+  if (rxml_memory_tracking_p())
+    return rxml_memory_bytes_used();
+
   rb_warn("libxml was compiled without memory debugging support");
   return (Qfalse);
 #endif
 }
 
+/*
+ * call-seq:
+ *    XML.allocation_stats -> Hash
+ *
+ * Returns statistics about the memory allocated by libxml, both for the
+ * whole process and for the calling thread.  The hash contains:
+ *
+ *  :tracking - Whether libxml's allocations are tracked.  Tracking is
+ *              not available on platforms whose allocator cannot report
+ *              the size of allocated blocks, or when another library
+ *              replaced libxml's allocator first.
+ *  :bytes - The number of bytes currently allocated
+ *  :total_bytes - The number of bytes allocated since libxml was loaded
+ *  :allocations - The number of blocks allocated
+ *  :frees - The number of blocks freed
+ *  :thread - A hash with the same counters for the calling thread.  The
+ *            thread's bytes are negative if it freed more memory than it
+ *            allocated.
+ *
+ * Memory allocated by a parse can be limited with
+ * XML::Parser::Context#memory_limit=, while the memory used by a
+ * document is returned by XML::Document#memory_bytes.
+ */
+static VALUE rxml_allocation_stats(VALUE self)
+{
+  return rxml_memory_allocation_stats();
+}
+
 /* The libxml gem provides Ruby language bindings for GNOME's Libxml2
  * XML toolkit. Refer to the README file to get started
  * and the LICENSE file for copyright and distribution information.
@@ -540,6 +572,7 @@ void rxml_init_xml(void)
   rb_define_module_function(mXML, "enabled_xpointer?", rxml_enabled_xpointer_q, 0);
   rb_define_module_function(mXML, "enabled_zlib?", rxml_enabled_zlib_q, 0);
 
+  rb_define_module_function(mXML, "allocation_stats", rxml_allocation_stats, 0);
   rb_define_module_function(mXML, "catalog_dump", rxml_catalog_dump, 0);
   rb_define_module_function(mXML, "catalog_remove", rxml_catalog_remove, 1);
   rb_define_module_function(mXML, "check_lib_versions", rxml_check_lib_versions, 0);
@@ -37,12 +37,18 @@ void rxml_attributes_mark(xmlNodePtr xnode)
   rxml_node_mark(xnode);
 }
 
+static const rb_data_type_t rxml_attributes_data_type = {
+  "LibXML::XML::Attributes",
+  { (RUBY_DATA_FUNC)rxml_attributes_mark, NULL, NULL },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 /*
  * Creates a  new attributes instance.  Not exposed to ruby.
  */
 VALUE rxml_attributes_new(xmlNodePtr xnode)
 {
-  return Data_Wrap_Struct(cXMLAttributes, rxml_attributes_mark, NULL, xnode);
+  return TypedData_Wrap_Struct(cXMLAttributes, &rxml_attributes_data_type, xnode);
 }
 
 /*
@@ -56,7 +62,7 @@ VALUE rxml_attributes_new(xmlNodePtr xnode)
 VALUE rxml_attributes_node_get(VALUE self)
 {
   xmlNodePtr xnode;
-  Data_Get_Struct(self, xmlNode, xnode);
+  TypedData_Get_Struct(self, xmlNode, &rxml_attributes_data_type, xnode);
   return rxml_node_wrap(xnode);
 }
 
@@ -80,7 +86,7 @@ static VALUE rxml_attributes_get_attribute(VALUE self, VALUE name)
 
   name = rb_obj_as_string(name);
 
-  Data_Get_Struct(self, xmlNode, xnode);
+  TypedData_Get_Struct(self, xmlNode, &rxml_attributes_data_type, xnode);
 
   xattr = xmlHasProp(xnode, (xmlChar*) StringValuePtr(name));
 
@@ -114,7 +120,7 @@ static VALUE rxml_attributes_get_attribute_ns(VALUE self, VALUE namespace,
 
   name = rb_obj_as_string(name);
 
-  Data_Get_Struct(self, xmlNode, xnode);
+  TypedData_Get_Struct(self, xmlNode, &rxml_attributes_data_type, xnode);
 
   xattr = xmlHasNsProp(xnode, (xmlChar*) StringValuePtr(name),
                       (xmlChar*) StringValuePtr(namespace));
@@ -191,7 +197,7 @@ static VALUE rxml_attributes_each(VALUE self)
 {
   xmlNodePtr xnode;
   xmlAttrPtr xattr;
-  Data_Get_Struct(self, xmlNode, xnode);
+  TypedData_Get_Struct(self, xmlNode, &rxml_attributes_data_type, xnode);
 
   xattr = xnode->properties;
 
@@ -222,7 +228,7 @@ static VALUE rxml_attributes_length(VALUE self)
   int length = 0;
   xmlNodePtr xnode;
   xmlAttrPtr xattr;
-  Data_Get_Struct(self, xmlNode, xnode);
+  TypedData_Get_Struct(self, xmlNode, &rxml_attributes_data_type, xnode);
 
   xattr = xnode->properties;
 
@@ -246,7 +252,7 @@ static VALUE rxml_attributes_length(VALUE self)
 static VALUE rxml_attributes_first(VALUE self)
 {
   xmlNodePtr xnode;
-  Data_Get_Struct(self, xmlNode, xnode);
+  TypedData_Get_Struct(self, xmlNode, &rxml_attributes_data_type, xnode);
 
   if (xnode->type == XML_ELEMENT_NODE)
   {
@@ -58,14 +58,122 @@
 #include <libxml/xmlschemas.h>
 #include <libxml/xinclude.h>
 
+#ifdef HAVE_RUBY_DIGEST_H
+#include <ruby/digest.h>
+#endif
+
 VALUE cXMLDocument;
 
+/* The libxml memory of each document wrapped by Ruby, as reported to
+   the garbage collector.  Large documents thus cause collections to
+   run sooner, freeing documents that are no longer referenced. */
+static st_table *rxml_document_memsizes = NULL;
+
+static size_t rxml_document_account(xmlDocPtr xdoc)
+{
+  size_t memsize = rxml_node_memsize((xmlNodePtr)xdoc);
+  st_data_t previous = 0;
+
+  st_lookup(rxml_document_memsizes, (st_data_t)xdoc, &previous);
+  st_insert(rxml_document_memsizes, (st_data_t)xdoc, (st_data_t)memsize);
+  rb_gc_adjust_memory_usage((ssize_t)memsize - (ssize_t)previous);
+
+  return memsize;
+}
+
+/* The arenas of documents built with XML::Document.build(arena: true) */
+static st_table *rxml_document_arenas = NULL;
+
+/* The number of arena builds running on any thread, so that creating
+   nodes only looks up the current build while there is one */
+static int rxml_document_arena_builds = 0;
+static ID BUILD_DOCUMENT_ID;
+
+/* Hidden ivar referencing the XML::Parser::Dictionary a document was
+   parsed with, which also keeps it alive */
+static ID DICTIONARY_ATTR;
+
 void rxml_document_free(xmlDocPtr xdoc)
 {
+  st_data_t key = (st_data_t)xdoc;
+  st_data_t memsize;
+  st_data_t arena;
+
+  if (st_delete(rxml_document_memsizes, &key, &memsize))
+    rb_gc_adjust_memory_usage(-(ssize_t)memsize);
+
   xdoc->_private = NULL;
   xmlFreeDoc(xdoc);
+
+  // Free the arena once libxml no longer uses the nodes it holds
+  key = (st_data_t)xdoc;
+  if (st_delete(rxml_document_arenas, &key, &arena))
+  {
+    rb_gc_adjust_memory_usage(-(ssize_t)rxml_arena_memsize((rxml_arena*)arena));
+    rxml_arena_free((rxml_arena*)arena);
+  }
+}
+
+/* Returns the arena of a document built with an arena, or NULL */
+rxml_arena *rxml_document_arena(xmlDocPtr xdoc)
+{
+  st_data_t arena;
+
+  if (st_lookup(rxml_document_arenas, (st_data_t)xdoc, &arena))
+    return (rxml_arena*)arena;
+  else
+    return NULL;
+}
+
+/* Returns the document whose XML::Document.build(arena: true) block the
+   current fiber is running, or NULL */
+xmlDocPtr rxml_document_arena_build(void)
+{
+  VALUE document;
+  xmlDocPtr xdoc;
+
+  if (rxml_document_arena_builds == 0)
+    return NULL;
+
+  document = rb_thread_local_aref(rb_thread_current(), BUILD_DOCUMENT_ID);
+  if (NIL_P(document))
+    return NULL;
+
+  TypedData_Get_Struct(document, xmlDoc, &rxml_document_data_type, xdoc);
+  return xdoc;
+}
+
+void rxml_document_set_dictionary(VALUE document, VALUE dictionary)
+{
+  if (!NIL_P(dictionary))
+    rb_ivar_set(document, DICTIONARY_ATTR, dictionary);
+}
+
+/* Determines whether the document's dictionary is shared with other
+   documents and parser contexts that other Ruby threads may use at any
+   time.  Looking names up in it, as validation does, must then hold the
+   GVL. */
+int rxml_document_shared_dict_p(VALUE document)
+{
+  return !NIL_P(rb_attr_get(document, DICTIONARY_ATTR));
+}
+
+static size_t rxml_document_memsize(const void *data)
+{
+  st_data_t memsize;
+
+  if (st_lookup(rxml_document_memsizes, (st_data_t)data, &memsize))
+    return (size_t)memsize;
+  else
+    return 0;
 }
 
+const rb_data_type_t rxml_document_data_type = {
+  "LibXML::XML::Document",
+  { NULL, (RUBY_DATA_FUNC)rxml_document_free, rxml_document_memsize },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED
+};
+
 VALUE rxml_document_wrap(xmlDocPtr xdoc)
 {
   VALUE result = Qnil;
@@ -77,8 +185,9 @@ VALUE rxml_document_wrap(xmlDocPtr xdoc)
   }
   else
   {
-    result = Data_Wrap_Struct(cXMLDocument, NULL, rxml_document_free, xdoc);
+    result = TypedData_Wrap_Struct(cXMLDocument, &rxml_document_data_type, xdoc);
     xdoc->_private = (void*)result;
+    rxml_document_account(xdoc);
   }
 
   return result;
@@ -93,7 +202,7 @@ VALUE rxml_document_wrap(xmlDocPtr xdoc)
  */
 static VALUE rxml_document_alloc(VALUE klass)
 {
-  return Data_Wrap_Struct(klass, NULL, rxml_document_free, NULL);
+  return TypedData_Wrap_Struct(klass, &rxml_document_data_type, NULL);
 }
 
 /*
@@ -124,12 +233,133 @@ static VALUE rxml_document_initialize(int argc, VALUE *argv, VALUE self)
   xdoc = xmlNewDoc((xmlChar*) StringValuePtr(xmlver));
 
   // Link the ruby object to the document and the document to the ruby object
-  RDATA(self)->data = xdoc;
+  RTYPEDDATA_DATA(self) = xdoc;
   xdoc->_private = (void*)self;
+  rxml_document_account(xdoc);
 
   return self;
 }
 
+typedef struct
+{
+  VALUE document;
+  VALUE previous;
+} rxml_document_build_args;
+
+static VALUE rxml_document_build_yield(VALUE data)
+{
+  rxml_document_build_args *args = (rxml_document_build_args*)data;
+  return rb_yield(args->document);
+}
+
+static VALUE rxml_document_build_ensure(VALUE data)
+{
+  rxml_document_build_args *args = (rxml_document_build_args*)data;
+
+  rb_thread_local_aset(rb_thread_current(), BUILD_DOCUMENT_ID, args->previous);
+  rxml_document_arena_builds--;
+  return Qnil;
+}
+
+/*
+ * call-seq:
+ *    XML::Document.build(xml_version = "1.0") {|document| ... } -> document
+ *    XML::Document.build(xml_version = "1.0", arena: true) {|document| ... } -> document
+ *
+ * Creates a new document, passes it to the block and returns it.
+ *
+ * With the :arena option, the document is built for bulk construction.
+ * Elements and text nodes created with XML::Node.new and
+ * XML::Node.new_text inside the block are allocated from an arena owned
+ * by the document, and element and attribute names are stored once in a
+ * dictionary owned by the document.  Creating nodes thus does not call
+ * malloc for each node and string, and the arena is released in one go
+ * when the document is freed.
+ *
+ *   doc = XML::Document.build(arena: true) do |doc|
+ *     doc.root = XML::Node.new('report')
+ *     rows.each do |row|
+ *       doc.root << XML::Node.new('row', row.to_s)
+ *     end
+ *   end
+ *
+ * Nodes created inside the block belong to the document even before
+ * they are added to it, so they cannot be added to other documents (use
+ * XML::Document#import to copy them).  Nodes that are never added, or
+ * are removed later, keep their memory until the document is freed.
+ *
+ * Arenas require memory tracking, see XML.allocation_stats.
+ */
+static VALUE rxml_document_build(int argc, VALUE *argv, VALUE klass)
+{
+  rxml_document_build_args args;
+  VALUE version, options;
+  VALUE arena = Qfalse;
+  xmlDocPtr xdoc;
+
+  rb_scan_args(argc, argv, "01:", &version, &options);
+
+  if (!NIL_P(options))
+    arena = rb_hash_aref(options, ID2SYM(rb_intern("arena")));
+
+  args.document = rb_class_new_instance(NIL_P(version) ? 0 : 1, &version, klass);
+  TypedData_Get_Struct(args.document, xmlDoc, &rxml_document_data_type, xdoc);
+
+  if (RTEST(arena))
+  {
+    rxml_arena *xarena = rxml_arena_create();
+
+    if (!xarena)
+      rb_raise(rb_eNotImpError, "libxml memory tracking is not available on this platform");
+
+    st_insert(rxml_document_arenas, (st_data_t)xdoc, (st_data_t)xarena);
+    xdoc->dict = xmlDictCreate();
+  }
+
+  if (!rb_block_given_p())
+    return args.document;
+
+  if (RTEST(arena))
+  {
+    args.previous = rb_thread_local_aref(rb_thread_current(), BUILD_DOCUMENT_ID);
+    rb_thread_local_aset(rb_thread_current(), BUILD_DOCUMENT_ID, args.document);
+    rxml_document_arena_builds++;
+
+    rb_ensure(rxml_document_build_yield, (VALUE)&args, rxml_document_build_ensure, (VALUE)&args);
+  }
+  else
+  {
+    rb_yield(args.document);
+  }
+
+  return args.document;
+}
+
+/*
+ * call-seq:
+ *    XML::Document.from_tree([name, attributes = {}, *children]) -> document
+ *
+ * Creates a new document whose root element is built from nested
+ * arrays in a single call, see XML::Node#append_tree.
+ *
+ *   doc = XML::Document.from_tree(['books',
+ *                                  ['book', {id: 1}, ['title', 'Programming Ruby']]])
+ */
+static VALUE rxml_document_from_tree(VALUE klass, VALUE spec)
+{
+  VALUE document = rb_class_new_instance(0, NULL, klass);
+  xmlDocPtr xdoc;
+  xmlNodePtr xroot;
+
+  TypedData_Get_Struct(document, xmlDoc, &rxml_document_data_type, xdoc);
+
+  xroot = rxml_node_build_tree(xdoc, spec);
+  xmlDocSetRootElement(xdoc, xroot);
+  rxml_document_account(xdoc);
+
+  return document;
+}
+
 /* XML_C14N_1* constants are not defined until libxml 1.1.25, so if they
    are not defined then define these constants to map to zero,
    the same value as XML_C14N_1_0. */
@@ -142,121 +372,76 @@ static VALUE rxml_document_initialize(int argc, VALUE *argv, VALUE self)
 #define XML_C14N_1_1 XML_C14N_1_0
 #endif
 
-/*
-  * :call-seq:
-  *   document.canonicalize -> String
-  *   document.canonicalize(options) -> String
-  *
-  * Returns a string containing the canonicalized form of the document.
-  * Implemented to include all of the functionality of the libxml2
-  * {xmlC14NDocDumpMemory}[http://xmlsoft.org/html/libxml-c14n.html#xmlC14NDocDumpMemory]
-  * method.
-  *
-  * === Options
-  * [comments]
-  *   * *Type:* Boolean
-  *   * *Default:* false
-  *   Specifies if comments should be output.
-  *   * Must be boolean, otherwise defaults to false.
-  * [inclusive_ns_prefixes]
-  *   * *Type:* Array of strings
-  *   * *Default:* empty array
-  *   Array of namespace prefixes to include in exclusive canonicalization only.
-  *   * The last item in the list is reserved for a NULL value because the C method demands it, therefore
-  *     up to the first 255 valid entries will be used.
-  *   * <em>Only used for *XML_C14N_EXCLUSIVE_1_0* mode. Ignored otherwise.</em>
-  * [mode]
-  *   * *Type:* XML::Document Constant
-  *   * *Default:* XML_C14N_1_0
-  *   Specifies the mode of canonicalization.
-  *   * *NOTE:* XML_C14N_1_1 may not be fully implemented upon compilation due to C library compatibility.
-  *     Please check if XML_C14N_1_0 and XML_C14N_1_1 are the same value prior to using XML_C14N_1_1.
-  * [nodes]
-  *   * *Type:* Array of XML::Node objects
-  *   * *Default:* empty array
-  *   XML::Nodes to include in the canonicalization process
-  *   * For large lists of more than 256 valid namespaces, up to the first 256 valid entries will be used.
-  */
 #define C14N_NS_LIMIT 256
 #define C14N_NODESET_LIMIT 256
 
-static VALUE
-rxml_document_canonicalize(int argc, VALUE *argv, VALUE self)
+typedef struct
 {
-  VALUE result = Qnil;
-  xmlDocPtr xdoc;
-  xmlChar *buffer = NULL;
-  VALUE option_hash = Qnil;
-  VALUE o_nodes = Qnil;
-
-  // :comments option
-  int comments = 0;
-  // :mode option
-  int c14n_mode = XML_C14N_1_0;
-  // :inclusive_ns_prefixes option (ARRAY)
-
-  xmlChar * inc_ns_prefixes_ptr[C14N_NS_LIMIT];
-
-  // :nodes option (ARRAY)
-  xmlNodePtr  node_ptr_array[C14N_NODESET_LIMIT];
-  xmlNodeSet nodeset = {
-    0, C14N_NODESET_LIMIT, NULL
-  };
+  int comments;
+  int mode;
+  xmlChar *inc_ns_prefixes[C14N_NS_LIMIT];
+  xmlNodePtr nodes[C14N_NODESET_LIMIT];
+  xmlNodeSet nodeset;
+  VALUE io;
+} rxml_c14n_options;
+
+/* Converts the canonicalize options hash.  Strings and nodes referenced by
+   the result belong to the hash, so it must be kept alive while in use. */
+static void rxml_c14n_options_get(VALUE option_hash, rxml_c14n_options *options)
+{
+  options->comments = 0;
+  options->mode = XML_C14N_1_0;
+  options->nodeset.nodeNr = 0;
+  options->nodeset.nodeMax = C14N_NODESET_LIMIT;
+  options->nodeset.nodeTab = options->nodes;
+  options->io = Qnil;
 
   /* At least one NULL value must be defined in the array or the extension will
    * segfault when using XML_C14N_EXCLUSIVE_1_0 mode.
    * API docs: "list of inclusive namespace prefixes ended with a NULL"
    */
-  inc_ns_prefixes_ptr[0] = NULL;
+  options->inc_ns_prefixes[0] = NULL;
 
-  rb_scan_args(argc, argv, "01", &option_hash);
   // Do stuff if ruby hash passed as argument
   if (!NIL_P(option_hash)) 
   {
-	VALUE o_comments = Qnil;
-	VALUE o_mode = Qnil;
-	VALUE o_i_ns_prefixes = Qnil;
-		
+    VALUE o_comments = Qnil;
+    VALUE o_mode = Qnil;
+    VALUE o_i_ns_prefixes = Qnil;
+    VALUE o_nodes = Qnil;
+
     Check_Type(option_hash, T_HASH);
 
     o_comments = rb_hash_aref(option_hash, ID2SYM(rb_intern("comments")));
-    comments = (RTEST(o_comments) ? 1 : 0);
+    options->comments = (RTEST(o_comments) ? 1 : 0);
 
     o_mode = rb_hash_aref(option_hash, ID2SYM(rb_intern("mode")));
     if (!NIL_P(o_mode)) 
-	{
+    {
       Check_Type(o_mode, T_FIXNUM);
-      c14n_mode = NUM2INT(o_mode);
-      //TODO: clean this up
-      //if (c14n_mode > 2) { c14n_mode = 0; }
-      //mode_int = (NUM2INT(o_mode) > 2 ? 0 : NUM2INT(o_mode));
+      options->mode = NUM2INT(o_mode);
     }
 
     o_i_ns_prefixes = rb_hash_aref(option_hash, ID2SYM(rb_intern("inclusive_ns_prefixes")));
     if (!NIL_P(o_i_ns_prefixes)) 
-	{
+    {
       int i;
       int p = 0; //pointer array index
       VALUE *list_in = NULL;
       long list_size = 0;
 
-	  Check_Type(o_i_ns_prefixes, T_ARRAY);
+      Check_Type(o_i_ns_prefixes, T_ARRAY);
       list_in = RARRAY_PTR(o_i_ns_prefixes);
       list_size = RARRAY_LEN(o_i_ns_prefixes);
 
-      if (list_size > 0) 
-	  {
-        for(i=0; i < list_size; ++i) {
-          if (p >= C14N_NS_LIMIT) { break; }
-
-          if (RTEST(list_in[i])) 
-		  {
-            if (TYPE(list_in[i]) == T_STRING) 
-			{
-              inc_ns_prefixes_ptr[p] = (xmlChar *)StringValueCStr(list_in[i]);
-              p++;
-            }
-          }
+      for (i=0; i < list_size; ++i)
+      {
+        if (p >= C14N_NS_LIMIT) { break; }
+
+        if (RTEST(list_in[i]) && TYPE(list_in[i]) == T_STRING) 
+        {
+          options->inc_ns_prefixes[p] = (xmlChar *)StringValueCStr(list_in[i]);
+          p++;
         }
       }
 
@@ -265,67 +450,323 @@ rxml_document_canonicalize(int argc, VALUE *argv, VALUE self)
 
       // API docs: "list of inclusive namespace prefixes ended with a NULL"
       // Set last element to NULL
-      inc_ns_prefixes_ptr[p] = NULL;
+      options->inc_ns_prefixes[p] = NULL;
     }
-    //o_ns_prefixes will free at end of block
 
     o_nodes = rb_hash_aref(option_hash, ID2SYM(rb_intern("nodes")));
     if (!NIL_P(o_nodes)) 
-	{
+    {
       int i;
       int p = 0; // index of pointer array
       VALUE * list_in = NULL;
       long node_list_size = 0;
 
-	  if (CLASS_OF(o_nodes) == cXMLXPathObject)
-	  {
-		  o_nodes = rb_funcall(o_nodes, rb_intern("to_a"), 0);
-	  }
-	  else
-	  {
-		  Check_Type(o_nodes, T_ARRAY);
-	  }
+      if (CLASS_OF(o_nodes) == cXMLXPathObject)
+      {
+        o_nodes = rb_funcall(o_nodes, rb_intern("to_a"), 0);
+        rb_hash_aset(option_hash, ID2SYM(rb_intern("nodes")), o_nodes);
+      }
+      else
+      {
+        Check_Type(o_nodes, T_ARRAY);
+      }
       list_in = RARRAY_PTR(o_nodes);
       node_list_size = RARRAY_LEN(o_nodes);
 
       for (i=0; i < node_list_size; ++i)
-	  {
+      {
         if (p >= C14N_NODESET_LIMIT) { break; }
 
         if (RTEST(list_in[i])) 
-		{
+        {
           xmlNodePtr node_ptr;
-          Data_Get_Struct(list_in[i], xmlNode, node_ptr);
-          node_ptr_array[p] = node_ptr;
+          TypedData_Get_Struct(list_in[i], xmlNode, &rxml_node_data_type, node_ptr);
+          options->nodes[p] = node_ptr;
           p++;
         }
       }
 
-      // Need to set values in nodeset struct
-      nodeset.nodeNr = (node_list_size > C14N_NODESET_LIMIT ?
-                        C14N_NODESET_LIMIT :
-                        (int)node_list_size);
-      nodeset.nodeTab = node_ptr_array;
+      options->nodeset.nodeNr = p;
     }
-  }//option_hash
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
-  xmlC14NDocDumpMemory(xdoc,
-                       (nodeset.nodeNr == 0 ? NULL : &nodeset),
-                       c14n_mode,
-                       inc_ns_prefixes_ptr,
-                       comments,
-                       &buffer);
+    options->io = rb_hash_aref(option_hash, ID2SYM(rb_intern("io")));
+  }
+}
+
+static int rxml_c14n_save_to(xmlDocPtr xdoc, rxml_c14n_options *options, xmlOutputBufferPtr output)
+{
+  return xmlC14NDocSaveTo(xdoc,
+                          (options->nodeset.nodeNr == 0 ? NULL : &options->nodeset),
+                          options->mode,
+                          options->inc_ns_prefixes,
+                          options->comments,
+                          output);
+}
+
+typedef struct
+{
+  VALUE io;
+  const char *buffer;
+  int len;
+  int state;
+} rxml_c14n_io_context;
+
+static VALUE rxml_c14n_io_write(VALUE data)
+{
+  rxml_c14n_io_context *context = (rxml_c14n_io_context*)data;
+  return INT2NUM(rxml_write_callback(context->io, context->buffer, context->len));
+}
 
-  if (buffer)
+/* Writes canonical output to the io.  Exceptions are held back until
+   libxml has cleaned up the output buffer. */
+static int rxml_c14n_io_write_callback(void *data, const char *buffer, int len)
+{
+  rxml_c14n_io_context *context = (rxml_c14n_io_context*)data;
+  VALUE written;
+
+  if (context->state)
+    return -1;
+
+  context->buffer = buffer;
+  context->len = len;
+  written = rb_protect(rxml_c14n_io_write, (VALUE)context, &context->state);
+
+  return context->state ? -1 : NUM2INT(written);
+}
+
+static VALUE rxml_c14n_to_io(xmlDocPtr xdoc, rxml_c14n_options *options)
+{
+  rxml_c14n_io_context context = {options->io, NULL, 0, 0};
+  xmlOutputBufferPtr output;
+  int result;
+
+  output = xmlOutputBufferCreateIO(rxml_c14n_io_write_callback, NULL, &context, NULL);
+  if (!output)
+    rxml_raise(xmlGetLastError());
+
+  result = rxml_c14n_save_to(xdoc, options, output);
+  if (result < 0)
+  {
+    xmlOutputBufferClose(output);
+  }
+  else
   {
-    result = rxml_new_cstr( buffer, NULL);
-    xmlFree(buffer);
+    result = xmlOutputBufferClose(output);
   }
 
+  if (context.state)
+    rb_jump_tag(context.state);
+
+  if (result < 0)
+    rxml_raise(xmlGetLastError());
+
+  return INT2NUM(result);
+}
+
+/*
+  * :call-seq:
+  *   document.canonicalize -> String
+  *   document.canonicalize(options) -> String
+  *   document.canonicalize(:io => io) -> Integer
+  *
+  * Returns a string containing the canonicalized form of the document.
+  * Implemented to include all of the functionality of the libxml2
+  * {xmlC14NDocDumpMemory}[http://xmlsoft.org/html/libxml-c14n.html#xmlC14NDocDumpMemory]
+  * method.
+  *
+  * === Options
+  * [comments]
+  *   * *Type:* Boolean
+  *   * *Default:* false
+  *   Specifies if comments should be output.
+  *   * Must be boolean, otherwise defaults to false.
+  * [inclusive_ns_prefixes]
+  *   * *Type:* Array of strings
+  *   * *Default:* empty array
+  *   Array of namespace prefixes to include in exclusive canonicalization only.
+  *   * The last item in the list is reserved for a NULL value because the C method demands it, therefore
+  *     up to the first 255 valid entries will be used.
+  *   * <em>Only used for *XML_C14N_EXCLUSIVE_1_0* mode. Ignored otherwise.</em>
+  * [io]
+  *   * *Type:* IO
+  *   * *Default:* nil
+  *   Writes the canonical form to the IO (or any object responding to write)
+  *   as it is produced instead of building a string.  The number of bytes
+  *   written is returned.
+  * [mode]
+  *   * *Type:* XML::Document Constant
+  *   * *Default:* XML_C14N_1_0
+  *   Specifies the mode of canonicalization.
+  *   * *NOTE:* XML_C14N_1_1 may not be fully implemented upon compilation due to C library compatibility.
+  *     Please check if XML_C14N_1_0 and XML_C14N_1_1 are the same value prior to using XML_C14N_1_1.
+  * [nodes]
+  *   * *Type:* Array of XML::Node objects
+  *   * *Default:* empty array
+  *   XML::Nodes to include in the canonicalization process
+  *   * For large lists of more than 256 valid namespaces, up to the first 256 valid entries will be used.
+  */
+static VALUE
+rxml_document_canonicalize(int argc, VALUE *argv, VALUE self)
+{
+  VALUE result = Qnil;
+  xmlDocPtr xdoc;
+  xmlChar *buffer = NULL;
+  VALUE option_hash = Qnil;
+  rxml_c14n_options options;
+
+  rb_scan_args(argc, argv, "01", &option_hash);
+  if (!NIL_P(option_hash))
+    option_hash = rb_hash_dup(option_hash);
+  rxml_c14n_options_get(option_hash, &options);
+
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
+
+  if (!NIL_P(options.io))
+  {
+    result = rxml_c14n_to_io(xdoc, &options);
+  }
+  else
+  {
+    xmlC14NDocDumpMemory(xdoc,
+                         (options.nodeset.nodeNr == 0 ? NULL : &options.nodeset),
+                         options.mode,
+                         options.inc_ns_prefixes,
+                         options.comments,
+                         &buffer);
+
+    if (buffer)
+    {
+      result = rxml_new_cstr( buffer, NULL);
+      xmlFree(buffer);
+    }
+  }
+
+  RB_GC_GUARD(option_hash);
   return result;
 }
 
+#ifdef HAVE_RUBY_DIGEST_H
+static const rb_digest_metadata_t* rxml_c14n_digest_metadata(VALUE klass)
+{
+  ID id_metadata = rb_id_metadata();
+  VALUE p;
+
+  for (p = klass; RB_TYPE_P(p, T_CLASS); p = rb_class_superclass(p))
+  {
+    if (rb_ivar_defined(p, id_metadata))
+    {
+      VALUE metadata = rb_ivar_get(p, id_metadata);
+      const rb_digest_metadata_t *meta;
+
+      if (!RB_TYPE_P(metadata, T_DATA))
+        break;
+
+      meta = (const rb_digest_metadata_t*)DATA_PTR(metadata);
+      if (meta->api_version != RUBY_DIGEST_API_VERSION)
+        rb_raise(rb_eRuntimeError, "Unsupported digest API version: %d", meta->api_version);
+
+      return meta;
+    }
+  }
+
+  rb_raise(rb_eArgError, "%"PRIsVALUE" is not a native Digest implementation", klass);
+  return NULL;
+}
+
+typedef struct
+{
+  xmlDocPtr xdoc;
+  rxml_c14n_options *options;
+  const rb_digest_metadata_t *meta;
+  void *context;
+  int result;
+} rxml_c14n_digest_args;
+
+static int rxml_c14n_digest_write_callback(void *data, const char *buffer, int len)
+{
+  rxml_c14n_digest_args *args = (rxml_c14n_digest_args*)data;
+  args->meta->update_func(args->context, (unsigned char*)buffer, (size_t)len);
+  return len;
+}
+
+static void* rxml_c14n_digest_nogvl(void *data)
+{
+  rxml_c14n_digest_args *args = (rxml_c14n_digest_args*)data;
+  xmlOutputBufferPtr output;
+
+  output = xmlOutputBufferCreateIO(rxml_c14n_digest_write_callback, NULL, args, NULL);
+  if (!output)
+  {
+    args->result = -1;
+    return NULL;
+  }
+
+  args->result = rxml_c14n_save_to(args->xdoc, args->options, output);
+  if (args->result < 0)
+    xmlOutputBufferClose(output);
+  else
+    args->result = xmlOutputBufferClose(output);
+
+  return NULL;
+}
+#endif
+
+/*
+ * call-seq:
+ *    document.native_c14n_digest(digest_class, options) -> String
+ *
+ * Implementation of XML::Document#c14n_digest.
+ */
+static VALUE rxml_document_c14n_digest(VALUE self, VALUE digest_class, VALUE option_hash)
+{
+#ifdef HAVE_RUBY_DIGEST_H
+  rxml_c14n_digest_args args;
+  rxml_c14n_options options;
+  VALUE result;
+  VALUE exception = Qnil;
+  int finished;
+
+  args.meta = rxml_c14n_digest_metadata(digest_class);
+
+  if (!NIL_P(option_hash))
+    option_hash = rb_hash_dup(option_hash);
+  rxml_c14n_options_get(option_hash, &options);
+  if (!NIL_P(options.io))
+    rb_raise(rb_eArgError, "The :io option is not supported when computing a digest");
+
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, args.xdoc);
+  args.options = &options;
+  args.result = 0;
+
+  result = rb_str_new(NULL, (long)args.meta->digest_len);
+  args.context = xmalloc(args.meta->ctx_size);
+  if (!args.meta->init_func(args.context))
+  {
+    xfree(args.context);
+    rb_raise(rb_eRuntimeError, "Could not initialize the digest");
+  }
+
+  rxml_without_gvl(rxml_c14n_digest_nogvl, &args, &exception);
+
+  finished = args.meta->finish_func(args.context, (unsigned char*)RSTRING_PTR(result));
+  xfree(args.context);
+  RB_GC_GUARD(option_hash);
+
+  if (exception != Qnil)
+    rb_exc_raise(exception);
+
+  if (args.result < 0)
+    rxml_raise(xmlGetLastError());
+
+  if (!finished)
+    rb_raise(rb_eRuntimeError, "Could not finalize the digest");
+
+  return result;
+#else
+  rb_raise(rb_eNotImpError, "Native digests are not supported by this build");
+  return Qnil;
+#endif
+}
 
 /*
  * call-seq:
@@ -339,7 +780,7 @@ static VALUE rxml_document_compression_get(VALUE self)
   xmlDocPtr xdoc;
 
   int compmode;
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
   compmode = xmlGetDocCompressMode(xdoc);
   if (compmode == -1)
@@ -365,7 +806,7 @@ static VALUE rxml_document_compression_set(VALUE self, VALUE num)
 
   int compmode;
   Check_Type(num, T_FIXNUM);
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
   if (xdoc == NULL)
   {
@@ -398,7 +839,7 @@ static VALUE rxml_document_compression_q(VALUE self)
 #ifdef HAVE_ZLIB_H
   xmlDocPtr xdoc;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
   if (xdoc->compression != -1)
   return(Qtrue);
@@ -419,7 +860,7 @@ static VALUE rxml_document_compression_q(VALUE self)
 static VALUE rxml_document_child_get(VALUE self)
 {
   xmlDocPtr xdoc;
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
   if (xdoc->children == NULL)
     return (Qnil);
@@ -436,7 +877,7 @@ static VALUE rxml_document_child_get(VALUE self)
 static VALUE rxml_document_child_q(VALUE self)
 {
   xmlDocPtr xdoc;
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
   if (xdoc->children == NULL)
     return (Qfalse);
@@ -456,7 +897,7 @@ static VALUE rxml_document_debug(VALUE self)
 {
 #ifdef LIBXML_DEBUG_ENABLED
   xmlDocPtr xdoc;
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
   xmlDebugDumpDocument(NULL, xdoc);
   return Qtrue;
 #else
@@ -475,7 +916,7 @@ static VALUE rxml_document_encoding_get(VALUE self)
 {
   xmlDocPtr xdoc;
   const char *xencoding;
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
   xencoding = (const char*)xdoc->encoding;
   return INT2NUM(xmlParseCharEncoding(xencoding));
@@ -493,7 +934,7 @@ static VALUE rxml_document_rb_encoding_get(VALUE self)
 {
   xmlDocPtr xdoc;
   rb_encoding* rbencoding;
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
   rbencoding = rxml_xml_encoding_to_rb_encoding(mXMLEncoding, xmlParseCharEncoding((const char*)xdoc->encoding));
   return rb_enc_from_encoding(rbencoding);
@@ -510,7 +951,7 @@ static VALUE rxml_document_encoding_set(VALUE self, VALUE encoding)
   xmlDocPtr xdoc;
   const char* xencoding = xmlGetCharEncodingName((xmlCharEncoding)NUM2INT(encoding));
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
   if (xdoc->encoding != NULL)
     xmlFree((xmlChar *) xdoc->encoding);
@@ -536,8 +977,8 @@ static VALUE rxml_document_import(VALUE self, VALUE node)
   xmlDocPtr xdoc;
   xmlNodePtr xnode, xresult;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
-  Data_Get_Struct(node, xmlNode, xnode);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
+  TypedData_Get_Struct(node, xmlNode, &rxml_node_data_type, xnode);
 
   xresult = xmlDocCopyNode(xnode, xdoc, 1);
 
@@ -557,7 +998,7 @@ static VALUE rxml_document_last_get(VALUE self)
 {
   xmlDocPtr xdoc;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
   if (xdoc->last == NULL)
     return (Qnil);
@@ -575,7 +1016,7 @@ static VALUE rxml_document_last_q(VALUE self)
 {
   xmlDocPtr xdoc;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
   if (xdoc->last == NULL)
     return (Qfalse);
@@ -583,6 +1024,26 @@ static VALUE rxml_document_last_q(VALUE self)
     return (Qtrue);
 }
 
+/*
+ * call-seq:
+ *    document.memory_bytes -> num_bytes
+ *
+ * Returns the number of bytes of memory libxml uses for this document's
+ * nodes, attributes, namespaces and text.  Names shared through the
+ * parser's dictionary are not included.  The sizes are exact when libxml's
+ * memory is tracked (see XML.allocation_stats) and estimated otherwise.
+ *
+ * The memory reported to Ruby's garbage collector for the document is
+ * updated at the same time.
+ */
+static VALUE rxml_document_memory_bytes(VALUE self)
+{
+  xmlDocPtr xdoc;
+
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
+  return SIZET2NUM(rxml_document_account(xdoc));
+}
+
 /*
  * call-seq:
  *    document.next -> node
@@ -593,7 +1054,7 @@ static VALUE rxml_document_next_get(VALUE self)
 {
   xmlDocPtr xdoc;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
   if (xdoc->next == NULL)
     return (Qnil);
@@ -611,7 +1072,7 @@ static VALUE rxml_document_next_q(VALUE self)
 {
   xmlDocPtr xdoc;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
   if (xdoc->next == NULL)
     return (Qfalse);
@@ -627,9 +1088,9 @@ static VALUE rxml_document_next_q(VALUE self)
  */
 static VALUE rxml_document_node_type(VALUE self)
 {
-  xmlNodePtr xnode;
-  Data_Get_Struct(self, xmlNode, xnode);
-  return (INT2NUM(xnode->type));
+  xmlDocPtr xdoc;
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
+  return (INT2NUM(xdoc->type));
 }
 
 /*
@@ -642,7 +1103,7 @@ static VALUE rxml_document_parent_get(VALUE self)
 {
   xmlDocPtr xdoc;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
   if (xdoc->parent == NULL)
     return (Qnil);
@@ -660,7 +1121,7 @@ static VALUE rxml_document_parent_q(VALUE self)
 {
   xmlDocPtr xdoc;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
   if (xdoc->parent == NULL)
     return (Qfalse);
@@ -678,7 +1139,7 @@ static VALUE rxml_document_prev_get(VALUE self)
 {
   xmlDocPtr xdoc;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
   if (xdoc->prev == NULL)
     return (Qnil);
@@ -696,7 +1157,7 @@ static VALUE rxml_document_prev_q(VALUE self)
 {
   xmlDocPtr xdoc;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
   if (xdoc->prev == NULL)
     return (Qfalse);
@@ -715,7 +1176,7 @@ static VALUE rxml_document_root_get(VALUE self)
   xmlDocPtr xdoc;
   xmlNodePtr root;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
   root = xmlDocGetRootElement(xdoc);
 
   if (root == NULL)
@@ -738,20 +1199,37 @@ static VALUE rxml_document_root_set(VALUE self, VALUE node)
   if (rb_obj_is_kind_of(node, cXMLNode) == Qfalse)
     rb_raise(rb_eTypeError, "must pass an XML::Node type object");
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
-  Data_Get_Struct(node, xmlNode, xnode);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
+  TypedData_Get_Struct(node, xmlNode, &rxml_node_data_type, xnode);
 
   if (xnode->doc != NULL && xnode->doc != xdoc)
     rb_raise(eXMLError, "Nodes belong to different documents.  You must first import the node by calling LibXML::XML::Document.import");
 
-  xmlDocSetRootElement(xdoc, xnode);
-
   // Ruby no longer manages this nodes memory
   rxml_node_unmanage(xnode, node);
 
+  xmlDocSetRootElement(xdoc, xnode);
+  rxml_node_cache(xnode, node);
+
   return node;
 }
 
+typedef struct
+{
+  xmlDocPtr xdoc;
+  const char *xfilename;
+  const xmlChar *xencoding;
+  int indent;
+  int length;
+} rxml_document_save_args;
+
+static void* rxml_document_save_nogvl(void *data)
+{
+  rxml_document_save_args *args = (rxml_document_save_args*)data;
+  args->length = xmlSaveFormatFileEnc(args->xfilename, args->xdoc, (const char*)args->xencoding, args->indent);
+  return NULL;
+}
+
 /*
  * call-seq:
  *    document.save(filename) -> int
@@ -768,13 +1246,19 @@ static VALUE rxml_document_root_set(VALUE self, VALUE node)
  * :encoding - Specifies the output encoding of the string.  It
  * defaults to the original encoding of the document (see
  * #encoding.  To override the orginal encoding, use one of the
- * XML::Encoding encoding constants. */
+ * XML::Encoding encoding constants.
+ *
+ * :nogvl - Specifies if the document should be written without holding
+ * Ruby's global VM lock, so other threads can run meanwhile.  The
+ * document must not be modified by other threads while it is saved.
+ * The default value is false. */
 static VALUE rxml_document_save(int argc, VALUE *argv, VALUE self)
 {
   VALUE options = Qnil;
   VALUE filename = Qnil;
   xmlDocPtr xdoc;
   int indent = 1;
+  int nogvl = 0;
   const char *xfilename;
   const xmlChar *xencoding;
   int length;
@@ -784,7 +1268,7 @@ static VALUE rxml_document_save(int argc, VALUE *argv, VALUE self)
   Check_Type(filename, T_STRING);
   xfilename = StringValuePtr(filename);
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
   xencoding = xdoc->encoding;
 
   if (!NIL_P(options))
@@ -793,6 +1277,7 @@ static VALUE rxml_document_save(int argc, VALUE *argv, VALUE self)
     Check_Type(options, T_HASH);
     rencoding = rb_hash_aref(options, ID2SYM(rb_intern("encoding")));
     rindent = rb_hash_aref(options, ID2SYM(rb_intern("indent")));
+    nogvl = RTEST(rb_hash_aref(options, ID2SYM(rb_intern("nogvl"))));
 
     if (rindent == Qfalse)
       indent = 0;
@@ -805,7 +1290,23 @@ static VALUE rxml_document_save(int argc, VALUE *argv, VALUE self)
     }
   }
 
-  length = xmlSaveFormatFileEnc(xfilename, xdoc, (const char*)xencoding, indent);
+  if (nogvl)
+  {
+    VALUE exception = Qnil;
+    rxml_document_save_args args = {xdoc, xfilename, xencoding, indent, -1};
+
+    rxml_without_gvl(rxml_document_save_nogvl, &args, &exception);
+    RB_GC_GUARD(filename);
+
+    if (exception != Qnil)
+      rb_exc_raise(exception);
+
+    length = args.length;
+  }
+  else
+  {
+    length = xmlSaveFormatFileEnc(xfilename, xdoc, (const char*)xencoding, indent);
+  }
 
   if (length == -1)
     rxml_raise(xmlGetLastError());
@@ -823,13 +1324,29 @@ static VALUE rxml_document_standalone_q(VALUE self)
 {
   xmlDocPtr xdoc;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
   if (xdoc->standalone)
     return (Qtrue);
   else
     return (Qfalse);
 }
 
+typedef struct
+{
+  xmlDocPtr xdoc;
+  const xmlChar *xencoding;
+  int indent;
+  xmlChar *buffer;
+  int length;
+} rxml_document_to_s_args;
+
+static void* rxml_document_to_s_nogvl(void *data)
+{
+  rxml_document_to_s_args *args = (rxml_document_to_s_args*)data;
+  xmlDocDumpFormatMemoryEnc(args->xdoc, &args->buffer, &args->length, (const char*)args->xencoding, args->indent);
+  return NULL;
+}
+
 /*
  * call-seq:
  *    document.to_s -> "string"
@@ -846,13 +1363,20 @@ static VALUE rxml_document_standalone_q(VALUE self)
  *
  * :encoding - Specifies the output encoding of the string.  It
  * defaults to XML::Encoding::UTF8.  To change it, use one of the
- * XML::Encoding encoding constants. */
+ * XML::Encoding encoding constants.
+ *
+ * :nogvl - Specifies if the document should be serialized without holding
+ * Ruby's global VM lock, so other threads can run meanwhile.  Only the
+ * creation of the resulting string requires the lock.  The document must
+ * not be modified by other threads while it is serialized.  The default
+ * value is false. */
 static VALUE rxml_document_to_s(int argc, VALUE *argv, VALUE self)
 {
   VALUE result;
   VALUE options = Qnil;
   xmlDocPtr xdoc;
   int indent = 1;
+  int nogvl = 0;
   const xmlChar *xencoding = (const xmlChar*) "UTF-8";
   xmlChar *buffer;
   int length;
@@ -865,6 +1389,7 @@ static VALUE rxml_document_to_s(int argc, VALUE *argv, VALUE self)
     Check_Type(options, T_HASH);
     rencoding = rb_hash_aref(options, ID2SYM(rb_intern("encoding")));
     rindent = rb_hash_aref(options, ID2SYM(rb_intern("indent")));
+    nogvl = RTEST(rb_hash_aref(options, ID2SYM(rb_intern("nogvl"))));
 
     if (rindent == Qfalse)
       indent = 0;
@@ -877,10 +1402,29 @@ static VALUE rxml_document_to_s(int argc, VALUE *argv, VALUE self)
     }
   }
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
-  xmlDocDumpFormatMemoryEnc(xdoc, &buffer, &length, (const char*)xencoding, indent);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 
-  result = rxml_new_cstr(buffer, xencoding);
+  if (nogvl)
+  {
+    VALUE exception = Qnil;
+    rxml_document_to_s_args args = {xdoc, xencoding, indent, NULL, 0};
+
+    rxml_without_gvl(rxml_document_to_s_nogvl, &args, &exception);
+    buffer = args.buffer;
+    length = args.length;
+
+    if (exception != Qnil)
+    {
+      xmlFree(buffer);
+      rb_exc_raise(exception);
+    }
+  }
+  else
+  {
+    xmlDocDumpFormatMemoryEnc(xdoc, &buffer, &length, (const char*)xencoding, indent);
+  }
+
+  result = rxml_new_cstr_len(buffer, length, xencoding);
   xmlFree(buffer);
   return result;
 }
@@ -895,7 +1439,7 @@ static VALUE rxml_document_url_get(VALUE self)
 {
   xmlDocPtr xdoc;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
   if (xdoc->URL == NULL)
     return (Qnil);
   else
@@ -912,7 +1456,7 @@ static VALUE rxml_document_version_get(VALUE self)
 {
   xmlDocPtr xdoc;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
   if (xdoc->version == NULL)
     return (Qnil);
   else
@@ -929,7 +1473,7 @@ static VALUE rxml_document_xhtml_q(VALUE self)
 {
   xmlDocPtr xdoc;
 	xmlDtdPtr xdtd;
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
 	xdtd = xmlGetIntSubset(xdoc);
   if (xdtd != NULL && xmlIsXHTML(xdtd->SystemID, xdtd->ExternalID) > 0)
     return (Qtrue);
@@ -950,7 +1494,7 @@ static VALUE rxml_document_xinclude(VALUE self)
 
   int ret;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
   ret = xmlXIncludeProcess(xdoc);
   if (ret >= 0)
   {
@@ -979,31 +1523,79 @@ static VALUE rxml_document_order_elements(VALUE self)
 {
   xmlDocPtr xdoc;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
   return LONG2FIX(xmlXPathOrderDocElems(xdoc));
 }
 
+typedef struct
+{
+  xmlSchemaValidCtxtPtr vptr;
+  xmlDocPtr xdoc;
+  int result;
+} rxml_document_validate_schema_args;
+
+static void* rxml_document_validate_schema_nogvl(void *data)
+{
+  rxml_document_validate_schema_args *args = (rxml_document_validate_schema_args*)data;
+  args->result = xmlSchemaValidateDoc(args->vptr, args->xdoc);
+  return NULL;
+}
+
 /*
  * call-seq:
  *    document.validate_schema(schema)
+ *    document.validate_schema(schema, :nogvl => true)
  *
  * Validate this document against the specified XML::Schema.
  * If the document is valid the method returns true.  Otherwise an
  * exception is raised with validation information.
+ *
+ * If the :nogvl option is true, the document is validated without
+ * holding Ruby's global VM lock so other threads can run meanwhile.
+ * The document must not be modified by other threads while it is
+ * validated.  Documents parsed with an XML::Parser::Dictionary are
+ * always validated holding the lock.  To validate many documents at once, see
+ * XML::Schema#validate_many.
  */
-static VALUE rxml_document_validate_schema(VALUE self, VALUE schema)
+static VALUE rxml_document_validate_schema(int argc, VALUE *argv, VALUE self)
 {
+  VALUE schema = Qnil;
+  VALUE options = Qnil;
   xmlSchemaValidCtxtPtr vptr;
   xmlDocPtr xdoc;
   xmlSchemaPtr xschema;
   int is_invalid;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
-  Data_Get_Struct(schema, xmlSchema, xschema);
+  rb_scan_args(argc, argv, "11", &schema, &options);
+
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
+  TypedData_Get_Struct(schema, xmlSchema, &rxml_schema_data_type, xschema);
+
+  if (!NIL_P(options))
+    Check_Type(options, T_HASH);
 
   vptr = xmlSchemaNewValidCtxt(xschema);
 
-  is_invalid = xmlSchemaValidateDoc(vptr, xdoc);
+  if (!NIL_P(options) && RTEST(rb_hash_aref(options, ID2SYM(rb_intern("nogvl")))) &&
+      !rxml_document_shared_dict_p(self))
+  {
+    VALUE exception = Qnil;
+    rxml_document_validate_schema_args args = {vptr, xdoc, 0};
+
+    rxml_without_gvl(rxml_document_validate_schema_nogvl, &args, &exception);
+    is_invalid = args.result;
+
+    if (exception != Qnil)
+    {
+      xmlSchemaFreeValidCtxt(vptr);
+      rb_exc_raise(exception);
+    }
+  }
+  else
+  {
+    is_invalid = xmlSchemaValidateDoc(vptr, xdoc);
+  }
+
   xmlSchemaFreeValidCtxt(vptr);
   if (is_invalid)
   {
@@ -1031,8 +1623,8 @@ static VALUE rxml_document_validate_relaxng(VALUE self, VALUE relaxng)
   xmlRelaxNGPtr xrelaxng;
   int is_invalid;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
-  Data_Get_Struct(relaxng, xmlRelaxNG, xrelaxng);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
+  TypedData_Get_Struct(relaxng, xmlRelaxNG, &rxml_relaxng_data_type, xrelaxng);
 
   vptr = xmlRelaxNGNewValidCtxt(xrelaxng);
 
@@ -1063,8 +1655,8 @@ static VALUE rxml_document_validate_dtd(VALUE self, VALUE dtd)
   xmlDocPtr xdoc;
   xmlDtdPtr xdtd;
 
-  Data_Get_Struct(self, xmlDoc, xdoc);
-  Data_Get_Struct(dtd, xmlDtd, xdtd);
+  TypedData_Get_Struct(self, xmlDoc, &rxml_document_data_type, xdoc);
+  TypedData_Get_Struct(dtd, xmlDtd, &rxml_dtd_data_type, xdtd);
 
   /* Setup context */
   memset(&ctxt, 0, sizeof(xmlValidCtxt));
@@ -1080,11 +1672,182 @@ static VALUE rxml_document_validate_dtd(VALUE self, VALUE dtd)
   }
 }
 
+/* Batches of documents validated on rxml_parallel workers.  Validation
+   adds IDs and default attributes to a document, which looks their names
+   up in the document's dictionary, so neither a document nor a dictionary
+   may be validated by two threads at once.  Each distinct document is thus
+   run once, and documents that share a dictionary are run one after the
+   other by the same worker.  Documents parsed with an XML::Parser::Dictionary
+   are validated before the GVL is released, since other Ruby threads may
+   use that dictionary at any time. */
+typedef struct
+{
+  rxml_parallel_work *work;
+  long *order;
+  long *groups;
+} rxml_document_batch;
+
+static void* rxml_document_batch_start(void *data, int worker)
+{
+  rxml_document_batch *batch = (rxml_document_batch*)data;
+  return batch->work->start ? batch->work->start(batch->work->data, worker) : NULL;
+}
+
+static void rxml_document_batch_run(void *data, void *state, long index)
+{
+  rxml_document_batch *batch = (rxml_document_batch*)data;
+  long i;
+
+  for (i = batch->groups[index]; i < batch->groups[index + 1]; i++)
+    batch->work->run(batch->work->data, state, batch->order[i]);
+}
+
+static void rxml_document_batch_finish(void *data, void *state)
+{
+  rxml_document_batch *batch = (rxml_document_batch*)data;
+
+  if (batch->work->finish)
+    batch->work->finish(batch->work->data, state);
+}
+
+static void rxml_document_batch_cancel(void *data, long index)
+{
+  rxml_document_batch *batch = (rxml_document_batch*)data;
+  long i;
+
+  if (!batch->work->cancel)
+    return;
+
+  for (i = batch->groups[index]; i < batch->groups[index + 1]; i++)
+    batch->work->cancel(batch->work->data, batch->order[i]);
+}
+
+/* Runs work, whose items are the given documents, on up to threads native
+   threads without the GVL.  The documents must have been type checked.
+   Documents left over when the calling thread is interrupted are passed to
+   work->cancel instead.
+   sources[i] is set to the index of the first occurrence of documents[i],
+   which is the only one that is run - the caller copies its results.
+   Returns the exception raised by Ruby callbacks, or Qnil. */
+VALUE rxml_document_run_many(VALUE documents, rxml_parallel_work *work, int threads, long *sources)
+{
+  long count = RARRAY_LEN(documents);
+  rxml_document_batch batch;
+  rxml_parallel_work pool;
+  st_table *firsts, *dicts;
+  VALUE exception = Qnil;
+  VALUE buffer;
+  long *group_of, ngroups = 0, shared = 0, i;
+
+  /* Group of each distinct document, then the documents ordered by group
+     and where each group starts in that order */
+  group_of = ALLOCV_N(long, buffer, count * 3 + 1);
+  batch.order = group_of + count;
+  batch.groups = batch.order + count;
+  batch.work = work;
+
+  firsts = st_init_numtable();
+  dicts = st_init_numtable();
+
+  for (i = 0; i < count; i++)
+  {
+    xmlDocPtr xdoc;
+    st_data_t value;
+
+    TypedData_Get_Struct(RARRAY_AREF(documents, i), xmlDoc, &rxml_document_data_type, xdoc);
+
+    if (st_lookup(firsts, (st_data_t)xdoc, &value))
+    {
+      sources[i] = (long)value;
+      group_of[i] = -1;
+      continue;
+    }
+
+    sources[i] = i;
+    st_insert(firsts, (st_data_t)xdoc, (st_data_t)i);
+
+    if (rxml_document_shared_dict_p(RARRAY_AREF(documents, i)))
+    {
+      group_of[i] = -2;
+      shared++;
+      continue;
+    }
+
+    if (!st_lookup(dicts, xdoc->dict ? (st_data_t)xdoc->dict : (st_data_t)xdoc, &value))
+    {
+      value = (st_data_t)ngroups++;
+      st_insert(dicts, xdoc->dict ? (st_data_t)xdoc->dict : (st_data_t)xdoc, value);
+    }
+    group_of[i] = (long)value;
+  }
+
+  st_free_table(firsts);
+  st_free_table(dicts);
+
+  if (shared > 0)
+  {
+    void *state = work->start ? work->start(work->data, 0) : NULL;
+
+    for (i = 0; i < count; i++)
+    {
+      if (group_of[i] == -2)
+        work->run(work->data, state, i);
+    }
+
+    if (work->finish)
+      work->finish(work->data, state);
+  }
+
+  /* Counting sort of the documents by group */
+  memset(batch.groups, 0, sizeof(long) * (ngroups + 1));
+  for (i = 0; i < count; i++)
+  {
+    if (group_of[i] >= 0)
+      batch.groups[group_of[i] + 1]++;
+  }
+
+  for (i = 0; i < ngroups; i++)
+    batch.groups[i + 1] += batch.groups[i];
+
+  for (i = 0; i < count; i++)
+  {
+    if (group_of[i] >= 0)
+      batch.order[batch.groups[group_of[i]]++] = i;
+  }
+
+  /* Filling in the order moved each start to the next group's start */
+  memmove(batch.groups + 1, batch.groups, sizeof(long) * ngroups);
+  batch.groups[0] = 0;
+
+  memset(&pool, 0, sizeof(pool));
+  pool.count = ngroups;
+  pool.data = &batch;
+  pool.start = rxml_document_batch_start;
+  pool.run = rxml_document_batch_run;
+  pool.finish = rxml_document_batch_finish;
+  pool.cancel = rxml_document_batch_cancel;
+
+  if (ngroups > 0)
+    rxml_parallel(&pool, threads, &exception);
+
+  ALLOCV_END(buffer);
+
+  return exception;
+}
+
 void rxml_init_document(void)
 {
   cXMLDocument = rb_define_class_under(mXML, "Document", rb_cObject);
   rb_define_alloc_func(cXMLDocument, rxml_document_alloc);
 
+  rxml_document_memsizes = st_init_numtable();
+  rxml_document_arenas = st_init_numtable();
+  BUILD_DOCUMENT_ID = rb_intern("__libxml_build_document__");
+  DICTIONARY_ATTR = rb_intern("dictionary");
+
+  rb_define_singleton_method(cXMLDocument, "build", rxml_document_build, -1);
+  rb_define_singleton_method(cXMLDocument, "from_tree", rxml_document_from_tree, 1);
+
   /* Original C14N 1.0 spec */
   rb_define_const(cXMLDocument, "XML_C14N_1_0", INT2NUM(XML_C14N_1_0));
   /* Exclusive C14N 1.0 spec */
@@ -1094,6 +1857,7 @@ void rxml_init_document(void)
 
   rb_define_method(cXMLDocument, "initialize", rxml_document_initialize, -1);
   rb_define_method(cXMLDocument, "canonicalize", rxml_document_canonicalize, -1);
+  rb_define_private_method(cXMLDocument, "native_c14n_digest", rxml_document_c14n_digest, 2);
   rb_define_method(cXMLDocument, "child", rxml_document_child_get, 0);
   rb_define_method(cXMLDocument, "child?", rxml_document_child_q, 0);
   rb_define_method(cXMLDocument, "compression", rxml_document_compression_get, 0);
@@ -1106,6 +1870,7 @@ void rxml_init_document(void)
   rb_define_method(cXMLDocument, "import", rxml_document_import, 1);
   rb_define_method(cXMLDocument, "last", rxml_document_last_get, 0);
   rb_define_method(cXMLDocument, "last?", rxml_document_last_q, 0);
+  rb_define_method(cXMLDocument, "memory_bytes", rxml_document_memory_bytes, 0);
   rb_define_method(cXMLDocument, "next", rxml_document_next_get, 0);
   rb_define_method(cXMLDocument, "next?", rxml_document_next_q, 0);
   rb_define_method(cXMLDocument, "node_type", rxml_document_node_type, 0);
@@ -1124,6 +1889,6 @@ void rxml_init_document(void)
   rb_define_method(cXMLDocument, "xhtml?", rxml_document_xhtml_q, 0);
   rb_define_method(cXMLDocument, "xinclude", rxml_document_xinclude, 0);
   rb_define_method(cXMLDocument, "validate", rxml_document_validate_dtd, 1);
-  rb_define_method(cXMLDocument, "validate_schema", rxml_document_validate_schema, 1);
+  rb_define_method(cXMLDocument, "validate_schema", rxml_document_validate_schema, -1);
   rb_define_method(cXMLDocument, "validate_relaxng", rxml_document_validate_relaxng, 1);
 }
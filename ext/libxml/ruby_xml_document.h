@@ -4,8 +4,14 @@
 #define __RXML_DOCUMENT__
 
 extern VALUE cXMLDocument;
+extern const rb_data_type_t rxml_document_data_type;
 void rxml_init_document(void);
 VALUE rxml_document_wrap(xmlDocPtr xnode);
+rxml_arena *rxml_document_arena(xmlDocPtr xdoc);
+xmlDocPtr rxml_document_arena_build(void);
+void rxml_document_set_dictionary(VALUE document, VALUE dictionary);
+int rxml_document_shared_dict_p(VALUE document);
+VALUE rxml_document_run_many(VALUE documents, rxml_parallel_work *work, int threads, long *sources);
 
 typedef xmlChar * xmlCharPtr;
 #endif
@@ -45,14 +45,33 @@ void rxml_dtd_mark(xmlDtdPtr xdtd)
   }
 }
 
+static size_t rxml_dtd_memsize(const void *data)
+{
+  return sizeof(xmlDtd);
+}
+
+/* Dtds created from Ruby are freed unless they were added to a document */
+const rb_data_type_t rxml_dtd_data_type = {
+  "LibXML::XML::Dtd",
+  { (RUBY_DATA_FUNC)rxml_dtd_mark, (RUBY_DATA_FUNC)rxml_dtd_free, rxml_dtd_memsize },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/* Dtds owned by libxml */
+static const rb_data_type_t rxml_dtd_wrapped_data_type = {
+  "LibXML::XML::Dtd",
+  { NULL, NULL, NULL },
+  &rxml_dtd_data_type, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 static VALUE rxml_dtd_alloc(VALUE klass)
 {
-  return Data_Wrap_Struct(klass, rxml_dtd_mark, rxml_dtd_free, NULL);
+  return TypedData_Wrap_Struct(klass, &rxml_dtd_data_type, NULL);
 }
 
 VALUE rxml_dtd_wrap(xmlDtdPtr xdtd)
 {
-  return  Data_Wrap_Struct(cXMLDtd, NULL, NULL, xdtd);
+  return TypedData_Wrap_Struct(cXMLDtd, &rxml_dtd_wrapped_data_type, xdtd);
 }
 
 /*
@@ -64,7 +83,7 @@ VALUE rxml_dtd_wrap(xmlDtdPtr xdtd)
 static VALUE rxml_dtd_external_id_get(VALUE self)
 {
   xmlDtdPtr xdtd;
-  Data_Get_Struct(self, xmlDtd, xdtd);
+  TypedData_Get_Struct(self, xmlDtd, &rxml_dtd_data_type, xdtd);
 
 
   if (xdtd->ExternalID == NULL)
@@ -82,7 +101,7 @@ static VALUE rxml_dtd_external_id_get(VALUE self)
 static VALUE rxml_dtd_name_get(VALUE self)
 {
   xmlDtdPtr xdtd;
-  Data_Get_Struct(self, xmlDtd, xdtd);
+  TypedData_Get_Struct(self, xmlDtd, &rxml_dtd_data_type, xdtd);
 
 
   if (xdtd->name == NULL)
@@ -101,7 +120,7 @@ static VALUE rxml_dtd_name_get(VALUE self)
 static VALUE rxml_dtd_uri_get(VALUE self)
 {
   xmlDtdPtr xdtd;
-  Data_Get_Struct(self, xmlDtd, xdtd);
+  TypedData_Get_Struct(self, xmlDtd, &rxml_dtd_data_type, xdtd);
 
   if (xdtd->SystemID == NULL)
     return (Qnil);
@@ -118,7 +137,7 @@ static VALUE rxml_dtd_uri_get(VALUE self)
 static VALUE rxml_dtd_type(VALUE self)
 {
   xmlDtdPtr xdtd;
-  Data_Get_Struct(self, xmlDtd, xdtd);
+  TypedData_Get_Struct(self, xmlDtd, &rxml_dtd_data_type, xdtd);
   return (INT2NUM(xdtd->type));
 }
 
@@ -178,7 +197,7 @@ static VALUE rxml_dtd_initialize(int argc, VALUE *argv, VALUE self)
           {
             if (rb_obj_is_kind_of(doc, cXMLDocument) == Qfalse)
               rb_raise(rb_eTypeError, "Must pass an LibXML::XML::Document object");
-            Data_Get_Struct(doc, xmlDoc, xdoc);
+            TypedData_Get_Struct(doc, xmlDoc, &rxml_document_data_type, xdoc);
           }
 
           if (internal == Qnil || internal == Qfalse)
@@ -189,9 +208,7 @@ static VALUE rxml_dtd_initialize(int argc, VALUE *argv, VALUE self)
           if (xdtd == NULL)
             rxml_raise(xmlGetLastError());
 
-          /* The document will free the dtd so Ruby should not */
-          RDATA(self)->dfree = NULL;
-          DATA_PTR(self) = xdtd;
+          RTYPEDDATA_DATA(self) = xdtd;
 
           xmlSetTreeDoc((xmlNodePtr) xdtd, xdoc);
         }
@@ -209,7 +226,7 @@ static VALUE rxml_dtd_initialize(int argc, VALUE *argv, VALUE self)
         if (xdtd == NULL)
           rxml_raise(xmlGetLastError());
 
-        DATA_PTR(self) = xdtd;
+        RTYPEDDATA_DATA(self) = xdtd;
 
         xmlSetTreeDoc((xmlNodePtr) xdtd, NULL);
         break;
@@ -234,7 +251,7 @@ static VALUE rxml_dtd_initialize(int argc, VALUE *argv, VALUE self)
 
         xmlFree(new_string);
 
-        DATA_PTR(self) = xdtd;
+        RTYPEDDATA_DATA(self) = xdtd;
         break;
       }
       default:
@@ -191,6 +191,20 @@ VALUE rxml_new_cstr_len(const xmlChar* xstr, const long length, const xmlChar* x
   return rb_external_str_new_with_enc((const char*)xstr, length, rbencoding);
 }
 
+/* Returns a frozen UTF-8 string.  Equal strings are the same object when
+   Ruby supports interned strings and no conversion to a different
+   default internal encoding is needed. */
+VALUE rxml_new_interned_cstr(const xmlChar* xstr)
+{
+#ifdef HAVE_RB_ENC_INTERNED_STR
+  rb_encoding *internal = rb_default_internal_encoding();
+
+  if (!internal || internal == rb_utf8_encoding())
+    return rb_enc_interned_str((const char*)xstr, (long)strlen((const char*)xstr), rb_utf8_encoding());
+#endif
+  return rb_obj_freeze(rxml_new_cstr(xstr, NULL));
+}
+
 void rxml_init_encoding(void)
 {
   mXMLEncoding = rb_define_module_under(mXML, "Encoding");
@@ -13,6 +13,7 @@ void rxml_init_encoding(void);
 
 VALUE rxml_new_cstr(const xmlChar* xstr, const xmlChar* xencoding);
 VALUE rxml_new_cstr_len(const xmlChar* xstr, const long length, const xmlChar* xencoding);
+VALUE rxml_new_interned_cstr(const xmlChar* xstr);
 
 rb_encoding* rxml_xml_encoding_to_rb_encoding(VALUE klass, xmlCharEncoding xmlEncoding);
 rb_encoding* rxml_figure_encoding(const xmlChar* xencoding);
@@ -96,13 +96,9 @@ VALUE rxml_error_wrap(const xmlError *xerror)
   return result;
 }
 
-/* Hook that receives xml error message */
-#if LIBXML_VERSION >= 21200
-static void structuredErrorFunc(void *userData, const xmlError *xerror)
-#else
-static void structuredErrorFunc(void *userData, xmlErrorPtr xerror)
-#endif
+static void* rxml_error_report(void *data)
 {
+  const xmlError *xerror = (const xmlError*)data;
   VALUE error = rxml_error_wrap(xerror);
 
   /* Wrap error up as Ruby object and send it off to ruby */
@@ -113,6 +109,18 @@ static void structuredErrorFunc(void *userData, xmlErrorPtr xerror)
   {
     rb_funcall(block, CALL_METHOD, 1, error);
   }
+  return NULL;
+}
+
+/* Hook that receives xml error message.  Errors can be raised while libxml
+   runs without the GVL, so make sure to hold it before calling into Ruby. */
+#if LIBXML_VERSION >= 21200
+static void structuredErrorFunc(void *userData, const xmlError *xerror)
+#else
+static void structuredErrorFunc(void *userData, xmlErrorPtr xerror)
+#endif
+{
+  rxml_with_gvl(rxml_error_report, (void*)xerror);
 }
 
 static void rxml_set_handler(VALUE self, VALUE block)
@@ -172,6 +180,67 @@ void rxml_raise(const xmlError *xerror)
   }
 }
 
+/* Fills in an error that libxml did not report itself, such as one for an
+   item of a batch that was cancelled.  Free it with xmlResetError. */
+void rxml_error_init(xmlError *xerror, int domain, int code, const char *message)
+{
+  memset(xerror, 0, sizeof(xmlError));
+  xerror->domain = domain;
+  xerror->code = code;
+  xerror->level = XML_ERR_FATAL;
+  xerror->message = (char*)xmlStrdup((const xmlChar*)message);
+}
+
+/* Copies an error into the list.  This does not call into Ruby so it may
+   be used without holding the GVL. */
+void rxml_error_list_add(rxml_error_list *list, const xmlError *xerror)
+{
+  if (!xerror)
+    return;
+
+  if (list->count == list->capacity)
+  {
+    int capacity = list->capacity ? list->capacity * 2 : 4;
+    xmlError *errors = realloc(list->errors, sizeof(xmlError) * capacity);
+
+    if (!errors)
+      return;
+
+    list->errors = errors;
+    list->capacity = capacity;
+  }
+
+  memset(&list->errors[list->count], 0, sizeof(xmlError));
+  xmlCopyError((xmlErrorPtr)xerror, &list->errors[list->count]);
+  list->count++;
+}
+
+/* Returns the errors as an array of XML::Error and frees the list */
+VALUE rxml_error_list_wrap(rxml_error_list *list)
+{
+  VALUE result = rb_ary_new_capa(list->count);
+  int i;
+
+  for (i = 0; i < list->count; i++)
+    rb_ary_push(result, rxml_error_wrap(&list->errors[i]));
+
+  rxml_error_list_free(list);
+  return result;
+}
+
+void rxml_error_list_free(rxml_error_list *list)
+{
+  int i;
+
+  for (i = 0; i < list->count; i++)
+    xmlResetError(&list->errors[i]);
+
+  free(list->errors);
+  list->errors = NULL;
+  list->count = 0;
+  list->capacity = 0;
+}
+
 void rxml_init_error(void)
 {
   CALL_METHOD = rb_intern("call");
@@ -351,6 +420,7 @@ void rxml_init_error(void)
   rb_define_const(eXMLError, "NOTATION_PROCESSING", INT2NUM(XML_ERR_NOTATION_PROCESSING));
   rb_define_const(eXMLError, "WAR_NS_COLUMN", INT2NUM(XML_WAR_NS_COLUMN));
   rb_define_const(eXMLError, "WAR_ENTITY_REDEFINED", INT2NUM(XML_WAR_ENTITY_REDEFINED));
+  rb_define_const(eXMLError, "USER_STOP", INT2NUM(XML_ERR_USER_STOP));
 #endif
   rb_define_const(eXMLError, "NS_ERR_XML_NAMESPACE", INT2NUM(XML_NS_ERR_XML_NAMESPACE));
   rb_define_const(eXMLError, "NS_ERR_UNDEFINED_NAMESPACE", INT2NUM(XML_NS_ERR_UNDEFINED_NAMESPACE));
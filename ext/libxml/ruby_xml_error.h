@@ -10,5 +10,18 @@ extern VALUE eXMLError;
 void rxml_init_error(void);
 VALUE rxml_error_wrap(const xmlError *xerror);
 void rxml_raise(const xmlError *xerror);
+void rxml_error_init(xmlError *xerror, int domain, int code, const char *message);
+
+/* Errors collected without the GVL, for example by batch validation */
+typedef struct
+{
+  xmlError *errors;
+  int count;
+  int capacity;
+} rxml_error_list;
+
+void rxml_error_list_add(rxml_error_list *list, const xmlError *xerror);
+VALUE rxml_error_list_wrap(rxml_error_list *list);
+void rxml_error_list_free(rxml_error_list *list);
 
 #endif
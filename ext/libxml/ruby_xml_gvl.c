@@ -0,0 +1,330 @@
+/* Please see the LICENSE file for copyright and distribution information */
+
+#include "ruby_libxml.h"
+#include <ruby/atomic.h>
+#include <ruby/thread.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/* Support for running libxml code without holding Ruby's global VM lock.
+ *
+ * rxml_without_gvl runs a function with the GVL released so other Ruby
+ * threads can make progress.  libxml may still need to call back into
+ * Ruby while that function runs - most commonly to report errors via
+ * XML::Error.set_handler.  Those callbacks must go through rxml_with_gvl,
+ * which reacquires the GVL when needed and otherwise calls straight through.
+ *
+ * Exceptions raised by Ruby code inside rxml_with_gvl cannot unwind through
+ * libxml, so they are caught, remembered and handed back to the caller of
+ * rxml_without_gvl once libxml has returned.  Any later callbacks in the same
+ * call are skipped.  Callbacks made on native threads that Ruby does not
+ * know about are skipped too, and rxml_with_gvl returns NULL. */
+
+typedef struct rxml_gvl_frame
+{
+  VALUE exception;
+  struct rxml_gvl_frame *previous;
+} rxml_gvl_frame;
+
+typedef struct
+{
+  rxml_gvl_frame *frame;
+  rxml_gvl_func func;
+  void *data;
+  void *result;
+} rxml_gvl_call;
+
+#ifdef RB_THREAD_LOCAL_SPECIFIER
+static RB_THREAD_LOCAL_SPECIFIER rxml_gvl_frame *current_frame = NULL;
+#endif
+
+int rxml_gvl_released_p(void)
+{
+#ifdef RB_THREAD_LOCAL_SPECIFIER
+  return current_frame != NULL;
+#else
+  return 0;
+#endif
+}
+
+static VALUE rxml_gvl_call_protected(VALUE data)
+{
+  rxml_gvl_call *call = (rxml_gvl_call*)data;
+  call->result = call->func(call->data);
+  return Qnil;
+}
+
+static void* rxml_gvl_call_with_gvl(void *data)
+{
+  rxml_gvl_call *call = (rxml_gvl_call*)data;
+  int state = 0;
+
+  rb_protect(rxml_gvl_call_protected, (VALUE)call, &state);
+
+  if (state)
+  {
+    call->frame->exception = rb_errinfo();
+    rb_set_errinfo(Qnil);
+  }
+  return NULL;
+}
+
+/* Releases the GVL like rxml_without_gvl.  If ubf is given it is called
+   when the thread is interrupted, and the interrupt is left pending for
+   the caller to handle once it has cleaned up.  func is not called at all
+   if the thread was already interrupted, in which case NULL is returned. */
+static void *rxml_without_gvl_ubf(rxml_gvl_func func, void *data, rb_unblock_function_t *ubf,
+                                  void *ubf_data, VALUE *exception)
+{
+#ifdef RB_THREAD_LOCAL_SPECIFIER
+  rxml_gvl_frame frame;
+  void *result;
+
+  frame.exception = Qnil;
+  frame.previous = current_frame;
+  current_frame = &frame;
+
+  if (ubf)
+    result = rb_thread_call_without_gvl2(func, data, ubf, ubf_data);
+  else
+    result = rb_thread_call_without_gvl(func, data, NULL, NULL);
+
+  current_frame = frame.previous;
+  *exception = frame.exception;
+  RB_GC_GUARD(frame.exception);
+
+  return result;
+#else
+  /* Without thread local storage there is no way for callbacks to know
+     whether they hold the GVL, so keep holding it. */
+  *exception = Qnil;
+  return func(data);
+#endif
+}
+
+void *rxml_without_gvl(rxml_gvl_func func, void *data, VALUE *exception)
+{
+  return rxml_without_gvl_ubf(func, data, NULL, NULL, exception);
+}
+
+/* Calls func holding the GVL, with the thread's memory scopes suspended
+   since the Ruby code it runs may switch fibers */
+static void *rxml_gvl_call_ruby(rxml_gvl_func func, void *data)
+{
+  rxml_memory_scope *scope = rxml_memory_scope_suspend();
+  void *result = func(data);
+
+  rxml_memory_scope_resume(scope);
+  return result;
+}
+
+void *rxml_with_gvl(rxml_gvl_func func, void *data)
+{
+#ifdef RB_THREAD_LOCAL_SPECIFIER
+  rxml_gvl_frame *frame = current_frame;
+  rxml_memory_scope *scope;
+  rxml_gvl_call call;
+
+  /* Threads Ruby does not know about, such as the workers started by
+     rxml_parallel, can never call into Ruby */
+  if (!ruby_native_thread_p())
+    return NULL;
+
+  if (frame == NULL)
+    return rxml_gvl_call_ruby(func, data);
+
+  /* An earlier callback raised an exception, don't call into Ruby again */
+  if (frame->exception != Qnil)
+    return NULL;
+
+  call.frame = frame;
+  call.func = func;
+  call.data = data;
+  call.result = NULL;
+
+  /* Nested calls made while holding the GVL should call straight through */
+  current_frame = NULL;
+  scope = rxml_memory_scope_suspend();
+  rb_thread_call_with_gvl(rxml_gvl_call_with_gvl, &call);
+  rxml_memory_scope_resume(scope);
+  current_frame = frame;
+
+  return call.result;
+#else
+  if (!ruby_native_thread_p())
+    return NULL;
+
+  return rxml_gvl_call_ruby(func, data);
+#endif
+}
+
+/* rxml_parallel runs a batch of independent items on a pool of native
+ * threads with the GVL released.  The work functions must never call into
+ * Ruby.  libxml's error handlers are per thread, so the worker threads
+ * silence them - work functions should install context specific handlers
+ * to collect errors.  Without pthreads the items are processed on the
+ * calling thread.
+ *
+ * Interrupting the calling thread, for example with Thread#raise or a
+ * signal, stops the workers from starting further items.  Those are passed
+ * to the cancel function with the GVL held, and the interrupt is handled
+ * once rxml_parallel has returned to Ruby. */
+typedef struct
+{
+  rxml_parallel_work *work;
+  int threads;
+  long next;
+  rb_atomic_t cancelled;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t lock;
+#endif
+} rxml_parallel_pool;
+
+typedef struct
+{
+  rxml_parallel_pool *pool;
+  int index;
+} rxml_parallel_worker_args;
+
+#if LIBXML_VERSION >= 21200
+static void rxml_parallel_error(void *userData, const xmlError *xerror)
+#else
+static void rxml_parallel_error(void *userData, xmlErrorPtr xerror)
+#endif
+{
+}
+
+static void rxml_parallel_process(rxml_parallel_pool *pool, int worker)
+{
+  rxml_parallel_work *work = pool->work;
+  void *state = work->start ? work->start(work->data, worker) : NULL;
+  long index;
+
+  /* Items are taken in order, so when cancelled the ones from pool->next
+     on were never started */
+  while (!RUBY_ATOMIC_LOAD(pool->cancelled))
+  {
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&pool->lock);
+    index = pool->next < work->count ? pool->next++ : work->count;
+    pthread_mutex_unlock(&pool->lock);
+#else
+    index = pool->next < work->count ? pool->next++ : work->count;
+#endif
+
+    if (index >= work->count)
+      break;
+
+    work->run(work->data, state, index);
+  }
+
+  if (work->finish)
+    work->finish(work->data, state);
+}
+
+static void rxml_parallel_cancel(void *data)
+{
+  rxml_parallel_pool *pool = (rxml_parallel_pool*)data;
+  RUBY_ATOMIC_SET(pool->cancelled, 1);
+}
+
+#ifdef HAVE_PTHREAD_H
+static void* rxml_parallel_worker(void *data)
+{
+  rxml_parallel_worker_args *args = (rxml_parallel_worker_args*)data;
+  xmlSetStructuredErrorFunc(NULL, rxml_parallel_error);
+  rxml_parallel_process(args->pool, args->index);
+  return NULL;
+}
+#endif
+
+static void* rxml_parallel_nogvl(void *data)
+{
+  rxml_parallel_pool *pool = (rxml_parallel_pool*)data;
+  int threads = pool->threads;
+
+  if (threads > pool->work->count)
+    threads = (int)pool->work->count;
+
+#ifdef HAVE_PTHREAD_H
+  {
+    int size = threads > 0 ? threads : 1;
+    pthread_t *workers = malloc(sizeof(pthread_t) * size);
+    rxml_parallel_worker_args *args = malloc(sizeof(rxml_parallel_worker_args) * size);
+    int started = 0;
+    int i;
+
+    for (i = 0; workers && args && i < threads; i++)
+    {
+      args[i].pool = pool;
+      args[i].index = i;
+      if (pthread_create(&workers[i], NULL, rxml_parallel_worker, &args[i]) != 0)
+        break;
+      started++;
+    }
+
+    /* If no threads could be started do the work on this one */
+    if (started == 0)
+      rxml_parallel_process(pool, 0);
+
+    for (i = 0; i < started; i++)
+      pthread_join(workers[i], NULL);
+
+    free(workers);
+    free(args);
+  }
+#else
+  rxml_parallel_process(pool, 0);
+#endif
+
+  return pool;
+}
+
+static VALUE rxml_parallel_check_ints(VALUE data)
+{
+  rb_thread_check_ints();
+  return Qnil;
+}
+
+void rxml_parallel(rxml_parallel_work *work, int threads, VALUE *exception)
+{
+  rxml_parallel_pool pool;
+  long i;
+
+  pool.work = work;
+  pool.threads = threads;
+  pool.next = 0;
+  pool.cancelled = 0;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_init(&pool.lock, NULL);
+#endif
+
+  /* Nothing is started while an interrupt is pending, which includes
+     Ruby's own thread switches.  Handle it and try again, unless it raised
+     an exception which is then returned like those of callbacks. */
+  while (!rxml_without_gvl_ubf(rxml_parallel_nogvl, &pool, rxml_parallel_cancel, &pool, exception))
+  {
+    int state = 0;
+
+    rb_protect(rxml_parallel_check_ints, Qnil, &state);
+    if (state)
+    {
+      *exception = rb_errinfo();
+      rb_set_errinfo(Qnil);
+      break;
+    }
+  }
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_destroy(&pool.lock);
+#endif
+
+  if (work->cancel)
+  {
+    for (i = pool.next; i < work->count; i++)
+      work->cancel(work->data, i);
+  }
+}
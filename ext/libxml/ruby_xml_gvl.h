@@ -0,0 +1,29 @@
+/* Please see the LICENSE file for copyright and distribution information */
+
+#ifndef __RXML_GVL__
+#define __RXML_GVL__
+
+typedef void *(*rxml_gvl_func)(void *data);
+
+int rxml_gvl_released_p(void);
+void *rxml_without_gvl(rxml_gvl_func func, void *data, VALUE *exception);
+void *rxml_with_gvl(rxml_gvl_func func, void *data);
+
+/* Work split over a pool of native threads by rxml_parallel.  start and
+   finish are optional and set up and tear down per thread state.  start
+   is passed the index of the worker, which is less than the number of
+   threads.  cancel is optional too and is called instead of run for the
+   items left over when the batch is interrupted. */
+typedef struct
+{
+  long count;
+  void *data;
+  void *(*start)(void *data, int worker);
+  void (*run)(void *data, void *state, long index);
+  void (*finish)(void *data, void *state);
+  void (*cancel)(void *data, long index);
+} rxml_parallel_work;
+
+void rxml_parallel(rxml_parallel_work *work, int threads, VALUE *exception);
+
+#endif
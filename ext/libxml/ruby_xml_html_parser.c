@@ -63,17 +63,20 @@ static VALUE rxml_html_parser_parse(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
   VALUE context = rb_ivar_get(self, CONTEXT_ATTR);
+  VALUE document;
   
-  Data_Get_Struct(context, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(context, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
-  if (htmlParseDocument(ctxt) == -1 && ! ctxt->recovery)
+  if (rxml_parser_context_parse_limited(context, ctxt, htmlParseDocument) == -1 && ! ctxt->recovery)
   {
     rxml_raise(&ctxt->lastError);
   }
 
   rb_funcall(context, rb_intern("close"), 0);
 
-  return rxml_document_wrap(ctxt->myDoc);
+  document = rxml_document_wrap(ctxt->myDoc);
+  rxml_document_set_dictionary(document, rxml_parser_context_dictionary(context));
+  return document;
 }
 
 void rxml_init_html_parser(void)
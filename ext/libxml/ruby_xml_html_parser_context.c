@@ -134,9 +134,16 @@ static void rxml_html_parser_context_free(htmlParserCtxtPtr ctxt)
   htmlFreeParserCtxt(ctxt);
 }
 
+/* Inherits from the XML parser context so that its methods accept it */
+static const rb_data_type_t rxml_html_parser_context_data_type = {
+  "LibXML::XML::HTMLParser::Context",
+  { NULL, (RUBY_DATA_FUNC)rxml_html_parser_context_free, rxml_parser_context_memsize },
+  &rxml_parser_context_data_type, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 static VALUE rxml_html_parser_context_wrap(htmlParserCtxtPtr ctxt)
 {
-  return Data_Wrap_Struct(cXMLHtmlParserContext, NULL, rxml_html_parser_context_free, ctxt);
+  return TypedData_Wrap_Struct(cXMLHtmlParserContext, &rxml_html_parser_context_data_type, ctxt);
 }
 
 /* call-seq:
@@ -182,7 +189,7 @@ static VALUE rxml_html_parser_context_io(int argc, VALUE* argv, VALUE klass)
   VALUE io, options;
   rb_scan_args(argc, argv, "11", &io, &options);
 
-  VALUE result;
+  VALUE result, io_input;
   htmlParserCtxtPtr ctxt;
   xmlParserInputBufferPtr input;
   xmlParserInputPtr stream;
@@ -190,8 +197,9 @@ static VALUE rxml_html_parser_context_io(int argc, VALUE* argv, VALUE klass)
   if (NIL_P(io))
     rb_raise(rb_eTypeError, "Must pass in an IO object");
 
+  io_input = rxml_io_input_new(io);
   input = xmlParserInputBufferCreateIO((xmlInputReadCallback) rxml_read_callback, NULL,
-                                     (void*)io, XML_CHAR_ENCODING_NONE);
+                                     RTYPEDDATA_DATA(io_input), XML_CHAR_ENCODING_NONE);
 
   ctxt = htmlNewParserCtxt();
   if (!ctxt)
@@ -218,7 +226,7 @@ static VALUE rxml_html_parser_context_io(int argc, VALUE* argv, VALUE klass)
   result = rxml_html_parser_context_wrap(ctxt);
 
   /* Attach io object to parser so it won't get freed.*/
-  rb_ivar_set(result, IO_ATTR, io);
+  rb_ivar_set(result, IO_ATTR, io_input);
 
   return result;
 }
@@ -275,7 +283,7 @@ static VALUE rxml_html_parser_context_close(VALUE self)
 {
   htmlParserCtxtPtr ctxt;
   xmlParserInputPtr xinput;
-  Data_Get_Struct(self, htmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, htmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   while ((xinput = inputPop(ctxt)) != NULL)
   {
@@ -293,7 +301,7 @@ static VALUE rxml_html_parser_context_close(VALUE self)
 static VALUE rxml_html_parser_context_disable_cdata_set(VALUE self, VALUE value)
 {
   htmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, htmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, htmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->sax == NULL)
     rb_raise(rb_eRuntimeError, "Sax handler is not yet set");
@@ -322,7 +330,7 @@ static VALUE rxml_html_parser_context_options_set(VALUE self, VALUE options)
   htmlParserCtxtPtr ctxt;
   Check_Type(options, T_FIXNUM);
 
-  Data_Get_Struct(self, htmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, htmlParserCtxt, &rxml_parser_context_data_type, ctxt);
   htmlCtxtUseOptions(ctxt, xml_options);
 
 #if LIBXML_VERSION >= 20707
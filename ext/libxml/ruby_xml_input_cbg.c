@@ -2,83 +2,327 @@
 
 #include "ruby_libxml.h"
 #include "ruby_xml_input_cbg.h"
+#include <ruby/util.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#if RUBY_ST_H
+#include <ruby/st.h>
+#else
+#include <st.h>
+#endif
 
 /* Document-class: LibXML::XML::InputCallbacks
  *
- * Support for adding custom scheme handlers. */
+ * Support for adding custom scheme handlers.  A handler is a class that
+ * responds to document_query(url).  It may return a String with the
+ * whole document, an IO-like object responding to read, or an
+ * Enumerable (such as an Enumerator) yielding the document in chunks.
+ * IO objects and chunks are read incrementally while the document is
+ * parsed, so documents do not need to be held in memory.  IO objects
+ * are closed once libxml is done with them.
+ *
+ *   class MyHandler
+ *     def self.document_query(url)
+ *       File.open(url.sub('my://', ''), 'rb')
+ *     end
+ *   end
+ *
+ *   XML::InputCallbacks.add_scheme('my://', MyHandler)
+ *   XML::InputCallbacks.register
+ *
+ *   XML::InputCallbacks.remove_scheme('my://')
+ *   XML::InputCallbacks.unregister */
+
+/* Schemes are indexed by the part of their name up to and including the
+   first colon ("http:"), compared case insensitively.  Each index entry
+   is the list of schemes sharing that prefix.  Scheme names without a
+   colon can match any url and are kept in a separate list. */
+#define IC_KEY_MAX 64
+
+static st_table *ic_schemes = NULL;
+static ic_scheme *ic_unkeyed_schemes = NULL;
+static VALUE ic_handlers = Qnil;
+static VALUE cInputCallbacks;
+static ID CLOSE_METHOD;
+static ID DOCUMENT_QUERY_METHOD;
+static ID READ_METHOD;
+static int ic_registered = 0;
+
+/* Documents libxml has opened and not closed yet, marked by ic_documents.
+   libxml may close them without the GVL, or after a callback raised an
+   exception, so they are unlinked without calling into Ruby. */
+static ic_doc_context *ic_open_documents = NULL;
+static VALUE ic_documents = Qnil;
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t ic_documents_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void ic_documents_lock_acquire(void)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&ic_documents_lock);
+#endif
+}
 
-static ic_scheme *first_scheme = 0;
+static void ic_documents_lock_release(void)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&ic_documents_lock);
+#endif
+}
 
-int ic_match(char const *filename)
+static void ic_documents_mark(void *data)
 {
-  ic_scheme *scheme;
+  ic_doc_context *ic_doc;
 
-  //fprintf( stderr, "ic_match: %s\n", filename );
+  ic_documents_lock_acquire();
+  for (ic_doc = ic_open_documents; ic_doc; ic_doc = ic_doc->next_doc)
+    rb_gc_mark(ic_doc->self);
+  ic_documents_lock_release();
+}
 
-  scheme = first_scheme;
-  while (0 != scheme)
+static const rb_data_type_t ic_documents_data_type = {
+  "LibXML::XML::InputCallbacks documents",
+  { ic_documents_mark, NULL, NULL },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static void ic_documents_add(ic_doc_context *ic_doc)
+{
+  ic_documents_lock_acquire();
+  ic_doc->prev_doc = NULL;
+  ic_doc->next_doc = ic_open_documents;
+  if (ic_open_documents)
+    ic_open_documents->prev_doc = ic_doc;
+  ic_open_documents = ic_doc;
+  ic_documents_lock_release();
+}
+
+static void ic_documents_remove(ic_doc_context *ic_doc)
+{
+  ic_documents_lock_acquire();
+  if (ic_doc->prev_doc)
+    ic_doc->prev_doc->next_doc = ic_doc->next_doc;
+  else
+    ic_open_documents = ic_doc->next_doc;
+  if (ic_doc->next_doc)
+    ic_doc->next_doc->prev_doc = ic_doc->prev_doc;
+  ic_documents_lock_release();
+}
+
+static int ic_scheme_key(const char *name, char *key)
+{
+  int i;
+
+  for (i = 0; i < IC_KEY_MAX - 1 && name[i]; i++)
   {
-    if (!xmlStrncasecmp(BAD_CAST filename, BAD_CAST scheme->scheme_name, scheme->name_len))
+    key[i] = name[i];
+    if (name[i] == ':')
     {
+      key[i + 1] = '\0';
       return 1;
     }
-    scheme = scheme->next_scheme;
   }
   return 0;
 }
 
-void* ic_open(char const *filename)
+static ic_scheme* ic_find_in(ic_scheme *scheme, char const *filename)
 {
-  ic_doc_context *ic_doc;
-  ic_scheme *scheme;
-  VALUE res;
-
-  scheme = first_scheme;
   while (0 != scheme)
   {
     if (!xmlStrncasecmp(BAD_CAST filename, BAD_CAST scheme->scheme_name, scheme->name_len))
-    {
-      ic_doc = (ic_doc_context*) malloc(sizeof(ic_doc_context));
+      return scheme;
+    scheme = scheme->next_scheme;
+  }
+  return 0;
+}
 
-      res = rb_funcall(scheme->class, rb_intern("document_query"), 1,
-          rb_str_new2(filename));
+/* Does not call into Ruby since libxml may call it without the GVL */
+static ic_scheme* ic_find(char const *filename)
+{
+  char key[IC_KEY_MAX];
+  st_data_t bucket;
+  ic_scheme *scheme = 0;
 
-      ic_doc->buffer = strdup(StringValuePtr(res));
+  if (ic_schemes && ic_scheme_key(filename, key) && st_lookup(ic_schemes, (st_data_t)key, &bucket))
+    scheme = ic_find_in((ic_scheme*)bucket, filename);
 
-      ic_doc->bpos = ic_doc->buffer;
-      ic_doc->remaining = (int)strlen(ic_doc->buffer);
-      return ic_doc;
-    }
-    scheme = scheme->next_scheme;
+  if (!scheme)
+    scheme = ic_find_in(ic_unkeyed_schemes, filename);
+
+  return scheme;
+}
+
+/* The handlers are Ruby objects, so urls are not matched on native
+   threads Ruby does not know about, such as XML::Parser.parse_many's
+   workers.  Loading them fails instead. */
+int ic_match(char const *filename)
+{
+  if (!ruby_native_thread_p())
+    return 0;
+
+  return ic_find(filename) ? 1 : 0;
+}
+
+static void ic_doc_context_mark(ic_doc_context *ic_doc)
+{
+  rb_gc_mark(ic_doc->source);
+  rb_gc_mark(ic_doc->io);
+}
+
+static void ic_doc_context_free(ic_doc_context *ic_doc)
+{
+  xfree(ic_doc);
+}
+
+static size_t ic_doc_context_memsize(const void *data)
+{
+  return sizeof(ic_doc_context);
+}
+
+static const rb_data_type_t ic_doc_context_data_type = {
+  "LibXML::XML::InputCallbacks document",
+  { (RUBY_DATA_FUNC)ic_doc_context_mark, (RUBY_DATA_FUNC)ic_doc_context_free, ic_doc_context_memsize },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+typedef struct
+{
+  ic_scheme *scheme;
+  char const *filename;
+} ic_query;
+
+/* Documents can be opened while parsing without the GVL, so
+   this is called via rxml_with_gvl. */
+static void* ic_document_query(void *data)
+{
+  ic_query *query = (ic_query*) data;
+  ic_doc_context *ic_doc;
+  VALUE res, document;
+
+  res = rb_funcall(query->scheme->class, DOCUMENT_QUERY_METHOD, 1,
+      rb_str_new2(query->filename));
+
+  if (NIL_P(res))
+    return NULL;
+
+  document = TypedData_Make_Struct(0, ic_doc_context, &ic_doc_context_data_type, ic_doc);
+  ic_doc->self = document;
+  ic_doc->source = Qnil;
+  ic_doc->io = Qnil;
+  ic_doc->offset = 0;
+
+  if (RB_TYPE_P(res, T_STRING))
+  {
+    ic_doc->source = rb_str_new_frozen(res);
+    ic_doc->is_string = 1;
   }
-  return 0;
+  else
+  {
+    if (!rb_respond_to(res, READ_METHOD))
+      res = rb_funcall(rb_const_get(cInputCallbacks, rb_intern("ChunkReader")), rb_intern("new"), 1, res);
+    else if (rb_respond_to(res, CLOSE_METHOD))
+      ic_doc->io = res;
+
+    ic_doc->source = rxml_io_input_new(res);
+    ic_doc->is_string = 0;
+  }
+
+  /* Keep the document alive until libxml closes it */
+  ic_documents_add(ic_doc);
+
+  return ic_doc;
 }
 
-int ic_read(void *context, char *buffer, int len)
+void* ic_open(char const *filename)
+{
+  ic_query query;
+
+  if (!ruby_native_thread_p())
+    return 0;
+
+  query.scheme = ic_find(filename);
+  if (!query.scheme)
+    return 0;
+
+  query.filename = filename;
+  return rxml_with_gvl(ic_document_query, &query);
+}
+
+typedef struct
 {
   ic_doc_context *ic_doc;
-  int ret_len;
-  ic_doc = (ic_doc_context*) context;
+  char *buffer;
+  int len;
+  int result;
+} ic_read_args;
+
+static void* ic_read_source(void *data)
+{
+  ic_read_args *args = (ic_read_args*) data;
+  args->result = rxml_read_callback(RTYPEDDATA_DATA(args->ic_doc->source), args->buffer, args->len);
+  return NULL;
+}
 
-  if (len >= ic_doc->remaining)
+int ic_read(void *context, char *buffer, int len)
+{
+  ic_doc_context *ic_doc = (ic_doc_context*) context;
+
+  if (ic_doc->is_string)
   {
-    ret_len = ic_doc->remaining;
+    /* The string is frozen and marked, so it can be read without the GVL */
+    long remaining = RSTRING_LEN(ic_doc->source) - ic_doc->offset;
+    int ret_len = remaining < len ? (int)remaining : len;
+
+    memcpy(buffer, RSTRING_PTR(ic_doc->source) + ic_doc->offset, ret_len);
+    ic_doc->offset += ret_len;
+    return ret_len;
+  }
+  else if (!ruby_native_thread_p())
+  {
+    return -1;
   }
   else
   {
-    ret_len = len;
+    ic_read_args args = {ic_doc, buffer, len, -1};
+    rxml_with_gvl(ic_read_source, &args);
+    return args.result;
   }
-  ic_doc->remaining -= ret_len;
-  strncpy(buffer, ic_doc->bpos, ret_len);
-  ic_doc->bpos += ret_len;
+}
 
-  return ret_len;
+static VALUE ic_close_io_protected(VALUE io)
+{
+  return rb_funcall(io, CLOSE_METHOD, 0);
+}
+
+static void* ic_close_io(void *data)
+{
+  ic_doc_context *ic_doc = (ic_doc_context*) data;
+  int state = 0;
+
+  /* libxml has already read the document, so failing to close it does not
+     fail the parse */
+  rb_protect(ic_close_io_protected, ic_doc->io, &state);
+  if (state)
+    rb_set_errinfo(Qnil);
+
+  return NULL;
 }
 
 int ic_close(void *context)
 {
-  ruby_xfree(((ic_doc_context*) context)->buffer);
-  ruby_xfree(context);
+  ic_doc_context *ic_doc = (ic_doc_context*) context;
+
+  /* IOs that cannot be closed now, for example after a callback raised an
+     exception or when the garbage collector frees the parser, are closed
+     once they are collected */
+  if (!NIL_P(ic_doc->io) && ruby_native_thread_p() && !rb_during_gc())
+    rxml_with_gvl(ic_close_io, ic_doc);
+
+  ic_documents_remove(ic_doc);
   return 1;
 }
 
@@ -90,99 +334,169 @@ int ic_close(void *context)
  */
 static VALUE input_callbacks_register_input_callbacks(VALUE self)
 {
-  xmlRegisterInputCallbacks(ic_match, ic_open, ic_read, ic_close);
+  if (!ic_registered && xmlRegisterInputCallbacks(ic_match, ic_open, ic_read, ic_close) >= 0)
+    ic_registered = 1;
   return (Qtrue);
 }
 
 /*
  * call-seq:
- *    add_scheme
+ *    unregister -> true|false
+ *
+ * Removes the callbacks added by register.  libxml can only remove the
+ * callbacks registered last, so no other library may have registered
+ * input callbacks since.
+ */
+static VALUE input_callbacks_unregister_input_callbacks(VALUE self)
+{
+  if (!ic_registered)
+    return Qfalse;
+
+  xmlPopInputCallbacks();
+  ic_registered = 0;
+  return Qtrue;
+}
+
+/*
+ * call-seq:
+ *    add_scheme(name, handler)
  *
- * No documentation available.
+ * Registers the handler for urls starting with name, for example
+ * "http://example.com/".  The handler must respond to document_query(url).
  */
 static VALUE input_callbacks_add_scheme(VALUE self, VALUE scheme_name,
     VALUE class)
 {
-  ic_scheme *scheme;
+  ic_scheme *scheme, **list;
+  char key[IC_KEY_MAX];
+  st_data_t bucket;
 
   Check_Type(scheme_name, T_STRING);
 
-  scheme = (ic_scheme*) malloc(sizeof(ic_scheme));
+  scheme = ALLOC(ic_scheme);
   scheme->next_scheme = 0;
-  scheme->scheme_name = strdup(StringValuePtr(scheme_name)); /* TODO alloc, dealloc */
+  scheme->scheme_name = ruby_strdup(StringValueCStr(scheme_name));
   scheme->name_len = (int)strlen(scheme->scheme_name);
-  scheme->class = class; /* TODO alloc, dealloc */
+  scheme->class = class;
+  rb_ary_push(ic_handlers, class);
 
-  //fprintf( stderr, "registered: %s, %d, %s\n", scheme->scheme_name, scheme->name_len, scheme->class );
-
-  if (0 == first_scheme)
-    first_scheme = scheme;
+  if (ic_scheme_key(scheme->scheme_name, key))
+  {
+    if (st_lookup(ic_schemes, (st_data_t)key, &bucket))
+    {
+      list = (ic_scheme**)&bucket;
+    }
+    else
+    {
+      st_insert(ic_schemes, (st_data_t)ruby_strdup(key), (st_data_t)scheme);
+      return (Qtrue);
+    }
+  }
   else
   {
-    ic_scheme *pos;
-    pos = first_scheme;
-    while (0 != pos->next_scheme)
-      pos = pos->next_scheme;
-    pos->next_scheme = scheme;
+    list = &ic_unkeyed_schemes;
   }
 
+  /* Schemes are matched in the order they were added */
+  while (0 != *list)
+    list = &(*list)->next_scheme;
+  *list = scheme;
+
   return (Qtrue);
 }
 
+static void ic_release_handler(VALUE class)
+{
+  long i;
+
+  /* A handler may be registered for several schemes */
+  for (i = 0; i < RARRAY_LEN(ic_handlers); i++)
+  {
+    if (rb_ary_entry(ic_handlers, i) == class)
+    {
+      rb_ary_delete_at(ic_handlers, i);
+      return;
+    }
+  }
+}
+
+static int ic_remove_from(ic_scheme **list, const char *name)
+{
+  while (0 != *list)
+  {
+    ic_scheme *scheme = *list;
+
+    if (!xmlStrncasecmp(BAD_CAST name, BAD_CAST scheme->scheme_name, scheme->name_len))
+    {
+      *list = scheme->next_scheme;
+      ic_release_handler(scheme->class);
+      xfree(scheme->scheme_name);
+      xfree(scheme);
+      return 1;
+    }
+    list = &scheme->next_scheme;
+  }
+  return 0;
+}
+
 /*
  * call-seq:
- *    remove_scheme
+ *    remove_scheme(name)
  *
- * No documentation available.
+ * Removes the handler registered for name.  Names are compared case
+ * insensitively, like urls are when they are matched.
  */
 static VALUE input_callbacks_remove_scheme(VALUE self, VALUE scheme_name)
 {
   char *name;
-  ic_scheme *save_scheme, *scheme;
+  char key[IC_KEY_MAX];
+  st_data_t bucket;
 
   Check_Type(scheme_name, T_STRING);
-  name = StringValuePtr(scheme_name);
+  name = StringValueCStr(scheme_name);
 
-  if (0 == first_scheme)
-    return Qfalse;
-
-  if (!strncmp(name, first_scheme->scheme_name, first_scheme->name_len))
+  if (ic_scheme_key(name, key) && st_lookup(ic_schemes, (st_data_t)key, &bucket))
   {
-    save_scheme = first_scheme->next_scheme;
-
-    ruby_xfree(first_scheme->scheme_name);
-    ruby_xfree(first_scheme);
-
-    first_scheme = save_scheme;
-    return Qtrue;
-  }
+    ic_scheme *list = (ic_scheme*)bucket;
 
-  scheme = first_scheme;
-  while (0 != scheme->next_scheme)
-  {
-    if (!strncmp(name, scheme->next_scheme->scheme_name,
-        scheme->next_scheme->name_len))
+    if (ic_remove_from(&list, name))
     {
-      save_scheme = scheme->next_scheme->next_scheme;
-
-      ruby_xfree(scheme->next_scheme->scheme_name);
-      ruby_xfree(scheme->next_scheme);
-
-      scheme->next_scheme = save_scheme;
+      if (list)
+      {
+        st_insert(ic_schemes, (st_data_t)key, (st_data_t)list);
+      }
+      else
+      {
+        st_data_t stored_key = (st_data_t)key;
+        st_delete(ic_schemes, &stored_key, NULL);
+        xfree((char*)stored_key);
+      }
       return Qtrue;
     }
-    scheme = scheme->next_scheme;
   }
-  return Qfalse;
+
+  return ic_remove_from(&ic_unkeyed_schemes, name) ? Qtrue : Qfalse;
 }
 
 void rxml_init_input_callbacks(void)
 {
-  VALUE cInputCallbacks;
   cInputCallbacks = rb_define_class_under(mXML, "InputCallbacks", rb_cObject);
 
+  CLOSE_METHOD = rb_intern("close");
+  DOCUMENT_QUERY_METHOD = rb_intern("document_query");
+  READ_METHOD = rb_intern("read");
+
+  ic_schemes = st_init_strcasetable();
+
+  /* Handlers and open documents are referenced from C only */
+  ic_handlers = rb_ary_new();
+  rb_gc_register_address(&ic_handlers);
+  ic_documents = TypedData_Wrap_Struct(0, &ic_documents_data_type, NULL);
+  rb_gc_register_address(&ic_documents);
+
   /* Class Methods */
   rb_define_singleton_method(cInputCallbacks, "register", input_callbacks_register_input_callbacks, 0);
+  rb_define_singleton_method(cInputCallbacks, "unregister", input_callbacks_unregister_input_callbacks, 0);
   rb_define_singleton_method(cInputCallbacks, "add_scheme", input_callbacks_add_scheme, 2);
   rb_define_singleton_method(cInputCallbacks, "remove_scheme", input_callbacks_remove_scheme, 1);
 }
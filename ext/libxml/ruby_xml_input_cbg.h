@@ -4,9 +4,14 @@
 void rxml_init_input_callbacks(void);
 
 typedef struct ic_doc_context {
-    char *buffer;
-    char *bpos;
-    int remaining;
+    VALUE self;
+    VALUE source;
+    VALUE io;
+    long offset;
+    int is_string;
+
+    struct ic_doc_context *prev_doc;
+    struct ic_doc_context *next_doc;
 } ic_doc_context;
 
 typedef struct ic_scheme {
@@ -3,34 +3,250 @@
 #include "ruby_libxml.h"
 #include <ruby/io.h>
 
+#ifdef HAVE_SYS_MMAN_H
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 static ID READ_METHOD;
 static ID WRITE_METHOD;
+static int rxml_io_chunk_size = 0;
+
+/* State of an IO object that libxml reads from.  Data is read into a
+   string that is reused for every read, and is then handed to libxml
+   in the pieces it asks for. */
+typedef struct
+{
+  VALUE io;
+  VALUE buffer;
+  VALUE data;
+  long offset;
+  int outbuf;
+} rxml_io_input;
+
+static void rxml_io_input_mark(rxml_io_input *input)
+{
+  rb_gc_mark(input->io);
+  rb_gc_mark(input->buffer);
+  rb_gc_mark(input->data);
+}
+
+static void rxml_io_input_free(rxml_io_input *input)
+{
+  xfree(input);
+}
+
+static size_t rxml_io_input_memsize(const void *data)
+{
+  return sizeof(rxml_io_input);
+}
+
+static const rb_data_type_t rxml_io_input_data_type = {
+  "LibXML::XML::IO input",
+  { (RUBY_DATA_FUNC)rxml_io_input_mark, (RUBY_DATA_FUNC)rxml_io_input_free, rxml_io_input_memsize },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/* Wraps an IO object for reading with rxml_read_callback.  The returned
+   object must be kept alive as long as libxml reads from it, and its
+   data pointer is the context to pass to the callback. */
+VALUE rxml_io_input_new(VALUE io)
+{
+  int arity = rb_obj_method_arity(io, READ_METHOD);
+  rxml_io_input *input;
+  VALUE result = TypedData_Make_Struct(0, rxml_io_input, &rxml_io_input_data_type, input);
+
+  input->io = io;
+  input->buffer = Qnil;
+  input->data = Qnil;
+  input->offset = 0;
+  /* Use read(length, buffer) if the object supports it, as IO and StringIO do */
+  input->outbuf = (arity == 2 || (arity < 0 && -arity - 1 <= 2));
+
+  /* Allocated once the wrapper exists so the buffer is marked */
+  if (input->outbuf)
+    input->buffer = rb_str_buf_new(rxml_io_chunk_size);
+
+  return result;
+}
 
 /* This method is called by libxml when it wants to read
  more data from a stream. We go with the duck typing
  solution to support StringIO objects. */
 int rxml_read_callback(void *context, char *buffer, int len)
 {
-  VALUE io = (VALUE) context;
-  VALUE string = rb_funcall(io, READ_METHOD, 1, INT2NUM(len));
+  rxml_io_input *input = (rxml_io_input*)context;
+  long available = NIL_P(input->data) ? 0 : RSTRING_LEN(input->data) - input->offset;
+  long size;
+
+  if (available <= 0)
+  {
+    long chunk = rxml_io_chunk_size > len ? rxml_io_chunk_size : len;
+    rxml_memory_scope *scope;
+    VALUE string;
+
+    /* Reading may switch fibers, for example under a fiber scheduler */
+    scope = rxml_memory_scope_suspend();
+    if (input->outbuf)
+      string = rb_funcall(input->io, READ_METHOD, 2, LONG2NUM(chunk), input->buffer);
+    else
+      string = rb_funcall(input->io, READ_METHOD, 1, LONG2NUM(chunk));
+    rxml_memory_scope_resume(scope);
+
+    if (string == Qnil)
+      return 0;
+
+    StringValue(string);
+    input->data = string;
+    input->offset = 0;
+    available = RSTRING_LEN(string);
+  }
+
+  size = available < len ? available : len;
+  memcpy(buffer, RSTRING_PTR(input->data) + input->offset, size);
+  input->offset += size;
+
+  return (int)size;
+}
+
+/* A read-only private mapping of a file, used as parser input.  The
+   mapping is removed when the object is garbage collected, so it must
+   be referenced by whatever parses it. */
+typedef struct
+{
+  char *data;
   size_t size;
+  size_t offset;
+} rxml_io_mmap;
 
-  if (string == Qnil)
-    return 0;
+static void rxml_io_mmap_free(rxml_io_mmap *mapping)
+{
+#ifdef HAVE_SYS_MMAN_H
+  if (mapping->data)
+    munmap(mapping->data, mapping->size);
+#endif
+  xfree(mapping);
+}
 
-  size = RSTRING_LEN(string);
-  memcpy(buffer, StringValuePtr(string), size);
+static size_t rxml_io_mmap_memsize(const void *data)
+{
+  return sizeof(rxml_io_mmap) + ((const rxml_io_mmap*)data)->size;
+}
+
+static const rb_data_type_t rxml_io_mmap_data_type = {
+  "LibXML::XML::IO mapping",
+  { NULL, (RUBY_DATA_FUNC)rxml_io_mmap_free, rxml_io_mmap_memsize },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+VALUE rxml_io_mmap_new(VALUE path)
+{
+#ifdef HAVE_SYS_MMAN_H
+  rxml_io_mmap *mapping;
+  struct stat st;
+  VALUE result;
+  void *data;
+  int fd;
+
+  FilePathValue(path);
+
+  fd = rb_cloexec_open(StringValueCStr(path), O_RDONLY, 0);
+  if (fd < 0)
+    rb_sys_fail_str(path);
+
+  if (fstat(fd, &st) != 0)
+  {
+    int error = errno;
+    close(fd);
+    rb_syserr_fail_str(error, path);
+  }
+
+  if (st.st_size == 0)
+  {
+    close(fd);
+    rb_raise(rb_eArgError, "Must specify a file with one or more characters");
+  }
+
+  data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED)
+    rb_sys_fail_str(path);
+
+#ifdef MADV_SEQUENTIAL
+  madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+
+  result = TypedData_Make_Struct(0, rxml_io_mmap, &rxml_io_mmap_data_type, mapping);
+  mapping->data = data;
+  mapping->size = (size_t)st.st_size;
+  mapping->offset = 0;
+
+  return result;
+#else
+  rb_raise(rb_eNotImpError, "Memory mapped input is not supported on this platform");
+  return Qnil;
+#endif
+}
+
+/* Copies the next piece of the mapping into libxml's input buffer, for
+   libxml releases that cannot read the mapping in place (see
+   rxml_io_mmap_static).  Does not call into Ruby, so mapped input can
+   be parsed without the GVL. */
+int rxml_io_mmap_read_callback(void *context, char *buffer, int len)
+{
+  rxml_io_mmap *mapping = (rxml_io_mmap*)context;
+  size_t size = mapping->size - mapping->offset;
+
+  if (size > (size_t)len)
+    size = (size_t)len;
+
+  memcpy(buffer, mapping->data + mapping->offset, size);
+  mapping->offset += size;
 
   return (int)size;
 }
 
+/* Returns the context for reading the mapping from the start with
+   rxml_io_mmap_read_callback. */
+void* rxml_io_mmap_context(VALUE mapping)
+{
+  rxml_io_mmap *xmapping = (rxml_io_mmap*)RTYPEDDATA_DATA(mapping);
+  xmapping->offset = 0;
+  return xmapping;
+}
+
+/* Since libxml 2.12 static memory buffers are read in place, so the
+   mapping is handed to libxml as is and parsing does not copy it.  Older
+   releases misparse static buffers that span more than one input chunk,
+   so they read the mapping through rxml_io_mmap_read_callback instead.
+   Returns whether the mapping can be read in place, and if so its data
+   and size. */
+int rxml_io_mmap_static(VALUE mapping, const char **data, int *size)
+{
+#if LIBXML_VERSION >= 21200
+  rxml_io_mmap *xmapping = (rxml_io_mmap*)RTYPEDDATA_DATA(mapping);
+
+  // libxml's memory buffers are limited to INT_MAX bytes
+  if (xmapping->size <= INT_MAX)
+  {
+    *data = xmapping->data;
+    *size = (int)xmapping->size;
+    return 1;
+  }
+#endif
+  return 0;
+}
+
 int rxml_write_callback(VALUE io, const char *buffer, int len)
 {
     if (rb_io_check_io(io) == Qnil)
     {
         // Could be StringIO
         VALUE written, string;
-        string = rb_external_str_new_with_enc(buffer, (long)strlen(buffer), rb_enc_get(io));
+        string = rb_external_str_new_with_enc(buffer, (long)len, rb_enc_get(io));
         written = rb_funcall(io, WRITE_METHOD, 1, string);
         return NUM2INT(written);
     }
@@ -40,8 +256,45 @@ int rxml_write_callback(VALUE io, const char *buffer, int len)
     }
 }
 
+/*
+ * call-seq:
+ *    XML.io_chunk_size -> num
+ *
+ * Obtain the number of bytes requested from IO objects per read when
+ * parsing them.  See XML.io_chunk_size=.
+ */
+static VALUE rxml_io_chunk_size_get(VALUE klass)
+{
+  return INT2NUM(rxml_io_chunk_size);
+}
+
+/*
+ * call-seq:
+ *    XML.io_chunk_size = num
+ *
+ * Set the number of bytes requested from IO objects per read when
+ * parsing them with XML::Parser.io, XML::SaxParser.io, XML::HTMLParser.io
+ * or XML::Reader.io.  Larger chunks mean fewer calls into Ruby, with
+ * the data handed to libxml in the pieces it asks for.  Note that reads
+ * block until a full chunk or the end of the stream is available.  The
+ * default of 0 reads as many bytes as libxml requests, usually 4000.
+ */
+static VALUE rxml_io_chunk_size_set(VALUE klass, VALUE size)
+{
+  int value = NUM2INT(size);
+
+  if (value < 0)
+    rb_raise(rb_eArgError, "The chunk size must not be negative");
+
+  rxml_io_chunk_size = value;
+  return size;
+}
+
 void rxml_init_io(void)
 {
   READ_METHOD = rb_intern("read");
   WRITE_METHOD = rb_intern("write");
+
+  rb_define_module_function(mXML, "io_chunk_size", rxml_io_chunk_size_get, 0);
+  rb_define_module_function(mXML, "io_chunk_size=", rxml_io_chunk_size_set, 1);
 }
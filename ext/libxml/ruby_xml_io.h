@@ -3,8 +3,13 @@
 #ifndef __RXML_IO__
 #define __RXML_IO__
 
+VALUE rxml_io_input_new(VALUE io);
 int rxml_read_callback(void *context, char *buffer, int len);
 int rxml_write_callback(VALUE io, const char *buffer, int len);
+VALUE rxml_io_mmap_new(VALUE path);
+void* rxml_io_mmap_context(VALUE mapping);
+int rxml_io_mmap_read_callback(void *context, char *buffer, int len);
+int rxml_io_mmap_static(VALUE mapping, const char **data, int *size);
 void rxml_init_io(void);
 
 #endif
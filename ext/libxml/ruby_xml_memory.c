@@ -0,0 +1,622 @@
+/* Please see the LICENSE file for copyright and distribution information */
+
+#include "ruby_libxml.h"
+#include "ruby_xml_memory.h"
+
+#include <ruby/atomic.h>
+
+#if defined(HAVE_MALLOC_USABLE_SIZE)
+#include <malloc.h>
+#define RXML_MEMORY_BLOCK_SIZE(ptr) malloc_usable_size((void*)(ptr))
+#elif defined(HAVE_MALLOC_SIZE)
+#include <malloc/malloc.h>
+#define RXML_MEMORY_BLOCK_SIZE(ptr) malloc_size(ptr)
+#elif defined(_WIN32)
+#include <malloc.h>
+#define RXML_MEMORY_BLOCK_SIZE(ptr) _msize((void*)(ptr))
+#endif
+
+/* Tracking of the memory allocated by libxml.
+ *
+ * libxml's allocation functions are replaced with thin wrappers around
+ * the system allocator that count the bytes and blocks allocated and
+ * freed, both for the whole process and for each thread.  Block sizes
+ * are asked from the system allocator rather than stored in a header,
+ * so blocks allocated before the wrappers were installed may still be
+ * freed safely.  Platforms that cannot report block sizes keep libxml's
+ * default allocator and do not track memory.
+ *
+ * Threads may also enter a memory scope, which refuses allocations that
+ * would take the memory allocated within the scope over its limit.  libxml
+ * treats refused allocations as out of memory errors and gives up.  Ruby
+ * code called back while a scope is active may switch fibers, so such
+ * calls suspend the thread's scopes until they return (see
+ * rxml_memory_scope_suspend).
+ *
+ * Finally, small allocations may be served from an arena instead (see
+ * rxml_arena_enter).  Arenas carve blocks out of large aligned chunks and
+ * free all of them at once.  The chunks are registered in a table so that
+ * freeing an arena block is recognized and ignored, and reallocating one
+ * copies it. */
+
+typedef struct
+{
+  size_t bytes;
+  size_t allocations;
+  size_t frees;
+  size_t total_bytes;
+} rxml_memory_counters;
+
+static int tracking = 0;
+static rxml_memory_counters process_counters;
+
+#ifdef RB_THREAD_LOCAL_SPECIFIER
+static RB_THREAD_LOCAL_SPECIFIER rxml_memory_counters thread_counters;
+static RB_THREAD_LOCAL_SPECIFIER rxml_memory_scope *current_scope = NULL;
+static RB_THREAD_LOCAL_SPECIFIER rxml_arena *current_arena = NULL;
+#endif
+
+#if defined(RXML_MEMORY_BLOCK_SIZE) && defined(RB_THREAD_LOCAL_SPECIFIER) && \
+    (defined(HAVE_POSIX_MEMALIGN) || defined(_WIN32))
+#define RXML_ARENA 1
+#endif
+
+#ifdef RXML_MEMORY_BLOCK_SIZE
+static void rxml_memory_allocated(size_t size, int block);
+static void rxml_memory_freed(size_t size, int block);
+#endif
+
+#ifdef RXML_ARENA
+/* Chunks are aligned to their size, so the chunk of any block is found by
+   masking its address.  Blocks larger than RXML_ARENA_BLOCK_MAX are not
+   served from arenas.  Each block starts with a header holding its size. */
+#define RXML_ARENA_CHUNK_SHIFT 20
+#define RXML_ARENA_CHUNK_SIZE ((size_t)1 << RXML_ARENA_CHUNK_SHIFT)
+#define RXML_ARENA_BLOCK_MAX (RXML_ARENA_CHUNK_SIZE / 8)
+#define RXML_ARENA_HEADER_SIZE 16
+#define RXML_ARENA_SLOTS 8192
+#define RXML_ARENA_SLOTS_MAX (RXML_ARENA_SLOTS / 2)
+
+struct rxml_arena
+{
+  char *next;
+  char *end;
+  void *chunks;
+  size_t bytes;
+};
+
+/* Linear probing table of the chunks of all arenas, keyed by chunk index
+   (address >> RXML_ARENA_CHUNK_SHIFT).  Removing a chunk shifts the
+   entries after it back instead of leaving a marker, so lookups never
+   probe further than the run of chunks that collide.  The table is only
+   changed while holding the GVL, but looked up by every libxml free on
+   any thread.  Changes make rxml_arena_sequence odd while they are made,
+   and lookups are retried if it changed meanwhile. */
+static rb_atomic_t rxml_arena_slots[RXML_ARENA_SLOTS];
+static rb_atomic_t rxml_arena_chunk_count = 0;
+static rb_atomic_t rxml_arena_sequence = 0;
+
+static size_t rxml_arena_slot(rb_atomic_t index)
+{
+  return index & (RXML_ARENA_SLOTS - 1);
+}
+
+static int rxml_arena_lookup(rb_atomic_t index)
+{
+  size_t slot = rxml_arena_slot(index);
+  rb_atomic_t value;
+
+  /* The table is never full, so there always is an empty slot */
+  while ((value = RUBY_ATOMIC_LOAD(rxml_arena_slots[slot])) != 0)
+  {
+    if (value == index)
+      return 1;
+    slot = (slot + 1) & (RXML_ARENA_SLOTS - 1);
+  }
+
+  return 0;
+}
+
+static int rxml_arena_owns(const void *ptr)
+{
+  size_t chunk = (size_t)ptr >> RXML_ARENA_CHUNK_SHIFT;
+  rb_atomic_t sequence;
+  int result;
+
+  if (RUBY_ATOMIC_LOAD(rxml_arena_chunk_count) == 0)
+    return 0;
+
+  /* Chunks whose index does not fit are never registered */
+  if (chunk != (rb_atomic_t)chunk)
+    return 0;
+
+  do
+  {
+    while ((sequence = RUBY_ATOMIC_LOAD(rxml_arena_sequence)) & 1)
+      ;
+    result = rxml_arena_lookup((rb_atomic_t)chunk);
+  }
+  while (RUBY_ATOMIC_LOAD(rxml_arena_sequence) != sequence);
+
+  return result;
+}
+
+static size_t rxml_arena_block_size(const void *ptr)
+{
+  return *(const size_t*)((const char*)ptr - RXML_ARENA_HEADER_SIZE);
+}
+
+static int rxml_arena_register(size_t chunk)
+{
+  size_t index = chunk >> RXML_ARENA_CHUNK_SHIFT;
+  size_t slot;
+
+  if (index == 0 || index != (rb_atomic_t)index)
+    return 0;
+
+  if (RUBY_ATOMIC_LOAD(rxml_arena_chunk_count) >= RXML_ARENA_SLOTS_MAX)
+    return 0;
+
+  slot = rxml_arena_slot((rb_atomic_t)index);
+  while (RUBY_ATOMIC_LOAD(rxml_arena_slots[slot]) != 0)
+    slot = (slot + 1) & (RXML_ARENA_SLOTS - 1);
+
+  RUBY_ATOMIC_INC(rxml_arena_sequence);
+  RUBY_ATOMIC_SET(rxml_arena_slots[slot], (rb_atomic_t)index);
+  RUBY_ATOMIC_INC(rxml_arena_chunk_count);
+  RUBY_ATOMIC_INC(rxml_arena_sequence);
+
+  return 1;
+}
+
+static void rxml_arena_unregister(size_t chunk)
+{
+  rb_atomic_t index = (rb_atomic_t)(chunk >> RXML_ARENA_CHUNK_SHIFT);
+  size_t slot = rxml_arena_slot(index);
+  size_t next;
+
+  while (RUBY_ATOMIC_LOAD(rxml_arena_slots[slot]) != index)
+  {
+    if (RUBY_ATOMIC_LOAD(rxml_arena_slots[slot]) == 0)
+      return;
+    slot = (slot + 1) & (RXML_ARENA_SLOTS - 1);
+  }
+
+  RUBY_ATOMIC_INC(rxml_arena_sequence);
+
+  /* Move later entries of the run into the hole unless that would put
+     them before their own slot */
+  for (next = (slot + 1) & (RXML_ARENA_SLOTS - 1);; next = (next + 1) & (RXML_ARENA_SLOTS - 1))
+  {
+    rb_atomic_t value = RUBY_ATOMIC_LOAD(rxml_arena_slots[next]);
+    size_t home;
+
+    if (value == 0)
+      break;
+
+    home = rxml_arena_slot(value);
+    if (((next - home) & (RXML_ARENA_SLOTS - 1)) >= ((next - slot) & (RXML_ARENA_SLOTS - 1)))
+    {
+      RUBY_ATOMIC_SET(rxml_arena_slots[slot], value);
+      slot = next;
+    }
+  }
+
+  RUBY_ATOMIC_SET(rxml_arena_slots[slot], 0);
+  RUBY_ATOMIC_DEC(rxml_arena_chunk_count);
+  RUBY_ATOMIC_INC(rxml_arena_sequence);
+}
+
+static void *rxml_arena_chunk_alloc(void)
+{
+  void *result = NULL;
+
+#ifdef _WIN32
+  result = _aligned_malloc(RXML_ARENA_CHUNK_SIZE, RXML_ARENA_CHUNK_SIZE);
+#else
+  if (posix_memalign(&result, RXML_ARENA_CHUNK_SIZE, RXML_ARENA_CHUNK_SIZE) != 0)
+    result = NULL;
+#endif
+
+  return result;
+}
+
+static void rxml_arena_chunk_free(void *chunk)
+{
+#ifdef _WIN32
+  _aligned_free(chunk);
+#else
+  free(chunk);
+#endif
+}
+
+static void *rxml_arena_alloc(rxml_arena *arena, size_t size)
+{
+  size_t block_size = (size + RXML_ARENA_HEADER_SIZE - 1) & ~(size_t)(RXML_ARENA_HEADER_SIZE - 1);
+  char *result;
+
+  if (size > RXML_ARENA_BLOCK_MAX)
+    return NULL;
+
+  if (arena->end - arena->next < (ptrdiff_t)(RXML_ARENA_HEADER_SIZE + block_size))
+  {
+    char *chunk = rxml_arena_chunk_alloc();
+
+    if (!chunk)
+      return NULL;
+
+    if (!rxml_arena_register((size_t)chunk))
+    {
+      rxml_arena_chunk_free(chunk);
+      return NULL;
+    }
+
+    /* The first block of each chunk links it to the previous one */
+    *(void**)chunk = arena->chunks;
+    arena->chunks = chunk;
+    arena->next = chunk + RXML_ARENA_HEADER_SIZE;
+    arena->end = chunk + RXML_ARENA_CHUNK_SIZE;
+    arena->bytes += RXML_ARENA_CHUNK_SIZE;
+    rxml_memory_allocated(RXML_ARENA_CHUNK_SIZE, 1);
+  }
+
+  *(size_t*)arena->next = block_size;
+  result = arena->next + RXML_ARENA_HEADER_SIZE;
+  arena->next = result + block_size;
+
+  return result;
+}
+#endif
+
+#ifdef RXML_MEMORY_BLOCK_SIZE
+/* Returns whether size more bytes may be allocated in the current scopes */
+static int rxml_memory_reserve(size_t size)
+{
+#ifdef RB_THREAD_LOCAL_SPECIFIER
+  rxml_memory_scope *scope;
+
+  for (scope = current_scope; scope; scope = scope->previous)
+  {
+    if (scope->limit && (size > scope->limit || scope->bytes > scope->limit - size))
+    {
+      scope->exceeded = 1;
+      return 0;
+    }
+  }
+#endif
+  return 1;
+}
+
+static void rxml_memory_allocated(size_t size, int block)
+{
+#ifdef RB_THREAD_LOCAL_SPECIFIER
+  rxml_memory_scope *scope;
+
+  for (scope = current_scope; scope; scope = scope->previous)
+    scope->bytes += size;
+
+  thread_counters.bytes += size;
+  thread_counters.total_bytes += size;
+  thread_counters.allocations += block;
+#endif
+
+  RUBY_ATOMIC_SIZE_ADD(process_counters.bytes, size);
+  RUBY_ATOMIC_SIZE_ADD(process_counters.total_bytes, size);
+  if (block)
+    RUBY_ATOMIC_SIZE_INC(process_counters.allocations);
+}
+
+static void rxml_memory_freed(size_t size, int block)
+{
+#ifdef RB_THREAD_LOCAL_SPECIFIER
+  rxml_memory_scope *scope;
+
+  /* Scopes may free memory that was allocated before they were entered */
+  for (scope = current_scope; scope; scope = scope->previous)
+    scope->bytes = scope->bytes > size ? scope->bytes - size : 0;
+
+  thread_counters.bytes -= size;
+  thread_counters.frees += block;
+#endif
+
+  RUBY_ATOMIC_SIZE_SUB(process_counters.bytes, size);
+  if (block)
+    RUBY_ATOMIC_SIZE_INC(process_counters.frees);
+}
+
+static void *rxml_memory_malloc(size_t size)
+{
+  void *result;
+
+  if (!rxml_memory_reserve(size))
+    return NULL;
+
+#ifdef RXML_ARENA
+  if (current_arena && (result = rxml_arena_alloc(current_arena, size)))
+    return result;
+#endif
+
+  result = malloc(size);
+  if (result)
+    rxml_memory_allocated(RXML_MEMORY_BLOCK_SIZE(result), 1);
+
+  return result;
+}
+
+static void *rxml_memory_realloc(void *ptr, size_t size)
+{
+  size_t old_size;
+  void *result;
+
+  if (!ptr)
+    return rxml_memory_malloc(size);
+
+#ifdef RXML_ARENA
+  /* Arena blocks cannot grow, so move them */
+  if (rxml_arena_owns(ptr))
+  {
+    old_size = rxml_arena_block_size(ptr);
+    if (size <= old_size)
+      return ptr;
+
+    result = rxml_memory_malloc(size);
+    if (result)
+      memcpy(result, ptr, old_size);
+    return result;
+  }
+#endif
+
+  old_size = RXML_MEMORY_BLOCK_SIZE(ptr);
+  if (size > old_size && !rxml_memory_reserve(size - old_size))
+    return NULL;
+
+  result = realloc(ptr, size);
+  if (result)
+  {
+    size_t new_size = RXML_MEMORY_BLOCK_SIZE(result);
+    if (new_size > old_size)
+      rxml_memory_allocated(new_size - old_size, 0);
+    else
+      rxml_memory_freed(old_size - new_size, 0);
+  }
+
+  return result;
+}
+
+static void rxml_memory_free(void *ptr)
+{
+  if (!ptr)
+    return;
+
+#ifdef RXML_ARENA
+  /* Arena blocks are freed along with their arena */
+  if (rxml_arena_owns(ptr))
+    return;
+#endif
+
+  rxml_memory_freed(RXML_MEMORY_BLOCK_SIZE(ptr), 1);
+  free(ptr);
+}
+
+static char *rxml_memory_strdup(const char *str)
+{
+  size_t size = strlen(str) + 1;
+  char *result = rxml_memory_malloc(size);
+
+  if (result)
+    memcpy(result, str, size);
+
+  return result;
+}
+#endif
+
+/* Replaces libxml's allocator with the tracking allocator.  This must be
+   done before libxml is initialized.  If another library already replaced
+   the allocator, it is left alone. */
+void rxml_memory_install(void)
+{
+#ifdef RXML_MEMORY_BLOCK_SIZE
+  xmlFreeFunc free_func;
+  xmlMallocFunc malloc_func;
+  xmlReallocFunc realloc_func;
+  xmlStrdupFunc strdup_func;
+
+  if (xmlMemGet(&free_func, &malloc_func, &realloc_func, &strdup_func) != 0)
+    return;
+
+  if (free_func != (xmlFreeFunc)free || malloc_func != (xmlMallocFunc)malloc)
+    return;
+
+  if (xmlMemSetup(rxml_memory_free, rxml_memory_malloc, rxml_memory_realloc, rxml_memory_strdup) == 0)
+    tracking = 1;
+#endif
+}
+
+int rxml_memory_tracking_p(void)
+{
+  return tracking;
+}
+
+/* Returns the size of a block allocated by libxml, or estimate if the
+   allocator cannot tell */
+size_t rxml_memory_size(const void *ptr, size_t estimate)
+{
+#ifdef RXML_ARENA
+  if (tracking && ptr && rxml_arena_owns(ptr))
+    return rxml_arena_block_size(ptr);
+#endif
+#ifdef RXML_MEMORY_BLOCK_SIZE
+  if (tracking && ptr)
+    return RXML_MEMORY_BLOCK_SIZE(ptr);
+#endif
+  return estimate;
+}
+
+/* Creates an arena, or returns NULL if arenas are not supported */
+rxml_arena *rxml_arena_create(void)
+{
+#ifdef RXML_ARENA
+  rxml_arena *result;
+
+  if (!tracking)
+    return NULL;
+
+  result = ALLOC(rxml_arena);
+  memset(result, 0, sizeof(rxml_arena));
+  return result;
+#else
+  return NULL;
+#endif
+}
+
+/* Frees an arena and all the blocks allocated from it.  libxml must not
+   use any of those blocks afterwards. */
+void rxml_arena_free(rxml_arena *arena)
+{
+#ifdef RXML_ARENA
+  void *chunk = arena->chunks;
+
+  while (chunk)
+  {
+    void *next = *(void**)chunk;
+    rxml_arena_unregister((size_t)chunk);
+    rxml_arena_chunk_free(chunk);
+    rxml_memory_freed(RXML_ARENA_CHUNK_SIZE, 1);
+    chunk = next;
+  }
+
+  xfree(arena);
+#endif
+}
+
+size_t rxml_arena_memsize(const rxml_arena *arena)
+{
+#ifdef RXML_ARENA
+  return arena->bytes;
+#else
+  return 0;
+#endif
+}
+
+/* Serves the small allocations libxml makes on this thread from the arena
+   until rxml_arena_leave is called.  Only wrap calls whose allocations
+   all belong to the arena's owner, such as creating its nodes, since
+   nothing allocated from the arena may outlive it. */
+void rxml_arena_enter(rxml_arena *arena)
+{
+#ifdef RXML_ARENA
+  current_arena = arena;
+#endif
+}
+
+void rxml_arena_leave(void)
+{
+#ifdef RXML_ARENA
+  current_arena = NULL;
+#endif
+}
+
+/* Enters a scope that limits the memory libxml may allocate on this thread
+   to limit bytes, or does not limit it if limit is 0.  The scope must be
+   left before the stack frame it lives in returns, so callers that may
+   raise exceptions should leave it with rb_ensure. */
+void rxml_memory_scope_enter(rxml_memory_scope *scope, size_t limit)
+{
+  scope->limit = limit;
+  scope->bytes = 0;
+  scope->exceeded = 0;
+#ifdef RB_THREAD_LOCAL_SPECIFIER
+  scope->previous = current_scope;
+  current_scope = scope;
+#else
+  scope->previous = NULL;
+#endif
+}
+
+/* Scopes are normally left in the reverse order they were entered.  If
+   fibers were switched by Ruby code that did not suspend the scopes,
+   another fiber's scopes may have been entered on top of this one, so
+   the scope is unlinked wherever it is in the list. */
+void rxml_memory_scope_leave(rxml_memory_scope *scope)
+{
+#ifdef RB_THREAD_LOCAL_SPECIFIER
+  rxml_memory_scope **link = &current_scope;
+
+  while (*link && *link != scope)
+    link = &(*link)->previous;
+
+  if (*link)
+    *link = scope->previous;
+#endif
+}
+
+/* Called before calling Ruby code from libxml callbacks.  That code may
+   switch to other fibers on this thread, which must neither be limited
+   by the current scopes nor leave their own scopes linked to them.
+   Returns the scopes to pass to rxml_memory_scope_resume once the call
+   returned. */
+rxml_memory_scope *rxml_memory_scope_suspend(void)
+{
+#ifdef RB_THREAD_LOCAL_SPECIFIER
+  rxml_memory_scope *scope = current_scope;
+  current_scope = NULL;
+  return scope;
+#else
+  return NULL;
+#endif
+}
+
+void rxml_memory_scope_resume(rxml_memory_scope *scope)
+{
+#ifdef RB_THREAD_LOCAL_SPECIFIER
+  current_scope = scope;
+#endif
+}
+
+void rxml_memory_raise_limit(rxml_memory_scope *scope)
+{
+  char message[100];
+  xmlError xerror;
+
+  snprintf(message, sizeof(message), "Memory limit of %lu bytes exceeded", (unsigned long)scope->limit);
+
+  memset(&xerror, 0, sizeof(xerror));
+  xerror.domain = XML_FROM_MEMORY;
+  xerror.code = XML_ERR_NO_MEMORY;
+  xerror.level = XML_ERR_FATAL;
+  xerror.message = message;
+  xerror.int1 = scope->limit > INT_MAX ? INT_MAX : (int)scope->limit;
+
+  rxml_raise(&xerror);
+}
+
+VALUE rxml_memory_bytes_used(void)
+{
+  return SSIZET2NUM((ssize_t)process_counters.bytes);
+}
+
+static VALUE rxml_memory_counters_hash(const rxml_memory_counters *counters)
+{
+  VALUE result = rb_hash_new();
+
+  rb_hash_aset(result, ID2SYM(rb_intern("bytes")), SSIZET2NUM((ssize_t)counters->bytes));
+  rb_hash_aset(result, ID2SYM(rb_intern("total_bytes")), SIZET2NUM(counters->total_bytes));
+  rb_hash_aset(result, ID2SYM(rb_intern("allocations")), SIZET2NUM(counters->allocations));
+  rb_hash_aset(result, ID2SYM(rb_intern("frees")), SIZET2NUM(counters->frees));
+
+  return result;
+}
+
+VALUE rxml_memory_allocation_stats(void)
+{
+  VALUE result = rxml_memory_counters_hash(&process_counters);
+
+  rb_hash_aset(result, ID2SYM(rb_intern("tracking")), tracking ? Qtrue : Qfalse);
+
+#ifdef RB_THREAD_LOCAL_SPECIFIER
+  if (tracking)
+    rb_hash_aset(result, ID2SYM(rb_intern("thread")), rxml_memory_counters_hash(&thread_counters));
+#endif
+
+  return result;
+}
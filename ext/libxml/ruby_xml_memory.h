@@ -0,0 +1,35 @@
+/* Please see the LICENSE file for copyright and distribution information */
+
+#ifndef __RXML_MEMORY__
+#define __RXML_MEMORY__
+
+/* A memory scope limits how much memory libxml may allocate on the
+   current thread until the scope is left.  Scopes may be nested. */
+typedef struct rxml_memory_scope
+{
+  size_t limit;
+  size_t bytes;
+  int exceeded;
+  struct rxml_memory_scope *previous;
+} rxml_memory_scope;
+
+/* An arena serves allocations from large chunks that are freed at once */
+typedef struct rxml_arena rxml_arena;
+
+void rxml_memory_install(void);
+int rxml_memory_tracking_p(void);
+size_t rxml_memory_size(const void *ptr, size_t estimate);
+void rxml_memory_scope_enter(rxml_memory_scope *scope, size_t limit);
+void rxml_memory_scope_leave(rxml_memory_scope *scope);
+rxml_memory_scope *rxml_memory_scope_suspend(void);
+void rxml_memory_scope_resume(rxml_memory_scope *scope);
+void rxml_memory_raise_limit(rxml_memory_scope *scope);
+VALUE rxml_memory_bytes_used(void);
+VALUE rxml_memory_allocation_stats(void);
+rxml_arena *rxml_arena_create(void);
+void rxml_arena_free(rxml_arena *arena);
+size_t rxml_arena_memsize(const rxml_arena *arena);
+void rxml_arena_enter(rxml_arena *arena);
+void rxml_arena_leave(void);
+
+#endif
@@ -4,6 +4,7 @@
 #define __RXML_NAMESPACE__
 
 extern VALUE cXMLNamespace;
+extern const rb_data_type_t rxml_namespace_data_type;
 
 void rxml_init_namespace(void);
 VALUE rxml_namespace_wrap(xmlNsPtr xns);
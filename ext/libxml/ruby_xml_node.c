@@ -1,6 +1,7 @@
 #include "ruby_libxml.h"
 #include "ruby_xml_node.h"
 #include <assert.h>
+#include <ruby/version.h>
 
 #include <libxml/debugXML.h>
 #include <libxml/parserInternals.h>
@@ -8,6 +9,16 @@
 
 VALUE cXMLNode;
 
+static ID OWNER_ATTR;
+static ID GET_METHOD;
+static ID SET_METHOD;
+
+/* ObjectSpace::WeakMap of the Ruby objects wrapping the nodes of documents
+   wrapped by Ruby, keyed by node address.  It is nil on Rubies whose weak
+   maps cannot have integer keys. */
+static VALUE rxml_node_wrappers = Qnil;
+static xmlDeregisterNodeFunc rxml_node_deregister_next = NULL;
+
 /* Document-class: LibXML::XML::Node
  *
  * Nodes are the primary objects that make up an XML document.
@@ -24,9 +35,10 @@ VALUE cXMLNode;
  * The bindings create a one-to-one mapping between ruby objects and
  * libxml documents and libxml parent nodes (ie, nodes that do not
  * have a parent and do not belong to a document). In these cases,
- * the bindings manage the memory.  They do this by installing a free
- * function and storing a back pointer to the Ruby object from the xmlnode
- * using the _private member on libxml structures.  When the Ruby object
+ * the bindings manage the memory.  They do this by attaching an owner
+ * object that frees the node to the Ruby object and storing a back pointer
+ * to the Ruby object from the xmlnode using the _private member on libxml
+ * structures.  When the Ruby object
  * goes out of scope, the underlying libxml structure is freed.  Libxml
  * itself then frees all child node (recursively).
  *
@@ -44,9 +56,20 @@ VALUE cXMLNode;
  * object is almost always freed before any ruby objects that wrap child nodes.
  * However, this is ok because those ruby objects do not have a free function
  * and are no longer in scope (since if they were the document would not be freed).
+ *
+ * So that walking a tree does not allocate a new object for every node it
+ * visits while the previous ones are still in use, the temporary objects for
+ * nodes in a document wrapped by Ruby are cached in a weak map.  Objects that
+ * are no longer referenced are collected as before.  When libxml frees a node
+ * whose object is still alive, for example when its content is replaced, the
+ * object stops pointing to it.
  */
 
-static void rxml_node_free(xmlNodePtr xnode)
+/* Standalone trees are owned by a hidden object attached to the ruby
+   object wrapping their root.  The owner is disarmed when the tree is
+   added to a parent or document, otherwise it frees the tree once it is
+   collected along with the wrapper. */
+static void rxml_node_owner_free(xmlNodePtr xnode)
 {
   /* The ruby object wrapping the xml object no longer exists and this
      is a standalone node without a document or parent so ruby is 
@@ -59,16 +82,44 @@ static void rxml_node_free(xmlNodePtr xnode)
   }
 }
 
-void rxml_node_manage(xmlNodePtr xnode, VALUE node)
+static size_t rxml_node_owner_memsize(const void *data)
 {
-  RDATA(node)->dfree = (RUBY_DATA_FUNC)rxml_node_free;
-  xnode->_private = (void*)node;
+  return rxml_node_memsize((xmlNodePtr)data);
 }
 
-void rxml_node_unmanage(xmlNodePtr xnode, VALUE node)
+static const rb_data_type_t rxml_node_owner_data_type = {
+  "LibXML::XML::Node owner",
+  { NULL, (RUBY_DATA_FUNC)rxml_node_owner_free, rxml_node_owner_memsize },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static void rxml_node_disown(VALUE node)
 {
-  RDATA(node)->dfree = NULL;
-  xnode->_private = NULL;
+  VALUE owner = rb_attr_get(node, OWNER_ATTR);
+
+  if (!NIL_P(owner))
+    RTYPEDDATA_DATA(owner) = NULL;
+}
+
+void rxml_node_manage(xmlNodePtr xnode, VALUE node)
+{
+  VALUE owner;
+
+  // Only one ruby object may own the tree
+  if (xnode->_private && (VALUE)xnode->_private != node)
+    rxml_node_disown((VALUE)xnode->_private);
+
+  // Trees that still belong to a document are freed by it
+  if (xnode->doc == NULL)
+  {
+    owner = rb_attr_get(node, OWNER_ATTR);
+    if (NIL_P(owner))
+      rb_ivar_set(node, OWNER_ATTR, TypedData_Wrap_Struct(0, &rxml_node_owner_data_type, xnode));
+    else
+      RTYPEDDATA_DATA(owner) = xnode;
+  }
+
+  xnode->_private = (void*)node;
 }
 
 xmlNodePtr rxml_node_root(xmlNodePtr xnode)
@@ -83,6 +134,87 @@ xmlNodePtr rxml_node_root(xmlNodePtr xnode)
   return current;
 }
 
+static size_t rxml_node_string_memsize(xmlDictPtr dict, const xmlChar *str)
+{
+  if (!str || (dict && xmlDictOwns(dict, str)))
+    return 0;
+  else
+    return rxml_memory_size(str, xmlStrlen(str) + 1);
+}
+
+static size_t rxml_node_self_memsize(xmlNodePtr xnode)
+{
+  xmlDictPtr dict = xnode->doc ? xnode->doc->dict : NULL;
+  size_t result;
+  xmlNsPtr xns;
+  xmlAttrPtr xattr;
+  xmlNodePtr xchild;
+
+  switch (xnode->type)
+  {
+  case XML_DOCUMENT_NODE:
+  case XML_HTML_DOCUMENT_NODE:
+    return rxml_memory_size(xnode, sizeof(xmlDoc));
+  case XML_DTD_NODE:
+    return rxml_memory_size(xnode, sizeof(xmlDtd));
+  case XML_ELEMENT_NODE:
+    result = rxml_memory_size(xnode, sizeof(xmlNode)) + rxml_node_string_memsize(dict, xnode->name);
+
+    for (xns = xnode->nsDef; xns; xns = xns->next)
+      result += rxml_memory_size(xns, sizeof(xmlNs)) + rxml_node_string_memsize(dict, xns->href) +
+                rxml_node_string_memsize(dict, xns->prefix);
+
+    for (xattr = xnode->properties; xattr; xattr = xattr->next)
+    {
+      result += rxml_memory_size(xattr, sizeof(xmlAttr)) + rxml_node_string_memsize(dict, xattr->name);
+      for (xchild = xattr->children; xchild; xchild = xchild->next)
+        result += rxml_node_memsize(xchild);
+    }
+
+    return result;
+  case XML_PI_NODE:
+    result = rxml_memory_size(xnode, sizeof(xmlNode)) + rxml_node_string_memsize(dict, xnode->name);
+    break;
+  default:
+    result = rxml_memory_size(xnode, sizeof(xmlNode));
+  }
+
+  // Short text may be stored inline in the node
+  if (xnode->content != (xmlChar*)&xnode->properties)
+    result += rxml_node_string_memsize(dict, xnode->content);
+
+  return result;
+}
+
+/* Returns the libxml memory used by a node, its attributes and its
+   descendants.  Sizes are estimated unless libxml's memory is tracked.
+   Strings shared through the document's dictionary are not included. */
+size_t rxml_node_memsize(xmlNodePtr xnode)
+{
+  xmlNodePtr current = xnode;
+  size_t result = 0;
+
+  while (current)
+  {
+    result += rxml_node_self_memsize(current);
+
+    // Entity references and dtds point to declarations rather than content
+    if (current->children && current->type != XML_ENTITY_REF_NODE &&
+        current->type != XML_DTD_NODE)
+    {
+      current = current->children;
+      continue;
+    }
+
+    while (current != xnode && !current->next)
+      current = current->parent;
+
+    current = (current == xnode) ? NULL : current->next;
+  }
+
+  return result;
+}
+
 void rxml_node_mark(xmlNodePtr xnode)
 {
    if (xnode->doc)
@@ -104,6 +236,84 @@ void rxml_node_mark(xmlNodePtr xnode)
    }
 }
 
+/* Only cached wrappers are write barrier protected, since the document
+   they mark never changes.  Other wrappers mark whichever object owns
+   their tree at the time. */
+const rb_data_type_t rxml_node_data_type = {
+  "LibXML::XML::Node",
+  { (RUBY_DATA_FUNC)rxml_node_mark, NULL, NULL },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED
+};
+
+/* Nodes are aligned, so their address fits in a Fixnum once shifted */
+static VALUE rxml_node_key(xmlNodePtr xnode)
+{
+  return LONG2FIX((long)((uintptr_t)xnode >> 3));
+}
+
+static int rxml_node_cacheable(xmlNodePtr xnode)
+{
+  return !NIL_P(rxml_node_wrappers) && xnode->doc && xnode->doc->_private;
+}
+
+/* Returns the cached wrapper of the node, or Qnil.  The map may still hold
+   the wrapper of an earlier node at the same address, which no longer
+   points to it. */
+static VALUE rxml_node_cached(xmlNodePtr xnode)
+{
+  VALUE node;
+
+  if (!rxml_node_cacheable(xnode))
+    return Qnil;
+
+  node = rb_funcall(rxml_node_wrappers, GET_METHOD, 1, rxml_node_key(xnode));
+  if (NIL_P(node) || RTYPEDDATA_DATA(node) != xnode)
+    return Qnil;
+
+  return node;
+}
+
+/* Called by libxml before it frees a node.  Documents freed by the garbage
+   collector take the wrappers of their nodes with them, and nodes freed
+   without the GVL belong to documents Ruby cannot see yet. */
+static void rxml_node_deregister(xmlNodePtr xnode)
+{
+  if (xnode->type != XML_DOCUMENT_NODE && xnode->type != XML_HTML_DOCUMENT_NODE &&
+      xnode->type != XML_ATTRIBUTE_NODE && xnode->type != XML_NAMESPACE_DECL &&
+      rxml_node_cacheable(xnode) && !rb_during_gc() && ruby_native_thread_p() &&
+      !rxml_gvl_released_p())
+  {
+    VALUE node = rxml_node_cached(xnode);
+
+    if (!NIL_P(node))
+      RTYPEDDATA_DATA(node) = NULL;
+  }
+
+  if (rxml_node_deregister_next)
+    rxml_node_deregister_next(xnode);
+}
+
+/* Called before the node is added to a parent or document, which then
+   frees it instead of Ruby */
+void rxml_node_unmanage(xmlNodePtr xnode, VALUE node)
+{
+  if (xnode->_private && (VALUE)xnode->_private != node)
+    rxml_node_disown((VALUE)xnode->_private);
+  rxml_node_disown(node);
+}
+
+/* Called once the node has been added to a parent or document.  The
+   node's wrapper is cached like the ones created by rxml_node_wrap, so it
+   is found again and is cleared when libxml frees the node.  Wrappers of
+   nodes in standalone trees are not cached. */
+void rxml_node_cache(xmlNodePtr xnode, VALUE node)
+{
+  xnode->_private = NULL;
+
+  if (rxml_node_cacheable(xnode))
+    rb_funcall(rxml_node_wrappers, SET_METHOD, 2, rxml_node_key(xnode), node);
+}
+
 VALUE rxml_node_wrap(xmlNodePtr xnode)
 {
   VALUE result = Qnil;
@@ -113,9 +323,14 @@ VALUE rxml_node_wrap(xmlNodePtr xnode)
   {
     result = (VALUE)xnode->_private;
   }
-  else
+  else if (NIL_P(result = rxml_node_cached(xnode)))
   {
-    result = Data_Wrap_Struct(cXMLNode, rxml_node_mark, NULL, xnode);
+    result = TypedData_Wrap_Struct(cXMLNode, &rxml_node_data_type, xnode);
+
+    if (xnode->parent && rxml_node_cacheable(xnode))
+      rb_funcall(rxml_node_wrappers, SET_METHOD, 2, rxml_node_key(xnode), result);
+    else
+      rb_gc_writebarrier_unprotect(result);
   }
 
   if (!xnode->doc && !xnode->parent)
@@ -127,14 +342,15 @@ VALUE rxml_node_wrap(xmlNodePtr xnode)
 
 static VALUE rxml_node_alloc(VALUE klass)
 {
-  // This node was created from Ruby so we are responsible for freeing it not libxml
-  return Data_Wrap_Struct(klass, rxml_node_mark, rxml_node_free, NULL);
+  VALUE result = TypedData_Wrap_Struct(klass, &rxml_node_data_type, NULL);
+  rb_gc_writebarrier_unprotect(result);
+  return result;
 }
 
 static xmlNodePtr rxml_get_xnode(VALUE node)
 {
    xmlNodePtr result;
-   Data_Get_Struct(node, xmlNode, result);
+   TypedData_Get_Struct(node, xmlNode, &rxml_node_data_type, result);
 
    if (!result)
     rb_raise(rb_eRuntimeError, "This node has already been freed.");
@@ -142,6 +358,29 @@ static xmlNodePtr rxml_get_xnode(VALUE node)
    return result;
 }
 
+/* Nodes created inside XML::Document.build(arena: true) blocks are
+   allocated from the document's arena.  Only calls that allocate the
+   node itself may run between entering and leaving the arena, and they
+   must not call back into Ruby. */
+static size_t rxml_node_arena_enter(xmlDocPtr xdoc)
+{
+  rxml_arena *arena = rxml_document_arena(xdoc);
+
+  rxml_arena_enter(arena);
+  return rxml_arena_memsize(arena);
+}
+
+static void rxml_node_arena_leave(xmlDocPtr xdoc, size_t bytes)
+{
+  size_t new_bytes = rxml_arena_memsize(rxml_document_arena(xdoc));
+
+  rxml_arena_leave();
+
+  // Report new arena chunks to the garbage collector
+  if (new_bytes > bytes)
+    rb_gc_adjust_memory_usage((ssize_t)(new_bytes - bytes));
+}
+
 /*
  * call-seq:
  *    XML::Node.new_cdata(content = nil) -> XML::Node
@@ -250,10 +489,21 @@ static VALUE rxml_node_new_pi(int argc, VALUE *argv, VALUE klass)
 static VALUE rxml_node_new_text(VALUE klass, VALUE content)
 {
   xmlNodePtr xnode;
+  xmlDocPtr xdoc = rxml_document_arena_build();
   Check_Type(content, T_STRING);
   content = rb_obj_as_string(content);
 
-  xnode = xmlNewText((xmlChar*) StringValueCStr(content));
+  if (xdoc)
+  {
+    const xmlChar *xcontent = (xmlChar*) StringValueCStr(content);
+    size_t bytes = rxml_node_arena_enter(xdoc);
+    xnode = xmlNewDocText(xdoc, xcontent);
+    rxml_node_arena_leave(xdoc, bytes);
+  }
+  else
+  {
+    xnode = xmlNewText((xmlChar*) StringValueCStr(content));
+  }
 
   if (xnode == NULL)
     rxml_raise(xmlGetLastError());
@@ -277,26 +527,54 @@ static VALUE rxml_node_initialize(int argc, VALUE *argv, VALUE self)
   VALUE ns;
   xmlNodePtr xnode = NULL;
   xmlNsPtr xns = NULL;
+  xmlDocPtr xdoc;
 
   rb_scan_args(argc, argv, "12", &name, &content, &ns);
 
   name = rb_obj_as_string(name);
 
   if (!NIL_P(ns))
-    Data_Get_Struct(ns, xmlNs, xns);
+    TypedData_Get_Struct(ns, xmlNs, &rxml_namespace_data_type, xns);
+
+  xdoc = rxml_document_arena_build();
+
+  if (xdoc)
+  {
+    const xmlChar *xname = (xmlChar*) StringValuePtr(name);
+    const xmlChar *xcontent = NULL;
+    xmlNodePtr xtext = NULL;
+    size_t bytes;
 
-  xnode = xmlNewNode(xns, (xmlChar*) StringValuePtr(name));
+    if (!NIL_P(content))
+    {
+      Check_Type(content, T_STRING);
+      xcontent = (xmlChar*) StringValuePtr(content);
+    }
+
+    bytes = rxml_node_arena_enter(xdoc);
+    xnode = xmlNewDocNode(xdoc, xns, xname, NULL);
+    if (xnode && xcontent && *xcontent)
+      xtext = xmlNewDocText(xdoc, xcontent);
+    rxml_node_arena_leave(xdoc, bytes);
+
+    if (xtext)
+      xmlAddChild(xnode, xtext);
+  }
+  else
+  {
+    xnode = xmlNewNode(xns, (xmlChar*) StringValuePtr(name));
+  }
 
   if (xnode == NULL)
     rxml_raise(xmlGetLastError());
 
   // Link the ruby wrapper to the underlying libxml node
-  RDATA(self)->data = xnode;
+  RTYPEDDATA_DATA(self) = xnode;
 
-  // Ruby is in charge of managing this node's memory
+  // Ruby is in charge of managing this node's memory, unless it belongs to a document
   rxml_node_manage(xnode, self);
 
-  if (!NIL_P(content))
+  if (!NIL_P(content) && !xdoc)
     rxml_node_content_set(self, content);
 
   return self;
@@ -306,6 +584,7 @@ static VALUE rxml_node_modify_dom(VALUE self, VALUE target,
                                   xmlNodePtr (*xmlFunc)(xmlNodePtr, xmlNodePtr))
 {
   xmlNodePtr xnode, xtarget, xresult;
+  VALUE cached;
 
   if (rb_obj_is_kind_of(target, cXMLNode) == Qfalse)
     rb_raise(rb_eTypeError, "Must pass an XML::Node object");
@@ -327,9 +606,18 @@ static VALUE rxml_node_modify_dom(VALUE self, VALUE target,
   if (!xresult)
 	  rxml_raise(xmlGetLastError());
 
+  /* A text target may have been merged into an adjacent text node.  If that
+     node is already wrapped, its wrapper replaces the target's. */
+  if (xresult != xtarget && !NIL_P(cached = rxml_node_cached(xresult)))
+  {
+    RTYPEDDATA_DATA(target) = NULL;
+    return cached;
+  }
+
   /* Assume the target was freed, we need to fix up the ruby object to point to the
      newly returned node. */
-  RDATA(target)->data = xresult;
+  RTYPEDDATA_DATA(target) = xresult;
+  rxml_node_cache(xresult, target);
 
   return target;
 }
@@ -503,6 +791,202 @@ static VALUE rxml_node_content_add(VALUE self, VALUE obj)
   return self;
 }
 
+/* Trees built from nested arrays may not be nested deeper than this,
+   which also stops arrays that contain themselves */
+#define RXML_NODE_TREE_MAX_DEPTH 2048
+
+typedef struct
+{
+  VALUE spec;
+  xmlDocPtr xdoc;
+  int arena;
+  xmlNodePtr root;
+  xmlNodePtr xnode;
+} rxml_node_tree_args;
+
+static VALUE rxml_node_tree_string(VALUE obj)
+{
+  if (RB_TYPE_P(obj, T_STRING))
+    return obj;
+  else if (SYMBOL_P(obj))
+    return rb_sym2str(obj);
+  else
+    return rb_obj_as_string(obj);
+}
+
+static int rxml_node_tree_attribute_i(VALUE name, VALUE value, VALUE data)
+{
+  rxml_node_tree_args *args = (rxml_node_tree_args*)data;
+  const xmlChar *xname;
+  const xmlChar *xvalue;
+  xmlAttrPtr xattr;
+  size_t bytes = 0;
+
+  if (NIL_P(value))
+    return ST_CONTINUE;
+
+  name = rxml_node_tree_string(name);
+  value = rxml_node_tree_string(value);
+  xname = (xmlChar*) StringValueCStr(name);
+  xvalue = (xmlChar*) StringValueCStr(value);
+
+  if (args->arena)
+    bytes = rxml_node_arena_enter(args->xdoc);
+  xattr = xmlSetProp(args->xnode, xname, xvalue);
+  if (args->arena)
+    rxml_node_arena_leave(args->xdoc, bytes);
+
+  if (xattr == NULL)
+    rxml_raise(xmlGetLastError());
+
+  return ST_CONTINUE;
+}
+
+static void rxml_node_tree_text(rxml_node_tree_args *args, xmlNodePtr parent, VALUE content)
+{
+  const xmlChar *xcontent;
+  xmlNodePtr xnode;
+  size_t bytes = 0;
+
+  if (RB_TYPE_P(content, T_HASH))
+    rb_raise(rb_eTypeError, "attributes must directly follow the element name");
+  if (rb_obj_is_kind_of(content, cXMLNode))
+    rb_raise(rb_eTypeError, "existing nodes cannot be part of a tree, use XML::Node#<<");
+
+  content = rxml_node_tree_string(content);
+  if (RSTRING_LEN(content) == 0)
+    return;
+
+  xcontent = (xmlChar*) StringValueCStr(content);
+
+  if (args->arena)
+    bytes = rxml_node_arena_enter(args->xdoc);
+  xnode = xmlNewDocText(args->xdoc, xcontent);
+  if (args->arena)
+    rxml_node_arena_leave(args->xdoc, bytes);
+
+  if (xnode == NULL)
+    rxml_raise(xmlGetLastError());
+
+  xmlAddChild(parent, xnode);
+}
+
+static void rxml_node_tree_element(rxml_node_tree_args *args, xmlNodePtr parent, VALUE spec, int depth)
+{
+  VALUE name;
+  const xmlChar *xname;
+  xmlNodePtr xnode;
+  size_t bytes = 0;
+  long i = 1;
+
+  if (RARRAY_LEN(spec) == 0)
+    rb_raise(rb_eArgError, "element must start with a name");
+  if (depth > RXML_NODE_TREE_MAX_DEPTH)
+    rb_raise(rb_eArgError, "tree is nested more than %d levels deep", RXML_NODE_TREE_MAX_DEPTH);
+
+  name = rxml_node_tree_string(RARRAY_AREF(spec, 0));
+  xname = (xmlChar*) StringValueCStr(name);
+
+  if (args->arena)
+    bytes = rxml_node_arena_enter(args->xdoc);
+  xnode = xmlNewDocNode(args->xdoc, NULL, xname, NULL);
+  if (args->arena)
+    rxml_node_arena_leave(args->xdoc, bytes);
+
+  if (xnode == NULL)
+    rxml_raise(xmlGetLastError());
+
+  // Link the node right away so it is freed with the tree if building fails
+  if (parent)
+    xmlAddChild(parent, xnode);
+  else
+    args->root = xnode;
+
+  if (RARRAY_LEN(spec) > 1 && RB_TYPE_P(RARRAY_AREF(spec, 1), T_HASH))
+  {
+    args->xnode = xnode;
+    rb_hash_foreach(RARRAY_AREF(spec, 1), rxml_node_tree_attribute_i, (VALUE)args);
+    i = 2;
+  }
+
+  for (; i < RARRAY_LEN(spec); i++)
+  {
+    VALUE child = RARRAY_AREF(spec, i);
+
+    if (RB_TYPE_P(child, T_ARRAY))
+      rxml_node_tree_element(args, xnode, child, depth + 1);
+    else if (!NIL_P(child))
+      rxml_node_tree_text(args, xnode, child);
+  }
+}
+
+static VALUE rxml_node_tree_build(VALUE data)
+{
+  rxml_node_tree_args *args = (rxml_node_tree_args*)data;
+  rxml_node_tree_element(args, NULL, args->spec, 1);
+  return Qnil;
+}
+
+/* Builds the element described by spec, and all its descendants, for
+   the given document.  Names are stored in the document's dictionary and
+   nodes come from the document's arena, if it has one.  The caller owns
+   the returned node. */
+xmlNodePtr rxml_node_build_tree(xmlDocPtr xdoc, VALUE spec)
+{
+  rxml_node_tree_args args;
+  int state = 0;
+
+  Check_Type(spec, T_ARRAY);
+
+  if (xdoc && !xdoc->dict)
+    xdoc->dict = xmlDictCreate();
+
+  args.spec = spec;
+  args.xdoc = xdoc;
+  args.arena = xdoc && rxml_document_arena(xdoc);
+  args.root = NULL;
+  args.xnode = NULL;
+
+  rb_protect(rxml_node_tree_build, (VALUE)&args, &state);
+
+  if (state)
+  {
+    if (args.root)
+      xmlFreeNode(args.root);
+    rb_jump_tag(state);
+  }
+
+  return args.root;
+}
+
+/*
+ * call-seq:
+ *    node.append_tree([name, attributes = {}, *children]) -> XML::Node
+ *
+ * Builds a subtree from nested arrays and adds it as the last child of
+ * this node.  Each element is an array that starts with the element's
+ * name, optionally followed by a hash of attributes, followed by its
+ * children.  Children that are arrays are elements, nil is skipped and
+ * anything else is added as text.  Attributes whose value is nil are
+ * skipped.  Returns the new element.
+ *
+ *   node.append_tree(['book', {id: 1},
+ *                      ['title', 'Programming Ruby'],
+ *                      ['price', {currency: 'USD'}, 29.95]])
+ *
+ * The whole subtree is built in a single call, so this is much faster
+ * than creating its nodes one by one.  Element and attribute names are
+ * stored once in the document's dictionary.
+ */
+static VALUE rxml_node_append_tree(VALUE self, VALUE spec)
+{
+  xmlNodePtr xnode = rxml_get_xnode(self);
+  xmlNodePtr xtree = rxml_node_build_tree(xnode->doc, spec);
+
+  xmlAddChild(xnode, xtree);
+  return rxml_node_wrap(xtree);
+}
+
 /*
  * call-seq:
  *    node.doc -> document
@@ -536,6 +1020,23 @@ static VALUE rxml_node_doc(VALUE self)
   return (VALUE)xdoc->_private;
 }
 
+typedef struct
+{
+  xmlOutputBufferPtr output;
+  xmlNodePtr xnode;
+  const xmlChar *xencoding;
+  int level;
+  int indent;
+} rxml_node_to_s_args;
+
+static void* rxml_node_to_s_nogvl(void *data)
+{
+  rxml_node_to_s_args *args = (rxml_node_to_s_args*)data;
+  xmlNodeDumpOutput(args->output, args->xnode->doc, args->xnode, args->level, args->indent, (const char*)args->xencoding);
+  xmlOutputBufferFlush(args->output);
+  return NULL;
+}
+
 /*
  * call-seq:
  *    node.to_s -> "string"
@@ -560,7 +1061,13 @@ static VALUE rxml_node_doc(VALUE self)
  *
  * :encoding - Specifies the output encoding of the string.  It
  * defaults to XML::Encoding::UTF8.  To change it, use one of the
- * XML::Encoding encoding constants. */
+ * XML::Encoding encoding constants.
+ *
+ * :nogvl - Specifies if the node should be serialized without holding
+ * Ruby's global VM lock, so other threads can run meanwhile.  Only the
+ * creation of the resulting string requires the lock.  The node's document
+ * must not be modified by other threads while it is serialized.  The
+ * default value is false. */
 
 static VALUE rxml_node_to_s(int argc, VALUE *argv, VALUE self)
 {
@@ -572,6 +1079,7 @@ static VALUE rxml_node_to_s(int argc, VALUE *argv, VALUE self)
 
   int level = 0;
   int indent = 1;
+  int nogvl = 0;
   const xmlChar *xencoding = (const xmlChar*)"UTF-8";
 
   rb_scan_args(argc, argv, "01", &options);
@@ -583,6 +1091,7 @@ static VALUE rxml_node_to_s(int argc, VALUE *argv, VALUE self)
     rencoding = rb_hash_aref(options, ID2SYM(rb_intern("encoding")));
     rindent = rb_hash_aref(options, ID2SYM(rb_intern("indent")));
     rlevel = rb_hash_aref(options, ID2SYM(rb_intern("level")));
+    nogvl = RTEST(rb_hash_aref(options, ID2SYM(rb_intern("nogvl"))));
 
     if (rindent == Qfalse)
       indent = 0;
@@ -603,8 +1112,24 @@ static VALUE rxml_node_to_s(int argc, VALUE *argv, VALUE self)
 
   xnode = rxml_get_xnode(self);
 
-  xmlNodeDumpOutput(output, xnode->doc, xnode, level, indent, (const char*)xencoding);
-  xmlOutputBufferFlush(output);
+  if (nogvl)
+  {
+    VALUE exception = Qnil;
+    rxml_node_to_s_args args = {output, xnode, xencoding, level, indent};
+
+    rxml_without_gvl(rxml_node_to_s_nogvl, &args, &exception);
+
+    if (exception != Qnil)
+    {
+      xmlOutputBufferClose(output);
+      rb_exc_raise(exception);
+    }
+  }
+  else
+  {
+    xmlNodeDumpOutput(output, xnode->doc, xnode, level, indent, (const char*)xencoding);
+    xmlOutputBufferFlush(output);
+  }
 
 #ifdef LIBXML2_NEW_BUFFER
   if (output->conv)
@@ -1293,6 +1818,29 @@ void rxml_init_node(void)
 {
   cXMLNode = rb_define_class_under(mXML, "Node", rb_cObject);
 
+  OWNER_ATTR = rb_intern("owner");
+  GET_METHOD = rb_intern("[]");
+  SET_METHOD = rb_intern("[]=");
+
+  /* Weak maps accept integer keys since Ruby 2.7 */
+#if RUBY_API_VERSION_MAJOR > 2 || RUBY_API_VERSION_MINOR >= 7
+  rxml_node_wrappers = rb_class_new_instance(0, NULL, rb_path2class("ObjectSpace::WeakMap"));
+  rb_global_variable(&rxml_node_wrappers);
+#endif
+
+  /* Both for this thread and ones that start using libxml later.  libxml
+     2.13 deprecates these, but has no other way to learn about freed
+     nodes. */
+#if LIBXML_VERSION >= 21300 && defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+  rxml_node_deregister_next = xmlDeregisterNodeDefault((xmlDeregisterNodeFunc)rxml_node_deregister);
+  xmlThrDefDeregisterNodeDefault((xmlDeregisterNodeFunc)rxml_node_deregister);
+#if LIBXML_VERSION >= 21300 && defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
   rb_define_const(cXMLNode, "SPACE_DEFAULT", INT2NUM(0));
   rb_define_const(cXMLNode, "SPACE_PRESERVE", INT2NUM(1));
   rb_define_const(cXMLNode, "SPACE_NOT_INHERIT", INT2NUM(-1));
@@ -1357,6 +1905,7 @@ void rxml_init_node(void)
   /* Modification */
   rb_define_method(cXMLNode, "[]=", rxml_node_property_set, 2);
   rb_define_method(cXMLNode, "<<", rxml_node_content_add, 1);
+  rb_define_method(cXMLNode, "append_tree", rxml_node_append_tree, 1);
   rb_define_method(cXMLNode, "sibling=", rxml_node_sibling_set, 1);
   rb_define_method(cXMLNode, "next=", rxml_node_next_set, 1);
   rb_define_method(cXMLNode, "prev=", rxml_node_prev_set, 1);
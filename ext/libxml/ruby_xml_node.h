@@ -4,10 +4,14 @@
 #define __RXML_NODE__
 
 extern VALUE cXMLNode;
+extern const rb_data_type_t rxml_node_data_type;
 
 void rxml_init_node(void);
 void rxml_node_mark(xmlNodePtr xnode);
 VALUE rxml_node_wrap(xmlNodePtr xnode);
 void rxml_node_manage(xmlNodePtr xnode, VALUE node);
 void rxml_node_unmanage(xmlNodePtr xnode, VALUE node);
+void rxml_node_cache(xmlNodePtr xnode, VALUE node);
+size_t rxml_node_memsize(xmlNodePtr xnode);
+xmlNodePtr rxml_node_build_tree(xmlDocPtr xdoc, VALUE spec);
 #endif
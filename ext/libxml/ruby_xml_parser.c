@@ -3,6 +3,8 @@
 #include <stdarg.h>
 #include "ruby_libxml.h"
 
+#include <libxml/parserInternals.h>
+
 /*
  * Document-class: LibXML::XML::Parser
  *
@@ -51,6 +53,60 @@ static VALUE rxml_parser_initialize(int argc, VALUE *argv, VALUE self)
   return self;
 }
 
+static void* rxml_parser_parse_nogvl(void *data)
+{
+  xmlParserCtxtPtr ctxt = (xmlParserCtxtPtr)data;
+  return (void*)(xmlParseDocument(ctxt) == -1 ? NULL : ctxt);
+}
+
+typedef struct
+{
+  VALUE context;
+  xmlParserCtxtPtr ctxt;
+  rxml_memory_scope scope;
+} rxml_parser_parse_args;
+
+static VALUE rxml_parser_parse_scoped(VALUE data)
+{
+  rxml_parser_parse_args *args = (rxml_parser_parse_args*)data;
+  xmlParserCtxtPtr ctxt = args->ctxt;
+  int status;
+
+  if (rxml_parser_context_push_p(args->context))
+  {
+    status = rxml_parser_context_push_finish(args->context, ctxt);
+  }
+  else if (rxml_parser_context_nogvl_p(args->context))
+  {
+    VALUE exception = Qnil;
+    status = rxml_without_gvl(rxml_parser_parse_nogvl, ctxt, &exception) ? 0 : -1;
+
+    /* An error handler raised an exception while parsing */
+    if (exception != Qnil)
+    {
+      if (ctxt->myDoc)
+      {
+        xmlFreeDoc(ctxt->myDoc);
+        ctxt->myDoc = NULL;
+      }
+      rb_exc_raise(exception);
+    }
+  }
+  else
+  {
+    status = xmlParseDocument(ctxt);
+  }
+
+  return INT2NUM(status);
+}
+
+static VALUE rxml_parser_parse_leave(VALUE data)
+{
+  rxml_parser_parse_args *args = (rxml_parser_parse_args*)data;
+  rxml_memory_scope_leave(&args->scope);
+  return Qnil;
+}
+
 /*
  * call-seq:
  *    parser.parse -> XML::Document
@@ -58,22 +114,241 @@ static VALUE rxml_parser_initialize(int argc, VALUE *argv, VALUE self)
  * Parse the input XML and create an XML::Document with
  * it's content. If an error occurs, XML::Parser::ParseError
  * is thrown.
+ *
+ * If the parser's context has XML::Parser::Context#nogvl set, then
+ * the document is parsed without holding Ruby's global VM lock.
+ *
+ * If the parser's context has XML::Parser::Context#memory_limit set,
+ * then XML::Error is raised if parsing would allocate more memory
+ * than allowed.
+ *
+ * For push contexts (see XML::Parser::Context.push), the input is
+ * finished if that was not done yet and the document built from the
+ * data fed to the context is returned.
  */
 static VALUE rxml_parser_parse(VALUE self)
 {
+  rxml_parser_parse_args args;
   xmlParserCtxtPtr ctxt;
   VALUE context = rb_ivar_get(self, CONTEXT_ATTR);
+  VALUE document;
+  int status;
   
-  Data_Get_Struct(context, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(context, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
-  if ((xmlParseDocument(ctxt) == -1 || !ctxt->wellFormed) && ! ctxt->recovery)
+  args.context = context;
+  args.ctxt = ctxt;
+  rxml_memory_scope_enter(&args.scope, rxml_parser_context_memory_limit(context));
+  status = NUM2INT(rb_ensure(rxml_parser_parse_scoped, (VALUE)&args, rxml_parser_parse_leave, (VALUE)&args));
+
+  /* Recovery mode would otherwise return whatever was parsed before the
+     limit was reached.  Push contexts may also have reached it while data
+     was fed to them. */
+  if (args.scope.exceeded || rxml_parser_context_memory_exceeded_p(context))
+  {
+    if (ctxt->myDoc)
+    {
+      xmlFreeDoc(ctxt->myDoc);
+      ctxt->myDoc = NULL;
+    }
+    rxml_memory_raise_limit(&args.scope);
+  }
+
+  if ((status == -1 || !ctxt->wellFormed) && ! ctxt->recovery)
   {
     rxml_raise(&ctxt->lastError);
   }
 
   rb_funcall(context, rb_intern("close"), 0);
 
-  return rxml_document_wrap(ctxt->myDoc);
+  document = rxml_document_wrap(ctxt->myDoc);
+  rxml_document_set_dictionary(document, rxml_parser_context_dictionary(context));
+  return document;
+}
+
+/* Batch parsing used by XML::Parser.parse_many.  Each input is parsed
+   into its own document by a pool of native threads that never touch
+   Ruby, so errors are recorded per item instead of being reported to
+   the Ruby error handler. */
+typedef struct
+{
+  const char *input;
+  long length;
+  xmlDocPtr doc;
+  xmlError error;
+} rxml_parse_item;
+
+typedef struct
+{
+  rxml_parse_item *items;
+  long count;
+  int files;
+  int options;
+  const char *encoding;
+} rxml_parse_batch;
+
+#if LIBXML_VERSION >= 21200
+static void rxml_parse_many_error(void *userData, const xmlError *xerror)
+#else
+static void rxml_parse_many_error(void *userData, xmlErrorPtr xerror)
+#endif
+{
+  /* Errors are read from the parser context once parsing is done */
+}
+
+static void rxml_parse_many_item(void *data, void *state, long index)
+{
+  rxml_parse_batch *batch = (rxml_parse_batch*)data;
+  rxml_parse_item *item = &batch->items[index];
+  xmlParserCtxtPtr ctxt;
+
+  if (batch->files)
+  {
+    ctxt = xmlCreateURLParserCtxt(item->input, 0);
+  }
+  else if (item->length == 0)
+  {
+    rxml_error_init(&item->error, XML_FROM_PARSER, XML_ERR_DOCUMENT_EMPTY, "Document is empty");
+    return;
+  }
+  else if (item->length > INT_MAX)
+  {
+    /* libxml's memory parser takes the length as an int */
+    rxml_error_init(&item->error, XML_FROM_PARSER, XML_ERR_INTERNAL_ERROR, "Document is too large");
+    return;
+  }
+  else
+  {
+    ctxt = xmlCreateMemoryParserCtxt(item->input, (int)item->length);
+  }
+
+  if (!ctxt)
+  {
+    xmlCopyError(xmlGetLastError(), &item->error);
+    return;
+  }
+
+  xmlCtxtUseOptions(ctxt, batch->options);
+  ctxt->sax->serror = rxml_parse_many_error;
+
+  if (batch->encoding)
+  {
+    xmlCharEncodingHandlerPtr hdlr = xmlFindCharEncodingHandler(batch->encoding);
+    if (hdlr)
+      xmlSwitchToEncoding(ctxt, hdlr);
+  }
+
+  if ((xmlParseDocument(ctxt) == -1 || !ctxt->wellFormed) && !ctxt->recovery)
+  {
+    xmlCopyError(&ctxt->lastError, &item->error);
+    if (ctxt->myDoc)
+      xmlFreeDoc(ctxt->myDoc);
+  }
+  else
+  {
+    item->doc = ctxt->myDoc;
+  }
+
+  ctxt->myDoc = NULL;
+  xmlFreeParserCtxt(ctxt);
+}
+
+static void rxml_parse_many_cancel(void *data, long index)
+{
+  rxml_parse_batch *batch = (rxml_parse_batch*)data;
+  rxml_error_init(&batch->items[index].error, XML_FROM_PARSER, XML_ERR_USER_STOP, "Parsing was cancelled");
+}
+
+/*
+ * call-seq:
+ *    XML::Parser.native_parse_many(inputs, files, threads, options, encoding) -> [XML::Document | XML::Error]
+ *
+ * Implementation of XML::Parser.parse_many.
+ */
+static VALUE rxml_parser_parse_many(VALUE klass, VALUE inputs, VALUE files, VALUE threads,
+                                    VALUE options, VALUE encoding)
+{
+  rxml_parse_batch batch;
+  rxml_parallel_work work;
+  VALUE sources, result;
+  VALUE exception = Qnil;
+  int nthreads = NUM2INT(threads);
+  long i;
+
+  Check_Type(inputs, T_ARRAY);
+
+  memset(&batch, 0, sizeof(batch));
+  batch.count = RARRAY_LEN(inputs);
+  batch.files = RTEST(files);
+  batch.options = NIL_P(options) ? 0 : NUM2INT(options);
+
+  if (!NIL_P(encoding))
+  {
+    batch.encoding = xmlGetCharEncodingName((xmlCharEncoding)NUM2INT(encoding));
+    if (!batch.encoding)
+      rb_raise(rb_eArgError, "Unknown encoding: %i", NUM2INT(encoding));
+  }
+
+  /* Take frozen copies of the inputs so other threads cannot change them
+     while they are being parsed */
+  sources = rb_ary_new_capa(batch.count);
+  for (i = 0; i < batch.count; i++)
+  {
+    VALUE input = rb_ary_entry(inputs, i);
+    Check_Type(input, T_STRING);
+    input = rb_str_new_frozen(input);
+
+    /* Check file names here, nothing may raise once the items are allocated */
+    if (batch.files)
+      StringValueCStr(input);
+
+    rb_ary_push(sources, input);
+  }
+
+  result = rb_ary_new_capa(batch.count);
+  if (batch.count == 0)
+    return result;
+
+  batch.items = ALLOC_N(rxml_parse_item, batch.count);
+  memset(batch.items, 0, sizeof(rxml_parse_item) * batch.count);
+
+  for (i = 0; i < batch.count; i++)
+  {
+    VALUE source = RARRAY_AREF(sources, i);
+    batch.items[i].input = RSTRING_PTR(source);
+    batch.items[i].length = RSTRING_LEN(source);
+  }
+
+  memset(&work, 0, sizeof(work));
+  work.count = batch.count;
+  work.data = &batch;
+  work.run = rxml_parse_many_item;
+  work.cancel = rxml_parse_many_cancel;
+
+  rxml_parallel(&work, nthreads, &exception);
+
+  for (i = 0; i < batch.count; i++)
+  {
+    rxml_parse_item *item = &batch.items[i];
+
+    if (item->doc)
+    {
+      rb_ary_push(result, rxml_document_wrap(item->doc));
+    }
+    else
+    {
+      rb_ary_push(result, rxml_error_wrap(&item->error));
+      xmlResetError(&item->error);
+    }
+  }
+
+  xfree(batch.items);
+  RB_GC_GUARD(sources);
+
+  if (exception != Qnil)
+    rb_exc_raise(exception);
+
+  return result;
 }
 
 void rxml_init_parser(void)
@@ -88,4 +363,7 @@ void rxml_init_parser(void)
   /* Instance Methods */
   rb_define_method(cXMLParser, "initialize", rxml_parser_initialize, -1);
   rb_define_method(cXMLParser, "parse", rxml_parser_parse, 0);
+
+  /* Class Methods */
+  rb_define_private_method(rb_singleton_class(cXMLParser), "native_parse_many", rxml_parser_parse_many, 5);
 }
@@ -4,9 +4,16 @@
 #include "ruby_xml_parser_context.h"
 
 #include <libxml/parserInternals.h>
+#include <libxml/uri.h>
 
 VALUE cXMLParserContext;
 static ID IO_ATTR;
+static ID NOGVL_ATTR;
+static ID DICTIONARY_ATTR;
+static ID PUSH_ATTR;
+static ID MEMORY_LIMIT_ATTR;
+static ID MEMORY_BYTES_ATTR;
+static ID MEMORY_EXCEEDED_ATTR;
 
 /*
  * Document-class: LibXML::XML::Parser::Context
@@ -20,16 +27,33 @@ static void rxml_parser_context_free(xmlParserCtxtPtr ctxt)
   xmlFreeParserCtxt(ctxt);
 }
 
+size_t rxml_parser_context_memsize(const void *data)
+{
+  const xmlParserCtxt *ctxt = (const xmlParserCtxt*)data;
+
+  return sizeof(xmlParserCtxt) +
+         ctxt->inputMax * sizeof(xmlParserInputPtr) +
+         ctxt->nodeMax * sizeof(xmlNodePtr) +
+         ctxt->nameMax * sizeof(xmlChar*) +
+         ctxt->spaceMax * sizeof(int);
+}
+
+const rb_data_type_t rxml_parser_context_data_type = {
+  "LibXML::XML::Parser::Context",
+  { NULL, (RUBY_DATA_FUNC)rxml_parser_context_free, rxml_parser_context_memsize },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 static VALUE rxml_parser_context_wrap(xmlParserCtxtPtr ctxt)
 {
-  return Data_Wrap_Struct(cXMLParserContext, NULL, rxml_parser_context_free, ctxt);
+  return TypedData_Wrap_Struct(cXMLParserContext, &rxml_parser_context_data_type, ctxt);
 }
 
 
 static VALUE rxml_parser_context_alloc(VALUE klass)
 {
   xmlParserCtxtPtr ctxt = xmlNewParserCtxt();
-  return Data_Wrap_Struct(klass, NULL, rxml_parser_context_free, ctxt);
+  return TypedData_Wrap_Struct(klass, &rxml_parser_context_data_type, ctxt);
 }
 
 /* call-seq:
@@ -53,7 +77,7 @@ static VALUE rxml_parser_context_document(int argc, VALUE* argv, VALUE klass)
   xmlDocPtr xdoc;
   xmlChar *buffer;
   int length;
-  Data_Get_Struct(document, xmlDoc, xdoc);
+  TypedData_Get_Struct(document, xmlDoc, &rxml_document_data_type, xdoc);
   xmlDocDumpFormatMemoryEnc(xdoc, &buffer, &length, (const char*)xdoc->encoding, 0);
 
   xmlParserCtxtPtr ctxt = xmlCreateDocParserCtxt(buffer);
@@ -151,8 +175,9 @@ static VALUE rxml_parser_context_io(int argc, VALUE* argv, VALUE klass)
   if (NIL_P(io))
     rb_raise(rb_eTypeError, "Must pass in an IO object");
 
+  VALUE io_input = rxml_io_input_new(io);
   xmlParserInputBufferPtr input = xmlParserInputBufferCreateIO((xmlInputReadCallback) rxml_read_callback, NULL,
-                                       (void*)io, XML_CHAR_ENCODING_NONE);
+                                       RTYPEDDATA_DATA(io_input), XML_CHAR_ENCODING_NONE);
 
   xmlParserCtxtPtr ctxt = xmlNewParserCtxt();
 
@@ -180,11 +205,287 @@ static VALUE rxml_parser_context_io(int argc, VALUE* argv, VALUE klass)
   VALUE result = rxml_parser_context_wrap(ctxt);
 
   /* Attach io object to parser so it won't get freed.*/
-  rb_ivar_set(result, IO_ATTR, io);
+  rb_ivar_set(result, IO_ATTR, io_input);
+
+  return result;
+}
+
+/* call-seq:
+ *    XML::Parser::Context.mmap(path, options = nil) -> XML::Parser::Context
+ *
+ * Creates a new parser context that reads the specified file through a
+ * private, read-only memory mapping instead of copying it through
+ * buffered reads.  The kernel is advised that the file is read
+ * sequentially, and the pages of the file are shared with any other
+ * process that maps or caches it.  The mapping is released when the
+ * context is garbage collected.  The file must not be truncated while
+ * it is parsed.
+ *
+ * Parameters:
+ *
+ *  path - Path to the file
+ *  options - A or'ed together list of LibXML::XML::Parser::Options values
+*/
+static VALUE rxml_parser_context_mmap(int argc, VALUE* argv, VALUE klass)
+{
+  VALUE path, options, mapping, result;
+  xmlParserInputBufferPtr input;
+  xmlParserInputPtr stream;
+  xmlParserCtxtPtr ctxt;
+  const char *data;
+  int size;
+
+  rb_scan_args(argc, argv, "11", &path, &options);
+
+  mapping = rxml_io_mmap_new(path);
+
+  if (rxml_io_mmap_static(mapping, &data, &size))
+    input = xmlParserInputBufferCreateStatic(data, size, XML_CHAR_ENCODING_NONE);
+  else
+    input = xmlParserInputBufferCreateIO(rxml_io_mmap_read_callback, NULL,
+                                         rxml_io_mmap_context(mapping), XML_CHAR_ENCODING_NONE);
+  if (!input)
+    rxml_raise(xmlGetLastError());
+
+  ctxt = xmlNewParserCtxt();
+  if (!ctxt)
+  {
+    xmlFreeParserInputBuffer(input);
+    rxml_raise(xmlGetLastError());
+  }
+
+  xmlCtxtUseOptions(ctxt, options == Qnil ? 0 : NUM2INT(options));
+
+  stream = xmlNewIOInputStream(ctxt, input, XML_CHAR_ENCODING_NONE);
+  if (!stream)
+  {
+    xmlFreeParserInputBuffer(input);
+    xmlFreeParserCtxt(ctxt);
+    rxml_raise(xmlGetLastError());
+  }
+
+  stream->filename = (const char*)xmlCanonicPath((const xmlChar*)StringValueCStr(path));
+  if (!ctxt->directory)
+    ctxt->directory = xmlParserGetDirectory(StringValueCStr(path));
+  inputPush(ctxt, stream);
+
+  result = rxml_parser_context_wrap(ctxt);
+
+  /* Attach the mapping to the context so it is not unmapped while parsing */
+  rb_ivar_set(result, IO_ATTR, mapping);
 
   return result;
 }
 
+/* call-seq:
+ *    XML::Parser::Context.push(options = nil) -> XML::Parser::Context
+ *
+ * Creates a new push parser context.  Instead of reading its input from
+ * a source, data is pushed to the context in chunks as it arrives using
+ * #feed, and the input is ended by calling #finish.  Chunks can be split
+ * at any byte, including inside a tag or a multibyte character.
+ *
+ * To build a document, create an XML::Parser for the context and call
+ * XML::Parser#parse once all the data was fed.  To receive SAX events
+ * while data is fed, create an XML::SaxParser for the context and set
+ * its callbacks before the first chunk is fed.
+ *
+ *  context = XML::Parser::Context.push
+ *  parser = XML::SaxParser.new(context)
+ *  parser.callbacks = MyCallbacks.new
+ *  socket.each(1024) {|chunk| context.feed(chunk)}
+ *  context.finish
+ *
+ * Parameters:
+ *
+ *  options - A or'ed together list of LibXML::XML::Parser::Options values
+*/
+static VALUE rxml_parser_context_push(int argc, VALUE* argv, VALUE klass)
+{
+  VALUE options, result;
+  rb_scan_args(argc, argv, "01", &options);
+
+  xmlParserCtxtPtr ctxt = xmlCreatePushParserCtxt(NULL, NULL, NULL, 0, NULL);
+
+  if (!ctxt)
+    rxml_raise(xmlGetLastError());
+
+  xmlCtxtUseOptions(ctxt, options == Qnil ? 0 : NUM2INT(options));
+
+  result = rxml_parser_context_wrap(ctxt);
+  rb_ivar_set(result, PUSH_ATTR, Qtrue);
+  return result;
+}
+
+typedef struct
+{
+  VALUE context;
+  xmlParserCtxtPtr ctxt;
+  const char *chunk;
+  int size;
+  int terminate;
+  int status;
+  rxml_memory_scope scope;
+} rxml_parser_context_chunk_args;
+
+static VALUE rxml_parser_context_chunk_scoped(VALUE data)
+{
+  rxml_parser_context_chunk_args *args = (rxml_parser_context_chunk_args*)data;
+  args->status = xmlParseChunk(args->ctxt, args->chunk, args->size, args->terminate);
+  return Qnil;
+}
+
+static VALUE rxml_parser_context_chunk_leave(VALUE data)
+{
+  rxml_parser_context_chunk_args *args = (rxml_parser_context_chunk_args*)data;
+
+  rxml_memory_scope_leave(&args->scope);
+  rb_ivar_set(args->context, MEMORY_BYTES_ATTR, SIZET2NUM(args->scope.bytes));
+  if (args->scope.exceeded)
+    rb_ivar_set(args->context, MEMORY_EXCEEDED_ATTR, Qtrue);
+
+  return Qnil;
+}
+
+/* Parses a chunk of a push context.  If the context has a memory limit,
+   the chunk is parsed in a memory scope that continues counting from the
+   bytes allocated by the earlier chunks, so the limit applies to the
+   whole document. */
+static int rxml_parser_context_parse_chunk(VALUE context, xmlParserCtxtPtr ctxt, const char *chunk, int size, int terminate)
+{
+  rxml_parser_context_chunk_args args;
+  size_t limit = rxml_parser_context_memory_limit(context);
+  VALUE bytes;
+
+  if (!limit)
+    return xmlParseChunk(ctxt, chunk, size, terminate);
+
+  args.context = context;
+  args.ctxt = ctxt;
+  args.chunk = chunk;
+  args.size = size;
+  args.terminate = terminate;
+  args.status = XML_ERR_OK;
+
+  bytes = rb_attr_get(context, MEMORY_BYTES_ATTR);
+  rxml_memory_scope_enter(&args.scope, limit);
+  if (!NIL_P(bytes))
+    args.scope.bytes = NUM2SIZET(bytes);
+
+  rb_ensure(rxml_parser_context_chunk_scoped, (VALUE)&args, rxml_parser_context_chunk_leave, (VALUE)&args);
+
+  return args.status;
+}
+
+static void rxml_parser_context_push_chunk(VALUE self, const char *chunk, int size, int terminate)
+{
+  xmlParserCtxtPtr ctxt;
+  int status;
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
+
+  if (!rxml_parser_context_push_p(self))
+    rb_raise(rb_eArgError, "Data can only be fed to push parser contexts");
+
+  if (ctxt->instate == XML_PARSER_EOF)
+    rb_raise(rb_eArgError, "The push parser context has already finished");
+
+  status = rxml_parser_context_parse_chunk(self, ctxt, chunk, size, terminate);
+
+  /* libxml does not always stop when the document ends with an error */
+  if (terminate)
+    ctxt->instate = XML_PARSER_EOF;
+
+  if (rxml_parser_context_memory_exceeded_p(self))
+  {
+    ctxt->instate = XML_PARSER_EOF;
+    rxml_parser_context_raise_memory_limit(self);
+  }
+
+  if (status != XML_ERR_OK && !ctxt->wellFormed && !ctxt->recovery)
+    rxml_raise(&ctxt->lastError);
+}
+
+/*
+ * call-seq:
+ *    context.feed(string) -> context
+ *
+ * Parses the next chunk of input of a push parser context.  Raises
+ * XML::Error if the data fed so far is not well formed, unless the
+ * context is in recovery mode.
+ */
+static VALUE rxml_parser_context_feed(VALUE self, VALUE string)
+{
+  StringValue(string);
+
+  if (RSTRING_LEN(string) > INT_MAX)
+    rb_raise(rb_eArgError, "Chunks must be smaller than 2GB");
+
+  rxml_parser_context_push_chunk(self, RSTRING_PTR(string), (int)RSTRING_LEN(string), 0);
+  RB_GC_GUARD(string);
+  return self;
+}
+
+/*
+ * call-seq:
+ *    context.finish -> context
+ *
+ * Signals the end of the input of a push parser context and parses any
+ * remaining data.  Raises XML::Error if the input is incomplete or not
+ * well formed, unless the context is in recovery mode.
+ */
+static VALUE rxml_parser_context_finish(VALUE self)
+{
+  rxml_parser_context_push_chunk(self, NULL, 0, 1);
+  return self;
+}
+
+/*
+ * call-seq:
+ *    context.finished? -> (true|false)
+ *
+ * Determine whether parsing of this context has ended, either because
+ * #finish was called or because a fatal error occurred.
+ */
+static VALUE rxml_parser_context_finished_q(VALUE self)
+{
+  xmlParserCtxtPtr ctxt;
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
+
+  return ctxt->instate == XML_PARSER_EOF ? Qtrue : Qfalse;
+}
+
+/*
+ * call-seq:
+ *    context.push? -> (true|false)
+ *
+ * Determine whether this is a push parser context created with
+ * XML::Parser::Context.push.
+ */
+static VALUE rxml_parser_context_push_q(VALUE self)
+{
+  return rxml_parser_context_push_p(self) ? Qtrue : Qfalse;
+}
+
+int rxml_parser_context_push_p(VALUE context)
+{
+  return RTEST(rb_ivar_get(context, PUSH_ATTR));
+}
+
+/* Ends the input of a push context unless that was already done.  Returns
+   -1 if libxml reported an error, errors are not raised. */
+int rxml_parser_context_push_finish(VALUE context, xmlParserCtxtPtr ctxt)
+{
+  int status = 0;
+
+  if (ctxt->instate != XML_PARSER_EOF)
+  {
+    status = rxml_parser_context_parse_chunk(context, ctxt, NULL, 0, 1) == XML_ERR_OK ? 0 : -1;
+    ctxt->instate = XML_PARSER_EOF;
+  }
+
+  return status;
+}
+
 /*
  * call-seq:
  *    context.base_uri -> "http:://libxml.org"
@@ -194,7 +495,7 @@ static VALUE rxml_parser_context_io(int argc, VALUE* argv, VALUE klass)
 static VALUE rxml_parser_context_base_uri_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->input && ctxt->input->filename)
     return rxml_new_cstr((const xmlChar*)ctxt->input->filename, ctxt->encoding);
@@ -211,7 +512,7 @@ static VALUE rxml_parser_context_base_uri_get(VALUE self)
 static VALUE rxml_parser_context_base_uri_set(VALUE self, VALUE url)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   Check_Type(url, T_STRING);
 
@@ -235,7 +536,7 @@ static VALUE rxml_parser_context_close(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
   xmlParserInputPtr xinput;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   while ((xinput = inputPop(ctxt)) != NULL)
   {
@@ -253,7 +554,7 @@ static VALUE rxml_parser_context_close(VALUE self)
 static VALUE rxml_parser_context_data_directory_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->directory == NULL)
     return (Qnil);
@@ -270,11 +571,73 @@ static VALUE rxml_parser_context_data_directory_get(VALUE self)
 static VALUE rxml_parser_context_depth_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   return (INT2NUM(ctxt->depth));
 }
 
+/*
+ * call-seq:
+ *    context.dictionary -> XML::Parser::Dictionary
+ *
+ * Returns the shared dictionary used by this context, or nil if the
+ * context uses its own dictionary.
+ */
+static VALUE rxml_parser_context_dictionary_get(VALUE self)
+{
+  return rb_ivar_get(self, DICTIONARY_ATTR);
+}
+
+/* Returns the shared dictionary of a context, or nil */
+VALUE rxml_parser_context_dictionary(VALUE context)
+{
+  return rb_ivar_get(context, DICTIONARY_ATTR);
+}
+
+/*
+ * call-seq:
+ *    context.dictionary = XML::Parser::Dictionary
+ *
+ * Makes this context store names in a dictionary that is shared with
+ * other contexts instead of its own (see XML::Parser::Dictionary).  The
+ * documents it creates reference the dictionary's copy of each name.
+ *
+ * The dictionary must be set before parsing starts.  Contexts with a
+ * shared dictionary cannot be parsed without the GVL, and the documents
+ * they create are always validated holding it.
+ */
+static VALUE rxml_parser_context_dictionary_set(VALUE self, VALUE dictionary)
+{
+  xmlParserCtxtPtr ctxt;
+  xmlDictPtr dict = rxml_parser_dictionary_get(dictionary);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
+
+  if (ctxt->instate != XML_PARSER_START || ctxt->myDoc)
+    rb_raise(rb_eArgError, "The dictionary must be set before parsing starts");
+
+  if (rxml_parser_context_nogvl_p(self))
+    rb_raise(rb_eArgError, "Contexts with a shared dictionary cannot be parsed without the GVL");
+
+  if (ctxt->dict != dict)
+  {
+    if (ctxt->dict)
+      xmlDictFree(ctxt->dict);
+
+    xmlDictReference(dict);
+    ctxt->dict = dict;
+
+    /* These are compared by pointer while parsing */
+    ctxt->str_xml = xmlDictLookup(dict, BAD_CAST "xml", 3);
+    ctxt->str_xmlns = xmlDictLookup(dict, BAD_CAST "xmlns", 5);
+    ctxt->str_xml_ns = xmlDictLookup(dict, XML_XML_NAMESPACE, 36);
+  }
+
+  ctxt->dictNames = 1;
+  rb_ivar_set(self, DICTIONARY_ATTR, dictionary);
+
+  return dictionary;
+}
+
 /*
  * call-seq:
  *    context.disable_cdata? -> (true|false)
@@ -284,7 +647,7 @@ static VALUE rxml_parser_context_depth_get(VALUE self)
 static VALUE rxml_parser_context_disable_cdata_q(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   /* LibXML controls this internally with the default SAX handler. */
   if (ctxt->sax && ctxt->sax->cdataBlock)
@@ -302,7 +665,7 @@ static VALUE rxml_parser_context_disable_cdata_q(VALUE self)
 static VALUE rxml_parser_context_disable_cdata_set(VALUE self, VALUE value)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->sax == NULL)
     rb_raise(rb_eRuntimeError, "Sax handler is not yet set");
@@ -326,7 +689,7 @@ static VALUE rxml_parser_context_disable_cdata_set(VALUE self, VALUE value)
 static VALUE rxml_parser_context_disable_sax_q(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->disableSAX)
     return (Qtrue);
@@ -343,7 +706,7 @@ static VALUE rxml_parser_context_disable_sax_q(VALUE self)
 static VALUE rxml_parser_context_docbook_q(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->html == 2) // TODO check this
     return (Qtrue);
@@ -361,7 +724,7 @@ static VALUE rxml_parser_context_docbook_q(VALUE self)
 static VALUE rxml_parser_context_encoding_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
   return INT2NUM(xmlParseCharEncoding((const char*)ctxt->encoding));
 }
 
@@ -381,7 +744,7 @@ static VALUE rxml_parser_context_encoding_set(VALUE self, VALUE encoding)
   if (!hdlr)
     rb_raise(rb_eArgError, "Unknown encoding: %i", NUM2INT(encoding));
 
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
   result = xmlSwitchToEncoding(ctxt, hdlr);
 
   if (result != 0)
@@ -403,7 +766,7 @@ static VALUE rxml_parser_context_encoding_set(VALUE self, VALUE encoding)
 static VALUE rxml_parser_context_errno_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   return (INT2NUM(ctxt->errNo));
 }
@@ -417,7 +780,7 @@ static VALUE rxml_parser_context_errno_get(VALUE self)
 static VALUE rxml_parser_context_html_q(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->html == 1)
     return (Qtrue);
@@ -436,7 +799,7 @@ static VALUE rxml_parser_context_io_max_num_streams_get(VALUE self)
 {
   // TODO alias to max_streams and dep this?
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   return (INT2NUM(ctxt->inputMax));
 }
@@ -451,7 +814,7 @@ static VALUE rxml_parser_context_io_max_num_streams_get(VALUE self)
 static VALUE rxml_parser_context_io_num_streams_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   return (INT2NUM(ctxt->inputNr));
 }
@@ -466,7 +829,7 @@ static VALUE rxml_parser_context_io_num_streams_get(VALUE self)
 static VALUE rxml_parser_context_keep_blanks_q(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->keepBlanks)
     return (Qtrue);
@@ -474,6 +837,127 @@ static VALUE rxml_parser_context_keep_blanks_q(VALUE self)
     return (Qfalse);
 }
 
+/*
+ * call-seq:
+ *    context.memory_limit -> num_bytes or nil
+ *
+ * Obtain the maximum number of bytes libxml may allocate while this
+ * context is parsed, or while data is fed to a push context, or nil if
+ * there is no limit.
+ */
+static VALUE rxml_parser_context_memory_limit_get(VALUE self)
+{
+  return rb_ivar_get(self, MEMORY_LIMIT_ATTR);
+}
+
+/*
+ * call-seq:
+ *    context.memory_limit = num_bytes or nil
+ *
+ * Limit the memory libxml may allocate while this context is parsed,
+ * including the memory of the document being built.  If
+ * the limit is reached parsing stops and XML::Error is raised, so that
+ * a single pathological input cannot exhaust the memory of the process.
+ *
+ * For push contexts the limit applies to all the data fed to the
+ * context together, and #feed or #finish raise XML::Error once it is
+ * reached.  The limit also applies when the context is parsed by
+ * XML::SaxParser or XML::HTMLParser.  XML::Reader does not use parser
+ * contexts and cannot be limited.
+ *
+ * Memory allocated by Ruby code called while parsing, such as SAX
+ * handlers or the read method of IO objects, does not count against the
+ * limit.
+ *
+ * Limits require memory tracking, see XML.allocation_stats.
+ */
+static VALUE rxml_parser_context_memory_limit_set(VALUE self, VALUE limit)
+{
+  if (!NIL_P(limit) && NUM2SSIZET(limit) <= 0)
+    rb_raise(rb_eArgError, "The memory limit must be positive");
+
+  if (!NIL_P(limit) && !rxml_memory_tracking_p())
+    rb_raise(rb_eNotImpError, "libxml memory tracking is not available on this platform");
+
+  rb_ivar_set(self, MEMORY_LIMIT_ATTR, NIL_P(limit) ? Qnil : SIZET2NUM(NUM2SIZET(limit)));
+  return limit;
+}
+
+size_t rxml_parser_context_memory_limit(VALUE context)
+{
+  VALUE limit = rb_ivar_get(context, MEMORY_LIMIT_ATTR);
+  return NIL_P(limit) ? 0 : NUM2SIZET(limit);
+}
+
+/* Returns whether a push context reached its memory limit while data
+   was fed to it */
+int rxml_parser_context_memory_exceeded_p(VALUE context)
+{
+  return RTEST(rb_attr_get(context, MEMORY_EXCEEDED_ATTR));
+}
+
+void rxml_parser_context_raise_memory_limit(VALUE context)
+{
+  rxml_memory_scope scope;
+
+  memset(&scope, 0, sizeof(scope));
+  scope.limit = rxml_parser_context_memory_limit(context);
+  rxml_memory_raise_limit(&scope);
+}
+
+typedef struct
+{
+  xmlParserCtxtPtr ctxt;
+  int (*parse)(xmlParserCtxtPtr ctxt);
+  int status;
+  rxml_memory_scope scope;
+} rxml_parser_context_limited_args;
+
+static VALUE rxml_parser_context_limited_scoped(VALUE data)
+{
+  rxml_parser_context_limited_args *args = (rxml_parser_context_limited_args*)data;
+  args->status = args->parse(args->ctxt);
+  return Qnil;
+}
+
+static VALUE rxml_parser_context_limited_leave(VALUE data)
+{
+  rxml_parser_context_limited_args *args = (rxml_parser_context_limited_args*)data;
+  rxml_memory_scope_leave(&args->scope);
+  return Qnil;
+}
+
+/* Runs parse, such as xmlParseDocument, with the context's memory limit.
+   Used by the parsers that do not build their documents through
+   XML::Parser#parse.  If the limit is reached any partial document is
+   freed and XML::Error is raised. */
+int rxml_parser_context_parse_limited(VALUE context, xmlParserCtxtPtr ctxt, int (*parse)(xmlParserCtxtPtr ctxt))
+{
+  rxml_parser_context_limited_args args;
+  size_t limit = rxml_parser_context_memory_limit(context);
+
+  if (!limit)
+    return parse(ctxt);
+
+  args.ctxt = ctxt;
+  args.parse = parse;
+  args.status = -1;
+  rxml_memory_scope_enter(&args.scope, limit);
+  rb_ensure(rxml_parser_context_limited_scoped, (VALUE)&args, rxml_parser_context_limited_leave, (VALUE)&args);
+
+  if (args.scope.exceeded)
+  {
+    if (ctxt->myDoc)
+    {
+      xmlFreeDoc(ctxt->myDoc);
+      ctxt->myDoc = NULL;
+    }
+    rxml_memory_raise_limit(&args.scope);
+  }
+
+  return args.status;
+}
+
 /*
  * call-seq:
  *    context.name_depth -> num
@@ -483,7 +967,7 @@ static VALUE rxml_parser_context_keep_blanks_q(VALUE self)
 static VALUE rxml_parser_context_name_depth_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   return (INT2NUM(ctxt->nameNr));
 }
@@ -497,7 +981,7 @@ static VALUE rxml_parser_context_name_depth_get(VALUE self)
 static VALUE rxml_parser_context_name_depth_max_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   return (INT2NUM(ctxt->nameMax));
 }
@@ -511,7 +995,7 @@ static VALUE rxml_parser_context_name_depth_max_get(VALUE self)
 static VALUE rxml_parser_context_name_node_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->name == NULL)
     return (Qnil);
@@ -531,7 +1015,7 @@ static VALUE rxml_parser_context_name_tab_get(VALUE self)
   xmlParserCtxtPtr ctxt;
   VALUE tab_ary;
 
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->nameTab == NULL)
     return (Qnil);
@@ -558,7 +1042,7 @@ static VALUE rxml_parser_context_name_tab_get(VALUE self)
 static VALUE rxml_parser_context_node_depth_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   return (INT2NUM(ctxt->nodeNr));
 }
@@ -572,7 +1056,7 @@ static VALUE rxml_parser_context_node_depth_get(VALUE self)
 static VALUE rxml_parser_context_node_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->node == NULL)
     return (Qnil);
@@ -589,11 +1073,56 @@ static VALUE rxml_parser_context_node_get(VALUE self)
 static VALUE rxml_parser_context_node_depth_max_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   return (INT2NUM(ctxt->nodeMax));
 }
 
+/*
+ * call-seq:
+ *    context.nogvl? -> (true|false)
+ *
+ * Determine whether XML::Parser#parse releases Ruby's global VM lock
+ * while parsing this context.
+ */
+static VALUE rxml_parser_context_nogvl_q(VALUE self)
+{
+  return RTEST(rb_ivar_get(self, NOGVL_ATTR)) ? Qtrue : Qfalse;
+}
+
+/*
+ * call-seq:
+ *    context.nogvl = true|false
+ *
+ * Control whether XML::Parser#parse releases Ruby's global VM lock while
+ * parsing this context, letting other Ruby threads run (and parse) at the
+ * same time.  The lock is only reacquired to report errors to the
+ * handler registered with XML::Error.set_handler.
+ *
+ * This is supported for string, file and document contexts.  IO contexts
+ * read their input by calling Ruby and therefore cannot release the lock.
+ */
+static VALUE rxml_parser_context_nogvl_set(VALUE self, VALUE value)
+{
+  xmlParserCtxtPtr ctxt;
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
+
+  if (RTEST(value) && ctxt->input && ctxt->input->buf &&
+      ctxt->input->buf->readcallback == (xmlInputReadCallback)rxml_read_callback)
+    rb_raise(rb_eArgError, "IO contexts cannot be parsed without the GVL");
+
+  if (RTEST(value) && !NIL_P(rb_ivar_get(self, DICTIONARY_ATTR)))
+    rb_raise(rb_eArgError, "Contexts with a shared dictionary cannot be parsed without the GVL");
+
+  rb_ivar_set(self, NOGVL_ATTR, RTEST(value) ? Qtrue : Qfalse);
+  return value;
+}
+
+int rxml_parser_context_nogvl_p(VALUE context)
+{
+  return RTEST(rb_ivar_get(context, NOGVL_ATTR));
+}
+
 /*
  * call-seq:
  *    context.num_chars -> num
@@ -603,7 +1132,7 @@ static VALUE rxml_parser_context_node_depth_max_get(VALUE self)
 static VALUE rxml_parser_context_num_chars_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   return (LONG2NUM(ctxt->nbChars));
 }
@@ -619,7 +1148,7 @@ static VALUE rxml_parser_context_num_chars_get(VALUE self)
 static VALUE rxml_parser_context_options_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   return INT2NUM(ctxt->options);
 }
@@ -638,7 +1167,7 @@ static VALUE rxml_parser_context_options_set(VALUE self, VALUE options)
   xmlParserCtxtPtr ctxt;
   Check_Type(options, T_FIXNUM);
 
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
   xmlCtxtUseOptions(ctxt, NUM2INT(options));
 
   return self;
@@ -654,7 +1183,7 @@ static VALUE rxml_parser_context_options_set(VALUE self, VALUE options)
 static VALUE rxml_parser_context_recovery_q(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->recovery)
     return (Qtrue);
@@ -672,7 +1201,7 @@ static VALUE rxml_parser_context_recovery_q(VALUE self)
 static VALUE rxml_parser_context_recovery_set(VALUE self, VALUE value)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (value == Qfalse)
   {
@@ -696,7 +1225,7 @@ static VALUE rxml_parser_context_recovery_set(VALUE self, VALUE value)
 static VALUE rxml_parser_context_replace_entities_q(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->replaceEntities)
     return (Qtrue);
@@ -714,7 +1243,7 @@ static VALUE rxml_parser_context_replace_entities_q(VALUE self)
 static VALUE rxml_parser_context_replace_entities_set(VALUE self, VALUE value)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (value == Qfalse)
   {
@@ -737,7 +1266,7 @@ static VALUE rxml_parser_context_replace_entities_set(VALUE self, VALUE value)
 static VALUE rxml_parser_context_space_depth_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   return (INT2NUM(ctxt->spaceNr));
 }
@@ -751,7 +1280,7 @@ static VALUE rxml_parser_context_space_depth_get(VALUE self)
 static VALUE rxml_parser_context_space_depth_max_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   return (INT2NUM(ctxt->spaceMax));
 }
@@ -766,7 +1295,7 @@ static VALUE rxml_parser_context_space_depth_max_get(VALUE self)
 static VALUE rxml_parser_context_subset_external_q(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->inSubset == 2)
     return (Qtrue);
@@ -784,7 +1313,7 @@ static VALUE rxml_parser_context_subset_external_q(VALUE self)
 static VALUE rxml_parser_context_subset_internal_q(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->inSubset == 1)
     return (Qtrue);
@@ -803,7 +1332,7 @@ static VALUE rxml_parser_context_subset_internal_q(VALUE self)
 static VALUE rxml_parser_context_subset_name_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->intSubName == NULL)
     return (Qnil);
@@ -822,7 +1351,7 @@ static VALUE rxml_parser_context_subset_name_get(VALUE self)
 static VALUE rxml_parser_context_subset_external_uri_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->extSubURI == NULL)
     return (Qnil);
@@ -841,7 +1370,7 @@ static VALUE rxml_parser_context_subset_external_uri_get(VALUE self)
 static VALUE rxml_parser_context_subset_external_system_id_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->extSubSystem == NULL)
     return (Qnil);
@@ -858,7 +1387,7 @@ static VALUE rxml_parser_context_subset_external_system_id_get(VALUE self)
 static VALUE rxml_parser_context_standalone_q(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->standalone)
     return (Qtrue);
@@ -875,7 +1404,7 @@ static VALUE rxml_parser_context_standalone_q(VALUE self)
 static VALUE rxml_parser_context_stats_q(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->record_info)
     return (Qtrue);
@@ -892,7 +1421,7 @@ static VALUE rxml_parser_context_stats_q(VALUE self)
 static VALUE rxml_parser_context_valid_q(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->valid)
     return (Qtrue);
@@ -909,7 +1438,7 @@ static VALUE rxml_parser_context_valid_q(VALUE self)
 static VALUE rxml_parser_context_validate_q(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->validate)
     return (Qtrue);
@@ -926,7 +1455,7 @@ static VALUE rxml_parser_context_validate_q(VALUE self)
 static VALUE rxml_parser_context_version_get(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->version == NULL)
     return (Qnil);
@@ -943,7 +1472,7 @@ static VALUE rxml_parser_context_version_get(VALUE self)
 static VALUE rxml_parser_context_well_formed_q(VALUE self)
 {
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(self, xmlParserCtxt, ctxt);
+  TypedData_Get_Struct(self, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
 
   if (ctxt->wellFormed)
     return (Qtrue);
@@ -954,6 +1483,12 @@ static VALUE rxml_parser_context_well_formed_q(VALUE self)
 void rxml_init_parser_context(void)
 {
   IO_ATTR = ID2SYM(rb_intern("@io"));
+  NOGVL_ATTR = rb_intern("@nogvl");
+  DICTIONARY_ATTR = rb_intern("@dictionary");
+  PUSH_ATTR = rb_intern("@push");
+  MEMORY_LIMIT_ATTR = rb_intern("@memory_limit");
+  MEMORY_BYTES_ATTR = rb_intern("memory_bytes");
+  MEMORY_EXCEEDED_ATTR = rb_intern("memory_exceeded");
 
   cXMLParserContext = rb_define_class_under(cXMLParser, "Context", rb_cObject);
   rb_define_alloc_func(cXMLParserContext, rxml_parser_context_alloc);
@@ -961,13 +1496,17 @@ void rxml_init_parser_context(void)
   rb_define_singleton_method(cXMLParserContext, "document", rxml_parser_context_document, -1);
   rb_define_singleton_method(cXMLParserContext, "file", rxml_parser_context_file, -1);
   rb_define_singleton_method(cXMLParserContext, "io", rxml_parser_context_io, -1);
+  rb_define_singleton_method(cXMLParserContext, "mmap", rxml_parser_context_mmap, -1);
   rb_define_singleton_method(cXMLParserContext, "string", rxml_parser_context_string, -1);
+  rb_define_singleton_method(cXMLParserContext, "push", rxml_parser_context_push, -1);
 
   rb_define_method(cXMLParserContext, "base_uri", rxml_parser_context_base_uri_get, 0);
   rb_define_method(cXMLParserContext, "base_uri=", rxml_parser_context_base_uri_set, 1);
   rb_define_method(cXMLParserContext, "close", rxml_parser_context_close, 0);
   rb_define_method(cXMLParserContext, "data_directory", rxml_parser_context_data_directory_get, 0);
   rb_define_method(cXMLParserContext, "depth", rxml_parser_context_depth_get, 0);
+  rb_define_method(cXMLParserContext, "dictionary", rxml_parser_context_dictionary_get, 0);
+  rb_define_method(cXMLParserContext, "dictionary=", rxml_parser_context_dictionary_set, 1);
   rb_define_method(cXMLParserContext, "disable_cdata?", rxml_parser_context_disable_cdata_q, 0);
   rb_define_method(cXMLParserContext, "disable_cdata=", rxml_parser_context_disable_cdata_set, 1);
   rb_define_method(cXMLParserContext, "disable_sax?", rxml_parser_context_disable_sax_q, 0);
@@ -975,10 +1514,15 @@ void rxml_init_parser_context(void)
   rb_define_method(cXMLParserContext, "encoding", rxml_parser_context_encoding_get, 0);
   rb_define_method(cXMLParserContext, "encoding=", rxml_parser_context_encoding_set, 1);
   rb_define_method(cXMLParserContext, "errno", rxml_parser_context_errno_get, 0);
+  rb_define_method(cXMLParserContext, "feed", rxml_parser_context_feed, 1);
+  rb_define_method(cXMLParserContext, "finish", rxml_parser_context_finish, 0);
+  rb_define_method(cXMLParserContext, "finished?", rxml_parser_context_finished_q, 0);
   rb_define_method(cXMLParserContext, "html?", rxml_parser_context_html_q, 0);
   rb_define_method(cXMLParserContext, "io_max_num_streams", rxml_parser_context_io_max_num_streams_get, 0);
   rb_define_method(cXMLParserContext, "io_num_streams", rxml_parser_context_io_num_streams_get, 0);
   rb_define_method(cXMLParserContext, "keep_blanks?", rxml_parser_context_keep_blanks_q, 0);
+  rb_define_method(cXMLParserContext, "memory_limit", rxml_parser_context_memory_limit_get, 0);
+  rb_define_method(cXMLParserContext, "memory_limit=", rxml_parser_context_memory_limit_set, 1);
   rb_define_method(cXMLParserContext, "name_node", rxml_parser_context_name_node_get, 0);
   rb_define_method(cXMLParserContext, "name_depth", rxml_parser_context_name_depth_get, 0);
   rb_define_method(cXMLParserContext, "name_depth_max", rxml_parser_context_name_depth_max_get, 0);
@@ -986,9 +1530,12 @@ void rxml_init_parser_context(void)
   rb_define_method(cXMLParserContext, "node", rxml_parser_context_node_get, 0);
   rb_define_method(cXMLParserContext, "node_depth", rxml_parser_context_node_depth_get, 0);
   rb_define_method(cXMLParserContext, "node_depth_max", rxml_parser_context_node_depth_max_get, 0);
+  rb_define_method(cXMLParserContext, "nogvl?", rxml_parser_context_nogvl_q, 0);
+  rb_define_method(cXMLParserContext, "nogvl=", rxml_parser_context_nogvl_set, 1);
   rb_define_method(cXMLParserContext, "num_chars", rxml_parser_context_num_chars_get, 0);
   rb_define_method(cXMLParserContext, "options", rxml_parser_context_options_get, 0);
   rb_define_method(cXMLParserContext, "options=", rxml_parser_context_options_set, 1);
+  rb_define_method(cXMLParserContext, "push?", rxml_parser_context_push_q, 0);
   rb_define_method(cXMLParserContext, "recovery?", rxml_parser_context_recovery_q, 0);
   rb_define_method(cXMLParserContext, "recovery=", rxml_parser_context_recovery_set, 1);
   rb_define_method(cXMLParserContext, "replace_entities?", rxml_parser_context_replace_entities_q, 0);
@@ -4,7 +4,17 @@
 #define __RXML_PARSER_CONTEXT__
 
 extern VALUE cXMLParserContext;
+extern const rb_data_type_t rxml_parser_context_data_type;
 
 void rxml_init_parser_context(void);
+int rxml_parser_context_nogvl_p(VALUE context);
+int rxml_parser_context_push_p(VALUE context);
+VALUE rxml_parser_context_dictionary(VALUE context);
+size_t rxml_parser_context_memory_limit(VALUE context);
+int rxml_parser_context_memory_exceeded_p(VALUE context);
+void rxml_parser_context_raise_memory_limit(VALUE context);
+int rxml_parser_context_parse_limited(VALUE context, xmlParserCtxtPtr ctxt, int (*parse)(xmlParserCtxtPtr ctxt));
+int rxml_parser_context_push_finish(VALUE context, xmlParserCtxtPtr ctxt);
+size_t rxml_parser_context_memsize(const void *data);
 
 #endif
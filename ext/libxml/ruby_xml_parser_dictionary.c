@@ -0,0 +1,124 @@
+/* Please see the LICENSE file for copyright and distribution information */
+
+#include "ruby_libxml.h"
+#include "ruby_xml_parser_dictionary.h"
+
+/*
+ * Document-class: LibXML::XML::Parser::Dictionary
+ *
+ * A dictionary stores the element names, attribute names and other
+ * strings a parser encounters so that each distinct string is only
+ * stored once.  By default every parser context creates its own
+ * dictionary, so the same names are stored again for every document.
+ *
+ * A dictionary can be shared by many parser contexts, including
+ * HTML parser contexts.  Names are then only stored once for all the
+ * documents they parse, which saves both time and memory when many
+ * similar documents are parsed.  Documents keep the dictionary alive
+ * for as long as they exist.
+ *
+ *   dictionary = XML::Parser::Dictionary.new
+ *
+ *   documents = files.map do |file|
+ *     XML::Parser.file(file, dictionary: dictionary).parse
+ *   end
+ *
+ * Dictionaries are not thread safe.  Besides parsing, validating a
+ * document looks names up in its dictionary.  So contexts that use a
+ * shared dictionary always parse while holding Ruby's global VM lock,
+ * and the documents they create are validated holding it too, even by
+ * Document#validate_schema(schema, :nogvl => true),
+ * XML::RelaxNG::Validator#validate and the validate_many methods.
+ * Serializing and searching documents does not use their dictionary.
+ */
+
+VALUE cXMLParserDictionary;
+
+static void rxml_parser_dictionary_free(xmlDictPtr dict)
+{
+  xmlDictFree(dict);
+}
+
+static const rb_data_type_t rxml_parser_dictionary_data_type = {
+  "LibXML::XML::Parser::Dictionary",
+  { NULL, (RUBY_DATA_FUNC)rxml_parser_dictionary_free, NULL },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static VALUE rxml_parser_dictionary_alloc(VALUE klass)
+{
+  xmlDictPtr dict = xmlDictCreate();
+
+  if (!dict)
+    rb_raise(rb_eNoMemError, "Could not allocate dictionary");
+
+  return TypedData_Wrap_Struct(klass, &rxml_parser_dictionary_data_type, dict);
+}
+
+xmlDictPtr rxml_parser_dictionary_get(VALUE dictionary)
+{
+  xmlDictPtr dict;
+
+  if (rb_obj_is_kind_of(dictionary, cXMLParserDictionary) == Qfalse)
+    rb_raise(rb_eTypeError, "Must pass an LibXML::XML::Parser::Dictionary object");
+
+  TypedData_Get_Struct(dictionary, xmlDict, &rxml_parser_dictionary_data_type, dict);
+  return dict;
+}
+
+/*
+ * call-seq:
+ *    dictionary.include?(name) -> (true|false)
+ *
+ * Determines whether the dictionary stores name.
+ */
+static VALUE rxml_parser_dictionary_include_q(VALUE self, VALUE name)
+{
+  xmlDictPtr dict;
+
+  Check_Type(name, T_STRING);
+  TypedData_Get_Struct(self, xmlDict, &rxml_parser_dictionary_data_type, dict);
+
+  if (RSTRING_LEN(name) > INT_MAX)
+    return Qfalse;
+
+  return xmlDictExists(dict, (const xmlChar*)RSTRING_PTR(name), (int)RSTRING_LEN(name)) ? Qtrue : Qfalse;
+}
+
+/*
+ * call-seq:
+ *    dictionary.size -> num
+ *
+ * Returns the number of strings stored in the dictionary.
+ */
+static VALUE rxml_parser_dictionary_size(VALUE self)
+{
+  xmlDictPtr dict;
+  TypedData_Get_Struct(self, xmlDict, &rxml_parser_dictionary_data_type, dict);
+
+  return INT2NUM(xmlDictSize(dict));
+}
+
+/*
+ * call-seq:
+ *    dictionary.usage -> num
+ *
+ * Returns the number of bytes used to store the dictionary's strings.
+ */
+static VALUE rxml_parser_dictionary_usage(VALUE self)
+{
+  xmlDictPtr dict;
+  TypedData_Get_Struct(self, xmlDict, &rxml_parser_dictionary_data_type, dict);
+
+  return SIZET2NUM(xmlDictGetUsage(dict));
+}
+
+void rxml_init_parser_dictionary(void)
+{
+  cXMLParserDictionary = rb_define_class_under(cXMLParser, "Dictionary", rb_cObject);
+  rb_define_alloc_func(cXMLParserDictionary, rxml_parser_dictionary_alloc);
+
+  rb_define_method(cXMLParserDictionary, "include?", rxml_parser_dictionary_include_q, 1);
+  rb_define_method(cXMLParserDictionary, "size", rxml_parser_dictionary_size, 0);
+  rb_define_method(cXMLParserDictionary, "usage", rxml_parser_dictionary_usage, 0);
+}
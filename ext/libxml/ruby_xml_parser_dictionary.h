@@ -0,0 +1,13 @@
+/* Please see the LICENSE file for copyright and distribution information */
+
+#ifndef __RXML_PARSER_DICTIONARY__
+#define __RXML_PARSER_DICTIONARY__
+
+#include <libxml/dict.h>
+
+extern VALUE cXMLParserDictionary;
+
+void rxml_init_parser_dictionary(void);
+xmlDictPtr rxml_parser_dictionary_get(VALUE dictionary);
+
+#endif
@@ -56,6 +56,7 @@ VALUE cXMLReader;
 
 static ID BASE_URI_SYMBOL;
 static ID ENCODING_SYMBOL;
+static ID DOC_ATTR;
 static ID IO_ATTR;
 static ID OPTIONS_SYMBOL;
 
@@ -64,23 +65,30 @@ static void rxml_reader_free(xmlTextReaderPtr xreader)
   xmlFreeTextReader(xreader);
 }
 
-static void rxml_reader_mark(xmlTextReaderPtr xreader)
-{
-  xmlDocPtr xdoc = xmlTextReaderCurrentDoc(xreader);
-  VALUE doc = (VALUE)xdoc->_private;
-  rb_gc_mark(doc);
-}
+static const rb_data_type_t rxml_reader_data_type = {
+  "LibXML::XML::Reader",
+  { NULL, (RUBY_DATA_FUNC)rxml_reader_free, NULL },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/* Expanded nodes are freed by the reader and are not marked, see
+   rxml_reader_expand */
+static const rb_data_type_t rxml_reader_node_data_type = {
+  "LibXML::XML::Node",
+  { NULL, NULL, NULL },
+  &rxml_node_data_type, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
 
 static VALUE rxml_reader_wrap(xmlTextReaderPtr xreader)
 {
-  return Data_Wrap_Struct(cXMLReader, NULL, rxml_reader_free, xreader);
+  return TypedData_Wrap_Struct(cXMLReader, &rxml_reader_data_type, xreader);
 }
 
 
 static xmlTextReaderPtr rxml_text_reader_get(VALUE obj)
 {
   xmlTextReaderPtr xreader;
-  Data_Get_Struct(obj, xmlTextReader, xreader);
+  TypedData_Get_Struct(obj, xmlTextReader, &rxml_reader_data_type, xreader);
   return xreader;
 }
 
@@ -95,7 +103,7 @@ VALUE rxml_reader_document(VALUE klass, VALUE doc)
   xmlDocPtr xdoc;
   xmlTextReaderPtr xreader;
 
-  Data_Get_Struct(doc, xmlDoc, xdoc);
+  TypedData_Get_Struct(doc, xmlDoc, &rxml_document_data_type, xdoc);
 
   xreader = xmlReaderWalker(xdoc);
 
@@ -153,6 +161,65 @@ static VALUE rxml_reader_file(int argc, VALUE *argv, VALUE klass)
   return rxml_reader_wrap(xreader);
 }
 
+/* call-seq:
+ *    XML::Reader.mmap(path) -> XML::Reader
+ *    XML::Reader.mmap(path, :encoding => XML::Encoding::UTF_8,
+ *                           :options => XML::Parser::Options::NOENT) -> XML::Reader
+ *
+ * Creates a new reader that reads the specified file through a private,
+ * read-only memory mapping.  See XML::Parser::Context.mmap.
+ *
+ * You may provide an optional hash table to control how the
+ * parsing is performed.  Valid options are:
+ *
+ *  encoding - The document encoding, defaults to nil. Valid values
+ *             are the encoding constants defined on XML::Encoding.
+ *  options - Controls the execution of the parser, defaults to 0.
+ *            Valid values are the constants defined on
+ *            XML::Parser::Options.  Mutliple options can be combined
+ *            by using Bitwise OR (|). 
+ */
+static VALUE rxml_reader_mmap(int argc, VALUE *argv, VALUE klass)
+{
+  xmlTextReaderPtr xreader;
+  VALUE path, options, mapping, result;
+  const char *xpath, *xencoding = NULL;
+  int xoptions = 0;
+
+  rb_scan_args(argc, argv, "11", &path, &options);
+
+  if (!NIL_P(options))
+  {
+    VALUE encoding, parserOptions;
+
+    Check_Type(options, T_HASH);
+
+    encoding = rb_hash_aref(options, ENCODING_SYMBOL);
+    xencoding = NIL_P(encoding) ? NULL : xmlGetCharEncodingName(NUM2INT(encoding));
+
+    parserOptions = rb_hash_aref(options, OPTIONS_SYMBOL);
+    xoptions = NIL_P(parserOptions) ? 0 : NUM2INT(parserOptions);
+  }
+
+  mapping = rxml_io_mmap_new(path);
+  xpath = StringValueCStr(path);
+
+  /* Readers feed their input to a push parser, which copies it anyway, so
+     the mapping is always read through the callback */
+  xreader = xmlReaderForIO(rxml_io_mmap_read_callback, NULL, rxml_io_mmap_context(mapping),
+                           xpath, xencoding, xoptions);
+
+  if (xreader == NULL)
+    rxml_raise(xmlGetLastError());
+
+  result = rxml_reader_wrap(xreader);
+
+  /* Attach the mapping to the reader so it is not unmapped while reading */
+  rb_ivar_set(result, IO_ATTR, mapping);
+
+  return result;
+}
+
 /* call-seq:
  *    XML::Reader.io(io) -> XML::Reader
  *    XML::Reader.io(io, :encoding => XML::Encoding::UTF_8,
@@ -175,7 +242,7 @@ static VALUE rxml_reader_io(int argc, VALUE *argv, VALUE klass)
 {
   xmlTextReaderPtr xreader;
   VALUE result;
-  VALUE io;
+  VALUE io, io_input;
   VALUE options;
   char *xbaseurl = NULL;
   const char *xencoding = NULL;
@@ -201,8 +268,9 @@ static VALUE rxml_reader_io(int argc, VALUE *argv, VALUE klass)
     xoptions = NIL_P(parserOptions) ? 0 : NUM2INT(parserOptions);
   }
   
+  io_input = rxml_io_input_new(io);
   xreader = xmlReaderForIO((xmlInputReadCallback) rxml_read_callback, NULL,
-                           (void *) io, 
+                           RTYPEDDATA_DATA(io_input),
                            xbaseurl, xencoding, xoptions);
 
   if (xreader == NULL)
@@ -211,7 +279,7 @@ static VALUE rxml_reader_io(int argc, VALUE *argv, VALUE klass)
   result = rxml_reader_wrap(xreader);
 
   /* Attach io object to parser so it won't get freed.*/
-  rb_ivar_set(result, IO_ATTR, io);
+  rb_ivar_set(result, IO_ATTR, io_input);
 
   return result;
 }
@@ -606,7 +674,7 @@ static VALUE rxml_reader_relax_ng_validate(VALUE self, VALUE rng)
   xmlTextReaderPtr xreader = rxml_text_reader_get(self);
   xmlRelaxNGPtr xrelax;
   int status;
-  Data_Get_Struct(rng, xmlRelaxNG, xrelax);
+  TypedData_Get_Struct(rng, xmlRelaxNG, &rxml_relaxng_data_type, xrelax);
   
   status = xmlTextReaderRelaxNGSetSchema(xreader, xrelax);
   return (status == 0 ? Qtrue : Qfalse);
@@ -631,7 +699,7 @@ rxml_reader_schema_validate(VALUE self, VALUE xsd)
   xmlSchemaPtr xschema;
   int status;
 
-  Data_Get_Struct(xsd, xmlSchema, xschema);
+  TypedData_Get_Struct(xsd, xmlSchema, &rxml_schema_data_type, xschema);
   status = xmlTextReaderSetSchema(xreader, xschema);
   return (status == 0 ? Qtrue : Qfalse);
 }
@@ -1002,8 +1070,328 @@ static VALUE rxml_reader_expand(VALUE self)
 	   this is only valid until the next xmlTextReaderRead call.  At that point the node is freed (from reading
 	   the libxml2 source code.  So don't set a mark or free function, because they will get called in the next
 	   garbage collection run and cause a segfault.*/
-	return Data_Wrap_Struct(cXMLNode, NULL, NULL, xnode);
+	return TypedData_Wrap_Struct(cXMLNode, &rxml_reader_node_data_type, xnode);
+  }
+}
+
+typedef struct
+{
+  VALUE self;
+  xmlPatternPtr pattern;
+  xmlStreamCtxtPtr stream;
+} rxml_reader_match_args;
+
+/* Yields a copy of the current node's subtree in its own document, so
+   it stays valid after the reader moves on and is freed with the
+   document once it is no longer referenced */
+static void rxml_reader_yield_match(xmlTextReaderPtr xreader)
+{
+  xmlNodePtr xnode = xmlTextReaderExpand(xreader);
+  xmlDocPtr xdoc;
+  xmlNodePtr xcopy;
+  VALUE doc;
+
+  if (!xnode)
+    rxml_raise(xmlGetLastError());
+
+  xdoc = xmlNewDoc(xnode->doc && xnode->doc->version ? xnode->doc->version : (const xmlChar*)"1.0");
+  doc = rxml_document_wrap(xdoc);
+
+  xcopy = xmlDocCopyNode(xnode, xdoc, 1);
+  if (!xcopy)
+    rxml_raise(xmlGetLastError());
+  xmlDocSetRootElement(xdoc, xcopy);
+
+  rb_yield(rxml_node_wrap(xcopy));
+  RB_GC_GUARD(doc);
+}
+
+static VALUE rxml_reader_each_match_loop(VALUE data)
+{
+  rxml_reader_match_args *args = (rxml_reader_match_args*) data;
+  xmlTextReaderPtr xreader = rxml_text_reader_get(args->self);
+  int result = xmlTextReaderRead(xreader);
+
+  while (result == 1)
+  {
+    switch (xmlTextReaderNodeType(xreader))
+    {
+      case XML_READER_TYPE_ELEMENT:
+        if (xmlStreamPush(args->stream, xmlTextReaderConstLocalName(xreader), xmlTextReaderConstNamespaceUri(xreader)) == 1)
+        {
+          rxml_reader_yield_match(xreader);
+
+          /* Skip the subtree, including its end element */
+          xmlStreamPop(args->stream);
+          result = xmlTextReaderNext(xreader);
+          continue;
+        }
+
+        if (xmlTextReaderIsEmptyElement(xreader))
+          xmlStreamPop(args->stream);
+        break;
+      case XML_READER_TYPE_END_ELEMENT:
+        xmlStreamPop(args->stream);
+        break;
+    }
+
+    result = xmlTextReaderRead(xreader);
   }
+
+  if (result == -1)
+    rxml_raise(xmlGetLastError());
+
+  return args->self;
+}
+
+static VALUE rxml_reader_each_match_free(VALUE data)
+{
+  rxml_reader_match_args *args = (rxml_reader_match_args*) data;
+
+  if (args->stream)
+    xmlFreeStreamCtxt(args->stream);
+  xmlFreePattern(args->pattern);
+
+  return Qnil;
+}
+
+/*
+ * call-seq:
+ *    reader.each_match(patterns) {|node| ... } -> reader
+ *    reader.each_match(patterns, prefix => uri) {|node| ... } -> reader
+ *
+ * Reads the rest of the document, yielding each element that matches
+ * any of the patterns together with its subtree.  Patterns use the
+ * subset of XPath that can be matched while streaming, such as
+ * '//record' or '/feed/entry'.  Prefixes used in the patterns are
+ * mapped to namespaces by the optional hash.
+ *
+ * The document is matched and read in C, so elements that do not match
+ * never reach Ruby.  Each yielded node is the root of a small document
+ * of its own, which remains valid after the reader moves on.  The
+ * subtree of a match is skipped, so matches are not nested.
+ *
+ *   reader = XML::Reader.file('records.xml')
+ *   reader.each_match('//record') do |record|
+ *     puts record['id']
+ *   end
+ */
+static VALUE rxml_reader_each_match(int argc, VALUE *argv, VALUE self)
+{
+  VALUE patterns, namespaces;
+  rxml_reader_match_args args;
+
+  RETURN_ENUMERATOR(self, argc, argv);
+  rb_scan_args(argc, argv, "11", &patterns, &namespaces);
+
+  args.self = self;
+  args.pattern = rxml_xpath_pattern_compile(patterns, namespaces, NULL);
+  args.stream = xmlPatternGetStreamCtxt(args.pattern);
+
+  if (!args.stream)
+  {
+    xmlFreePattern(args.pattern);
+    rb_raise(rb_eNoMemError, "Could not create the pattern's stream");
+  }
+
+  /* Pushing no name stands for the document node, which absolute
+     patterns start from */
+  xmlStreamPush(args.stream, NULL, NULL);
+
+  return rb_ensure(rxml_reader_each_match_loop, (VALUE)&args, rxml_reader_each_match_free, (VALUE)&args);
+}
+
+/* Finds the field named by xname.  Attribute fields start with '@'. */
+static long rxml_reader_record_field(VALUE fields, const xmlChar *xname, int attribute)
+{
+  long i;
+
+  for (i = 0; i < RARRAY_LEN(fields); i++)
+  {
+    const char *field = RSTRING_PTR(RARRAY_AREF(fields, i));
+
+    if ((field[0] == '@') == attribute && xmlStrEqual((const xmlChar*)field + attribute, xname))
+      return i;
+  }
+
+  return -1;
+}
+
+/* Reads the record the reader is positioned on into values, leaving the
+   reader on its end.  Without fields, every child element is read into
+   the record hash instead. */
+static void rxml_reader_read_record(xmlTextReaderPtr xreader, VALUE fields, VALUE values, VALUE record)
+{
+  const xmlChar *xencoding = xmlTextReaderConstEncoding(xreader);
+  int depth = xmlTextReaderDepth(xreader);
+  int result;
+  long i;
+
+  if (!NIL_P(fields))
+  {
+    for (i = 0; i < RARRAY_LEN(fields); i++)
+    {
+      const char *field = RSTRING_PTR(RARRAY_AREF(fields, i));
+
+      if (field[0] == '@')
+      {
+        xmlChar *xattr = xmlTextReaderGetAttribute(xreader, (const xmlChar*)field + 1);
+        if (xattr)
+        {
+          rb_ary_store(values, i, rxml_new_cstr(xattr, xencoding));
+          xmlFree(xattr);
+        }
+      }
+    }
+  }
+
+  if (xmlTextReaderIsEmptyElement(xreader))
+    return;
+
+  result = xmlTextReaderRead(xreader);
+
+  while (result == 1)
+  {
+    int type = xmlTextReaderNodeType(xreader);
+
+    if (type == XML_READER_TYPE_END_ELEMENT && xmlTextReaderDepth(xreader) == depth)
+      return;
+
+    if (type == XML_READER_TYPE_ELEMENT && xmlTextReaderDepth(xreader) == depth + 1)
+    {
+      const xmlChar *xname = xmlTextReaderConstName(xreader);
+      long field = NIL_P(fields) ? -1 : rxml_reader_record_field(fields, xname, 0);
+
+      if (NIL_P(fields) || field >= 0)
+      {
+        xmlChar *xvalue = xmlTextReaderReadString(xreader);
+        VALUE value = xvalue ? rxml_new_cstr(xvalue, xencoding) : Qnil;
+        xmlFree(xvalue);
+
+        if (NIL_P(fields))
+          rb_hash_aset(record, rxml_new_cstr(xname, xencoding), value);
+        else
+          rb_ary_store(values, field, value);
+      }
+
+      /* Fields are read as a whole, so skip their subtrees */
+      result = xmlTextReaderNext(xreader);
+      continue;
+    }
+
+    result = xmlTextReaderRead(xreader);
+  }
+
+  if (result == -1)
+    rxml_raise(xmlGetLastError());
+}
+
+static VALUE rxml_reader_record_new(VALUE fields, VALUE values, VALUE as)
+{
+  VALUE result;
+  long i;
+
+  if (!NIL_P(as))
+    return rb_class_new_instance((int)RARRAY_LEN(values), RARRAY_CONST_PTR(values), as);
+
+  result = rb_hash_new();
+  for (i = 0; i < RARRAY_LEN(fields); i++)
+    rb_hash_aset(result, RARRAY_AREF(fields, i), RARRAY_AREF(values, i));
+
+  return result;
+}
+
+/*
+ * call-seq:
+ *    reader.each_record(name) {|hash| ... } -> reader
+ *    reader.each_record(name, :fields => ['a', '@id']) {|hash| ... } -> reader
+ *    reader.each_record(name, :fields => ['a', '@id'], :as => Struct) {|struct| ... } -> reader
+ *
+ * Reads the rest of the document, yielding each element with the given
+ * name as a record.  Records are read in C, so there is a single call
+ * into Ruby per record.
+ *
+ * The :fields option lists the record's child elements to read, by
+ * name, and its attributes, prefixed by '@'.  The record is yielded as
+ * a Hash of those fields and their text content, with nil for missing
+ * fields.  If the :as option gives a Struct class, instances of it are
+ * yielded instead, with the fields passed in order.  Without fields,
+ * every child element is read into the Hash.
+ *
+ *   reader = XML::Reader.file('table.xml')
+ *   reader.each_record('row', :fields => %w(@id name price)) do |row|
+ *     puts "#{row['@id']}: #{row['name']}"
+ *   end
+ */
+static VALUE rxml_reader_each_record(int argc, VALUE *argv, VALUE self)
+{
+  xmlTextReaderPtr xreader = rxml_text_reader_get(self);
+  VALUE name, options, fields = Qnil, as = Qnil;
+  const xmlChar *xname;
+  int result;
+
+  RETURN_ENUMERATOR(self, argc, argv);
+  rb_scan_args(argc, argv, "11", &name, &options);
+
+  name = rb_str_new_frozen(rb_obj_as_string(name));
+  xname = (const xmlChar*)StringValueCStr(name);
+
+  if (!NIL_P(options))
+  {
+    Check_Type(options, T_HASH);
+    fields = rb_hash_aref(options, ID2SYM(rb_intern("fields")));
+    as = rb_hash_aref(options, ID2SYM(rb_intern("as")));
+  }
+
+  if (!NIL_P(fields))
+  {
+    long i;
+
+    fields = rb_ary_dup(rb_Array(fields));
+    for (i = 0; i < RARRAY_LEN(fields); i++)
+    {
+      VALUE field = rb_str_new_frozen(rb_obj_as_string(RARRAY_AREF(fields, i)));
+      StringValueCStr(field);
+      rb_ary_store(fields, i, field);
+    }
+  }
+  else if (!NIL_P(as))
+  {
+    rb_raise(rb_eArgError, "The :as option requires :fields");
+  }
+
+  result = xmlTextReaderRead(xreader);
+
+  while (result == 1)
+  {
+    if (xmlTextReaderNodeType(xreader) == XML_READER_TYPE_ELEMENT &&
+        xmlStrEqual(xmlTextReaderConstName(xreader), xname))
+    {
+      VALUE record = Qnil, values = Qnil;
+
+      if (NIL_P(fields))
+      {
+        record = rb_hash_new();
+        rxml_reader_read_record(xreader, fields, values, record);
+      }
+      else
+      {
+        values = rb_ary_new_capa(RARRAY_LEN(fields));
+        rb_ary_resize(values, RARRAY_LEN(fields));
+        rxml_reader_read_record(xreader, fields, values, record);
+        record = rxml_reader_record_new(fields, values, as);
+      }
+
+      rb_yield(record);
+    }
+
+    result = xmlTextReaderRead(xreader);
+  }
+
+  if (result == -1)
+    rxml_raise(xmlGetLastError());
+
+  return self;
 }
 
 /*
@@ -1027,8 +1415,8 @@ static VALUE rxml_reader_doc(VALUE self)
 
   result = rxml_document_wrap(xdoc);
 
-  // And now hook in a mark function to keep the document alive as long as the reader is valid
-  RDATA(self)->dmark = (RUBY_DATA_FUNC)rxml_reader_mark;
+  // And now keep the document alive as long as the reader is valid
+  rb_ivar_set(self, DOC_ATTR, result);
 
   return result;
 }
@@ -1133,6 +1521,7 @@ void rxml_init_reader(void)
 {
   BASE_URI_SYMBOL = ID2SYM(rb_intern("base_uri"));
   ENCODING_SYMBOL = ID2SYM(rb_intern("encoding"));
+  DOC_ATTR = rb_intern("@doc");
   IO_ATTR = rb_intern("@io");
   OPTIONS_SYMBOL = ID2SYM(rb_intern("options"));
 
@@ -1142,6 +1531,7 @@ void rxml_init_reader(void)
   rb_define_singleton_method(cXMLReader, "document", rxml_reader_document, 1);
   rb_define_singleton_method(cXMLReader, "file", rxml_reader_file, -1);
   rb_define_singleton_method(cXMLReader, "io", rxml_reader_io, -1);
+  rb_define_singleton_method(cXMLReader, "mmap", rxml_reader_mmap, -1);
   rb_define_singleton_method(cXMLReader, "string", rxml_reader_string, -1);
 
   rb_define_method(cXMLReader, "[]", rxml_reader_attribute, 1);
@@ -1156,6 +1546,8 @@ void rxml_init_reader(void)
 #endif
   rb_define_method(cXMLReader, "depth", rxml_reader_depth, 0);
   rb_define_method(cXMLReader, "doc", rxml_reader_doc, 0);
+  rb_define_method(cXMLReader, "each_match", rxml_reader_each_match, -1);
+  rb_define_method(cXMLReader, "each_record", rxml_reader_each_record, -1);
   rb_define_method(cXMLReader, "encoding", rxml_reader_encoding, 0);
   rb_define_method(cXMLReader, "expand", rxml_reader_expand, 0);
   rb_define_method(cXMLReader, "get_attribute", rxml_reader_get_attribute, 1);
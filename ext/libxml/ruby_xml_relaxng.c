@@ -39,6 +39,12 @@ static void rxml_relaxng_free(xmlRelaxNGPtr xrelaxng)
   xmlRelaxNGFree(xrelaxng);
 }
 
+const rb_data_type_t rxml_relaxng_data_type = {
+  "LibXML::XML::RelaxNG",
+  { NULL, (RUBY_DATA_FUNC)rxml_relaxng_free, NULL },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 /*
  * call-seq:
  *    XML::Relaxng.new(relaxng_uri) -> relaxng
@@ -56,7 +62,7 @@ static VALUE rxml_relaxng_init_from_uri(VALUE class, VALUE uri)
   xrelaxng = xmlRelaxNGParse(xparser);
   xmlRelaxNGFreeParserCtxt(xparser);
 
-  return Data_Wrap_Struct(cXMLRelaxNG, NULL, rxml_relaxng_free, xrelaxng);
+  return TypedData_Wrap_Struct(cXMLRelaxNG, &rxml_relaxng_data_type, xrelaxng);
 }
 
 /*
@@ -71,13 +77,13 @@ static VALUE rxml_relaxng_init_from_document(VALUE class, VALUE document)
   xmlRelaxNGPtr xrelaxng;
   xmlRelaxNGParserCtxtPtr xparser;
 
-  Data_Get_Struct(document, xmlDoc, xdoc);
+  TypedData_Get_Struct(document, xmlDoc, &rxml_document_data_type, xdoc);
 
   xparser = xmlRelaxNGNewDocParserCtxt(xdoc);
   xrelaxng = xmlRelaxNGParse(xparser);
   xmlRelaxNGFreeParserCtxt(xparser);
 
-  return Data_Wrap_Struct(cXMLRelaxNG, NULL, rxml_relaxng_free, xrelaxng);
+  return TypedData_Wrap_Struct(cXMLRelaxNG, &rxml_relaxng_data_type, xrelaxng);
 }
 
 /*
@@ -97,7 +103,352 @@ static VALUE rxml_relaxng_init_from_string(VALUE self, VALUE relaxng_str)
   xrelaxng = xmlRelaxNGParse(xparser);
   xmlRelaxNGFreeParserCtxt(xparser);
 
-  return Data_Wrap_Struct(cXMLRelaxNG, NULL, rxml_relaxng_free, xrelaxng);
+  return TypedData_Wrap_Struct(cXMLRelaxNG, &rxml_relaxng_data_type, xrelaxng);
+}
+
+/*
+ * Document-class: LibXML::XML::RelaxNG::Validator
+ *
+ * The XML::RelaxNG::Validator class validates many documents against
+ * the same XML::RelaxNG schema.  Unlike XML::Document#validate_relaxng,
+ * which sets up a new validation context for every call, a validator
+ * keeps a pool of validation contexts and reuses them, one per thread
+ * that is validating at the same time.  Documents are validated without
+ * holding Ruby's global VM lock and every error found is reported instead
+ * of raising an exception.
+ *
+ * Basic Usage:
+ *
+ *  validator = XML::RelaxNG::Validator.new(relaxng_schema)
+ *
+ *  errors = validator.validate(instance)
+ *  puts errors.map(&:to_s) unless errors.empty?
+ *
+ *  results = validator.validate_many(instances, threads: 4)
+ */
+
+VALUE cXMLRelaxNGValidator;
+
+typedef struct
+{
+  xmlRelaxNGValidCtxtPtr vptr;
+  rxml_error_list *errors;
+} rxml_relaxng_valid_ctxt;
+
+typedef struct
+{
+  VALUE relaxng;
+  rxml_relaxng_valid_ctxt **contexts;
+  int count;
+  int capacity;
+} rxml_relaxng_validator;
+
+#if LIBXML_VERSION >= 21200
+static void rxml_relaxng_validator_error(void *data, const xmlError *xerror)
+#else
+static void rxml_relaxng_validator_error(void *data, xmlErrorPtr xerror)
+#endif
+{
+  rxml_relaxng_valid_ctxt *context = (rxml_relaxng_valid_ctxt*)data;
+
+  if (context->errors)
+    rxml_error_list_add(context->errors, xerror);
+}
+
+static void rxml_relaxng_validator_mark(rxml_relaxng_validator *validator)
+{
+  rb_gc_mark(validator->relaxng);
+}
+
+static void rxml_relaxng_validator_free(rxml_relaxng_validator *validator)
+{
+  int i;
+
+  for (i = 0; i < validator->count; i++)
+  {
+    xmlRelaxNGFreeValidCtxt(validator->contexts[i]->vptr);
+    xfree(validator->contexts[i]);
+  }
+
+  xfree(validator->contexts);
+  xfree(validator);
+}
+
+static size_t rxml_relaxng_validator_memsize(const void *data)
+{
+  const rxml_relaxng_validator *validator = (const rxml_relaxng_validator*)data;
+
+  return sizeof(rxml_relaxng_validator) +
+         validator->capacity * sizeof(rxml_relaxng_valid_ctxt*) +
+         validator->count * sizeof(rxml_relaxng_valid_ctxt);
+}
+
+static const rb_data_type_t rxml_relaxng_validator_data_type = {
+  "LibXML::XML::RelaxNG::Validator",
+  { (RUBY_DATA_FUNC)rxml_relaxng_validator_mark, (RUBY_DATA_FUNC)rxml_relaxng_validator_free, rxml_relaxng_validator_memsize },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static VALUE rxml_relaxng_validator_alloc(VALUE klass)
+{
+  rxml_relaxng_validator *validator = ALLOC(rxml_relaxng_validator);
+  memset(validator, 0, sizeof(rxml_relaxng_validator));
+  validator->relaxng = Qnil;
+
+  return TypedData_Wrap_Struct(klass, &rxml_relaxng_validator_data_type, validator);
+}
+
+/* Takes a validation context out of the pool, creating a new one if the
+   pool is empty.  The pool is only modified while holding the GVL. */
+static rxml_relaxng_valid_ctxt* rxml_relaxng_validator_checkout(rxml_relaxng_validator *validator)
+{
+  rxml_relaxng_valid_ctxt *context;
+  xmlRelaxNGPtr xrelaxng;
+
+  if (validator->count > 0)
+    return validator->contexts[--validator->count];
+
+  TypedData_Get_Struct(validator->relaxng, xmlRelaxNG, &rxml_relaxng_data_type, xrelaxng);
+
+  context = ALLOC(rxml_relaxng_valid_ctxt);
+  context->errors = NULL;
+  context->vptr = xmlRelaxNGNewValidCtxt(xrelaxng);
+
+  if (!context->vptr)
+  {
+    xfree(context);
+    rxml_raise(xmlGetLastError());
+  }
+
+  xmlRelaxNGSetValidStructuredErrors(context->vptr, rxml_relaxng_validator_error, context);
+  return context;
+}
+
+static void rxml_relaxng_validator_checkin(rxml_relaxng_validator *validator, rxml_relaxng_valid_ctxt *context)
+{
+  if (validator->count == validator->capacity)
+  {
+    validator->capacity = validator->capacity ? validator->capacity * 2 : 4;
+    REALLOC_N(validator->contexts, rxml_relaxng_valid_ctxt*, validator->capacity);
+  }
+
+  context->errors = NULL;
+  validator->contexts[validator->count++] = context;
+}
+
+/* Validates a document, recording its errors.  Does not call into Ruby. */
+static void rxml_relaxng_validator_validate_doc(rxml_relaxng_valid_ctxt *context, xmlDocPtr xdoc,
+                                                rxml_error_list *errors)
+{
+  context->errors = errors;
+
+  if (xmlRelaxNGValidateDoc(context->vptr, xdoc) != 0 && errors->count == 0)
+    rxml_error_list_add(errors, xmlGetLastError());
+
+  context->errors = NULL;
+}
+
+/*
+ * call-seq:
+ *    XML::RelaxNG::Validator.new(relaxng) -> XML::RelaxNG::Validator
+ *
+ * Creates a new validator for the specified XML::RelaxNG schema.
+ */
+static VALUE rxml_relaxng_validator_initialize(VALUE self, VALUE relaxng)
+{
+  rxml_relaxng_validator *validator;
+  xmlRelaxNGPtr xrelaxng;
+
+  if (rb_obj_is_kind_of(relaxng, cXMLRelaxNG) == Qfalse)
+    rb_raise(rb_eTypeError, "Must pass an LibXML::XML::RelaxNG object");
+
+  TypedData_Get_Struct(relaxng, xmlRelaxNG, &rxml_relaxng_data_type, xrelaxng);
+  if (!xrelaxng)
+    rb_raise(rb_eArgError, "The RelaxNG schema could not be parsed");
+
+  TypedData_Get_Struct(self, rxml_relaxng_validator, &rxml_relaxng_validator_data_type, validator);
+  validator->relaxng = relaxng;
+
+  return self;
+}
+
+/*
+ * call-seq:
+ *    validator.relaxng -> XML::RelaxNG
+ *
+ * Returns the schema this validator validates against.
+ */
+static VALUE rxml_relaxng_validator_relaxng(VALUE self)
+{
+  rxml_relaxng_validator *validator;
+  TypedData_Get_Struct(self, rxml_relaxng_validator, &rxml_relaxng_validator_data_type, validator);
+  return validator->relaxng;
+}
+
+typedef struct
+{
+  rxml_relaxng_valid_ctxt *context;
+  xmlDocPtr xdoc;
+  rxml_error_list errors;
+} rxml_relaxng_validate_args;
+
+static void* rxml_relaxng_validator_validate_nogvl(void *data)
+{
+  rxml_relaxng_validate_args *args = (rxml_relaxng_validate_args*)data;
+  rxml_relaxng_validator_validate_doc(args->context, args->xdoc, &args->errors);
+  return NULL;
+}
+
+/*
+ * call-seq:
+ *    validator.validate(document) -> [XML::Error]
+ *
+ * Validates the document without holding Ruby's global VM lock and
+ * returns the list of errors that were found.  The list is empty if the
+ * document is valid.  Errors are not passed to the handler registered
+ * via XML::Error.set_handler.  The document must not be modified by
+ * other threads while it is validated.  Documents parsed with an
+ * XML::Parser::Dictionary are validated holding the lock.
+ */
+static VALUE rxml_relaxng_validator_validate(VALUE self, VALUE document)
+{
+  rxml_relaxng_validator *validator;
+  rxml_relaxng_validate_args args;
+  VALUE exception = Qnil;
+
+  if (rb_obj_is_kind_of(document, cXMLDocument) == Qfalse)
+    rb_raise(rb_eTypeError, "Must pass an LibXML::XML::Document object");
+
+  TypedData_Get_Struct(self, rxml_relaxng_validator, &rxml_relaxng_validator_data_type, validator);
+  TypedData_Get_Struct(document, xmlDoc, &rxml_document_data_type, args.xdoc);
+  memset(&args.errors, 0, sizeof(args.errors));
+  args.context = rxml_relaxng_validator_checkout(validator);
+
+  if (rxml_document_shared_dict_p(document))
+    rxml_relaxng_validator_validate_nogvl(&args);
+  else
+    rxml_without_gvl(rxml_relaxng_validator_validate_nogvl, &args, &exception);
+  rxml_relaxng_validator_checkin(validator, args.context);
+
+  if (exception != Qnil)
+  {
+    rxml_error_list_free(&args.errors);
+    rb_exc_raise(exception);
+  }
+
+  return rxml_error_list_wrap(&args.errors);
+}
+
+typedef struct
+{
+  rxml_relaxng_valid_ctxt **contexts;
+  xmlDocPtr *xdocs;
+  rxml_error_list *errors;
+} rxml_relaxng_validate_batch;
+
+static void* rxml_relaxng_validator_start(void *data, int worker)
+{
+  rxml_relaxng_validate_batch *batch = (rxml_relaxng_validate_batch*)data;
+  return batch->contexts[worker];
+}
+
+static void rxml_relaxng_validator_run(void *data, void *state, long index)
+{
+  rxml_relaxng_validate_batch *batch = (rxml_relaxng_validate_batch*)data;
+  rxml_relaxng_validator_validate_doc((rxml_relaxng_valid_ctxt*)state, batch->xdocs[index], &batch->errors[index]);
+}
+
+static void rxml_relaxng_validator_cancel(void *data, long index)
+{
+  rxml_relaxng_validate_batch *batch = (rxml_relaxng_validate_batch*)data;
+  xmlError xerror;
+
+  rxml_error_init(&xerror, XML_FROM_RELAXNGV, XML_ERR_USER_STOP, "Validation was cancelled");
+  rxml_error_list_add(&batch->errors[index], &xerror);
+  xmlResetError(&xerror);
+}
+
+/*
+ * call-seq:
+ *    validator.native_validate_many(documents, threads) -> [[XML::Error]]
+ *
+ * Implementation of XML::RelaxNG::Validator#validate_many.
+ */
+static VALUE rxml_relaxng_validator_validate_many(VALUE self, VALUE documents, VALUE threads)
+{
+  rxml_relaxng_validator *validator;
+  rxml_relaxng_validate_batch batch;
+  rxml_parallel_work work;
+  VALUE result;
+  VALUE exception;
+  long *sources;
+  long count, i;
+  int nthreads = NUM2INT(threads);
+
+  Check_Type(documents, T_ARRAY);
+  documents = rb_ary_dup(documents);
+  count = RARRAY_LEN(documents);
+
+  result = rb_ary_new_capa(count);
+  if (count == 0)
+    return result;
+
+  for (i = 0; i < count; i++)
+  {
+    if (rb_obj_is_kind_of(RARRAY_AREF(documents, i), cXMLDocument) == Qfalse)
+      rb_raise(rb_eTypeError, "Must pass LibXML::XML::Document objects");
+  }
+
+  if (nthreads < 1)
+    nthreads = 1;
+  if (nthreads > count)
+    nthreads = (int)count;
+
+  TypedData_Get_Struct(self, rxml_relaxng_validator, &rxml_relaxng_validator_data_type, validator);
+
+  batch.contexts = ALLOC_N(rxml_relaxng_valid_ctxt*, nthreads);
+  for (i = 0; i < nthreads; i++)
+    batch.contexts[i] = rxml_relaxng_validator_checkout(validator);
+
+  batch.xdocs = ALLOC_N(xmlDocPtr, count);
+  batch.errors = ALLOC_N(rxml_error_list, count);
+  memset(batch.errors, 0, sizeof(rxml_error_list) * count);
+  sources = ALLOC_N(long, count);
+
+  for (i = 0; i < count; i++)
+    TypedData_Get_Struct(RARRAY_AREF(documents, i), xmlDoc, &rxml_document_data_type, batch.xdocs[i]);
+
+  memset(&work, 0, sizeof(work));
+  work.count = count;
+  work.data = &batch;
+  work.start = rxml_relaxng_validator_start;
+  work.run = rxml_relaxng_validator_run;
+  work.cancel = rxml_relaxng_validator_cancel;
+
+  exception = rxml_document_run_many(documents, &work, nthreads, sources);
+
+  for (i = 0; i < nthreads; i++)
+    rxml_relaxng_validator_checkin(validator, batch.contexts[i]);
+
+  // Documents that were passed more than once share the first one's errors
+  for (i = 0; i < count; i++)
+  {
+    if (sources[i] == i)
+      rb_ary_push(result, rxml_error_list_wrap(&batch.errors[i]));
+    else
+      rb_ary_push(result, rb_ary_dup(RARRAY_AREF(result, sources[i])));
+  }
+
+  xfree(batch.contexts);
+  xfree(batch.xdocs);
+  xfree(batch.errors);
+  xfree(sources);
+  RB_GC_GUARD(documents);
+
+  if (exception != Qnil)
+    rb_exc_raise(exception);
+
+  return result;
 }
 
 void rxml_init_relaxng(void)
@@ -109,5 +460,12 @@ void rxml_init_relaxng(void)
       rxml_relaxng_init_from_string, 1);
   rb_define_singleton_method(cXMLRelaxNG, "document",
       rxml_relaxng_init_from_document, 1);
+
+  cXMLRelaxNGValidator = rb_define_class_under(cXMLRelaxNG, "Validator", rb_cObject);
+  rb_define_alloc_func(cXMLRelaxNGValidator, rxml_relaxng_validator_alloc);
+  rb_define_method(cXMLRelaxNGValidator, "initialize", rxml_relaxng_validator_initialize, 1);
+  rb_define_method(cXMLRelaxNGValidator, "relaxng", rxml_relaxng_validator_relaxng, 0);
+  rb_define_method(cXMLRelaxNGValidator, "validate", rxml_relaxng_validator_validate, 1);
+  rb_define_private_method(cXMLRelaxNGValidator, "native_validate_many", rxml_relaxng_validator_validate_many, 2);
 }
 
@@ -2,6 +2,8 @@
 #define __RXML_RELAXNG__
 
 extern VALUE cXMLRelaxNG;
+extern const rb_data_type_t rxml_relaxng_data_type;
+extern VALUE cXMLRelaxNGValidator;
 
 void  rxml_init_relaxng(void);
 #endif
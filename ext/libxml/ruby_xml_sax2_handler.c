@@ -1,5 +1,6 @@
 /* Please see the LICENSE file for copyright and distribution information */
 
+#include <stdarg.h>
 #include "ruby_libxml.h"
 #include "ruby_xml_sax2_handler.h"
 
@@ -21,226 +22,491 @@ VALUE cbidOnReference;
 VALUE cbidOnStartElement;
 VALUE cbidOnStartElementNs;
 VALUE cbidOnStartDocument;
+static ID cbidOnEvents;
+
+static VALUE EVENT_CDATA;
+static VALUE EVENT_CHARACTERS;
+static VALUE EVENT_COMMENT;
+static VALUE EVENT_END_DOCUMENT;
+static VALUE EVENT_END_ELEMENT;
+static VALUE EVENT_PROCESSING_INSTRUCTION;
+static VALUE EVENT_START_DOCUMENT;
+static VALUE EVENT_START_ELEMENT;
+
+/* Element, attribute and namespace names are stored in the parser's
+   dictionary, so the same name is always passed to the callbacks as the
+   same pointer.  Each name is converted to a frozen string once and then
+   looked up by its address. */
+VALUE rxml_sax_name(rxml_sax_state *state, const xmlChar *name)
+{
+  st_data_t cached;
+  VALUE result;
+
+  if (!name)
+    return Qnil;
+
+  if (st_lookup(state->names, (st_data_t)name, &cached))
+    return (VALUE)cached;
+
+  result = rxml_new_interned_cstr(name);
+
+  /* Only dictionary strings are never freed or reused while parsing */
+  if (state->ctxt->dict && xmlDictOwns(state->ctxt->dict, name) == 1)
+    st_insert(state->names, (st_data_t)name, (st_data_t)result);
+
+  return result;
+}
+
+/* Returns prefix:localname for the on_start_element and on_end_element callbacks */
+static VALUE rxml_sax_qname(rxml_sax_state *state, const xmlChar *xlocalname, const xmlChar *xprefix)
+{
+  const xmlChar *qname;
+
+  if (!xprefix)
+    return rxml_sax_name(state, xlocalname);
+
+  qname = state->ctxt->dict ? xmlDictQLookup(state->ctxt->dict, xprefix, xlocalname) : NULL;
+  if (qname)
+    return rxml_sax_name(state, qname);
+  else
+  {
+    VALUE name = rxml_new_cstr(xprefix, NULL);
+    rb_str_cat2(name, ":");
+    rb_str_cat2(name, (const char*)xlocalname);
+    return rb_obj_freeze(name);
+  }
+}
+
+/* Calls a handler method.  Handlers may parse other documents or switch
+   fibers, so the memory scopes of the current parse are suspended while
+   they run. */
+static VALUE rxml_sax_call(VALUE handler, ID callback, int argc, ...)
+{
+  rxml_memory_scope *scope;
+  VALUE argv[5];
+  VALUE result;
+  va_list ap;
+  int i;
+
+  va_start(ap, argc);
+  for (i = 0; i < argc; i++)
+    argv[i] = va_arg(ap, VALUE);
+  va_end(ap);
+
+  scope = rxml_memory_scope_suspend();
+  result = rb_funcallv(handler, callback, argc, argv);
+  rxml_memory_scope_resume(scope);
+
+  return result;
+}
+
+/* Delivers the buffered events to the handler's on_events callback */
+static void rxml_sax_flush_events(rxml_sax_state *state)
+{
+  VALUE batch = state->batch;
+
+  if (NIL_P(batch))
+    return;
+
+  /* Handlers may keep the batch, so a new array is used for the next one */
+  state->batch = Qnil;
+  rxml_sax_call(state->handler, cbidOnEvents, 1, batch);
+}
+
+/* Buffers an event for on_events.  Each event takes four entries in the
+   batch: type, name, attributes and value. */
+static void rxml_sax_event(rxml_sax_state *state, VALUE type, VALUE name, VALUE attributes, VALUE value)
+{
+  if (NIL_P(state->batch))
+    state->batch = rb_ary_new_capa(state->batch_size * 4);
+
+  rb_ary_push(state->batch, type);
+  rb_ary_push(state->batch, name);
+  rb_ary_push(state->batch, attributes);
+  rb_ary_push(state->batch, value);
+
+  if (RARRAY_LEN(state->batch) >= state->batch_size * 4)
+    rxml_sax_flush_events(state);
+}
+
+/* Appends character data to the text run that is being coalesced */
+static void rxml_sax_buffer_characters(rxml_sax_state *state, const xmlChar *chars, int len)
+{
+  if (state->text_length + len > state->text_capacity)
+  {
+    long capacity = state->text_capacity ? state->text_capacity : 256;
+
+    while (capacity < state->text_length + len)
+      capacity *= 2;
+
+    REALLOC_N(state->text, char, capacity);
+    state->text_capacity = capacity;
+  }
+
+  memcpy(state->text + state->text_length, chars, len);
+  state->text_length += len;
+}
+
+static void rxml_sax_deliver_characters(rxml_sax_state *state, VALUE chars)
+{
+  if (state->batching)
+    rxml_sax_event(state, EVENT_CHARACTERS, Qnil, Qnil, chars);
+  else if (state->handler != Qnil)
+    rxml_sax_call(state->handler, cbidOnCharacters, 1, chars);
+}
+
+/* Delivers the coalesced text run, called before any other event */
+static void rxml_sax_flush_characters(rxml_sax_state *state)
+{
+  VALUE chars;
+
+  if (state->text_length == 0)
+    return;
+
+  chars = rxml_new_cstr_len((const xmlChar*)state->text, state->text_length, NULL);
+  state->text_length = 0;
+  rxml_sax_deliver_characters(state, chars);
+}
 
 /* ======  Callbacks  =========== */
+/* Installed when only on_characters is implemented, since libxml
+   reports CDATA sections as characters if there is no cdataBlock
+   callback */
+static void ignore_cdata_block_callback(void *ctx, const xmlChar *value, int len)
+{
+  rxml_sax_flush_characters((rxml_sax_state*) ctx);
+}
+
+/* Installed when character data is coalesced to end text runs at events
+   the handler does not implement */
+static void text_boundary_comment_callback(void *ctx, const xmlChar *msg)
+{
+  rxml_sax_flush_characters((rxml_sax_state*) ctx);
+}
+
+static void text_boundary_end_element_ns_callback(void *ctx, const xmlChar *xlocalname, const xmlChar *xprefix, const xmlChar *xURI)
+{
+  rxml_sax_flush_characters((rxml_sax_state*) ctx);
+}
+
+static void text_boundary_processing_instruction_callback(void *ctx, const xmlChar *target, const xmlChar *data)
+{
+  rxml_sax_flush_characters((rxml_sax_state*) ctx);
+}
+
+static void text_boundary_start_element_ns_callback(void *ctx, 
+                                                    const xmlChar *xlocalname, const xmlChar *xprefix, const xmlChar *xURI,
+                                                    int nb_namespaces, const xmlChar **xnamespaces,
+                                                    int nb_attributes, int nb_defaulted, const xmlChar **xattributes)
+{
+  rxml_sax_flush_characters((rxml_sax_state*) ctx);
+}
+
 static void cdata_block_callback(void *ctx, const xmlChar *value, int len)
 {
-  VALUE handler = (VALUE) ctx;
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+  VALUE handler = state->handler;
 
-  if (handler != Qnil)
+  rxml_sax_flush_characters(state);
+
+  if (state->batching)
+    rxml_sax_event(state, EVENT_CDATA, Qnil, Qnil, rxml_new_cstr_len(value, len, NULL));
+  else if (handler != Qnil)
   {
-    rb_funcall(handler, cbidOnCdataBlock,1, rxml_new_cstr_len(value, len, NULL));
+    rxml_sax_call(handler, cbidOnCdataBlock,1, rxml_new_cstr_len(value, len, NULL));
   }
 }
 
 static void characters_callback(void *ctx, const xmlChar *chars, int len)
 {
-  VALUE handler = (VALUE) ctx;
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
 
-  if (handler != Qnil)
-  {
-    VALUE rchars = rxml_new_cstr_len(chars, len, NULL);
-    rb_funcall(handler, cbidOnCharacters, 1, rchars);
-  }
+  if (state->coalesce_characters)
+    rxml_sax_buffer_characters(state, chars, len);
+  else
+    rxml_sax_deliver_characters(state, rxml_new_cstr_len(chars, len, NULL));
 }
 
 static void comment_callback(void *ctx, const xmlChar *msg)
 {
-  VALUE handler = (VALUE) ctx;
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+  VALUE handler = state->handler;
 
-  if (handler != Qnil)
+  rxml_sax_flush_characters(state);
+
+  if (state->batching)
+    rxml_sax_event(state, EVENT_COMMENT, Qnil, Qnil, rxml_new_cstr(msg, NULL));
+  else if (handler != Qnil)
   {
-    rb_funcall(handler, cbidOnComment, 1, rxml_new_cstr(msg, NULL));
+    rxml_sax_call(handler, cbidOnComment, 1, rxml_new_cstr(msg, NULL));
   }
 }
 
 static void end_document_callback(void *ctx)
 {
-  VALUE handler = (VALUE) ctx;
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+  VALUE handler = state->handler;
 
-  if (handler != Qnil)
+  rxml_sax_flush_characters(state);
+
+  if (state->batching)
+  {
+    rxml_sax_event(state, EVENT_END_DOCUMENT, Qnil, Qnil, Qnil);
+    rxml_sax_flush_events(state);
+  }
+  else if (handler != Qnil)
   {
-    rb_funcall(handler, cbidOnEndDocument, 0);
+    rxml_sax_call(handler, cbidOnEndDocument, 0);
   }
 }
 
 static void end_element_ns_callback(void *ctx, const xmlChar *xlocalname, const xmlChar *xprefix, const xmlChar *xURI)
 {
-  VALUE handler = (VALUE) ctx;
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+  VALUE handler = state->handler;
+
+  rxml_sax_flush_characters(state);
+
+  if (state->batching)
+  {
+    rxml_sax_event(state, EVENT_END_ELEMENT, rxml_sax_name(state, xlocalname), Qnil, rxml_sax_name(state, xURI));
+    return;
+  }
 
   if (handler == Qnil)
     return;
 
   /* Call end element for old-times sake */
-  if (rb_respond_to(handler, cbidOnEndElement))
+  if (state->on_end_element)
   {
-    VALUE name;
-    if (xprefix)
-    {
-      name = rxml_new_cstr(xprefix, NULL);
-      rb_str_cat2(name, ":"); 
-      rb_str_cat2(name, (const char*)xlocalname);
-    }
-    else
-    {
-      name = rxml_new_cstr(xlocalname, NULL);
-    }
-    rb_funcall(handler, cbidOnEndElement, 1, name);
+    rxml_sax_call(handler, cbidOnEndElement, 1, rxml_sax_qname(state, xlocalname, xprefix));
   }
 
-  rb_funcall(handler, cbidOnEndElementNs, 3, 
-             rxml_new_cstr(xlocalname, NULL),
-             xprefix ? rxml_new_cstr(xprefix, NULL) : Qnil,
-             xURI ? rxml_new_cstr(xURI, NULL) : Qnil);
+  if (state->on_end_element_ns)
+  {
+    rxml_sax_call(handler, cbidOnEndElementNs, 3, 
+                  rxml_sax_name(state, xlocalname),
+                  rxml_sax_name(state, xprefix),
+                  rxml_sax_name(state, xURI));
+  }
 }
 
 static void external_subset_callback(void *ctx, const xmlChar *name, const xmlChar *extid, const xmlChar *sysid)
 {
-  VALUE handler = (VALUE) ctx;
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+  VALUE handler = state->handler;
 
   if (handler != Qnil)
   {
-    VALUE rname = name ? rxml_new_cstr(name, NULL) : Qnil;
+    VALUE rname = rxml_sax_name(state, name);
     VALUE rextid = extid ? rxml_new_cstr(extid, NULL) : Qnil;
     VALUE rsysid = sysid ? rxml_new_cstr(sysid, NULL) : Qnil;
-    rb_funcall(handler, cbidOnExternalSubset, 3, rname, rextid, rsysid);
+
+    /* Keep the order of batched events */
+    rxml_sax_flush_events(state);
+    rxml_sax_call(handler, cbidOnExternalSubset, 3, rname, rextid, rsysid);
   }
 }
 
 static void has_external_subset_callback(void *ctx)
 {
-  VALUE handler = (VALUE) ctx;
+  VALUE handler = ((rxml_sax_state*) ctx)->handler;
 
   if (handler != Qnil)
   {
-    rb_funcall(handler, cbidOnHasExternalSubset, 0);
+    rxml_sax_call(handler, cbidOnHasExternalSubset, 0);
   }
 }
 
 static void has_internal_subset_callback(void *ctx)
 {
-  VALUE handler = (VALUE) ctx;
+  VALUE handler = ((rxml_sax_state*) ctx)->handler;
 
   if (handler != Qnil)
   {
-    rb_funcall(handler, cbidOnHasInternalSubset, 0);
+    rxml_sax_call(handler, cbidOnHasInternalSubset, 0);
   }
 }
 
 static void internal_subset_callback(void *ctx, const xmlChar *name, const xmlChar *extid, const xmlChar *sysid)
 {
-  VALUE handler = (VALUE) ctx;
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+  VALUE handler = state->handler;
 
   if (handler != Qnil)
   {
-    VALUE rname = name ? rxml_new_cstr(name, NULL) : Qnil;
+    VALUE rname = rxml_sax_name(state, name);
     VALUE rextid = extid ? rxml_new_cstr(extid, NULL) : Qnil;
     VALUE rsysid = sysid ? rxml_new_cstr(sysid, NULL) : Qnil;
-    rb_funcall(handler, cbidOnInternalSubset, 3, rname, rextid, rsysid);
+
+    /* Keep the order of batched events */
+    rxml_sax_flush_events(state);
+    rxml_sax_call(handler, cbidOnInternalSubset, 3, rname, rextid, rsysid);
   }
 }
 
 static void is_standalone_callback(void *ctx)
 {
-  VALUE handler = (VALUE) ctx;
+  VALUE handler = ((rxml_sax_state*) ctx)->handler;
 
   if (handler != Qnil)
   {
-    rb_funcall(handler, cbidOnIsStandalone,0);
+    rxml_sax_call(handler, cbidOnIsStandalone,0);
   }
 }
 
 static void processing_instruction_callback(void *ctx, const xmlChar *target, const xmlChar *data)
 {
-  VALUE handler = (VALUE) ctx;
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+  VALUE handler = state->handler;
+
+  rxml_sax_flush_characters(state);
 
   if (handler != Qnil)
   {
-    VALUE rtarget = target ? rxml_new_cstr(target, NULL) : Qnil;
+    VALUE rtarget = rxml_sax_name(state, target);
     VALUE rdata = data ? rxml_new_cstr(data, NULL) : Qnil;
-    rb_funcall(handler, cbidOnProcessingInstruction, 2, rtarget, rdata);
+
+    if (state->batching)
+      rxml_sax_event(state, EVENT_PROCESSING_INSTRUCTION, rtarget, Qnil, rdata);
+    else
+      rxml_sax_call(handler, cbidOnProcessingInstruction, 2, rtarget, rdata);
   }
 }
 
 static void reference_callback(void *ctx, const xmlChar *name)
 {
-  VALUE handler = (VALUE) ctx;
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+  VALUE handler = state->handler;
 
   if (handler != Qnil)
   {
-    rb_funcall(handler, cbidOnReference, 1, rxml_new_cstr(name, NULL));
+    /* Keep the order of batched events */
+    rxml_sax_flush_characters(state);
+    rxml_sax_flush_events(state);
+    rxml_sax_call(handler, cbidOnReference, 1, rxml_sax_name(state, name));
   }
 }
 
 static void start_document_callback(void *ctx)
 {
-  VALUE handler = (VALUE) ctx;
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+  VALUE handler = state->handler;
 
-  if (handler != Qnil)
+  if (state->batching)
+    rxml_sax_event(state, EVENT_START_DOCUMENT, Qnil, Qnil, Qnil);
+  else if (handler != Qnil)
   {
-    rb_funcall(handler, cbidOnStartDocument, 0);
+    rxml_sax_call(handler, cbidOnStartDocument, 0);
   }
 }
 
+typedef struct
+{
+  rxml_sax_state *state;
+  const xmlChar *xlocalname;
+  const xmlChar *xprefix;
+  const xmlChar *xURI;
+  VALUE attributes;
+  VALUE namespaces;
+} rxml_sax_start_element_args;
+
+static VALUE rxml_sax_start_element(VALUE data)
+{
+  rxml_sax_start_element_args *args = (rxml_sax_start_element_args*) data;
+  rxml_sax_state *state = args->state;
+
+  /* Call start element for old-times sake */
+  if (state->on_start_element)
+  {
+    rxml_sax_call(state->handler, cbidOnStartElement, 2, rxml_sax_qname(state, args->xlocalname, args->xprefix), args->attributes);
+  }
+
+  if (state->on_start_element_ns)
+  {
+    rxml_sax_call(state->handler, cbidOnStartElementNs, 5, 
+                  rxml_sax_name(state, args->xlocalname),
+                  args->attributes,
+                  rxml_sax_name(state, args->xprefix),
+                  rxml_sax_name(state, args->xURI),
+                  args->namespaces);
+  }
+
+  return Qnil;
+}
+
+static VALUE rxml_sax_expire_attributes(VALUE attributes)
+{
+  rxml_sax_attributes_expire(attributes);
+  return Qnil;
+}
+
 static void start_element_ns_callback(void *ctx, 
                                       const xmlChar *xlocalname, const xmlChar *xprefix, const xmlChar *xURI,
                                 		  int nb_namespaces, const xmlChar **xnamespaces,
 					                            int nb_attributes, int nb_defaulted, const xmlChar **xattributes)
 {
-  VALUE handler = (VALUE) ctx;
-  VALUE attributes = rb_hash_new();
-  VALUE namespaces = rb_hash_new();
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+  VALUE handler = state->handler;
+  rxml_sax_start_element_args args;
+  int lazy = state->lazy_attributes && !state->batching;
 
   if (handler == Qnil)
     return;
 
-  if (xattributes)
+  rxml_sax_flush_characters(state);
+
+  if (lazy)
   {
-    /* Each attribute is an array of [localname, prefix, URI, value, end] */
-    int i;
-    for (i = 0;i < nb_attributes * 5; i+=5) 
+    args.attributes = rxml_sax_attributes_new(state, xattributes, nb_attributes);
+  }
+  else
+  {
+    args.attributes = rb_hash_new();
+
+    if (xattributes)
     {
-      VALUE attrName = rxml_new_cstr(xattributes[i+0], NULL);
-      long attrLen = (long)(xattributes[i+4] - xattributes[i+3]);
-      VALUE attrValue = rxml_new_cstr_len(xattributes[i+3], attrLen, NULL);
-      rb_hash_aset(attributes, attrName, attrValue);
+      /* Each attribute is an array of [localname, prefix, URI, value, end] */
+      int i;
+      for (i = 0;i < nb_attributes * 5; i+=5) 
+      {
+        VALUE attrName = rxml_sax_name(state, xattributes[i+0]);
+        long attrLen = (long)(xattributes[i+4] - xattributes[i+3]);
+        VALUE attrValue = rxml_new_cstr_len(xattributes[i+3], attrLen, NULL);
+        rb_hash_aset(args.attributes, attrName, attrValue);
+      }
     }
   }
 
+  if (state->batching)
+  {
+    rxml_sax_event(state, EVENT_START_ELEMENT, rxml_sax_name(state, xlocalname), args.attributes, rxml_sax_name(state, xURI));
+    return;
+  }
+
+  args.namespaces = rb_hash_new();
+
   if (xnamespaces)
   {
     int i;
     for (i = 0;i < nb_namespaces * 2; i+=2) 
     {
-      VALUE nsPrefix = xnamespaces[i+0] ? rxml_new_cstr(xnamespaces[i+0], NULL) : Qnil;
-      VALUE nsURI = xnamespaces[i+1] ? rxml_new_cstr(xnamespaces[i+1], NULL) : Qnil;
-      rb_hash_aset(namespaces, nsPrefix, nsURI);
+      VALUE nsPrefix = rxml_sax_name(state, xnamespaces[i+0]);
+      VALUE nsURI = rxml_sax_name(state, xnamespaces[i+1]);
+      rb_hash_aset(args.namespaces, nsPrefix, nsURI);
     }
   }
 
-  /* Call start element for old-times sake */
-  if (rb_respond_to(handler, cbidOnStartElement))
-  {
-    VALUE name;
-    if (xprefix)
-    {
-      name = rxml_new_cstr(xprefix, NULL);
-      rb_str_cat2(name, ":");
-      rb_str_cat2(name, (const char*)xlocalname);
-    }
-    else
-    {
-      name = rxml_new_cstr(xlocalname, NULL);
-    }
-    rb_funcall(handler, cbidOnStartElement, 2, name, attributes);
-  }
+  args.state = state;
+  args.xlocalname = xlocalname;
+  args.xprefix = xprefix;
+  args.xURI = xURI;
 
-  rb_funcall(handler, cbidOnStartElementNs, 5, 
-             rxml_new_cstr(xlocalname, NULL),
-             attributes,
-             xprefix ? rxml_new_cstr(xprefix, NULL) : Qnil,
-             xURI ? rxml_new_cstr(xURI, NULL) : Qnil,
-             namespaces);
+  /* The attributes view must not be used after the parser moves on */
+  if (lazy)
+    rb_ensure(rxml_sax_start_element, (VALUE)&args, rxml_sax_expire_attributes, args.attributes);
+  else
+    rxml_sax_start_element((VALUE)&args);
 }
 
 static void structured_error_callback(void *ctx, const xmlError *xerror)
@@ -257,17 +523,116 @@ static void structured_error_callback(void *ctx, const xmlError *xerror)
     ctx = ctxt->userData;
   #endif
 
-  handler = (VALUE) ctx;
+  handler = ((rxml_sax_state*) ctx)->handler;
 
-  if (handler != Qnil)
+  if (((rxml_sax_state*) ctx)->on_error)
   {
+    /* Report the error after the events that preceded it */
+    rxml_sax_flush_characters((rxml_sax_state*) ctx);
+    rxml_sax_flush_events((rxml_sax_state*) ctx);
+
     VALUE error = rxml_error_wrap(xerror);
-    rb_funcall(handler, cbidOnError, 1, error);
+    rxml_sax_call(handler, cbidOnError, 1, error);
   }
 }
 
+/* ======  Filter  =========== */
+/* Installed in front of the handler's callbacks when parsing with a
+   pattern.  Every element is pushed onto the pattern's stream, but
+   nothing reaches Ruby until an element matches. */
+static void filter_start_element_ns_callback(void *ctx, 
+                                             const xmlChar *xlocalname, const xmlChar *xprefix, const xmlChar *xURI,
+                                             int nb_namespaces, const xmlChar **xnamespaces,
+                                             int nb_attributes, int nb_defaulted, const xmlChar **xattributes)
+{
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+  int match = xmlStreamPush(state->stream, xlocalname, xURI);
+
+  state->depth++;
+  if (state->match_depth == 0 && match == 1)
+    state->match_depth = state->depth;
+
+  if (state->match_depth && state->filtered.startElementNs)
+    state->filtered.startElementNs(ctx, xlocalname, xprefix, xURI, nb_namespaces, xnamespaces,
+                                   nb_attributes, nb_defaulted, xattributes);
+}
+
+static void filter_end_element_ns_callback(void *ctx, const xmlChar *xlocalname, const xmlChar *xprefix, const xmlChar *xURI)
+{
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+
+  if (state->match_depth && state->filtered.endElementNs)
+    state->filtered.endElementNs(ctx, xlocalname, xprefix, xURI);
+
+  if (state->match_depth == state->depth)
+    state->match_depth = 0;
+  state->depth--;
+  xmlStreamPop(state->stream);
+}
+
+static void filter_cdata_block_callback(void *ctx, const xmlChar *value, int len)
+{
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+
+  if (state->match_depth)
+    state->filtered.cdataBlock(ctx, value, len);
+}
+
+static void filter_characters_callback(void *ctx, const xmlChar *chars, int len)
+{
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+
+  if (state->match_depth)
+    state->filtered.characters(ctx, chars, len);
+}
+
+static void filter_comment_callback(void *ctx, const xmlChar *msg)
+{
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+
+  if (state->match_depth)
+    state->filtered.comment(ctx, msg);
+}
+
+static void filter_processing_instruction_callback(void *ctx, const xmlChar *target, const xmlChar *data)
+{
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+
+  if (state->match_depth)
+    state->filtered.processingInstruction(ctx, target, data);
+}
+
+static void filter_reference_callback(void *ctx, const xmlChar *name)
+{
+  rxml_sax_state *state = (rxml_sax_state*) ctx;
+
+  if (state->match_depth)
+    state->filtered.reference(ctx, name);
+}
+
+static void rxml_sax_state_filter(rxml_sax_state *state)
+{
+  xmlSAXHandlerPtr sax = state->ctxt->sax;
+
+  memcpy(&state->filtered, sax, sizeof(xmlSAXHandler));
+
+  sax->startElementNs = filter_start_element_ns_callback;
+  sax->endElementNs = filter_end_element_ns_callback;
+
+  if (sax->cdataBlock)
+    sax->cdataBlock = filter_cdata_block_callback;
+  if (sax->characters)
+    sax->characters = filter_characters_callback;
+  if (sax->comment)
+    sax->comment = filter_comment_callback;
+  if (sax->processingInstruction)
+    sax->processingInstruction = filter_processing_instruction_callback;
+  if (sax->reference)
+    sax->reference = filter_reference_callback;
+}
+
 /* ======  Handler  =========== */
-xmlSAXHandler rxml_sax_handler = {
+static xmlSAXHandler rxml_sax_handler = {
   (internalSubsetSAXFunc) internal_subset_callback,
   (isStandaloneSAXFunc) is_standalone_callback,
   (hasInternalSubsetSAXFunc) has_internal_subset_callback,
@@ -302,6 +667,200 @@ xmlSAXHandler rxml_sax_handler = {
   (xmlStructuredErrorFunc) structured_error_callback
 };
 
+static void rxml_sax_state_mark(rxml_sax_state *state)
+{
+  rb_gc_mark(state->handler);
+  rb_gc_mark(state->batch);
+  rb_mark_tbl(state->names);
+}
+
+static void rxml_sax_state_free(rxml_sax_state *state)
+{
+  st_free_table(state->names);
+  xfree(state->text);
+
+  if (state->stream)
+    xmlFreeStreamCtxt(state->stream);
+  if (state->pattern)
+    xmlFreePattern(state->pattern);
+
+  xfree(state);
+}
+
+static size_t rxml_sax_state_memsize(const void *data)
+{
+  const rxml_sax_state *state = (const rxml_sax_state*)data;
+  return sizeof(rxml_sax_state) + st_memsize(state->names) + state->text_capacity;
+}
+
+static const rb_data_type_t rxml_sax_state_data_type = {
+  "LibXML::XML::SaxParser state",
+  { (RUBY_DATA_FUNC)rxml_sax_state_mark, (RUBY_DATA_FUNC)rxml_sax_state_free, rxml_sax_state_memsize },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/* Determines whether the handler implements a callback, rather than
+   inheriting the empty method from XML::SaxParser::Callbacks */
+static int rxml_sax_implemented(VALUE handler, VALUE defaults, ID callback)
+{
+  VALUE method;
+
+  if (NIL_P(handler) || !rb_respond_to(handler, callback))
+    return 0;
+
+  if (NIL_P(defaults))
+    return 1;
+
+  method = rb_obj_method(handler, ID2SYM(callback));
+  return rb_funcall(method, rb_intern("owner"), 0) != defaults;
+}
+
+/* Sets up the context's SAX handler with just the callbacks implemented
+   by the handler, so that libxml does no work for events that would be
+   ignored.  This is done once per handler instead of on every event. */
+static void rxml_sax_state_dispatch(rxml_sax_state *state)
+{
+  xmlSAXHandlerPtr sax = state->ctxt->sax;
+  VALUE handler = state->handler;
+  VALUE defaults = Qnil;
+  ID callbacks = rb_intern("Callbacks");
+
+  if (rb_const_defined_at(cXMLSaxParser, callbacks))
+    defaults = rb_const_get_at(cXMLSaxParser, callbacks);
+
+  memcpy(sax, &rxml_sax_handler, sizeof(rxml_sax_handler));
+
+  state->on_start_element = rxml_sax_implemented(handler, defaults, cbidOnStartElement);
+  state->on_start_element_ns = rxml_sax_implemented(handler, defaults, cbidOnStartElementNs);
+  state->on_end_element = rxml_sax_implemented(handler, defaults, cbidOnEndElement);
+  state->on_end_element_ns = rxml_sax_implemented(handler, defaults, cbidOnEndElementNs);
+  state->on_error = rxml_sax_implemented(handler, defaults, cbidOnError);
+  state->batching = rxml_sax_implemented(handler, defaults, cbidOnEvents);
+
+  /* When batching, document, element, text, comment and processing
+     instruction events go to on_events instead of their own callbacks */
+  if (!state->batching)
+  {
+    if (!state->on_start_element && !state->on_start_element_ns)
+      sax->startElementNs = NULL;
+    if (!state->on_end_element && !state->on_end_element_ns)
+      sax->endElementNs = NULL;
+
+    if (!rxml_sax_implemented(handler, defaults, cbidOnCharacters))
+      sax->characters = NULL;
+    if (!rxml_sax_implemented(handler, defaults, cbidOnCdataBlock))
+      sax->cdataBlock = sax->characters ? ignore_cdata_block_callback : NULL;
+
+    if (!rxml_sax_implemented(handler, defaults, cbidOnComment))
+      sax->comment = NULL;
+    if (!rxml_sax_implemented(handler, defaults, cbidOnEndDocument))
+      sax->endDocument = NULL;
+    if (!rxml_sax_implemented(handler, defaults, cbidOnProcessingInstruction))
+      sax->processingInstruction = NULL;
+    if (!rxml_sax_implemented(handler, defaults, cbidOnStartDocument))
+      sax->startDocument = NULL;
+  }
+
+  /* Coalesced text runs end at elements, comments, processing
+     instructions and CDATA sections even if they are not reported */
+  if (state->coalesce_characters && sax->characters)
+  {
+    if (!sax->startElementNs)
+      sax->startElementNs = text_boundary_start_element_ns_callback;
+    if (!sax->endElementNs)
+      sax->endElementNs = text_boundary_end_element_ns_callback;
+    if (!sax->comment)
+      sax->comment = text_boundary_comment_callback;
+    if (!sax->processingInstruction)
+      sax->processingInstruction = text_boundary_processing_instruction_callback;
+  }
+
+  if (!rxml_sax_implemented(handler, defaults, cbidOnExternalSubset))
+    sax->externalSubset = NULL;
+  if (!rxml_sax_implemented(handler, defaults, cbidOnHasExternalSubset))
+    sax->hasExternalSubset = NULL;
+  if (!rxml_sax_implemented(handler, defaults, cbidOnHasInternalSubset))
+    sax->hasInternalSubset = NULL;
+  if (!rxml_sax_implemented(handler, defaults, cbidOnInternalSubset))
+    sax->internalSubset = NULL;
+  if (!rxml_sax_implemented(handler, defaults, cbidOnIsStandalone))
+    sax->isStandalone = NULL;
+  if (!rxml_sax_implemented(handler, defaults, cbidOnReference))
+    sax->reference = NULL;
+
+  if (state->stream)
+    rxml_sax_state_filter(state);
+}
+
+/* Makes the parser context send its events to handler.  The returned
+   object holds the state of the callbacks and must be kept alive for as
+   long as the context can generate events. */
+VALUE rxml_sax_state_new(xmlParserCtxtPtr ctxt, VALUE handler)
+{
+  rxml_sax_state *state;
+  VALUE result = TypedData_Make_Struct(0, rxml_sax_state, &rxml_sax_state_data_type, state);
+
+  state->handler = handler;
+  state->ctxt = ctxt;
+  state->names = st_init_numtable();
+  state->batch = Qnil;
+  state->batch_size = RXML_SAX_BATCH_SIZE;
+  state->lazy_attributes = 0;
+  state->coalesce_characters = 0;
+  state->text = NULL;
+  state->text_length = 0;
+  state->text_capacity = 0;
+  state->pattern = NULL;
+  state->stream = NULL;
+  state->depth = 0;
+  state->match_depth = 0;
+
+  ctxt->sax2 = 1;
+  ctxt->userData = state;
+  rxml_sax_state_dispatch(state);
+
+  return result;
+}
+
+void rxml_sax_state_handler_set(VALUE state, VALUE handler)
+{
+  rxml_sax_state *sax_state = (rxml_sax_state*)RTYPEDDATA_DATA(state);
+
+  sax_state->handler = handler;
+  rxml_sax_state_dispatch(sax_state);
+}
+
+/* Restricts events to the subtrees of elements matching any of the
+   patterns, which use libxml's streamable XPath subset.  namespaces is
+   a Hash of the prefixes used in the patterns, or nil.  Takes effect
+   once the handler is set. */
+void rxml_sax_state_filter_set(VALUE state, VALUE patterns, VALUE namespaces)
+{
+  rxml_sax_state *sax_state = (rxml_sax_state*)RTYPEDDATA_DATA(state);
+
+  sax_state->pattern = rxml_xpath_pattern_compile(patterns, namespaces, sax_state->ctxt->dict);
+  sax_state->stream = xmlPatternGetStreamCtxt(sax_state->pattern);
+
+  if (!sax_state->stream)
+    rb_raise(rb_eNoMemError, "Could not create the pattern's stream");
+
+  /* Pushing no name stands for the document node, which absolute
+     patterns start from */
+  xmlStreamPush(sax_state->stream, NULL, NULL);
+}
+
+/* Delivers events that are still buffered, for example because parsing
+   stopped with an error */
+void rxml_sax_state_flush(VALUE state)
+{
+  rxml_sax_state *sax_state = (rxml_sax_state*)RTYPEDDATA_DATA(state);
+
+  rxml_sax_flush_characters(sax_state);
+
+  if (sax_state->batching)
+    rxml_sax_flush_events(sax_state);
+}
+
 void rxml_init_sax2_handler(void)
 {
 
@@ -323,4 +882,15 @@ void rxml_init_sax2_handler(void)
   cbidOnStartElement =          rb_intern("on_start_element");
   cbidOnStartElementNs =        rb_intern("on_start_element_ns");
   cbidOnStartDocument =         rb_intern("on_start_document");
+  cbidOnEvents =                rb_intern("on_events");
+
+  /* Batched event types */
+  EVENT_CDATA =                  ID2SYM(rb_intern("cdata"));
+  EVENT_CHARACTERS =             ID2SYM(rb_intern("characters"));
+  EVENT_COMMENT =                ID2SYM(rb_intern("comment"));
+  EVENT_END_DOCUMENT =           ID2SYM(rb_intern("end_document"));
+  EVENT_END_ELEMENT =            ID2SYM(rb_intern("end_element"));
+  EVENT_PROCESSING_INSTRUCTION = ID2SYM(rb_intern("processing_instruction"));
+  EVENT_START_DOCUMENT =         ID2SYM(rb_intern("start_document"));
+  EVENT_START_ELEMENT =          ID2SYM(rb_intern("start_element"));
 }
@@ -3,8 +3,53 @@
 #ifndef __RXML_SAX2_HANDLER__
 #define __RXML_SAX2_HANDLER__
 
-extern xmlSAXHandler rxml_sax_handler;
+#include <ruby/st.h>
+#include <libxml/pattern.h>
+
+/* Number of events passed to on_events at a time by default */
+#define RXML_SAX_BATCH_SIZE 256
+
+typedef struct
+{
+  VALUE handler;
+  xmlParserCtxtPtr ctxt;
+  st_table *names;
+
+  /* Callbacks that are checked on each event, resolved once per handler */
+  int on_start_element;
+  int on_start_element_ns;
+  int on_end_element;
+  int on_end_element_ns;
+  int on_error;
+
+  /* Events buffered for on_events */
+  int batching;
+  long batch_size;
+  VALUE batch;
+
+  /* Pass attributes as an XML::SaxParser::Attributes view */
+  int lazy_attributes;
+
+  /* Character data buffered to deliver whole text runs at once */
+  int coalesce_characters;
+  char *text;
+  long text_length;
+  long text_capacity;
+
+  /* Only events inside elements matching the pattern are passed on to
+     the callbacks in filtered */
+  xmlPatternPtr pattern;
+  xmlStreamCtxtPtr stream;
+  xmlSAXHandler filtered;
+  long depth;
+  long match_depth;
+} rxml_sax_state;
 
 void rxml_init_sax2_handler(void);
+VALUE rxml_sax_state_new(xmlParserCtxtPtr ctxt, VALUE handler);
+void rxml_sax_state_handler_set(VALUE state, VALUE handler);
+void rxml_sax_state_filter_set(VALUE state, VALUE patterns, VALUE namespaces);
+VALUE rxml_sax_name(rxml_sax_state *state, const xmlChar *name);
+void rxml_sax_state_flush(VALUE state);
 
 #endif
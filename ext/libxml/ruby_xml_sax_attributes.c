@@ -0,0 +1,205 @@
+/* Please see the LICENSE file for copyright and distribution information */
+
+#include "ruby_libxml.h"
+#include "ruby_xml_sax_attributes.h"
+
+/*
+ * Document-class: LibXML::XML::SaxParser::Attributes
+ *
+ * A read-only view of the attributes of an element that is passed to
+ * the start element callbacks when XML::SaxParser#lazy_attributes is
+ * set.  Names and values are only converted to Ruby strings when they
+ * are read.  Attributes are identified by their local name, like the
+ * keys of the Hash that is passed otherwise.
+ *
+ * The view reads the parser's internal data, so it can only be used
+ * while the callback it was passed to runs.  Use to_h to keep a copy.
+ *
+ *   def on_start_element_ns(name, attributes, prefix, uri, namespaces)
+ *     @ids << attributes['id'] if attributes.key?('id')
+ *   end
+ */
+
+VALUE cXMLSaxParserAttributes;
+
+typedef struct
+{
+  rxml_sax_state *state;
+  /* Each attribute is an array of [localname, prefix, URI, value, end] */
+  const xmlChar **attributes;
+  int count;
+} rxml_sax_attributes;
+
+static void rxml_sax_attributes_free(rxml_sax_attributes *attributes)
+{
+  xfree(attributes);
+}
+
+static size_t rxml_sax_attributes_memsize(const void *data)
+{
+  return sizeof(rxml_sax_attributes);
+}
+
+static const rb_data_type_t rxml_sax_attributes_data_type = {
+  "LibXML::XML::SaxParser::Attributes",
+  { NULL, (RUBY_DATA_FUNC)rxml_sax_attributes_free, rxml_sax_attributes_memsize },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+VALUE rxml_sax_attributes_new(rxml_sax_state *state, const xmlChar **xattributes, int count)
+{
+  rxml_sax_attributes *attributes;
+  VALUE result = TypedData_Make_Struct(cXMLSaxParserAttributes, rxml_sax_attributes, &rxml_sax_attributes_data_type, attributes);
+
+  attributes->state = state;
+  attributes->attributes = xattributes;
+  attributes->count = xattributes ? count : 0;
+
+  return result;
+}
+
+/* Called when the callback returns, after which the parser's data is
+   no longer valid */
+void rxml_sax_attributes_expire(VALUE self)
+{
+  rxml_sax_attributes *attributes;
+  TypedData_Get_Struct(self, rxml_sax_attributes, &rxml_sax_attributes_data_type, attributes);
+
+  attributes->state = NULL;
+  attributes->attributes = NULL;
+  attributes->count = 0;
+}
+
+static rxml_sax_attributes* rxml_sax_attributes_get(VALUE self)
+{
+  rxml_sax_attributes *attributes;
+  TypedData_Get_Struct(self, rxml_sax_attributes, &rxml_sax_attributes_data_type, attributes);
+
+  if (!attributes->state)
+    rb_raise(rb_eRuntimeError, "Attributes can only be read in the callback they were passed to");
+
+  return attributes;
+}
+
+static VALUE rxml_sax_attributes_value(const xmlChar **attribute)
+{
+  return rxml_new_cstr_len(attribute[3], (long)(attribute[4] - attribute[3]), NULL);
+}
+
+static int rxml_sax_attributes_find(rxml_sax_attributes *attributes, VALUE name)
+{
+  int i;
+
+  Check_Type(name, T_STRING);
+
+  for (i = 0; i < attributes->count; i++)
+  {
+    const char *localname = (const char*)attributes->attributes[i * 5];
+
+    if ((long)strlen(localname) == RSTRING_LEN(name) &&
+        memcmp(localname, RSTRING_PTR(name), RSTRING_LEN(name)) == 0)
+      return i;
+  }
+
+  return -1;
+}
+
+/*
+ * call-seq:
+ *    attributes[name] -> "value"
+ *
+ * Returns the value of the attribute with the given local name, or nil
+ * if the element does not have it.
+ */
+static VALUE rxml_sax_attributes_get_attribute(VALUE self, VALUE name)
+{
+  rxml_sax_attributes *attributes = rxml_sax_attributes_get(self);
+  int index = rxml_sax_attributes_find(attributes, name);
+
+  return index < 0 ? Qnil : rxml_sax_attributes_value(attributes->attributes + index * 5);
+}
+
+/*
+ * call-seq:
+ *    attributes.key?(name) -> (true|false)
+ *
+ * Determines whether the element has an attribute with the given
+ * local name.
+ */
+static VALUE rxml_sax_attributes_key_q(VALUE self, VALUE name)
+{
+  rxml_sax_attributes *attributes = rxml_sax_attributes_get(self);
+  return rxml_sax_attributes_find(attributes, name) < 0 ? Qfalse : Qtrue;
+}
+
+/*
+ * call-seq:
+ *    attributes.each {|name, value| ... }
+ *
+ * Iterates over the element's attributes.
+ */
+static VALUE rxml_sax_attributes_each(VALUE self)
+{
+  int i;
+
+  RETURN_ENUMERATOR(self, 0, 0);
+
+  /* The block may end the callback's lifetime, so check on each step */
+  for (i = 0; i < rxml_sax_attributes_get(self)->count; i++)
+  {
+    rxml_sax_attributes *attributes = rxml_sax_attributes_get(self);
+    const xmlChar **attribute = attributes->attributes + i * 5;
+
+    rb_yield_values(2, rxml_sax_name(attributes->state, attribute[0]), rxml_sax_attributes_value(attribute));
+  }
+
+  return self;
+}
+
+/*
+ * call-seq:
+ *    attributes.length -> num
+ *
+ * Returns the number of attributes.
+ */
+static VALUE rxml_sax_attributes_length(VALUE self)
+{
+  return INT2NUM(rxml_sax_attributes_get(self)->count);
+}
+
+/*
+ * call-seq:
+ *    attributes.to_h -> Hash
+ *
+ * Returns a Hash of the attributes' local names and values that can be
+ * kept after the callback returns.
+ */
+static VALUE rxml_sax_attributes_to_h(VALUE self)
+{
+  rxml_sax_attributes *attributes = rxml_sax_attributes_get(self);
+  VALUE result = rb_hash_new();
+  int i;
+
+  for (i = 0; i < attributes->count; i++)
+  {
+    const xmlChar **attribute = attributes->attributes + i * 5;
+    rb_hash_aset(result, rxml_sax_name(attributes->state, attribute[0]), rxml_sax_attributes_value(attribute));
+  }
+
+  return result;
+}
+
+void rxml_init_sax_attributes(void)
+{
+  cXMLSaxParserAttributes = rb_define_class_under(cXMLSaxParser, "Attributes", rb_cObject);
+  rb_undef_alloc_func(cXMLSaxParserAttributes);
+  rb_include_module(cXMLSaxParserAttributes, rb_mEnumerable);
+
+  rb_define_method(cXMLSaxParserAttributes, "[]", rxml_sax_attributes_get_attribute, 1);
+  rb_define_method(cXMLSaxParserAttributes, "each", rxml_sax_attributes_each, 0);
+  rb_define_method(cXMLSaxParserAttributes, "include?", rxml_sax_attributes_key_q, 1);
+  rb_define_method(cXMLSaxParserAttributes, "key?", rxml_sax_attributes_key_q, 1);
+  rb_define_method(cXMLSaxParserAttributes, "length", rxml_sax_attributes_length, 0);
+  rb_define_method(cXMLSaxParserAttributes, "size", rxml_sax_attributes_length, 0);
+  rb_define_method(cXMLSaxParserAttributes, "to_h", rxml_sax_attributes_to_h, 0);
+}
@@ -0,0 +1,12 @@
+/* Please see the LICENSE file for copyright and distribution information */
+
+#ifndef __RXML_SAX_ATTRIBUTES__
+#define __RXML_SAX_ATTRIBUTES__
+
+extern VALUE cXMLSaxParserAttributes;
+
+void rxml_init_sax_attributes(void);
+VALUE rxml_sax_attributes_new(rxml_sax_state *state, const xmlChar **attributes, int count);
+void rxml_sax_attributes_expire(VALUE self);
+
+#endif
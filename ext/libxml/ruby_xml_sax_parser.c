@@ -39,10 +39,37 @@
 VALUE cXMLSaxParser;
 static ID CALLBACKS_ATTR;
 static ID CONTEXT_ATTR;
+static ID SAX_STATE_ATTR;
+static ID BATCH_SIZE_ATTR;
+static ID LAZY_ATTRIBUTES_ATTR;
+static ID COALESCE_CHARACTERS_ATTR;
 
 
 /* ======  Parser  =========== */
 
+/* Applies the parser's settings and callbacks to a callback state */
+static void rxml_sax_parser_configure(VALUE self, VALUE state)
+{
+  rxml_sax_state *sax_state = (rxml_sax_state*)RTYPEDDATA_DATA(state);
+  VALUE batch_size = rb_ivar_get(self, BATCH_SIZE_ATTR);
+
+  sax_state->batch_size = NIL_P(batch_size) ? RXML_SAX_BATCH_SIZE : NUM2LONG(batch_size);
+  sax_state->lazy_attributes = RTEST(rb_ivar_get(self, LAZY_ATTRIBUTES_ATTR));
+  sax_state->coalesce_characters = RTEST(rb_ivar_get(self, COALESCE_CHARACTERS_ATTR));
+
+  rxml_sax_state_handler_set(state, rb_ivar_get(self, CALLBACKS_ATTR));
+}
+
+/* Push contexts deliver events as data is fed to them, so changes to
+   the parser's settings apply immediately */
+static void rxml_sax_parser_reconfigure(VALUE self)
+{
+  VALUE context = rb_ivar_get(self, CONTEXT_ATTR);
+
+  if (rxml_parser_context_push_p(context))
+    rxml_sax_parser_configure(self, rb_ivar_get(context, SAX_STATE_ATTR));
+}
+
 /*
  * call-seq:
  *    parser.initialize(context) -> XML::Parser
@@ -62,27 +89,203 @@ static VALUE rxml_sax_parser_initialize(int argc, VALUE *argv, VALUE self)
   }
 
   rb_ivar_set(self, CONTEXT_ATTR, context);
+
+  /* Push contexts generate events as data is fed to them, so the
+     handler has to be in place before parsing starts. */
+  if (rxml_parser_context_push_p(context))
+  {
+    xmlParserCtxtPtr ctxt;
+    TypedData_Get_Struct(context, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
+
+    /* The context references the callback state so the callbacks are
+       not collected while it is still being fed */
+    rb_ivar_set(context, SAX_STATE_ATTR, rxml_sax_state_new(ctxt, Qnil));
+  }
+
   return self;
 }
 
+/*
+ * call-seq:
+ *    parser.callbacks = object
+ *
+ * Sets the object that receives the parser's callbacks.  For push
+ * contexts, events are delivered to this object as data is fed to
+ * the context.
+ */
+static VALUE rxml_sax_parser_callbacks_set(VALUE self, VALUE callbacks)
+{
+  rb_ivar_set(self, CALLBACKS_ATTR, callbacks);
+  rxml_sax_parser_reconfigure(self);
+
+  return callbacks;
+}
+
+/*
+ * call-seq:
+ *    parser.batch_size = num
+ *
+ * Sets the number of events passed at a time to the callbacks object's
+ * on_events method.  The default is 256.
+ *
+ * Implementing on_events(batch) instead of the individual callbacks
+ * greatly reduces the number of calls from the parser into Ruby.  The
+ * batch is an array with four entries per event: type, name, attributes
+ * and value.
+ *
+ *   class MyCallbacks
+ *     def on_events(batch)
+ *       batch.each_slice(4) do |type, name, attributes, value|
+ *         ...
+ *       end
+ *     end
+ *   end
+ *
+ * The event types are :start_document, :end_document, :start_element,
+ * :end_element, :characters, :cdata, :comment and :processing_instruction.
+ * Element events give the element's local name, start element events
+ * a Hash of attributes, and both the element's namespace URI as value.
+ * Processing instructions give the target as name.  Text and comments
+ * are given as value.
+ *
+ * Errors and other events are delivered to their own callbacks, after
+ * the events that preceded them.
+ */
+static VALUE rxml_sax_parser_batch_size_set(VALUE self, VALUE batch_size)
+{
+  if (NUM2LONG(batch_size) < 1)
+    rb_raise(rb_eArgError, "The batch size must be positive");
+
+  rb_ivar_set(self, BATCH_SIZE_ATTR, batch_size);
+  rxml_sax_parser_reconfigure(self);
+
+  return batch_size;
+}
+
+/*
+ * call-seq:
+ *    parser.coalesce_characters? -> (true|false)
+ *
+ * Determines whether character data is delivered one text run at a time.
+ */
+static VALUE rxml_sax_parser_coalesce_characters_q(VALUE self)
+{
+  return RTEST(rb_ivar_get(self, COALESCE_CHARACTERS_ATTR)) ? Qtrue : Qfalse;
+}
+
+/*
+ * call-seq:
+ *    parser.coalesce_characters = true|false
+ *
+ * libxml reports character data in pieces that depend on its input
+ * buffers and on entities, so a single text node can result in several
+ * calls to on_characters.  When this is true, the pieces are collected
+ * by the parser and on_characters is called once for each contiguous
+ * run of text, before the event that ends it.  Elements, comments,
+ * processing instructions and CDATA sections end a text run.
+ */
+static VALUE rxml_sax_parser_coalesce_characters_set(VALUE self, VALUE value)
+{
+  rb_ivar_set(self, COALESCE_CHARACTERS_ATTR, RTEST(value) ? Qtrue : Qfalse);
+  rxml_sax_parser_reconfigure(self);
+
+  return value;
+}
+
+/*
+ * call-seq:
+ *    parser.lazy_attributes? -> (true|false)
+ *
+ * Determines whether start element callbacks are passed an
+ * XML::SaxParser::Attributes view instead of a Hash.
+ */
+static VALUE rxml_sax_parser_lazy_attributes_q(VALUE self)
+{
+  return RTEST(rb_ivar_get(self, LAZY_ATTRIBUTES_ATTR)) ? Qtrue : Qfalse;
+}
+
+/*
+ * call-seq:
+ *    parser.lazy_attributes = true|false
+ *
+ * When true, on_start_element_ns and on_start_element are passed an
+ * XML::SaxParser::Attributes view of the element's attributes instead
+ * of a Hash.  Attribute names and values are then only converted to
+ * strings when they are read, which is faster when handlers only look
+ * at a few attributes.  The view can only be used while the callback
+ * it was passed to runs.
+ */
+static VALUE rxml_sax_parser_lazy_attributes_set(VALUE self, VALUE value)
+{
+  rb_ivar_set(self, LAZY_ATTRIBUTES_ATTR, RTEST(value) ? Qtrue : Qfalse);
+  rxml_sax_parser_reconfigure(self);
+
+  return value;
+}
+
 /*
  * call-seq:
  *    parser.parse -> (true|false)
+ *    parser.parse(:only => patterns, :namespaces => {prefix => uri}) -> (true|false)
  *
  * Parse the input XML, generating callbacks to the object
  * registered via the +callbacks+ attributesibute.
+ *
+ * The :only option restricts the callbacks to the elements matching
+ * any of the given patterns and everything inside them.  The rest of
+ * the document is parsed without calling into Ruby, apart from the
+ * start and end document callbacks and errors.  Patterns use the
+ * subset of XPath that can be matched while streaming, such as
+ * '/feed/entry/id' or '//price'.  Prefixes used in the patterns are
+ * mapped to namespaces with the :namespaces option:
+ *
+ *   parser.parse(:only => ['/atom:feed/atom:entry/atom:id'],
+ *                :namespaces => {'atom' => 'http://www.w3.org/2005/Atom'})
+ *
+ * For push contexts (see XML::Parser::Context.push), this finishes the
+ * input if that was not done yet.  Since their events are delivered as
+ * data is fed, the :only option cannot be used with them.
  */
-static VALUE rxml_sax_parser_parse(VALUE self)
+static VALUE rxml_sax_parser_parse(int argc, VALUE *argv, VALUE self)
 {
   VALUE context = rb_ivar_get(self, CONTEXT_ATTR);
+  VALUE options, only = Qnil, namespaces = Qnil;
   xmlParserCtxtPtr ctxt;
-  Data_Get_Struct(context, xmlParserCtxt, ctxt);
+  int status;
+  TypedData_Get_Struct(context, xmlParserCtxt, &rxml_parser_context_data_type, ctxt);
+
+  rb_scan_args(argc, argv, "01", &options);
+
+  if (!NIL_P(options))
+  {
+    Check_Type(options, T_HASH);
+    only = rb_hash_aref(options, ID2SYM(rb_intern("only")));
+    namespaces = rb_hash_aref(options, ID2SYM(rb_intern("namespaces")));
+  }
+
+  if (rxml_parser_context_push_p(context))
+  {
+    if (!NIL_P(only))
+      rb_raise(rb_eArgError, "The :only option cannot be used with push contexts");
+
+    status = rxml_parser_context_push_finish(context, ctxt);
+
+    if (rxml_parser_context_memory_exceeded_p(context))
+      rxml_parser_context_raise_memory_limit(context);
+  }
+  else
+  {
+    VALUE state = rxml_sax_state_new(ctxt, Qnil);
+
+    rb_ivar_set(context, SAX_STATE_ATTR, state);
+    if (!NIL_P(only))
+      rxml_sax_state_filter_set(state, only, namespaces);
+    rxml_sax_parser_configure(self, state);
+
+    status = rxml_parser_context_parse_limited(context, ctxt, xmlParseDocument);
+  }
 
-  ctxt->sax2 = 1;
-	ctxt->userData = (void*)rb_ivar_get(self, CALLBACKS_ATTR);
-  memcpy(ctxt->sax, &rxml_sax_handler, sizeof(rxml_sax_handler));
-    
-  int status = xmlParseDocument(ctxt);
+  rxml_sax_state_flush(rb_ivar_get(context, SAX_STATE_ATTR));
 
   /* Now check the parsing result*/
   if (status == -1 || !ctxt->wellFormed)
@@ -100,9 +303,20 @@ void rxml_init_sax_parser(void)
   /* Atributes */
   CALLBACKS_ATTR = rb_intern("@callbacks");
   CONTEXT_ATTR = rb_intern("@context");
-  rb_define_attr(cXMLSaxParser, "callbacks", 1, 1);
+  SAX_STATE_ATTR = rb_intern("sax_state");
+  BATCH_SIZE_ATTR = rb_intern("@batch_size");
+  LAZY_ATTRIBUTES_ATTR = rb_intern("@lazy_attributes");
+  COALESCE_CHARACTERS_ATTR = rb_intern("@coalesce_characters");
+  rb_define_attr(cXMLSaxParser, "callbacks", 1, 0);
+  rb_define_method(cXMLSaxParser, "callbacks=", rxml_sax_parser_callbacks_set, 1);
+  rb_define_attr(cXMLSaxParser, "batch_size", 1, 0);
+  rb_define_method(cXMLSaxParser, "batch_size=", rxml_sax_parser_batch_size_set, 1);
+  rb_define_method(cXMLSaxParser, "coalesce_characters?", rxml_sax_parser_coalesce_characters_q, 0);
+  rb_define_method(cXMLSaxParser, "coalesce_characters=", rxml_sax_parser_coalesce_characters_set, 1);
+  rb_define_method(cXMLSaxParser, "lazy_attributes?", rxml_sax_parser_lazy_attributes_q, 0);
+  rb_define_method(cXMLSaxParser, "lazy_attributes=", rxml_sax_parser_lazy_attributes_set, 1);
 
   /* Instance Methods */
   rb_define_method(cXMLSaxParser, "initialize", rxml_sax_parser_initialize, -1);
-  rb_define_method(cXMLSaxParser, "parse", rxml_sax_parser_parse, 0);
+  rb_define_method(cXMLSaxParser, "parse", rxml_sax_parser_parse, -1);
 }
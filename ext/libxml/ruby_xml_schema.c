@@ -114,6 +114,12 @@ static void rxml_schema_free(xmlSchemaPtr xschema)
   xmlSchemaFree(xschema);
 }
 
+const rb_data_type_t rxml_schema_data_type = {
+  "LibXML::XML::Schema",
+  { NULL, (RUBY_DATA_FUNC)rxml_schema_free, NULL },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 VALUE rxml_wrap_schema(xmlSchemaPtr xschema)
 {
   VALUE result;
@@ -121,7 +127,7 @@ VALUE rxml_wrap_schema(xmlSchemaPtr xschema)
   if (!xschema)
     rb_raise(rb_eArgError, "XML::Schema is required!");
 
-  result = Data_Wrap_Struct(cXMLSchema, NULL, rxml_schema_free, xschema);
+  result = TypedData_Wrap_Struct(cXMLSchema, &rxml_schema_data_type, xschema);
 
   /*
    * Create these as instance variables to provide the output of inspect/to_str some
@@ -179,7 +185,7 @@ static VALUE rxml_schema_init_from_document(VALUE class, VALUE document)
   xmlDocPtr xdoc;
   xmlSchemaParserCtxtPtr xparser;
 
-  Data_Get_Struct(document, xmlDoc, xdoc);
+  TypedData_Get_Struct(document, xmlDoc, &rxml_document_data_type, xdoc);
 
   xmlResetLastError();
   xparser = xmlSchemaNewDocParserCtxt(xdoc);
@@ -219,7 +225,7 @@ static VALUE rxml_schema_document(VALUE self)
 {
   xmlSchemaPtr xschema;
 
-  Data_Get_Struct(self, xmlSchema, xschema);
+  TypedData_Get_Struct(self, xmlSchema, &rxml_schema_data_type, xschema);
 
   return rxml_node_wrap(xmlDocGetRootElement(xschema->doc));
 }
@@ -254,7 +260,7 @@ static VALUE rxml_schema_namespaces(VALUE self)
   VALUE result;
   xmlSchemaPtr xschema;
 
-  Data_Get_Struct(self, xmlSchema, xschema);
+  TypedData_Get_Struct(self, xmlSchema, &rxml_schema_data_type, xschema);
 
   result = rb_ary_new();
   xmlHashScan(xschema->schemasImports, (xmlHashScanner)scan_namespaces, (void *)result);
@@ -273,7 +279,7 @@ static VALUE rxml_schema_elements(VALUE self)
   VALUE result = rb_hash_new();
   xmlSchemaPtr xschema;
 
-  Data_Get_Struct(self, xmlSchema, xschema);
+  TypedData_Get_Struct(self, xmlSchema, &rxml_schema_data_type, xschema);
   xmlHashScan(xschema->elemDecl, (xmlHashScanner)scan_schema_element, (void *)result);
 
   return result;
@@ -300,7 +306,7 @@ static VALUE rxml_schema_imported_ns_elements(VALUE self)
   xmlSchemaPtr xschema;
   VALUE result = rb_hash_new();
 
-  Data_Get_Struct(self, xmlSchema, xschema);
+  TypedData_Get_Struct(self, xmlSchema, &rxml_schema_data_type, xschema);
 
   if (xschema)
   {
@@ -321,7 +327,7 @@ static VALUE rxml_schema_types(VALUE self)
   VALUE result = rb_hash_new();
   xmlSchemaPtr xschema;
 
-  Data_Get_Struct(self, xmlSchema, xschema);
+  TypedData_Get_Struct(self, xmlSchema, &rxml_schema_data_type, xschema);
 
   if (xschema != NULL && xschema->typeDecl != NULL)
   {
@@ -350,7 +356,7 @@ static VALUE rxml_schema_imported_types(VALUE self)
   xmlSchemaPtr xschema;
   VALUE result = rb_hash_new();
 
-  Data_Get_Struct(self, xmlSchema, xschema);
+  TypedData_Get_Struct(self, xmlSchema, &rxml_schema_data_type, xschema);
 
   if (xschema)
   {
@@ -381,7 +387,7 @@ static VALUE rxml_schema_imported_ns_types(VALUE self)
   xmlSchemaPtr xschema;
   VALUE result = rb_hash_new();
 
-  Data_Get_Struct(self, xmlSchema, xschema);
+  TypedData_Get_Struct(self, xmlSchema, &rxml_schema_data_type, xschema);
 
   if (xschema)
   {
@@ -391,6 +397,161 @@ static VALUE rxml_schema_imported_ns_types(VALUE self)
   return result;
 }
 
+/* Batch validation used by XML::Schema#validate_many.  Each worker thread
+   creates one validation context for the shared compiled schema and reuses
+   it for all the documents it validates. */
+typedef struct
+{
+  xmlDocPtr xdoc;
+  rxml_error_list errors;
+} rxml_schema_validate_item;
+
+typedef struct
+{
+  xmlSchemaPtr xschema;
+  rxml_schema_validate_item *items;
+} rxml_schema_validate_batch;
+
+typedef struct
+{
+  xmlSchemaValidCtxtPtr vptr;
+  rxml_schema_validate_item *item;
+} rxml_schema_validate_worker;
+
+#if LIBXML_VERSION >= 21200
+static void rxml_schema_validate_error(void *data, const xmlError *xerror)
+#else
+static void rxml_schema_validate_error(void *data, xmlErrorPtr xerror)
+#endif
+{
+  rxml_schema_validate_worker *worker = (rxml_schema_validate_worker*)data;
+  rxml_error_list_add(&worker->item->errors, xerror);
+}
+
+static void* rxml_schema_validate_start(void *data, int index)
+{
+  rxml_schema_validate_batch *batch = (rxml_schema_validate_batch*)data;
+  rxml_schema_validate_worker *worker = calloc(1, sizeof(rxml_schema_validate_worker));
+
+  if (worker)
+  {
+    worker->vptr = xmlSchemaNewValidCtxt(batch->xschema);
+    if (worker->vptr)
+      xmlSchemaSetValidStructuredErrors(worker->vptr, rxml_schema_validate_error, worker);
+  }
+  return worker;
+}
+
+static void rxml_schema_validate_run(void *data, void *state, long index)
+{
+  rxml_schema_validate_batch *batch = (rxml_schema_validate_batch*)data;
+  rxml_schema_validate_worker *worker = (rxml_schema_validate_worker*)state;
+  rxml_schema_validate_item *item = &batch->items[index];
+
+  if (!worker || !worker->vptr)
+  {
+    rxml_error_list_add(&item->errors, xmlGetLastError());
+    return;
+  }
+
+  worker->item = item;
+  if (xmlSchemaValidateDoc(worker->vptr, item->xdoc) != 0 && item->errors.count == 0)
+    rxml_error_list_add(&item->errors, xmlGetLastError());
+  worker->item = NULL;
+}
+
+static void rxml_schema_validate_finish(void *data, void *state)
+{
+  rxml_schema_validate_worker *worker = (rxml_schema_validate_worker*)state;
+
+  if (worker)
+  {
+    if (worker->vptr)
+      xmlSchemaFreeValidCtxt(worker->vptr);
+    free(worker);
+  }
+}
+
+static void rxml_schema_validate_cancel(void *data, long index)
+{
+  rxml_schema_validate_batch *batch = (rxml_schema_validate_batch*)data;
+  xmlError xerror;
+
+  rxml_error_init(&xerror, XML_FROM_SCHEMASV, XML_ERR_USER_STOP, "Validation was cancelled");
+  rxml_error_list_add(&batch->items[index].errors, &xerror);
+  xmlResetError(&xerror);
+}
+
+/*
+ * call-seq:
+ *    schema.native_validate_many(documents, threads) -> [[XML::Error]]
+ *
+ * Implementation of XML::Schema#validate_many.
+ */
+static VALUE rxml_schema_validate_many(VALUE self, VALUE documents, VALUE threads)
+{
+  rxml_schema_validate_batch batch;
+  rxml_parallel_work work;
+  VALUE result;
+  VALUE exception;
+  long *sources;
+  long count, i;
+  int nthreads = NUM2INT(threads);
+
+  Check_Type(documents, T_ARRAY);
+  documents = rb_ary_dup(documents);
+  count = RARRAY_LEN(documents);
+
+  result = rb_ary_new_capa(count);
+
+  // Also tells the compiler that count is positive when it is allocated below
+  if (count <= 0)
+    return result;
+
+  for (i = 0; i < count; i++)
+  {
+    if (rb_obj_is_kind_of(RARRAY_AREF(documents, i), cXMLDocument) == Qfalse)
+      rb_raise(rb_eTypeError, "Must pass LibXML::XML::Document objects");
+  }
+
+  TypedData_Get_Struct(self, xmlSchema, &rxml_schema_data_type, batch.xschema);
+  batch.items = ALLOC_N(rxml_schema_validate_item, count);
+  memset(batch.items, 0, sizeof(rxml_schema_validate_item) * count);
+
+  sources = ALLOC_N(long, count);
+
+  for (i = 0; i < count; i++)
+    TypedData_Get_Struct(RARRAY_AREF(documents, i), xmlDoc, &rxml_document_data_type, batch.items[i].xdoc);
+
+  memset(&work, 0, sizeof(work));
+  work.count = count;
+  work.data = &batch;
+  work.start = rxml_schema_validate_start;
+  work.run = rxml_schema_validate_run;
+  work.finish = rxml_schema_validate_finish;
+  work.cancel = rxml_schema_validate_cancel;
+
+  exception = rxml_document_run_many(documents, &work, nthreads, sources);
+
+  // Documents that were passed more than once share the first one's errors
+  for (i = 0; i < count; i++)
+  {
+    if (sources[i] == i)
+      rb_ary_push(result, rxml_error_list_wrap(&batch.items[i].errors));
+    else
+      rb_ary_push(result, rb_ary_dup(RARRAY_AREF(result, sources[i])));
+  }
+
+  xfree(batch.items);
+  xfree(sources);
+  RB_GC_GUARD(documents);
+
+  if (exception != Qnil)
+    rb_exc_raise(exception);
+
+  return result;
+}
+
 void rxml_init_schema(void)
 {
   cXMLSchema = rb_define_class_under(mXML, "Schema", rb_cObject);
@@ -414,6 +575,7 @@ void rxml_init_schema(void)
   rb_define_method(cXMLSchema, "types", rxml_schema_types, 0);
   rb_define_method(cXMLSchema, "imported_types", rxml_schema_imported_types, 0);
   rb_define_method(cXMLSchema, "imported_ns_types", rxml_schema_imported_ns_types, 0);
+  rb_define_private_method(cXMLSchema, "native_validate_many", rxml_schema_validate_many, 2);
 
   rxml_init_schema_facet();
   rxml_init_schema_element();
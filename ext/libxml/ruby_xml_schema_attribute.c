@@ -56,6 +56,12 @@ static void rxml_schema_attribute_free(xmlSchemaAttributeUsePtr attr)
   xmlFree(attr);
 }
 
+static const rb_data_type_t rxml_schema_attribute_data_type = {
+  "LibXML::XML::Schema::Attribute",
+  { NULL, (RUBY_DATA_FUNC)rxml_schema_attribute_free, NULL },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 VALUE rxml_wrap_schema_attribute(xmlSchemaAttributeUsePtr attr)
 {
   VALUE result;
@@ -64,7 +70,7 @@ VALUE rxml_wrap_schema_attribute(xmlSchemaAttributeUsePtr attr)
   if (!attr)
     rb_raise(rb_eArgError, "XML::Schema::Attribute required!");
 
-  result = Data_Wrap_Struct(cXMLSchemaAttribute, NULL, rxml_schema_attribute_free, attr);
+  result = TypedData_Wrap_Struct(cXMLSchemaAttribute, &rxml_schema_attribute_data_type, attr);
 
   if (attr->type == XML_SCHEMA_EXTRA_ATTR_USE_PROHIB) {
     tns_str = ((xmlSchemaAttributeUseProhibPtr) attr)->targetNamespace;
@@ -89,7 +95,7 @@ static VALUE rxml_schema_attribute_node(VALUE self)
 {
   xmlSchemaAttributeUsePtr attr;
 
-  Data_Get_Struct(self, xmlSchemaAttributeUse, attr);
+  TypedData_Get_Struct(self, xmlSchemaAttributeUse, &rxml_schema_attribute_data_type, attr);
 
   return rxml_node_wrap(attr->node);
 }
@@ -10,6 +10,12 @@ static void rxml_schema_element_free(xmlSchemaElementPtr xschema_element)
   xmlFree(xschema_element);
 }
 
+static const rb_data_type_t rxml_schema_element_data_type = {
+  "LibXML::XML::Schema::Element",
+  { NULL, (RUBY_DATA_FUNC)rxml_schema_element_free, NULL },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 VALUE rxml_wrap_schema_element(xmlSchemaElementPtr xelem)
 {
   VALUE result;
@@ -17,7 +23,7 @@ VALUE rxml_wrap_schema_element(xmlSchemaElementPtr xelem)
   if (!xelem)
     rb_raise(rb_eArgError, "XML::Schema::Element is required!");
 
-  result = Data_Wrap_Struct(cXMLSchemaElement, NULL, rxml_schema_element_free, xelem);
+  result = TypedData_Wrap_Struct(cXMLSchemaElement, &rxml_schema_element_data_type, xelem);
 
   rb_iv_set(result, "@name", QNIL_OR_STRING(xelem->name));
   rb_iv_set(result, "@value", QNIL_OR_STRING(xelem->value));
@@ -31,7 +37,7 @@ static VALUE rxml_schema_element_node(VALUE self)
 {
   xmlSchemaElementPtr xelem;
 
-  Data_Get_Struct(self, xmlSchemaElement, xelem);
+  TypedData_Get_Struct(self, xmlSchemaElement, &rxml_schema_element_data_type, xelem);
 
   return rxml_node_wrap(xelem->node);
 }
@@ -41,7 +47,7 @@ static VALUE rxml_schema_element_annot(VALUE self)
   xmlSchemaElementPtr xelem;
   VALUE annotation = Qnil;
 
-  Data_Get_Struct(self, xmlSchemaElement, xelem);
+  TypedData_Get_Struct(self, xmlSchemaElement, &rxml_schema_element_data_type, xelem);
 
   if ((xelem->annot != NULL) && (xelem->annot->content != NULL))
   {
@@ -13,6 +13,12 @@ static void rxml_schema_facet_free(xmlSchemaFacetPtr xschema_type)
   xmlFree(xschema_type);
 }
 
+static const rb_data_type_t rxml_schema_facet_data_type = {
+  "LibXML::XML::Schema::Facet",
+  { NULL, (RUBY_DATA_FUNC)rxml_schema_facet_free, NULL },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 VALUE rxml_wrap_schema_facet(xmlSchemaFacetPtr facet)
 {
   VALUE result;
@@ -20,7 +26,7 @@ VALUE rxml_wrap_schema_facet(xmlSchemaFacetPtr facet)
   if (!facet)
     rb_raise(rb_eArgError, "XML::Schema::Facet required!");
 
-  result = Data_Wrap_Struct(cXMLSchemaFacet, NULL, rxml_schema_facet_free, facet);
+  result = TypedData_Wrap_Struct(cXMLSchemaFacet, &rxml_schema_facet_data_type, facet);
 
   rb_iv_set(result, "@kind", INT2NUM(facet->type));
   rb_iv_set(result, "@value", QNIL_OR_STRING(facet->value));
@@ -35,7 +41,7 @@ static VALUE rxml_schema_facet_node(VALUE self)
 {
   xmlSchemaFacetPtr facet;
 
-  Data_Get_Struct(self, xmlSchemaFacet, facet);
+  TypedData_Get_Struct(self, xmlSchemaFacet, &rxml_schema_facet_data_type, facet);
 
   return rxml_node_wrap(facet->node);
 }
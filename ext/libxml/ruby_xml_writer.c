@@ -63,16 +63,28 @@ static void rxml_writer_mark(rxml_writer_object* rwo)
     }
 }
 
+static size_t rxml_writer_memsize(const void* data)
+{
+    const rxml_writer_object* rwo = (const rxml_writer_object*)data;
+    return sizeof(rxml_writer_object) + (rwo->buffer ? rwo->buffer->size : 0);
+}
+
+static const rb_data_type_t rxml_writer_data_type = {
+    "LibXML::XML::Writer",
+    { (RUBY_DATA_FUNC)rxml_writer_mark, (RUBY_DATA_FUNC)rxml_writer_free, rxml_writer_memsize },
+    0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 static VALUE rxml_writer_wrap(rxml_writer_object* rwo)
 {
-    return Data_Wrap_Struct(cXMLWriter, rxml_writer_mark, rxml_writer_free, rwo);
+    return TypedData_Wrap_Struct(cXMLWriter, &rxml_writer_data_type, rwo);
 }
 
 static rxml_writer_object* rxml_textwriter_get(VALUE obj)
 {
     rxml_writer_object* rwo;
 
-    Data_Get_Struct(obj, rxml_writer_object, rwo);
+    TypedData_Get_Struct(obj, rxml_writer_object, &rxml_writer_data_type, rwo);
 
     return rwo;
 }
@@ -168,6 +168,61 @@ xmlXPathObjectPtr rxml_xpath_from_value(VALUE value)
   return result;
 }
 
+/* Compiles one or more patterns, which use the subset of XPath that
+   libxml can match while streaming, into a single pattern.  namespaces
+   is a Hash mapping the prefixes used in the patterns to their uris,
+   or nil. */
+xmlPatternPtr rxml_xpath_pattern_compile(VALUE patterns, VALUE namespaces, xmlDictPtr dict)
+{
+  xmlPatternPtr result;
+  const xmlChar **xnamespaces = NULL;
+  VALUE pattern;
+  VALUE prefixes = Qnil;
+
+  patterns = rb_Array(patterns);
+  if (RARRAY_LEN(patterns) == 0)
+    rb_raise(rb_eArgError, "At least one pattern must be given");
+
+  /* The pattern language supports unions */
+  pattern = rb_ary_join(patterns, rb_str_new2("|"));
+
+  if (!NIL_P(namespaces))
+  {
+    long i, count;
+
+    Check_Type(namespaces, T_HASH);
+    prefixes = rb_funcall(namespaces, rb_intern("keys"), 0);
+    count = RARRAY_LEN(prefixes);
+
+    /* Pairs of uri and prefix, terminated by NULL */
+    xnamespaces = ALLOCA_N(const xmlChar*, count * 2 + 1);
+    for (i = 0; i < count; i++)
+    {
+      VALUE prefix = rb_obj_as_string(rb_ary_entry(prefixes, i));
+      VALUE uri = rb_obj_as_string(rb_hash_aref(namespaces, rb_ary_entry(prefixes, i)));
+      rb_ary_store(prefixes, i, rb_assoc_new(prefix, uri));
+
+      xnamespaces[i * 2] = (const xmlChar*)StringValueCStr(uri);
+      xnamespaces[i * 2 + 1] = (const xmlChar*)StringValueCStr(prefix);
+    }
+    xnamespaces[count * 2] = NULL;
+  }
+
+  result = xmlPatterncompile((const xmlChar*)StringValueCStr(pattern), dict, 0, xnamespaces);
+  RB_GC_GUARD(prefixes);
+
+  if (!result)
+    rb_raise(rb_eArgError, "Invalid pattern: %s", StringValueCStr(pattern));
+
+  if (xmlPatternStreamable(result) != 1)
+  {
+    xmlFreePattern(result);
+    rb_raise(rb_eArgError, "Pattern cannot be used while streaming: %s", StringValueCStr(pattern));
+  }
+
+  return result;
+}
+
 void rxml_init_xpath(void)
 {
   mXPath = rb_define_module_under(mXML, "XPath");
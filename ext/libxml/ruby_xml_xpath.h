@@ -4,6 +4,7 @@
 #define __RXML_XPATH__
 
 #include <libxml/xpath.h>
+#include <libxml/pattern.h>
 
 extern VALUE mXPath;
 
@@ -11,5 +12,6 @@ void rxml_init_xpath(void);
 
 VALUE rxml_xpath_to_value(xmlXPathContextPtr, xmlXPathObjectPtr);
 xmlXPathObjectPtr rxml_xpath_from_value(VALUE);
+xmlPatternPtr rxml_xpath_pattern_compile(VALUE patterns, VALUE namespaces, xmlDictPtr dict);
 
 #endif
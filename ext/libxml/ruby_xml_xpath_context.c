@@ -39,9 +39,15 @@ static void rxml_xpath_context_mark(xmlXPathContextPtr ctxt)
   rb_gc_mark(value);
 }
 
+static const rb_data_type_t rxml_xpath_context_data_type = {
+  "LibXML::XML::XPath::Context",
+  { (RUBY_DATA_FUNC)rxml_xpath_context_mark, (RUBY_DATA_FUNC)rxml_xpath_context_free, NULL },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 static VALUE rxml_xpath_context_alloc(VALUE klass)
 {
-  return Data_Wrap_Struct(cXMLXPathContext, rxml_xpath_context_mark, rxml_xpath_context_free, NULL);
+  return TypedData_Wrap_Struct(cXMLXPathContext, &rxml_xpath_context_data_type, NULL);
 }
 
 /* call-seq:
@@ -64,8 +70,8 @@ static VALUE rxml_xpath_context_initialize(VALUE self, VALUE document)
     rb_raise(rb_eTypeError, "Supplied argument must be a document or node.");
   }
 
-  Data_Get_Struct(document, xmlDoc, xdoc);
-  DATA_PTR(self) = xmlXPathNewContext(xdoc);
+  TypedData_Get_Struct(document, xmlDoc, &rxml_document_data_type, xdoc);
+  RTYPEDDATA_DATA(self) = xmlXPathNewContext(xdoc);
 
   return self;
 }
@@ -80,7 +86,7 @@ static VALUE rxml_xpath_context_doc(VALUE self)
 {
   xmlDocPtr xdoc = NULL;
   xmlXPathContextPtr ctxt;
-  Data_Get_Struct(self, xmlXPathContext, ctxt);
+  TypedData_Get_Struct(self, xmlXPathContext, &rxml_xpath_context_data_type, ctxt);
   
   xdoc = ctxt->doc;
   return rxml_document_wrap(xdoc);
@@ -98,7 +104,7 @@ static VALUE rxml_xpath_context_doc(VALUE self)
 static VALUE rxml_xpath_context_register_namespace(VALUE self, VALUE prefix, VALUE uri)
 {
   xmlXPathContextPtr ctxt;
-  Data_Get_Struct(self, xmlXPathContext, ctxt);
+  TypedData_Get_Struct(self, xmlXPathContext, &rxml_xpath_context_data_type, ctxt);
 
   /* Prefix could be a symbol. */
   prefix = rb_obj_as_string(prefix);
@@ -132,17 +138,17 @@ static VALUE rxml_xpath_context_register_namespaces_from_node(VALUE self,
   xmlNodePtr xnode;
   xmlNsPtr *xnsArr;
 
-  Data_Get_Struct(self, xmlXPathContext, xctxt);
+  TypedData_Get_Struct(self, xmlXPathContext, &rxml_xpath_context_data_type, xctxt);
 
   if (rb_obj_is_kind_of(node, cXMLDocument) == Qtrue)
   {
     xmlDocPtr xdoc;
-    Data_Get_Struct(node, xmlDoc, xdoc);
+    TypedData_Get_Struct(node, xmlDoc, &rxml_document_data_type, xdoc);
     xnode = xmlDocGetRootElement(xdoc);
   }
   else if (rb_obj_is_kind_of(node, cXMLNode) == Qtrue)
   {
-    Data_Get_Struct(node, xmlNode, xnode);
+    TypedData_Get_Struct(node, xmlNode, &rxml_node_data_type, xnode);
   }
   else
   {
@@ -200,7 +206,7 @@ static VALUE rxml_xpath_context_register_namespaces(VALUE self, VALUE nslist)
   VALUE rprefix, ruri;
   xmlXPathContextPtr xctxt;
 
-  Data_Get_Struct(self, xmlXPathContext, xctxt);
+  TypedData_Get_Struct(self, xmlXPathContext, &rxml_xpath_context_data_type, xctxt);
 
   /* Need to loop through the 2nd argument and iterate through the
    * list of namespaces that we want to allow */
@@ -252,37 +258,71 @@ static VALUE rxml_xpath_context_node_set(VALUE self, VALUE node)
   xmlXPathContextPtr xctxt;
   xmlNodePtr xnode;
 
-  Data_Get_Struct(self, xmlXPathContext, xctxt);
-  Data_Get_Struct(node, xmlNode, xnode);
+  TypedData_Get_Struct(self, xmlXPathContext, &rxml_xpath_context_data_type, xctxt);
+  TypedData_Get_Struct(node, xmlNode, &rxml_node_data_type, xnode);
   xctxt->node = xnode;
   return node;
 }
 
+typedef struct
+{
+  xmlXPathContextPtr xctxt;
+  const xmlChar *expression;
+  xmlXPathCompExprPtr xcompexpr;
+  xmlXPathObjectPtr xobject;
+} rxml_xpath_context_find_args;
+
+static void* rxml_xpath_context_find_nogvl(void *data)
+{
+  rxml_xpath_context_find_args *args = (rxml_xpath_context_find_args*)data;
+
+  if (args->xcompexpr)
+    args->xobject = xmlXPathCompiledEval(args->xcompexpr, args->xctxt);
+  else
+    args->xobject = xmlXPathEval(args->expression, args->xctxt);
+
+  return NULL;
+}
+
 /*
  * call-seq:
  *    context.find("xpath") -> true|false|number|string|XML::XPath::Object
+ *    context.find("xpath", :nogvl => true) -> true|false|number|string|XML::XPath::Object
  *
  * Executes the provided xpath function.  The result depends on the execution
  * of the xpath statement.  It may be true, false, a number, a string or 
  * a node set.
+ *
+ * Options:
+ *
+ * :nogvl - Specifies if the expression should be evaluated without holding
+ *          Ruby's global VM lock so that other threads can run, including
+ *          threads querying the same document.  The result is converted to
+ *          Ruby objects once the lock is reacquired.  Defaults to false.
+ *          The document must not be modified, for example by adding or
+ *          removing nodes, while it is being queried.  Freezing the
+ *          document does not prevent that.
  */
-static VALUE rxml_xpath_context_find(VALUE self, VALUE xpath_expr)
+static VALUE rxml_xpath_context_find(int argc, VALUE *argv, VALUE self)
 {
-  xmlXPathContextPtr xctxt;
-  xmlXPathObjectPtr xobject;
-  xmlXPathCompExprPtr xcompexpr;
+  VALUE xpath_expr, options, expression = Qnil;
+  VALUE exception = Qnil;
+  rxml_xpath_context_find_args args;
+  int nogvl = 0;
+
+  rb_scan_args(argc, argv, "11", &xpath_expr, &options);
 
-  Data_Get_Struct(self, xmlXPathContext, xctxt);
+  memset(&args, 0, sizeof(args));
+  TypedData_Get_Struct(self, xmlXPathContext, &rxml_xpath_context_data_type, args.xctxt);
 
   if (TYPE(xpath_expr) == T_STRING)
   {
-    VALUE expression = rb_check_string_type(xpath_expr);
-    xobject = xmlXPathEval((xmlChar*) StringValueCStr(expression), xctxt);
+    expression = rb_str_new_frozen(xpath_expr);
+    args.expression = (const xmlChar*)StringValueCStr(expression);
   }
   else if (rb_obj_is_kind_of(xpath_expr, cXMLXPathExpression))
   {
-    Data_Get_Struct(xpath_expr, xmlXPathCompExpr, xcompexpr);
-    xobject = xmlXPathCompiledEval(xcompexpr, xctxt);
+    TypedData_Get_Struct(xpath_expr, xmlXPathCompExpr, &rxml_xpath_expression_data_type, args.xcompexpr);
   }
   else
   {
@@ -290,7 +330,32 @@ static VALUE rxml_xpath_context_find(VALUE self, VALUE xpath_expr)
         "Argument should be an instance of a String or XPath::Expression");
   }
 
-  return rxml_xpath_to_value(xctxt, xobject);
+  if (!NIL_P(options))
+  {
+    Check_Type(options, T_HASH);
+    nogvl = RTEST(rb_hash_aref(options, ID2SYM(rb_intern("nogvl"))));
+  }
+
+  if (nogvl)
+  {
+    rxml_without_gvl(rxml_xpath_context_find_nogvl, &args, &exception);
+  }
+  else
+  {
+    rxml_xpath_context_find_nogvl(&args);
+  }
+
+  RB_GC_GUARD(expression);
+  RB_GC_GUARD(xpath_expr);
+
+  if (exception != Qnil)
+  {
+    if (args.xobject)
+      xmlXPathFreeObject(args.xobject);
+    rb_exc_raise(exception);
+  }
+
+  return rxml_xpath_to_value(args.xctxt, args.xobject);
 }
 
 #if LIBXML_VERSION >= 20626
@@ -312,7 +377,7 @@ rxml_xpath_context_enable_cache(int argc,  VALUE *argv, VALUE self)
   VALUE size;
   int value = -1;
 
-  Data_Get_Struct(self, xmlXPathContext, xctxt);
+  TypedData_Get_Struct(self, xmlXPathContext, &rxml_xpath_context_data_type, xctxt);
 
   if (rb_scan_args(argc, argv, "01", &size) == 1)
   {
@@ -335,7 +400,7 @@ static VALUE
 rxml_xpath_context_disable_cache(VALUE self)
 {
   xmlXPathContextPtr xctxt;
-  Data_Get_Struct(self, xmlXPathContext, xctxt);
+  TypedData_Get_Struct(self, xmlXPathContext, &rxml_xpath_context_data_type, xctxt);
 
   if (xmlXPathContextSetCache(xctxt, 0, 0, 0) == -1)
     rxml_raise(xmlGetLastError());
@@ -354,7 +419,7 @@ void rxml_init_xpath_context(void)
   rb_define_method(cXMLXPathContext, "register_namespaces_from_node", rxml_xpath_context_register_namespaces_from_node, 1);
   rb_define_method(cXMLXPathContext, "register_namespace", rxml_xpath_context_register_namespace, 2);
   rb_define_method(cXMLXPathContext, "node=", rxml_xpath_context_node_set, 1);
-  rb_define_method(cXMLXPathContext, "find", rxml_xpath_context_find, 1);
+  rb_define_method(cXMLXPathContext, "find", rxml_xpath_context_find, -1);
 #if LIBXML_VERSION >= 20626
   rb_define_method(cXMLXPathContext, "enable_cache", rxml_xpath_context_enable_cache, -1);
   rb_define_method(cXMLXPathContext, "disable_cache", rxml_xpath_context_disable_cache, 0);
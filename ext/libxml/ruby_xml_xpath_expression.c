@@ -26,10 +26,15 @@ static void rxml_xpath_expression_free(xmlXPathCompExprPtr expr)
   xmlXPathFreeCompExpr(expr);
 }
 
+const rb_data_type_t rxml_xpath_expression_data_type = {
+  "LibXML::XML::XPath::Expression",
+  { NULL, (RUBY_DATA_FUNC)rxml_xpath_expression_free, NULL },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 static VALUE rxml_xpath_expression_alloc(VALUE klass)
 {
-  return Data_Wrap_Struct(cXMLXPathExpression, NULL,
-      rxml_xpath_expression_free, NULL);
+  return TypedData_Wrap_Struct(cXMLXPathExpression, &rxml_xpath_expression_data_type, NULL);
 }
 
 /* call-seq:
@@ -68,7 +73,7 @@ static VALUE rxml_xpath_expression_initialize(VALUE self, VALUE expression)
     rxml_raise(xerror);
   }
 
-  DATA_PTR( self) = compexpr;
+  RTYPEDDATA_DATA(self) = compexpr;
   return self;
 }
 
@@ -49,6 +49,18 @@ static void rxml_xpath_namespace_free(xmlNsPtr xns)
   xmlFreeNs(xns);
 }
 
+static size_t rxml_xpath_namespace_memsize(const void *data)
+{
+  const xmlNs *xns = (const xmlNs*)data;
+  return sizeof(xmlNs) + xmlStrlen(xns->href) + xmlStrlen(xns->prefix);
+}
+
+static const rb_data_type_t rxml_xpath_namespace_data_type = {
+  "LibXML::XML::Namespace",
+  { NULL, (RUBY_DATA_FUNC)rxml_xpath_namespace_free, rxml_xpath_namespace_memsize },
+  &rxml_namespace_data_type, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 static void rxml_xpath_object_mark(rxml_xpath_object *rxpop)
 {
   VALUE doc = (VALUE)rxpop->xdoc->_private;
@@ -56,6 +68,23 @@ static void rxml_xpath_object_mark(rxml_xpath_object *rxpop)
   rb_gc_mark(rxpop->nsnodes);
 }
 
+static size_t rxml_xpath_object_memsize(const void *data)
+{
+  const rxml_xpath_object *rxpop = (const rxml_xpath_object*)data;
+  size_t result = sizeof(rxml_xpath_object) + sizeof(xmlXPathObject);
+
+  if (rxpop->xpop->nodesetval)
+    result += sizeof(xmlNodeSet) + rxpop->xpop->nodesetval->nodeMax * sizeof(xmlNodePtr);
+
+  return result;
+}
+
+static const rb_data_type_t rxml_xpath_object_data_type = {
+  "LibXML::XML::XPath::Object",
+  { (RUBY_DATA_FUNC)rxml_xpath_object_mark, (RUBY_DATA_FUNC)rxml_xpath_object_free, rxml_xpath_object_memsize },
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 VALUE rxml_xpath_object_wrap(xmlDocPtr xdoc, xmlXPathObjectPtr xpop)
 {
   int i;
@@ -82,17 +111,16 @@ VALUE rxml_xpath_object_wrap(xmlDocPtr xdoc, xmlXPathObjectPtr xpop)
            to another namespace. */
         xns->next = NULL;
 
-        /* Specify a custom free function here since by default
+        /* Use a type with a free function here since by default
            namespace nodes will not be freed */
-        ns = rxml_namespace_wrap((xmlNsPtr)xnode);
-        RDATA(ns)->dfree = (RUBY_DATA_FUNC)rxml_xpath_namespace_free;
+        ns = TypedData_Wrap_Struct(cXMLNamespace, &rxml_xpath_namespace_data_type, xns);
         rb_ary_push(nsnodes, ns);
       }
     }
   }
 
   rxpop->nsnodes = nsnodes;
-  return Data_Wrap_Struct(cXMLXPathObject, rxml_xpath_object_mark, rxml_xpath_object_free, rxpop);
+  return TypedData_Wrap_Struct(cXMLXPathObject, &rxml_xpath_object_data_type, rxpop);
 }
 
 static VALUE rxml_xpath_object_tabref(xmlXPathObjectPtr xpop, int index)
@@ -129,7 +157,7 @@ static VALUE rxml_xpath_object_to_a(VALUE self)
   xmlXPathObjectPtr xpop;
   int i;
 
-  Data_Get_Struct(self, rxml_xpath_object, rxpop);
+  TypedData_Get_Struct(self, rxml_xpath_object, &rxml_xpath_object_data_type, rxpop);
   xpop = rxpop->xpop;
 
   set_ary = rb_ary_new();
@@ -155,7 +183,7 @@ static VALUE rxml_xpath_object_to_a(VALUE self)
 static VALUE rxml_xpath_object_empty_q(VALUE self)
 {
   rxml_xpath_object *rxpop;
-  Data_Get_Struct(self, rxml_xpath_object, rxpop);
+  TypedData_Get_Struct(self, rxml_xpath_object, &rxml_xpath_object_data_type, rxpop);
 
   if (rxpop->xpop->type != XPATH_NODESET)
     return Qnil;
@@ -178,7 +206,7 @@ static VALUE rxml_xpath_object_each(VALUE self)
   if (rxml_xpath_object_empty_q(self) == Qtrue)
     return Qnil;
 
-  Data_Get_Struct(self, rxml_xpath_object, rxpop);
+  TypedData_Get_Struct(self, rxml_xpath_object, &rxml_xpath_object_data_type, rxpop);
 
   for (i = 0; i < rxpop->xpop->nodesetval->nodeNr; i++)
   {
@@ -200,7 +228,7 @@ static VALUE rxml_xpath_object_first(VALUE self)
   if (rxml_xpath_object_empty_q(self) == Qtrue)
     return Qnil;
 
-  Data_Get_Struct(self, rxml_xpath_object, rxpop);
+  TypedData_Get_Struct(self, rxml_xpath_object, &rxml_xpath_object_data_type, rxpop);
   return rxml_xpath_object_tabref(rxpop->xpop, 0);
 }
 
@@ -217,7 +245,7 @@ static VALUE rxml_xpath_object_last(VALUE self)
   if (rxml_xpath_object_empty_q(self) == Qtrue)
     return Qnil;
 
-  Data_Get_Struct(self, rxml_xpath_object, rxpop);
+  TypedData_Get_Struct(self, rxml_xpath_object, &rxml_xpath_object_data_type, rxpop);
   return rxml_xpath_object_tabref(rxpop->xpop, -1);
 }
 
@@ -234,7 +262,7 @@ static VALUE rxml_xpath_object_aref(VALUE self, VALUE aref)
   if (rxml_xpath_object_empty_q(self) == Qtrue)
     return Qnil;
 
-  Data_Get_Struct(self, rxml_xpath_object, rxpop);
+  TypedData_Get_Struct(self, rxml_xpath_object, &rxml_xpath_object_data_type, rxpop);
   return rxml_xpath_object_tabref(rxpop->xpop, NUM2INT(aref));
 }
 
@@ -251,7 +279,7 @@ static VALUE rxml_xpath_object_length(VALUE self)
   if (rxml_xpath_object_empty_q(self) == Qtrue)
     return INT2FIX(0);
 
-  Data_Get_Struct(self, rxml_xpath_object, rxpop);
+  TypedData_Get_Struct(self, rxml_xpath_object, &rxml_xpath_object_data_type, rxpop);
   return INT2NUM(rxpop->xpop->nodesetval->nodeNr);
 }
 
@@ -277,7 +305,7 @@ static VALUE rxml_xpath_object_length(VALUE self)
 static VALUE rxml_xpath_object_get_type(VALUE self)
 {
   rxml_xpath_object *rxpop;
-  Data_Get_Struct(self, rxml_xpath_object, rxpop);
+  TypedData_Get_Struct(self, rxml_xpath_object, &rxml_xpath_object_data_type, rxpop);
   return INT2FIX(rxpop->xpop->type);
 }
 
@@ -291,7 +319,7 @@ static VALUE rxml_xpath_object_string(VALUE self)
 {
   rxml_xpath_object *rxpop;
 
-  Data_Get_Struct(self, rxml_xpath_object, rxpop);
+  TypedData_Get_Struct(self, rxml_xpath_object, &rxml_xpath_object_data_type, rxpop);
 
   if (rxpop->xpop->stringval == NULL)
     return Qnil;
@@ -310,7 +338,7 @@ static VALUE rxml_xpath_object_debug(VALUE self)
 {
 #ifdef LIBXML_DEBUG_ENABLED
   rxml_xpath_object *rxpop;
-  Data_Get_Struct(self, rxml_xpath_object, rxpop);
+  TypedData_Get_Struct(self, rxml_xpath_object, &rxml_xpath_object_data_type, rxpop);
   xmlXPathDebugDumpObject(stdout, rxpop->xpop, 0);
   return Qtrue;
 #else
@@ -22,6 +22,8 @@ require 'libxml/tree'
 require 'libxml/html_parser'
 require 'libxml/sax_parser'
 require 'libxml/sax_callbacks'
+require 'libxml/relaxng'
+require 'libxml/input_callbacks'
 
 #Schema Interface
 require 'libxml/schema'
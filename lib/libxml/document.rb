@@ -1,5 +1,7 @@
 # encoding: UTF-8
 
+require 'digest'
+
 module LibXML
   module XML
     class Document
@@ -96,13 +98,19 @@ module LibXML
       # to the XML::XPath documentation.
       #
       # call-seq:
-      #   document.find(xpath, nslist=nil) -> XML::XPath::Object
+      #   document.find(xpath, nslist=nil, options=nil) -> XML::XPath::Object
+      #   document.find(xpath, nogvl: true) -> XML::XPath::Object
       # 
       # Parameters:
       # * xpath - The xpath expression as a string
       # * namespaces - An optional list of namespaces (see XML::XPath for information).
+      # * options - An optional hash of options passed to XML::XPath::Context#find.
+      #   A hash whose only key is :nogvl is taken as the options when no
+      #   namespaces are given.
       #
       #  document.find('/foo', 'xlink:http://www.w3.org/1999/xlink')
+      #  document.find('//foo', nogvl: true)
+      #  document.find('//xlink:foo', 'xlink:http://www.w3.org/1999/xlink', nogvl: true)
       #
       # IMPORTANT - The returned XML::Node::Set must be freed before
       # its associated document.  In a running Ruby program this will
@@ -119,15 +127,42 @@ module LibXML
       #    ... do stuff ...
       #  end
       # #  nodes = nil #  GC.start
-      def find(xpath, nslist = nil)
-        self.context(nslist).find(xpath)
+      def find(xpath, nslist = nil, options = nil)
+        # find(xpath, nogvl: true) passes the options in place of the namespaces
+        if options.nil? && nslist.is_a?(Hash) && nslist.keys == [:nogvl]
+          nslist, options = nil, nslist
+        end
+        self.context(nslist).find(xpath, options)
       end
     
       # Return the first node matching the specified xpath expression.
       # For more information, please refer to the documentation
       # for XML::Document#find.
-      def find_first(xpath, nslist = nil)
-        find(xpath, nslist).first
+      def find_first(xpath, nslist = nil, options = nil)
+        find(xpath, nslist, options).first
+      end
+
+      # call-seq:
+      #   document.c14n_digest -> String
+      #   document.c14n_digest(:sha1, options) -> String
+      #   document.c14n_digest(Digest::SHA512, options) -> String
+      #
+      # Returns the binary digest of the document's canonical form.  The
+      # canonical bytes are hashed as libxml produces them, without holding
+      # Ruby's global VM lock and without building the canonical string
+      # in memory.
+      #
+      # The algorithm is either a Digest class implemented in C, such as
+      # Digest::SHA256, or the name of one (:sha1, :sha256, :sha384,
+      # :sha512, :md5 or :rmd160).  The options are the same as those of
+      # #canonicalize, except :io.  The document must not be modified
+      # by other threads while the digest is computed.
+      #
+      #  digest = doc.c14n_digest(:sha256, :mode => XML::Document::XML_C14N_EXCLUSIVE_1_0)
+      #  Base64.strict_encode64(digest)
+      def c14n_digest(algorithm = :sha256, options = nil)
+        digest = algorithm.is_a?(Class) ? algorithm : Digest(algorithm.to_s.upcase)
+        native_c14n_digest(digest, options)
       end
       
       # Returns this node's type name    
@@ -18,10 +18,13 @@ module LibXML
       #  options - Parser options.  Valid values are the constants defined on
       #            XML::HTMLParser::Options.  Mutliple options can be combined
       #            by using Bitwise OR (|).
-      def self.file(path, encoding: nil, options: nil)
+      #  dictionary - An XML::Parser::Dictionary that stores element and
+      #               attribute names.  See XML::Parser::Context#dictionary=.
+      def self.file(path, encoding: nil, options: nil, dictionary: nil)
         context = XML::HTMLParser::Context.file(path)
         context.encoding = encoding if encoding
         context.options = options if options
+        context.dictionary = dictionary if dictionary
         self.new(context)
       end
 
@@ -42,11 +45,14 @@ module LibXML
       #  options - Parser options.  Valid values are the constants defined on
       #            XML::HTMLParser::Options.  Mutliple options can be combined
       #            by using Bitwise OR (|).
-      def self.io(io, base_uri: nil, encoding: nil, options: nil)
+      #  dictionary - An XML::Parser::Dictionary that stores element and
+      #               attribute names.  See XML::Parser::Context#dictionary=.
+      def self.io(io, base_uri: nil, encoding: nil, options: nil, dictionary: nil)
         context = XML::HTMLParser::Context.io(io)
         context.base_uri = base_uri if base_uri
         context.encoding = encoding if encoding
         context.options = options if options
+        context.dictionary = dictionary if dictionary
         self.new(context)
       end
 
@@ -67,11 +73,14 @@ module LibXML
       #  options - Parser options.  Valid values are the constants defined on
       #            XML::HTMLParser::Options.  Mutliple options can be combined
       #            by using Bitwise OR (|).
-      def self.string(string, base_uri: nil, encoding: nil, options: nil)
+      #  dictionary - An XML::Parser::Dictionary that stores element and
+      #               attribute names.  See XML::Parser::Context#dictionary=.
+      def self.string(string, base_uri: nil, encoding: nil, options: nil, dictionary: nil)
         context = XML::HTMLParser::Context.string(string)
         context.base_uri = base_uri if base_uri
         context.encoding = encoding if encoding
         context.options = options if options
+        context.dictionary = dictionary if dictionary
         self.new(context)
       end
 
@@ -0,0 +1,24 @@
+module LibXML
+  module XML
+    class InputCallbacks
+      # Adapts a scheme handler result that yields a document in chunks,
+      # such as an Enumerator, to the read interface used by the parser.
+      class ChunkReader
+        def initialize(chunks)
+          @chunks = chunks.is_a?(Enumerator) ? chunks : chunks.to_enum(:each)
+        end
+
+        # Returns the next chunk, or nil once all chunks have been read.
+        # Chunks may be longer than length.
+        def read(length = nil, buffer = nil)
+          while true
+            chunk = @chunks.next.to_s
+            return chunk unless chunk.empty?
+          end
+        rescue StopIteration
+          nil
+        end
+      end
+    end
+  end
+end
@@ -64,25 +64,31 @@ module LibXML
       end
 
       # call-seq:
-      #   node.find(namespaces=nil) -> XPath::XPathObject
+      #   node.find(namespaces=nil, options=nil) -> XPath::XPathObject
+      #   node.find(xpath, nogvl: true) -> XPath::XPathObject
       #
       # Return nodes matching the specified xpath expression.
       # For more information, please refer to the documentation
       # for XML::Document#find.
       #
-      # Namespaces is an optional array of XML::NS objects
-      def find(xpath, nslist = nil)
-        self.context(nslist).find(xpath)
+      # Namespaces is an optional array of XML::NS objects.  Options are
+      # passed to XML::XPath::Context#find.
+      def find(xpath, nslist = nil, options = nil)
+        # find(xpath, nogvl: true) passes the options in place of the namespaces
+        if options.nil? && nslist.is_a?(Hash) && nslist.keys == [:nogvl]
+          nslist, options = nil, nslist
+        end
+        self.context(nslist).find(xpath, options)
       end
     
       # call-seq:
-      #   node.find_first(namespaces=nil) -> XML::Node
+      #   node.find_first(namespaces=nil, options=nil) -> XML::Node
       #
       # Return the first node matching the specified xpath expression.
       # For more information, please refer to the documentation
       # for the #find method.
-      def find_first(xpath, nslist = nil)
-        find(xpath, nslist).first
+      def find_first(xpath, nslist = nil, options = nil)
+        find(xpath, nslist, options).first
       end
 
       # call-seq:
@@ -1,5 +1,7 @@
 # encoding: UTF-8
 
+require 'etc'
+
 module LibXML
   module XML
     class Parser
@@ -19,7 +21,8 @@ module LibXML
       # call-seq:
       #    XML::Parser.file(path) -> XML::Parser
       #    XML::Parser.file(path, encoding: XML::Encoding::UTF_8,
-      #                           options: XML::Parser::Options::NOENT) -> XML::Parser
+      #                           options: XML::Parser::Options::NOENT,
+      #                           nogvl: true) -> XML::Parser
       #
       # Creates a new parser for the specified file or uri.
       #
@@ -32,11 +35,53 @@ module LibXML
       #  options - Parser options.  Valid values are the constants defined on
       #            XML::Parser::Options.  Mutliple options can be combined
       #            by using Bitwise OR (|).
-      def self.file(path, base_uri: nil, encoding: nil, options: nil)
+      #  dictionary - An XML::Parser::Dictionary that stores element and
+      #               attribute names.  See XML::Parser::Context#dictionary=.
+      #  memory_limit - The maximum number of bytes libxml may allocate while
+      #                 parsing.  See XML::Parser::Context#memory_limit=.
+      #  nogvl - Parse without holding Ruby's global VM lock so that other
+      #          threads can run.  See XML::Parser::Context#nogvl=.
+      def self.file(path, base_uri: nil, encoding: nil, options: nil, dictionary: nil, memory_limit: nil, nogvl: false)
         context = XML::Parser::Context.file(path)
         context.base_uri = base_uri if base_uri
         context.encoding = encoding if encoding
         context.options = options if options
+        context.dictionary = dictionary if dictionary
+        context.memory_limit = memory_limit if memory_limit
+        context.nogvl = nogvl if nogvl
+        self.new(context)
+      end
+
+      # call-seq:
+      #    XML::Parser.mmap(path) -> XML::Parser
+      #    XML::Parser.mmap(path, encoding: XML::Encoding::UTF_8,
+      #                           options: XML::Parser::Options::NOENT,
+      #                           nogvl: true) -> XML::Parser
+      #
+      # Creates a new parser for the specified file, which is read through
+      # a memory mapping.  See XML::Parser::Context.mmap.
+      #
+      # Parameters:
+      #
+      #  path - Path to file
+      #  encoding - The document encoding, defaults to nil. Valid values
+      #             are the encoding constants defined on XML::Encoding.
+      #  options - Parser options.  Valid values are the constants defined on
+      #            XML::Parser::Options.  Mutliple options can be combined
+      #            by using Bitwise OR (|).
+      #  dictionary - An XML::Parser::Dictionary that stores element and
+      #               attribute names.  See XML::Parser::Context#dictionary=.
+      #  memory_limit - The maximum number of bytes libxml may allocate while
+      #                 parsing.  See XML::Parser::Context#memory_limit=.
+      #  nogvl - Parse without holding Ruby's global VM lock so that other
+      #          threads can run.  See XML::Parser::Context#nogvl=.
+      def self.mmap(path, encoding: nil, options: nil, dictionary: nil, memory_limit: nil, nogvl: false)
+        context = XML::Parser::Context.mmap(path)
+        context.encoding = encoding if encoding
+        context.options = options if options
+        context.dictionary = dictionary if dictionary
+        context.memory_limit = memory_limit if memory_limit
+        context.nogvl = nogvl if nogvl
         self.new(context)
       end
 
@@ -57,11 +102,17 @@ module LibXML
       #  options - Parser options.  Valid values are the constants defined on
       #            XML::Parser::Options.  Mutliple options can be combined
       #            by using Bitwise OR (|).
-      def self.io(io, base_uri: nil, encoding: nil, options: nil)
+      #  dictionary - An XML::Parser::Dictionary that stores element and
+      #               attribute names.  See XML::Parser::Context#dictionary=.
+      #  memory_limit - The maximum number of bytes libxml may allocate while
+      #                 parsing.  See XML::Parser::Context#memory_limit=.
+      def self.io(io, base_uri: nil, encoding: nil, options: nil, dictionary: nil, memory_limit: nil)
         context = XML::Parser::Context.io(io)
         context.base_uri = base_uri if base_uri
         context.encoding = encoding if encoding
         context.options = options if options
+        context.dictionary = dictionary if dictionary
+        context.memory_limit = memory_limit if memory_limit
         self.new(context)
       end
 
@@ -69,7 +120,8 @@ module LibXML
       #    XML::Parser.string(string)
       #    XML::Parser.string(string, encoding: XML::Encoding::UTF_8,
       #                               options: XML::Parser::Options::NOENT
-      #                               base_uri: "http://libxml.org") -> XML::Parser
+      #                               base_uri: "http://libxml.org",
+      #                               nogvl: true) -> XML::Parser
       #
       # Creates a new parser by parsing the specified string.
       #
@@ -82,14 +134,55 @@ module LibXML
       #  options - Parser options.  Valid values are the constants defined on
       #            XML::Parser::Options.  Multiple options can be combined
       #            by using Bitwise OR (|).
-      def self.string(string, base_uri: nil, encoding: nil, options: nil)
+      #  dictionary - An XML::Parser::Dictionary that stores element and
+      #               attribute names.  See XML::Parser::Context#dictionary=.
+      #  memory_limit - The maximum number of bytes libxml may allocate while
+      #                 parsing.  See XML::Parser::Context#memory_limit=.
+      #  nogvl - Parse without holding Ruby's global VM lock so that other
+      #          threads can run.  See XML::Parser::Context#nogvl=.
+      def self.string(string, base_uri: nil, encoding: nil, options: nil, dictionary: nil, memory_limit: nil, nogvl: false)
         context = XML::Parser::Context.string(string)
         context.base_uri = base_uri if base_uri
         context.encoding = encoding if encoding
         context.options = options if options
+        context.dictionary = dictionary if dictionary
+        context.memory_limit = memory_limit if memory_limit
+        context.nogvl = nogvl if nogvl
         self.new(context)
       end
 
+      # call-seq:
+      #    XML::Parser.parse_many(strings) -> [XML::Document | XML::Error]
+      #    XML::Parser.parse_many(paths, files: true, threads: 8,
+      #                                  encoding: XML::Encoding::UTF_8,
+      #                                  options: XML::Parser::Options::NOENT) -> [XML::Document | XML::Error]
+      #
+      # Parses many inputs at once using a pool of native threads that run
+      # without holding Ruby's global VM lock.  Returns an array with one
+      # entry per input, in the same order, that is either the parsed
+      # XML::Document or the XML::Error describing why parsing failed.
+      # Errors are returned instead of being raised or passed to the
+      # handler registered via XML::Error.set_handler, and that includes
+      # empty strings.  If the calling thread is interrupted, for example
+      # by Thread#raise or a signal, inputs that were not started yet are
+      # returned as errors with the code XML::Error::USER_STOP.
+      #
+      # Parameters:
+      #
+      #  inputs - An array of strings to parse, or of file paths or uris
+      #           if files is true
+      #  files - Whether inputs are file paths instead of xml strings
+      #  threads - Number of native threads to parse with, defaults to
+      #            the number of processors
+      #  encoding - The document encoding, defaults to nil. Valid values
+      #             are the encoding constants defined on XML::Encoding.
+      #  options - Parser options.  Valid values are the constants defined on
+      #            XML::Parser::Options.  Multiple options can be combined
+      #            by using Bitwise OR (|).
+      def self.parse_many(inputs, files: false, threads: Etc.nprocessors, encoding: nil, options: nil)
+        native_parse_many(inputs, files, threads, options, encoding)
+      end
+
       def self.register_error_handler(proc)
         warn('Parser.register_error_handler is deprecated.  Use Error.set_handler instead')
         if proc.nil?
@@ -0,0 +1,37 @@
+require 'etc'
+
+module LibXML
+  module XML
+    class RelaxNG
+      class Validator
+        # call-seq:
+        #    validator.validate_many(documents) -> [[XML::Error], ...]
+        #    validator.validate_many(documents, threads: 8) -> [[XML::Error], ...]
+        #
+        # Validates many documents at once using a pool of native threads
+        # that run without holding Ruby's global VM lock.  Each thread takes
+        # a validation context from this validator's pool and uses it for
+        # all the documents it validates.
+        #
+        # Returns an array with one entry per document, in the same order,
+        # that lists the XML::Error objects reported while validating that
+        # document.  Valid documents have an empty list.
+        #
+        # Validation adds IDs to the documents, so a document that is passed
+        # more than once is only validated once and documents that share a
+        # dictionary are validated one after the other by the same thread.
+        # Documents parsed with an XML::Parser::Dictionary are validated on
+        # the calling thread while holding the lock, since other threads may
+        # use that dictionary at any time.  The documents must not be used
+        # by other threads while they are validated.
+        #
+        # If the calling thread is interrupted, for example by Thread#raise or
+        # a signal, documents that were not started yet get a single error with
+        # the code XML::Error::USER_STOP.
+        def validate_many(documents, threads: Etc.nprocessors)
+          native_validate_many(documents, threads)
+        end
+      end
+    end
+  end
+end
@@ -12,6 +12,16 @@ module LibXML
         self.new(context)
       end
 
+      # call-seq:
+      #    XML::SaxParser.mmap(path) -> XML::SaxParser
+      #
+      # Creates a new parser for the specified file, which is read through
+      # a memory mapping.  See XML::Parser::Context.mmap.
+      def self.mmap(path)
+        context = XML::Parser::Context.mmap(path)
+        self.new(context)
+      end
+
       # call-seq:
       #    XML::SaxParser.io(io) -> XML::SaxParser
       #    XML::SaxParser.io(io, :encoding => XML::Encoding::UTF_8) -> XML::SaxParser
@@ -1,6 +1,43 @@
+require 'etc'
+
 module LibXML
   module XML
     class Schema
+      # call-seq:
+      #    schema.validate_many(documents) -> [[XML::Error], ...]
+      #    schema.validate_many(documents, threads: 8) -> [[XML::Error], ...]
+      #
+      # Validates many documents against this schema at once using a pool
+      # of native threads that run without holding Ruby's global VM lock.
+      # Each thread reuses a single validation context for all the documents
+      # it validates.
+      #
+      # Returns an array with one entry per document, in the same order,
+      # that lists the XML::Error objects reported while validating that
+      # document.  Valid documents have an empty list.  Errors are not passed
+      # to the handler registered via XML::Error.set_handler.
+      #
+      # Validation adds IDs and default attributes to the documents, so a
+      # document that is passed more than once is only validated once and
+      # documents that share a dictionary are validated one after the other
+      # by the same thread.  Documents parsed with an XML::Parser::Dictionary
+      # are validated on the calling thread while holding the lock, since
+      # other threads may use that dictionary at any time.  The documents
+      # must not be used by other threads while they are validated.
+      #
+      # If the calling thread is interrupted, for example by Thread#raise or
+      # a signal, documents that were not started yet get a single error with
+      # the code XML::Error::USER_STOP.
+      #
+      # Parameters:
+      #
+      #  documents - An array of XML::Document objects
+      #  threads - Number of native threads to validate with, defaults to
+      #            the number of processors
+      def validate_many(documents, threads: Etc.nprocessors)
+        native_validate_many(documents, threads)
+      end
+
       module Types
         XML_SCHEMA_TYPE_BASIC            = 1 # A built-in datatype
         XML_SCHEMA_TYPE_ANY              = 2
@@ -1,5 +1,7 @@
 # encoding: UTF-8
 require_relative './test_helper'
+require 'stringio'
+require 'tempfile'
 
 class TestCanonicalize < Minitest::Test
   def path(file)
@@ -117,4 +119,56 @@ class TestCanonicalize < Minitest::Test
     # TODO - This fails because the namespace nodes aren't taken into account
     # assert_equal(expected, given_doc.canonicalize(:nodes => subdoc_nodes))
   end
+
+  def test_canonicalize_to_io
+    given_doc = LibXML::XML::Document.file(self.path('c14n/given/example-1.xml'))
+    expected = IO.read(self.path('c14n/result/with-comments/example-1'))
+
+    io = StringIO.new
+    assert_equal(expected.bytesize, given_doc.canonicalize(:comments => true, :io => io))
+    assert_equal(expected, io.string)
+
+    Tempfile.create('c14n') do |file|
+      given_doc.canonicalize(:io => file)
+      file.rewind
+      assert_equal(given_doc.canonicalize, file.read)
+    end
+  end
+
+  def test_canonicalize_to_io_error
+    given_doc = LibXML::XML::Document.file(self.path('c14n/given/example-1.xml'))
+    io = Object.new
+    def io.write(string)
+      raise(IOError, 'closed stream')
+    end
+
+    assert_raises(IOError) do
+      given_doc.canonicalize(:io => io)
+    end
+  end
+
+  def test_c14n_digest
+    given_doc = LibXML::XML::Document.file(self.path('c14n/given/example-6.xml'))
+    expected = given_doc.canonicalize
+
+    assert_equal(Digest::SHA256.digest(expected), given_doc.c14n_digest)
+    assert_equal(Digest::SHA1.digest(expected), given_doc.c14n_digest(:sha1))
+    assert_equal(Digest::SHA512.digest(expected), given_doc.c14n_digest(Digest::SHA512))
+
+    mode = LibXML::XML::Document::XML_C14N_1_1
+    expected = given_doc.canonicalize(:mode => mode, :comments => true)
+    assert_equal(Digest::SHA256.digest(expected), given_doc.c14n_digest(:sha256, :mode => mode, :comments => true))
+  end
+
+  def test_c14n_digest_invalid
+    given_doc = LibXML::XML::Document.file(self.path('c14n/given/example-1.xml'))
+
+    assert_raises(ArgumentError) do
+      given_doc.c14n_digest(String)
+    end
+
+    assert_raises(ArgumentError) do
+      given_doc.c14n_digest(:sha256, :io => StringIO.new)
+    end
+  end
 end
@@ -1,5 +1,6 @@
 # encoding: UTF-8
 require_relative './test_helper'
+require 'objspace'
 
 class TestDocument < Minitest::Test
   def setup
@@ -123,6 +124,114 @@ class TestDocument < Minitest::Test
                  doc2.root.to_s(:indent => false))
   end
 
+  def test_memsize
+    small = LibXML::XML::Document.string('<nums/>')
+    large = LibXML::XML::Document.string("<nums>#{'<num>text</num>' * 1000}</nums>")
+
+    # Each num element and its text node
+    assert_operator(ObjectSpace.memsize_of(large), :>, ObjectSpace.memsize_of(small) + 1000 * 2 * 100)
+  end
+
+  def test_build
+    doc = LibXML::XML::Document.build do |doc|
+      doc.root = LibXML::XML::Node.new('nums')
+    end
+    assert_equal("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<nums/>\n", doc.to_s)
+  end
+
+  def test_from_tree
+    doc = LibXML::XML::Document.from_tree(['books',
+                                           ['book', {id: 1}, ['title', 'Programming <Ruby>']],
+                                           ['book', {id: 2}, ['title', 'Eloquent Ruby']]])
+
+    assert_equal("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<books><book id=\"1\"><title>Programming &lt;Ruby&gt;</title></book><book id=\"2\"><title>Eloquent Ruby</title></book></books>\n",
+                 doc.to_s(indent: false))
+  end
+
+  def test_build_arena
+    before = LibXML::XML.allocation_stats
+
+    doc = LibXML::XML::Document.build(arena: true) do |doc|
+      doc.root = LibXML::XML::Node.new('nums')
+      1000.times do |i|
+        doc.root << LibXML::XML::Node.new('num', i.to_s)
+      end
+      doc.root << LibXML::XML::Node.new_text('a & b')
+      doc.root['count'] = '1000'
+    end
+
+    # Nodes and names come from the arena instead of one block each
+    after = LibXML::XML.allocation_stats
+    assert_operator(after[:allocations] - before[:allocations], :<, 1000)
+
+    assert_equal('1000', doc.root['count'])
+    assert_equal(1001, doc.root.children.size)
+    assert_equal('<num>999</num>', doc.root.children[999].to_s)
+    assert_equal('a &amp; b', doc.root.last.to_s)
+
+    # Text nodes from the arena can still grow
+    doc.root.first << LibXML::XML::Node.new_text(' and more')
+    assert_equal('<num>0 and more</num>', doc.root.first.to_s)
+  end
+
+  def test_build_arena_other_document
+    node = nil
+    LibXML::XML::Document.build(arena: true) do |doc|
+      node = LibXML::XML::Node.new('num')
+    end
+
+    doc = LibXML::XML::Document.new
+    assert_raises(LibXML::XML::Error) do
+      doc.root = node
+    end
+
+    doc.root = doc.import(node)
+    assert_equal('<num/>', doc.root.to_s)
+  end
+
+  def test_build_arena_nodes_outside_block
+    doc = LibXML::XML::Document.build(arena: true)
+    doc.root = LibXML::XML::Node.new('nums')
+    doc.root << LibXML::XML::Node.new('num', 'one')
+    assert_equal('<nums><num>one</num></nums>', doc.root.to_s(indent: false))
+  end
+
+  def test_build_arena_many
+    kept = LibXML::XML::Document.build(arena: true) do |doc|
+      doc.root = LibXML::XML::Node.new('kept')
+    end
+
+    # Arena chunks are registered and removed again many more times than
+    # the table has slots while one stays registered
+    10_000.times do |i|
+      LibXML::XML::Document.build(arena: true) do |doc|
+        doc.root = LibXML::XML::Node.new('num', i.to_s)
+      end
+      GC.start if i % 100 == 0
+    end
+    GC.start
+
+    kept.root << LibXML::XML::Node.new('num', 'one')
+    assert_equal('<kept><num>one</num></kept>', kept.root.to_s(indent: false))
+
+    doc = LibXML::XML::Document.string('<nums/>')
+    doc.root << LibXML::XML::Node.new('num', 'two')
+    assert_equal('<nums><num>two</num></nums>', doc.root.to_s(indent: false))
+  end
+
+  def test_memory_bytes
+    doc = LibXML::XML::Document.string('<nums/>')
+    before = doc.memory_bytes
+
+    1000.times do
+      doc.root << LibXML::XML::Node.new('num', 'text')
+    end
+
+    # Each num element and its text node
+    assert_operator(doc.memory_bytes, :>, before + 1000 * 2 * 100)
+    assert_operator(ObjectSpace.memsize_of(doc), :>=, doc.memory_bytes)
+  end
+
   def test_nonet
     xml_string = '<ruby_array uga="booga" foo="bar"><fixnum>one</fixnum><fixnum>two</fixnum></ruby_array>'
     xml = LibXML::XML::Document.string(xml_string, options: LibXML::XML::Parser::Options::NONET)
@@ -69,6 +69,15 @@ class TestDocumentWrite < Minitest::Test
   end
 
   # --- save tests -----
+  def test_to_s_nogvl
+    assert_equal(@doc.to_s, @doc.to_s(:nogvl => true))
+    assert_equal(@doc.to_s(:indent => false), @doc.to_s(:nogvl => true, :indent => false))
+
+    value = @doc.to_s(:nogvl => true, :encoding => LibXML::XML::Encoding::ISO_8859_1)
+    assert_equal(Encoding::ISO8859_1, value.encoding)
+    assert_equal(@doc.to_s(:encoding => LibXML::XML::Encoding::ISO_8859_1), value)
+  end
+
   def test_save_utf8
     temp_filename = File.join(Dir.tmpdir, "tc_document_write_test_save_utf8.xml")
 
@@ -96,6 +105,18 @@ class TestDocumentWrite < Minitest::Test
     File.delete(temp_filename)
   end
 
+  def test_save_nogvl
+    temp_filename = File.join(Dir.tmpdir, "tc_document_write_test_save_nogvl.xml")
+
+    bytes = @doc.save(temp_filename, :nogvl => true)
+    assert_equal(305, bytes)
+
+    contents = File.read(temp_filename, nil, nil, :encoding => Encoding::UTF_8)
+    assert_equal(@doc.to_s.sub('encoding="UTF-8"', 'encoding="utf-8"'), contents)
+  ensure
+    File.delete(temp_filename)
+  end
+
   def test_save_iso_8859_1
     temp_filename = File.join(Dir.tmpdir, "tc_document_write_test_save_iso_8859_1.xml")
     bytes = @doc.save(temp_filename, :encoding => LibXML::XML::Encoding::ISO_8859_1)
@@ -159,4 +159,19 @@ class HTMLParserTest < Minitest::Test
       LibXML::XML::HTMLParser.file(file).parse
     end
   end
+
+  def test_memory_limit
+    html = "<html><body>#{'<p>text</p>' * 10_000}</body></html>"
+    context = LibXML::XML::HTMLParser::Context.string(html)
+    context.memory_limit = 10_000
+
+    error = assert_raises(LibXML::XML::Error) do
+      LibXML::XML::HTMLParser.new(context).parse
+    end
+    assert_equal(LibXML::XML::Error::NO_MEMORY, error.code)
+
+    context = LibXML::XML::HTMLParser::Context.string(html)
+    context.memory_limit = 100_000_000
+    assert_equal(10_000, LibXML::XML::HTMLParser.new(context).parse.find('//p').size)
+  end
 end
@@ -0,0 +1,174 @@
+# encoding: UTF-8
+
+require_relative './test_helper'
+require 'stringio'
+require 'weakref'
+
+class TestInputCallbacks < Minitest::Test
+  DOCUMENT = '<root><child>value</child></root>'
+
+  class StringHandler
+    def self.document_query(url)
+      DOCUMENT
+    end
+  end
+
+  class IOHandler
+    def self.document_query(url)
+      StringIO.new(DOCUMENT)
+    end
+  end
+
+  class ChunkHandler
+    def self.document_query(url)
+      DOCUMENT.scan(/.{1,5}/m).each
+    end
+  end
+
+  class ArrayHandler
+    def self.document_query(url)
+      ['<root>', '', '<child>', 'value', '</child></root>']
+    end
+  end
+
+  class BrokenIO
+    def read(*)
+      raise(IOError, 'broken')
+    end
+
+    def close
+    end
+  end
+
+  def setup
+    LibXML::XML::InputCallbacks.register
+  end
+
+  def teardown
+    %w(string: io://other/ io:// io: chunks: array: nul: broken:).each do |scheme|
+      LibXML::XML::InputCallbacks.remove_scheme(scheme)
+    end
+    LibXML::XML::InputCallbacks.unregister
+  end
+
+  def parse(url)
+    LibXML::XML::Parser.file(url).parse
+  end
+
+  def test_string
+    LibXML::XML::InputCallbacks.add_scheme('string:', StringHandler)
+    assert_equal('value', parse('string:doc').root.child.content)
+  end
+
+  def test_io
+    LibXML::XML::InputCallbacks.add_scheme('io:', IOHandler)
+    assert_equal('value', parse('io:doc').root.child.content)
+  end
+
+  def test_io_closed
+    ios = []
+    handler = Class.new do
+      define_singleton_method(:document_query) do |url|
+        StringIO.new(DOCUMENT).tap {|io| ios << io}
+      end
+    end
+
+    LibXML::XML::InputCallbacks.add_scheme('io:', handler)
+    assert_equal('value', parse('io:doc').root.child.content)
+    assert_equal(1, ios.size)
+    assert(ios.first.closed?)
+  end
+
+  # The documents opened for the handler are released even when a read
+  # raised and libxml closes them without calling into Ruby
+  def test_close_after_exception
+    LibXML::XML::InputCallbacks.add_scheme('broken:', Class.new do
+      define_singleton_method(:document_query) do |url|
+        BrokenIO.new
+      end
+    end)
+
+    refs = 10.times.map do
+      assert_raises(IOError) do
+        LibXML::XML::Parser.file('broken:doc', nogvl: true).parse
+      end
+      WeakRef.new(ObjectSpace.each_object(BrokenIO).first)
+    end
+
+    GC.start
+    assert_operator(refs.count(&:weakref_alive?), :<, 10)
+  end
+
+  def test_enumerator
+    LibXML::XML::InputCallbacks.add_scheme('chunks:', ChunkHandler)
+    assert_equal('value', parse('chunks:doc').root.child.content)
+  end
+
+  def test_enumerable
+    LibXML::XML::InputCallbacks.add_scheme('array:', ArrayHandler)
+    assert_equal('value', parse('array:doc').root.child.content)
+  end
+
+  def test_binary_string
+    handler = Class.new do
+      def self.document_query(url)
+        "\uFEFF<root>é</root>".encode('UTF-16LE').force_encoding('BINARY')
+      end
+    end
+    LibXML::XML::InputCallbacks.add_scheme('nul:', handler)
+    assert_equal("é", parse('nul:doc').root.content)
+  end
+
+  def test_scheme_case
+    LibXML::XML::InputCallbacks.add_scheme('string:', StringHandler)
+    assert_equal('value', parse('STRING:doc').root.child.content)
+  end
+
+  def test_longer_scheme_prefix
+    LibXML::XML::InputCallbacks.add_scheme('io://other/', StringHandler)
+    LibXML::XML::InputCallbacks.add_scheme('io://', IOHandler)
+    assert_equal('value', parse('io://doc').root.child.content)
+    assert(LibXML::XML::InputCallbacks.remove_scheme('io://other/'))
+  end
+
+  def test_remove_scheme
+    LibXML::XML::InputCallbacks.add_scheme('string:', StringHandler)
+    assert(LibXML::XML::InputCallbacks.remove_scheme('string:'))
+    refute(LibXML::XML::InputCallbacks.remove_scheme('string:'))
+
+    assert_raises(LibXML::XML::Error) do
+      parse('string:doc')
+    end
+  end
+
+  def test_remove_scheme_case
+    LibXML::XML::InputCallbacks.add_scheme('io://', IOHandler)
+    assert(LibXML::XML::InputCallbacks.remove_scheme('IO://'))
+    refute(LibXML::XML::InputCallbacks.remove_scheme('io://'))
+  end
+
+  def test_unregister
+    LibXML::XML::InputCallbacks.add_scheme('string:', StringHandler)
+    assert(LibXML::XML::InputCallbacks.unregister)
+    refute(LibXML::XML::InputCallbacks.unregister)
+
+    assert_raises(LibXML::XML::Error) do
+      parse('string:doc')
+    end
+  end
+
+  def test_parse_many
+    LibXML::XML::InputCallbacks.add_scheme('string:', StringHandler)
+
+    # Handlers cannot be called from parse_many's native threads
+    results = LibXML::XML::Parser.parse_many(['string:doc'], files: true, threads: 2)
+    assert_instance_of(LibXML::XML::Error, results.first)
+  end
+
+  def test_xinclude
+    LibXML::XML::InputCallbacks.add_scheme('chunks:', ChunkHandler)
+    doc = LibXML::XML::Document.string('<doc xmlns:xi="http://www.w3.org/2001/XInclude"><xi:include href="chunks:doc"/></doc>')
+    assert_equal(1, doc.xinclude)
+    assert_equal('value', doc.find_first('/doc/root/child').content)
+  end
+end
@@ -82,10 +82,10 @@ class TestNode < Minitest::Test
     node_a = @doc.find_first('*[@country]')
     node_b = @doc.root.child
 
-    # On the ruby side these are different objects
-    refute(node_a.equal?(node_b))
+    # The ruby objects wrapping a document's nodes are cached
+    assert(node_a.equal?(node_b))
 
-    # But they are the same underlying libxml node so specify they are equal
+    # They are the same underlying libxml node so specify they are equal
     assert(node_a == node_b)
     assert(node_a.eql?(node_b))
 
@@ -113,6 +113,78 @@ class TestNode < Minitest::Test
     assert(node_a.eql?(node_b))
   end
 
+  def test_wrapper_cache
+    nodes = @doc.root.to_a
+    GC.start
+    assert(nodes.zip(@doc.root.to_a).all? { |a, b| a.equal?(b) })
+    assert(@doc.find('//iron_maiden').first.equal?(@doc.root.last))
+  end
+
+  def test_wrapper_cache_weak
+    doc = LibXML::XML::Document.string("<items>#{'<item/>' * 10_000}</items>")
+    GC.start
+    before = ObjectSpace.each_object(LibXML::XML::Node).count
+
+    # Wrappers that are no longer referenced are not kept by the cache
+    doc.root.each {}
+    GC.start
+    assert_operator(ObjectSpace.each_object(LibXML::XML::Node).count - before, :<, 1_000)
+    assert_equal(10_000, doc.root.children.size)
+  end
+
+  def test_wrapper_cache_freed_node
+    node = @doc.root.first
+    text = node.first
+    assert(text.text?)
+
+    # Replacing the content frees the old text node
+    node.content = 'replaced'
+    assert_raises(RuntimeError) do
+      text.content
+    end
+    assert_equal('replaced', node.first.content)
+
+    # Added nodes are cached, and cleared once libxml frees them
+    child = LibXML::XML::Node.new('child')
+    node << child
+    assert(node.last.equal?(child))
+
+    following = LibXML::XML::Node.new('next')
+    node.next = following
+    assert(node.next.equal?(following))
+
+    preceding = LibXML::XML::Node.new('prev')
+    node.prev = preceding
+    assert(node.prev.equal?(preceding))
+
+    node.content = 'again'
+    assert_raises(RuntimeError) do
+      child.name
+    end
+
+    @doc.root.content = 'gone'
+    assert_raises(RuntimeError) do
+      following.name
+    end
+    assert_raises(RuntimeError) do
+      preceding.name
+    end
+  end
+
+  def test_wrapper_cache_merged_text
+    node = @doc.root.first
+    text = node.first
+    added = LibXML::XML::Node.new_text(' more')
+
+    # The added text is merged into the existing, already wrapped text node
+    node << added
+    assert(node.first.equal?(text))
+    assert_equal(1, node.children.size)
+    assert_raises(RuntimeError) do
+      added.content
+    end
+  end
+
   def test_equality_nil
     node = @doc.root
     assert(node != nil)
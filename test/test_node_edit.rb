@@ -74,6 +74,22 @@ class TestNodeEdit < Minitest::Test
     refute_nil(doc)
   end
 
+  def test_remove_standalone_node_gc
+    parent = LibXML::XML::Node.new('parent')
+    child = LibXML::XML::Node.new('child')
+    parent << child
+
+    # Remove the child through a different ruby object than the one that created it
+    removed = parent.first.remove!
+    removed.remove!
+    child.remove!
+    removed = nil
+    GC.start
+
+    assert_equal('<child/>', child.to_s)
+    assert_equal('<parent/>', parent.to_s)
+  end
+
   def test_remove_node_iteration
     nodes = Array.new
     @doc.root.each_element do |node|
@@ -106,6 +122,28 @@ class TestNodeEdit < Minitest::Test
                  doc.root.to_s)
   end
 
+  def test_append_tree
+    node = @doc.root.append_tree(['num', {id: 4, skip: nil}, 'four', nil, ['sub', {lang: :en}, 4.0]])
+    assert_equal('num', node.name)
+    assert_equal(@doc.root, node.parent)
+    assert_equal('<num id="4">four<sub lang="en">4.0</sub></num>', @doc.root.last.to_s(indent: false))
+  end
+
+  def test_append_tree_invalid
+    error = assert_raises(TypeError) do
+      @doc.root.append_tree(['num', ['sub', {}, {id: 1}]])
+    end
+    assert_equal('attributes must directly follow the element name', error.message)
+
+    tree = ['num']
+    tree << tree
+    assert_raises(ArgumentError) do
+      @doc.root.append_tree(tree)
+    end
+
+    assert_equal(3, @doc.root.children.size)
+  end
+
   def test_wrong_doc
     doc1 = LibXML::XML::Parser.string('<nums><one></one></nums>').parse
     doc2 = LibXML::XML::Parser.string('<nums><two></two></nums>').parse
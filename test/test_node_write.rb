@@ -78,6 +78,14 @@ class TestNodeWrite < Minitest::Test
     assert_equal('Unknown encoding value: -9999', error.to_s)
   end
 
+  def test_to_s_nogvl
+    node = @doc.root
+    value = node.to_s(:nogvl => true)
+    assert_equal(Encoding::UTF_8, value.encoding)
+    assert_equal(node.to_s, value)
+    assert_equal(node.to_s(:level => 1), node.to_s(:nogvl => true, :level => 1))
+  end
+
   def test_inner_xml
     # Default to_s has indentation
     node = @doc.root
@@ -1,6 +1,7 @@
 # encoding: UTF-8
 
 require_relative './test_helper'
+require 'tempfile'
 require 'stringio'
 
 class TestParser < Minitest::Test
@@ -39,6 +40,42 @@ class TestParser < Minitest::Test
     assert_instance_of(LibXML::XML::Parser::Context, parser.context)
   end
 
+  def test_mmap
+    file = File.expand_path(File.join(File.dirname(__FILE__), 'model/rubynet.xml'))
+
+    parser = LibXML::XML::Parser.mmap(file)
+    doc = parser.parse
+    assert_instance_of(LibXML::XML::Document, doc)
+    assert_equal('rubynet', doc.root.name)
+    assert_equal(LibXML::XML::Parser.file(file).parse.to_s, doc.to_s)
+    assert_match(/rubynet\.xml$/, doc.url)
+  end
+
+  def test_mmap_nogvl
+    file = File.expand_path(File.join(File.dirname(__FILE__), 'model/rubynet.xml'))
+    doc = LibXML::XML::Parser.mmap(file, nogvl: true).parse
+    assert_equal('rubynet', doc.root.name)
+  end
+
+  def test_mmap_gc
+    file = File.expand_path(File.join(File.dirname(__FILE__), 'model/rubynet.xml'))
+    parser = LibXML::XML::Parser.mmap(file)
+    GC.start
+    assert_equal('rubynet', parser.parse.root.name)
+  end
+
+  def test_mmap_errors
+    assert_raises(Errno::ENOENT) do
+      LibXML::XML::Parser.mmap('i_dont_exist.xml')
+    end
+
+    Tempfile.create('empty') do |file|
+      assert_raises(ArgumentError) do
+        LibXML::XML::Parser.mmap(file.path)
+      end
+    end
+  end
+
   def test_noexistent_file
     error = assert_raises(LibXML::XML::Error) do
       LibXML::XML::Parser.file('i_dont_exist.xml')
@@ -141,6 +178,57 @@ class TestParser < Minitest::Test
     puts 'Thread completed'
   end
 
+  def test_io_read_buffer
+    data = File.read(File.join(File.dirname(__FILE__), 'model/rubynet.xml'))
+    string_io = StringIO.new(data)
+    buffers = []
+    string_io.define_singleton_method(:read) do |length, buffer = nil|
+      buffers << buffer
+      super(length, buffer)
+    end
+
+    doc = LibXML::XML::Parser.io(string_io).parse
+    assert_equal('rubynet', doc.root.name)
+
+    # The same buffer is passed to every read
+    refute_empty(buffers)
+    assert_equal(1, buffers.map(&:object_id).uniq.length)
+  end
+
+  def test_io_read_length_only
+    data = File.read(File.join(File.dirname(__FILE__), 'model/rubynet.xml'))
+    io = Object.new
+    io.define_singleton_method(:read) do |length|
+      data.slice!(0, length)&.then {|chunk| chunk.empty? ? nil : chunk}
+    end
+
+    doc = LibXML::XML::Parser.io(io).parse
+    assert_equal('rubynet', doc.root.name)
+  end
+
+  def test_io_chunk_size
+    assert_equal(0, LibXML::XML.io_chunk_size)
+
+    data = File.read(File.join(File.dirname(__FILE__), 'model/rubynet.xml'))
+    string_io = StringIO.new(data)
+    lengths = []
+    string_io.define_singleton_method(:read) do |length, buffer = nil|
+      lengths << length
+      super(length, buffer)
+    end
+
+    LibXML::XML.io_chunk_size = 65536
+    doc = LibXML::XML::Parser.io(string_io).parse
+    assert_equal('rubynet', doc.root.name)
+    assert_equal([65536], lengths.uniq)
+
+    assert_raises(ArgumentError) do
+      LibXML::XML.io_chunk_size = -1
+    end
+  ensure
+    LibXML::XML.io_chunk_size = 0
+  end
+
   def test_string
     str = '<ruby_array uga="booga" foo="bar"><fixnum>one</fixnum><fixnum>two</fixnum></ruby_array>'
 
@@ -330,4 +418,267 @@ class TestParser < Minitest::Test
     assert_equal(errors.size, 0)
     assert_equal(background_errors.size, 1)
   end
+
+  def test_string_nogvl
+    str = '<ruby_array uga="booga" foo="bar"><fixnum>one</fixnum><fixnum>two</fixnum></ruby_array>'
+
+    parser = LibXML::XML::Parser.string(str, nogvl: true)
+    assert(parser.context.nogvl?)
+
+    doc = parser.parse
+    assert_instance_of(LibXML::XML::Document, doc)
+    assert_equal('ruby_array', doc.root.name)
+    assert_equal(2, doc.root.children.size)
+  end
+
+  def test_file_nogvl
+    file = File.expand_path(File.join(File.dirname(__FILE__), 'model/rubynet.xml'))
+
+    doc = LibXML::XML::Parser.file(file, nogvl: true).parse
+    assert_instance_of(LibXML::XML::Document, doc)
+    assert_equal('rubynet', doc.root.name)
+  end
+
+  def test_io_nogvl
+    context = LibXML::XML::Parser::Context.io(StringIO.new('<a/>'))
+    refute(context.nogvl?)
+
+    error = assert_raises(ArgumentError) do
+      context.nogvl = true
+    end
+    assert_equal('IO contexts cannot be parsed without the GVL', error.message)
+  end
+
+  def test_error_nogvl
+    errors = []
+    LibXML::XML::Error.set_handler do |error|
+      errors << error
+    end
+
+    error = assert_raises(LibXML::XML::Error) do
+      LibXML::XML::Parser.string('<foo><bar/></foz>', nogvl: true).parse
+    end
+    assert_equal("Fatal error: Opening and ending tag mismatch: foo line 1 and foz at :1.", error.message)
+    assert_equal(1, errors.size)
+    assert_equal(LibXML::XML::Error::TAG_NAME_MISMATCH, errors.first.code)
+  ensure
+    LibXML::XML::Error.set_handler(&LibXML::XML::Error::QUIET_HANDLER)
+  end
+
+  def test_error_handler_raises_nogvl
+    LibXML::XML::Error.set_handler do |error|
+      raise(ArgumentError, "handler: #{error.code}")
+    end
+
+    error = assert_raises(ArgumentError) do
+      LibXML::XML::Parser.string('<foo><bar/></foz>', nogvl: true).parse
+    end
+    assert_equal("handler: #{LibXML::XML::Error::TAG_NAME_MISMATCH}", error.message)
+  ensure
+    LibXML::XML::Error.set_handler(&LibXML::XML::Error::QUIET_HANDLER)
+  end
+
+  def test_nogvl_threads
+    str = '<items>' + (1..1000).map {|i| "<item id=\"#{i}\">#{i}</item>"}.join + '</items>'
+
+    threads = 4.times.map do
+      Thread.new do
+        5.times.map do
+          LibXML::XML::Parser.string(str, nogvl: true).parse.root.children.size
+        end
+      end
+    end
+
+    threads.each do |thread|
+      assert_equal([1000] * 5, thread.value)
+    end
+  end
+
+  def test_memory_limit
+    str = "<items>#{'<item>text</item>' * 10_000}</items>"
+
+    parser = LibXML::XML::Parser.string(str, memory_limit: 10_000)
+    assert_equal(10_000, parser.context.memory_limit)
+
+    error = assert_raises(LibXML::XML::Error) do
+      parser.parse
+    end
+    assert_equal('Fatal error: Memory limit of 10000 bytes exceeded.', error.message)
+    assert_equal(LibXML::XML::Error::NO_MEMORY, error.code)
+
+    doc = LibXML::XML::Parser.string(str, memory_limit: 100_000_000).parse
+    assert_equal(10_000, doc.root.children.size)
+  end
+
+  def test_memory_limit_recovery
+    str = "<items>#{'<item>text</item>' * 10_000}</items>"
+    parser = LibXML::XML::Parser.string(str, memory_limit: 10_000, options: LibXML::XML::Parser::Options::RECOVER)
+
+    assert_raises(LibXML::XML::Error) do
+      parser.parse
+    end
+  end
+
+  def test_memory_limit_nogvl
+    str = "<items>#{'<item>text</item>' * 10_000}</items>"
+
+    assert_raises(LibXML::XML::Error) do
+      LibXML::XML::Parser.string(str, memory_limit: 10_000, nogvl: true).parse
+    end
+  end
+
+  def test_memory_limit_push
+    chunks = ['<items>'] + ['<item>text</item>'] * 20_000 + ['</items>']
+
+    context = LibXML::XML::Parser::Context.push(LibXML::XML::Parser::Options::RECOVER)
+    context.memory_limit = 10_000
+    error = assert_raises(LibXML::XML::Error) do
+      chunks.each { |chunk| context.feed(chunk) }
+    end
+    assert_equal(LibXML::XML::Error::NO_MEMORY, error.code)
+
+    assert_raises(LibXML::XML::Error) do
+      LibXML::XML::Parser.new(context).parse
+    end
+
+    context = LibXML::XML::Parser::Context.push
+    context.memory_limit = 100_000_000
+    chunks.each { |chunk| context.feed(chunk) }
+    assert_equal(20_000, LibXML::XML::Parser.new(context).parse.root.children.size)
+  end
+
+  def test_memory_limit_fibers
+    reader = Class.new do
+      def initialize(str)
+        @io = StringIO.new(str)
+      end
+
+      def read(*args)
+        Fiber.yield
+        @io.read(*args)
+      end
+    end
+
+    large = "<items>#{'<item>text</item>' * 10_000}</items>"
+    small = '<items><item>text</item></items>'
+    fibers = [[large, 100_000_000], [small, 100_000]].map do |str, limit|
+      Fiber.new do
+        LibXML::XML::Parser.io(reader.new(str), memory_limit: limit).parse.root.children.size
+      end
+    end
+
+    results = {}
+    until results.size == fibers.size
+      fibers.each_with_index do |fiber, i|
+        next if results.key?(i)
+        value = fiber.resume
+        results[i] = value unless fiber.alive?
+      end
+    end
+    assert_equal({0 => 10_000, 1 => 1}, results)
+  end
+
+  def test_memory_limit_invalid
+    context = LibXML::XML::Parser::Context.string('<a/>')
+    assert_nil(context.memory_limit)
+
+    assert_raises(ArgumentError) do
+      context.memory_limit = 0
+    end
+
+    context.memory_limit = nil
+    assert_nil(context.memory_limit)
+  end
+
+  def test_parse_many
+    strings = (1..50).map {|i| "<item id=\"#{i}\">#{i}</item>"}
+    docs = LibXML::XML::Parser.parse_many(strings, threads: 4)
+
+    assert_equal(50, docs.size)
+    docs.each_with_index do |doc, i|
+      assert_instance_of(LibXML::XML::Document, doc)
+      assert_equal((i + 1).to_s, doc.root['id'])
+    end
+  end
+
+  def test_parse_many_files
+    files = %w(rubynet.xml bands.utf-8.xml i_dont_exist.xml).map do |name|
+      File.expand_path(File.join(File.dirname(__FILE__), 'model', name))
+    end
+
+    results = LibXML::XML::Parser.parse_many(files, files: true, threads: 2)
+    assert_equal('rubynet', results[0].root.name)
+    assert_equal('bands', results[1].root.name)
+    assert_instance_of(LibXML::XML::Error, results[2])
+  end
+
+  def test_parse_many_errors
+    errors = []
+    LibXML::XML::Error.set_handler do |error|
+      errors << error
+    end
+
+    results = LibXML::XML::Parser.parse_many(['<a/>', '<foo><bar/></foz>'])
+    assert_instance_of(LibXML::XML::Document, results[0])
+
+    error = results[1]
+    assert_instance_of(LibXML::XML::Error, error)
+    assert_equal("Fatal error: Opening and ending tag mismatch: foo line 1 and foz at :1.", error.message)
+    assert_equal(LibXML::XML::Error::TAG_NAME_MISMATCH, error.code)
+    assert_empty(errors)
+  ensure
+    LibXML::XML::Error.set_handler(&LibXML::XML::Error::QUIET_HANDLER)
+  end
+
+  def test_parse_many_options
+    results = LibXML::XML::Parser.parse_many(['<a>  <b/>  </a>'], options: LibXML::XML::Parser::Options::NOBLANKS)
+    assert_equal(1, results[0].root.children.size)
+  end
+
+  def test_parse_many_invalid
+    assert_equal([], LibXML::XML::Parser.parse_many([]))
+
+    assert_raises(TypeError) do
+      LibXML::XML::Parser.parse_many(['<a/>', nil])
+    end
+
+    assert_raises(ArgumentError) do
+      LibXML::XML::Parser.parse_many(["a\0b.xml"], files: true)
+    end
+  end
+
+  def test_parse_many_empty
+    results = LibXML::XML::Parser.parse_many(['<a/>', '', '<b/>'])
+    assert_equal('a', results[0].root.name)
+    assert_equal('b', results[2].root.name)
+
+    error = results[1]
+    assert_instance_of(LibXML::XML::Error, error)
+    assert_equal(LibXML::XML::Error::DOCUMENT_EMPTY, error.code)
+    assert_equal("Fatal error: Document is empty.", error.message)
+  end
+
+  def test_parse_many_interrupted
+    skip('Signals are not supported') unless Signal.list.include?('USR1')
+
+    string = "<items>#{'<item/>' * 20_000}</items>"
+    previous = trap('USR1') {}
+    signal = Thread.new do
+      sleep(0.05)
+      Process.kill('USR1', Process.pid)
+    end
+
+    # The signal interrupts the main thread, which stops the batch
+    results = LibXML::XML::Parser.parse_many([string] * 300, threads: 1)
+    signal.join
+
+    assert_equal(300, results.size)
+    cancelled = results.grep(LibXML::XML::Error)
+    refute_empty(cancelled)
+    assert_equal([LibXML::XML::Error::USER_STOP], cancelled.map(&:code).uniq)
+    assert_equal("Fatal error: Parsing was cancelled.", cancelled.first.message)
+    assert_equal(results.take_while {|result| result.is_a?(LibXML::XML::Document)}.size, 300 - cancelled.size)
+  ensure
+    trap('USR1', previous) if previous
+  end
 end
@@ -195,4 +195,157 @@ class TestParserContext < Minitest::Test
     assert_equal('1.0', context.version)
     assert_equal(false, context.well_formed?)
   end
+
+  def test_push
+    context = LibXML::XML::Parser::Context.push
+    assert(context.push?)
+    refute(context.finished?)
+
+    xml = '<?xml version="1.0" encoding="UTF-8"?><root><child attr="1">text ü</child><child/></root>'
+    xml.bytes.each_slice(5) do |bytes|
+      context.feed(bytes.pack('C*'))
+    end
+    context.finish
+    assert(context.finished?)
+
+    doc = LibXML::XML::Parser.new(context).parse
+    assert_instance_of(LibXML::XML::Document, doc)
+    assert_equal(2, doc.root.children.length)
+    assert_equal('text ü', doc.root.first.content)
+    assert_equal('1', doc.root.first['attr'])
+  end
+
+  def test_push_parse_finishes
+    context = LibXML::XML::Parser::Context.push(LibXML::XML::Parser::Options::NOBLANKS)
+    context.feed('<root>  <a/>').feed('  <b/> </root>')
+
+    doc = LibXML::XML::Parser.new(context).parse
+    assert(context.finished?)
+    assert_equal(%w(a b), doc.root.children.map(&:name))
+  end
+
+  def test_push_error
+    context = LibXML::XML::Parser::Context.push
+    context.feed('<root><a>')
+
+    error = assert_raises(LibXML::XML::Error) do
+      context.feed('</b></root>')
+    end
+    assert_equal(LibXML::XML::Error::TAG_NAME_MISMATCH, error.code)
+
+    assert_raises(LibXML::XML::Error) do
+      context.finish
+    end
+    assert(context.finished?)
+
+    assert_raises(ArgumentError) do
+      context.feed('<c/>')
+    end
+  end
+
+  def test_push_incomplete
+    context = LibXML::XML::Parser::Context.push
+    context.feed('<root><a>')
+
+    assert_raises(LibXML::XML::Error) do
+      context.finish
+    end
+  end
+
+  def test_feed_not_push
+    context = LibXML::XML::Parser::Context.string('<root/>')
+    refute(context.push?)
+
+    assert_raises(ArgumentError) do
+      context.feed('<root/>')
+    end
+  end
+
+  def test_dictionary
+    dictionary = LibXML::XML::Parser::Dictionary.new
+    refute(dictionary.include?('item'))
+
+    documents = 3.times.map do |i|
+      context = LibXML::XML::Parser::Context.string("<root><item>#{i}</item></root>")
+      assert_nil(context.dictionary)
+      context.dictionary = dictionary
+      assert_same(dictionary, context.dictionary)
+      LibXML::XML::Parser.new(context).parse
+    end
+
+    assert(dictionary.include?('root'))
+    assert(dictionary.include?('item'))
+    assert_operator(dictionary.usage, :>, 0)
+    size = dictionary.size
+
+    LibXML::XML::Parser.string('<root><item>4</item></root>', dictionary: dictionary).parse
+    assert_equal(size + 1, dictionary.size)
+
+    dictionary = nil
+    GC.start
+    documents.each_with_index do |document, i|
+      document.root << LibXML::XML::Node.new('item', 'new')
+      assert_equal(%w(item item), document.root.children.map(&:name))
+      assert_equal(i.to_s, document.root.first.content)
+    end
+  end
+
+  def test_dictionary_html
+    dictionary = LibXML::XML::Parser::Dictionary.new
+    document = LibXML::XML::HTMLParser.string('<html><body><p>text</p></body></html>', dictionary: dictionary).parse
+    assert(dictionary.include?('body'))
+    assert_equal('text', document.find_first('//p').content)
+  end
+
+  def test_dictionary_after_parse
+    context = LibXML::XML::Parser::Context.string('<root/>')
+    LibXML::XML::Parser.new(context).parse
+
+    assert_raises(ArgumentError) do
+      context.dictionary = LibXML::XML::Parser::Dictionary.new
+    end
+  end
+
+  def test_dictionary_validate
+    schema = LibXML::XML::Schema.from_string(<<~XSD)
+      <xs:schema xmlns:xs="http://www.w3.org/2001/XMLSchema">
+        <xs:element name="items">
+          <xs:complexType>
+            <xs:sequence>
+              <xs:element name="item" maxOccurs="unbounded">
+                <xs:complexType>
+                  <xs:attribute name="id" type="xs:ID"/>
+                </xs:complexType>
+              </xs:element>
+            </xs:sequence>
+          </xs:complexType>
+        </xs:element>
+      </xs:schema>
+    XSD
+    dictionary = LibXML::XML::Parser::Dictionary.new
+
+    # Validation adds the IDs' values to the shared dictionary
+    documents = 8.times.map do |i|
+      xml = "<items>#{(1..500).map { |j| %(<item id="d#{i}n#{j}"/>) }.join}</items>"
+      LibXML::XML::Parser.string(xml, dictionary: dictionary).parse
+    end
+    parser = Thread.new do
+      50.times.map do |i|
+        LibXML::XML::Parser.string("<items><item id='p#{i}'/></items>", dictionary: dictionary).parse
+      end
+    end
+
+    assert_equal([[]] * 8, schema.validate_many(documents, threads: 8))
+    assert(documents.last.validate_schema(schema, nogvl: true))
+    parser.value.each do |document|
+      assert(document.validate_schema(schema, nogvl: true))
+    end
+    assert(dictionary.include?('d7n500'))
+  end
+
+  def test_dictionary_nogvl
+    assert_raises(ArgumentError) do
+      LibXML::XML::Parser.string('<root/>', dictionary: LibXML::XML::Parser::Dictionary.new, nogvl: true)
+    end
+  end
 end
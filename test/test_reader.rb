@@ -59,6 +59,11 @@ class TestReader < Minitest::Test
     verify_simple(reader)
   end
 
+  def test_mmap
+    reader = LibXML::XML::Reader.mmap(XML_FILE)
+    verify_simple(reader)
+  end
+
   def test_invalid_file
     error = assert_raises(Errno::ENOENT) do
       LibXML::XML::Reader.file('/does/not/exist')
@@ -242,6 +247,85 @@ class TestReader < Minitest::Test
     assert(true)
   end
 
+  def test_each_match
+    xml = '<rows><row id="1"><a>1</a></row><group><row id="2"><row id="3"/></row></group><other/><row id="4"/></rows>'
+    reader = LibXML::XML::Reader.string(xml)
+
+    rows = Array.new
+    assert_same(reader, reader.each_match('//row') { |row| rows << row })
+
+    assert_equal(['1', '2', '4'], rows.map { |row| row['id'] })
+    assert_equal('<row id="1"><a>1</a></row>', rows.first.to_s(:indent => false))
+    assert_equal(['3'], rows[1].find('row').map { |row| row['id'] })
+
+    # The nodes are owned by their own documents
+    GC.start
+    assert_equal(rows.first.doc, rows.first.doc.root.doc)
+    assert_equal('1', rows.first.doc.root['id'])
+  end
+
+  def test_each_match_absolute
+    reader = LibXML::XML::Reader.string('<rows><row>1</row><group><row>2</row></group><row>3</row></rows>')
+    assert_equal(['1', '3'], reader.each_match(['/rows/row']).map(&:content))
+  end
+
+  def test_each_match_namespaces
+    reader = LibXML::XML::Reader.file(XML_FILE)
+    paragraphs = reader.each_match('//xhtml:p', 'xhtml' => 'http://www.w3.org/1999/xhtml').to_a
+
+    assert_equal(1, paragraphs.length)
+    assert_equal('hi there', paragraphs.first.content)
+    assert_equal('http://www.w3.org/1999/xhtml', paragraphs.first.namespaces.namespace.href)
+  end
+
+  def test_each_match_invalid
+    reader = LibXML::XML::Reader.string('<rows/>')
+
+    assert_raises(ArgumentError) do
+      reader.each_match('//row[') {}
+    end
+  end
+
+  def test_each_record
+    xml = <<~EOS
+      <table>
+        <row id="1"><a>one</a><b>1</b><c><i>x</i>y</c></row>
+        <row id="2"><b>2</b><skip><a>nested</a></skip></row>
+        <row/>
+      </table>
+    EOS
+
+    reader = LibXML::XML::Reader.string(xml)
+    records = Array.new
+    result = reader.each_record('row', :fields => %w(a b c @id)) do |record|
+      records << record
+    end
+
+    assert_same(reader, result)
+    assert_equal([{'a' => 'one', 'b' => '1', 'c' => 'xy', '@id' => '1'},
+                  {'a' => nil, 'b' => '2', 'c' => nil, '@id' => '2'},
+                  {'a' => nil, 'b' => nil, 'c' => nil, '@id' => nil}],
+                 records)
+  end
+
+  def test_each_record_struct
+    row = Struct.new(:id, :b)
+    reader = LibXML::XML::Reader.string('<table><row id="1"><b>1</b></row><row id="2"/></table>')
+
+    records = reader.each_record('row', :fields => %w(@id b), :as => row).to_a
+    assert_equal([row.new('1', '1'), row.new('2', nil)], records)
+  end
+
+  def test_each_record_all_fields
+    reader = LibXML::XML::Reader.string('<table><row id="1"><a>1</a><b>2</b></row></table>')
+    assert_equal([{'a' => '1', 'b' => '2'}], reader.each_record('row').to_a)
+
+    reader = LibXML::XML::Reader.string('<table/>')
+    assert_raises(ArgumentError) do
+      reader.each_record('row', :as => Struct.new(:a)) {}
+    end
+  end
+
   def test_mode
     reader = LibXML::XML::Reader.string('<xml/>')
     assert_equal(LibXML::XML::Reader::MODE_INITIAL, reader.read_state)
@@ -50,4 +50,86 @@ class TestRelaxNG < Minitest::Test
     refute_nil(error.node)
     assert_equal('invalid', error.node.name)
   end
+
+  def invalid_document
+    doc = LibXML::XML::Document.string(@doc.to_s)
+    doc.root << LibXML::XML::Node.new('invalid', 'this will mess up validation')
+    doc
+  end
+
+  def valid_document
+    LibXML::XML::Document.string(@doc.to_s)
+  end
+
+  def test_validator_valid
+    validator = LibXML::XML::RelaxNG::Validator.new(relaxng)
+    assert_equal([], validator.validate(@doc))
+  end
+
+  def test_validator_invalid
+    validator = LibXML::XML::RelaxNG::Validator.new(relaxng)
+    errors = validator.validate(invalid_document)
+
+    refute_empty(errors)
+    error = errors.first
+    assert_kind_of(LibXML::XML::Error, error)
+    assert_equal(LibXML::XML::Error::RELAXNGV, error.domain)
+    assert_equal(LibXML::XML::Error::LT_IN_ATTRIBUTE, error.code)
+    assert(error.message.match(/Did not expect element invalid there/))
+
+    # The pooled context is reused and starts with a clean error list
+    assert_equal([], validator.validate(@doc))
+  end
+
+  def test_validator_type
+    assert_raises(TypeError) do
+      LibXML::XML::RelaxNG::Validator.new(@doc)
+    end
+
+    validator = LibXML::XML::RelaxNG::Validator.new(relaxng)
+    assert_raises(TypeError) do
+      validator.validate('<shiporder/>')
+    end
+  end
+
+  def test_validator_validate_many
+    validator = LibXML::XML::RelaxNG::Validator.new(relaxng)
+    docs = [@doc, invalid_document, valid_document, invalid_document, valid_document]
+
+    results = validator.validate_many(docs, threads: 3)
+    assert_equal(5, results.length)
+    assert_equal([], results[0])
+    refute_empty(results[1])
+    assert_equal([], results[2])
+    refute_empty(results[3])
+    assert_equal([], results[4])
+    assert_equal(LibXML::XML::Error::RELAXNGV, results[1].first.domain)
+
+    assert_equal([], validator.validate_many([]))
+    assert_equal([[]], validator.validate_many([@doc], threads: 1))
+  end
+
+  def test_validator_validate_many_same_document
+    relaxng = LibXML::XML::RelaxNG.from_string(<<~RNG)
+      <element name="items" xmlns="http://relaxng.org/ns/structure/1.0"
+               datatypeLibrary="http://www.w3.org/2001/XMLSchema-datatypes">
+        <oneOrMore>
+          <element name="item">
+            <attribute name="id"><data type="ID"/></attribute>
+          </element>
+        </oneOrMore>
+      </element>
+    RNG
+    validator = LibXML::XML::RelaxNG::Validator.new(relaxng)
+    xml = "<items>#{(1..1000).map { |i| %(<item id="n#{i}"/>) }.join}</items>"
+
+    # Validation adds the IDs to the document, which must not happen on
+    # several threads at once
+    10.times do
+      doc = LibXML::XML::Document.string(xml)
+      results = validator.validate_many([doc] * 8, threads: 8)
+      assert_equal([[]] * 8, results)
+      assert_equal(1, doc.find('id("n2")').size)
+    end
+  end
 end
@@ -144,6 +144,13 @@ class TestSaxParser < Minitest::Test
     verify(parser)
   end
 
+  def test_mmap
+    parser = LibXML::XML::SaxParser.mmap(saxtest_file)
+    parser.callbacks = TestCaseCallbacks.new
+    parser.parse
+    verify(parser)
+  end
+
   def test_file_no_callbacks
     parser = LibXML::XML::SaxParser.file(saxtest_file)
     assert_equal true, parser.parse
@@ -206,6 +213,44 @@ class TestSaxParser < Minitest::Test
     verify(parser)
   end
 
+  def test_push
+    context = LibXML::XML::Parser::Context.push
+    parser = LibXML::XML::SaxParser.new(context)
+    parser.callbacks = TestCaseCallbacks.new
+
+    context.feed(File.read(saxtest_file))
+    assert_equal(true, parser.parse)
+    verify(parser)
+  end
+
+  def test_push_chunks
+    context = LibXML::XML::Parser::Context.push
+    parser = LibXML::XML::SaxParser.new(context)
+    parser.callbacks = TestCaseCallbacks.new
+
+    xml = File.read(saxtest_file)
+    xml.bytes.each_slice(3) do |bytes|
+      context.feed(bytes.pack('C*'))
+    end
+
+    # Events are delivered while data is fed
+    assert_includes(parser.callbacks.result, "end_element: entry")
+    refute_includes(parser.callbacks.result, "end_document")
+
+    context.finish
+    result = parser.callbacks.result.grep(/^(start|end)_element/)
+    assert_equal("start_element: feed, attr: {}", result.first)
+    assert_equal("end_element_ns feed, prefix: , uri: http://www.w3.org/2005/Atom", result.last)
+    assert_equal("end_document", parser.callbacks.result.last)
+  end
+
+  def test_push_no_callbacks
+    context = LibXML::XML::Parser::Context.push
+    parser = LibXML::XML::SaxParser.new(context)
+    context.feed(File.read(saxtest_file))
+    assert_equal(true, parser.parse)
+  end
+
   def test_nil_string
     error = assert_raises(TypeError) do
       LibXML::XML::SaxParser.string(nil)
@@ -342,4 +387,402 @@ EOS
     # Check callbacks
     parser.callbacks.result
   end
+
+  class NameCallbacks
+    include LibXML::XML::SaxParser::Callbacks
+
+    attr_reader :names
+
+    def initialize
+      @names = Array.new
+    end
+
+    def on_start_element_ns(name, attributes, prefix, uri, namespaces)
+      @names << name << prefix << uri
+      @names.concat(attributes.keys)
+      @names.concat(namespaces.keys.compact)
+    end
+
+    def on_end_element_ns(name, prefix, uri)
+      @names << name << prefix << uri
+    end
+  end
+
+  def test_interned_names
+    parser = LibXML::XML::SaxParser.string('<a:root xmlns:a="urn:a"><a:item id="1"/><a:item id="2"/></a:root>')
+    parser.callbacks = NameCallbacks.new
+    parser.parse
+
+    names = parser.callbacks.names
+    assert(names.all?(&:frozen?))
+
+    items = names.select { |name| name == 'item' }
+    assert_equal(4, items.length)
+    assert_equal(1, items.map(&:object_id).uniq.length)
+
+    ids = names.select { |name| name == 'id' }
+    assert_equal(2, ids.length)
+    assert_same(ids[0], ids[1])
+
+    uris = names.select { |name| name == 'urn:a' }
+    assert_equal(6, uris.length)
+    assert_equal(1, uris.map(&:object_id).uniq.length)
+    assert_equal(Encoding::UTF_8, uris[0].encoding)
+  end
+
+  def test_partial_callbacks
+    handler = Class.new do
+      attr_reader :names
+
+      def initialize
+        @names = Array.new
+      end
+
+      def on_start_element_ns(name, attributes, prefix, uri, namespaces)
+        @names << name
+      end
+    end.new
+
+    parser = LibXML::XML::SaxParser.string('<?pi data?><root><!-- comment -->text<a/></root>')
+    parser.callbacks = handler
+    parser.parse
+    assert_equal(%w(root a), handler.names)
+  end
+
+  def test_characters_without_cdata_block
+    handler = Class.new do
+      include LibXML::XML::SaxParser::Callbacks
+
+      attr_reader :chars
+
+      def initialize
+        @chars = Array.new
+      end
+
+      def on_characters(chars)
+        @chars << chars
+      end
+    end.new
+
+    parser = LibXML::XML::SaxParser.string('<root>text<![CDATA[cdata]]></root>')
+    parser.callbacks = handler
+    parser.parse
+    assert_equal(%w(text), handler.chars)
+  end
+
+  class BatchCallbacks
+    include LibXML::XML::SaxParser::Callbacks
+
+    attr_reader :batches, :errors
+
+    def initialize
+      @batches = Array.new
+      @errors = Array.new
+    end
+
+    def on_events(batch)
+      @batches << batch
+    end
+
+    def on_error(error)
+      @errors << [@batches.flatten.length / 4, error]
+    end
+
+    def on_start_element_ns(name, attributes, prefix, uri, namespaces)
+      raise('on_start_element_ns should not be called when batching')
+    end
+  end
+
+  def test_batch
+    parser = LibXML::XML::SaxParser.string('<?pi data?><a:root xmlns:a="urn:a" id="1">text<!--comment--><![CDATA[cdata]]><a:item/></a:root>')
+    parser.callbacks = BatchCallbacks.new
+    parser.batch_size = 4
+    assert_equal(4, parser.batch_size)
+    parser.parse
+
+    batches = parser.callbacks.batches
+    assert_equal([16, 16, 8], batches.map(&:length))
+    assert_equal([[:start_document, nil, nil, nil],
+                  [:processing_instruction, 'pi', nil, 'data'],
+                  [:start_element, 'root', {'id' => '1'}, 'urn:a'],
+                  [:characters, nil, nil, 'text'],
+                  [:comment, nil, nil, 'comment'],
+                  [:cdata, nil, nil, 'cdata'],
+                  [:start_element, 'item', {}, 'urn:a'],
+                  [:end_element, 'item', nil, 'urn:a'],
+                  [:end_element, 'root', nil, 'urn:a'],
+                  [:end_document, nil, nil, nil]],
+                 batches.flatten(1).each_slice(4).to_a)
+  end
+
+  def test_batch_error
+    parser = LibXML::XML::SaxParser.string('<root><a>text</b></root>')
+    parser.callbacks = BatchCallbacks.new
+
+    assert_raises(LibXML::XML::Error) do
+      parser.parse
+    end
+
+    events = parser.callbacks.batches.flatten(1).each_slice(4).map(&:first)
+    assert_equal([:start_document, :start_element, :start_element, :characters], events.first(4))
+    assert_equal(4, parser.callbacks.errors.first.first)
+  end
+
+  def test_batch_size_invalid
+    parser = LibXML::XML::SaxParser.string('<root/>')
+    assert_raises(ArgumentError) do
+      parser.batch_size = 0
+    end
+  end
+
+  class CharactersCallbacks
+    include LibXML::XML::SaxParser::Callbacks
+
+    attr_reader :chars
+
+    def initialize
+      @chars = Array.new
+    end
+
+    def on_characters(chars)
+      @chars << chars
+    end
+  end
+
+  def test_coalesce_characters
+    xml = '<root>a &amp; b &#169; c<a/>d<!--comment-->e<?pi?>f<![CDATA[g]]>h</root>'
+
+    parser = LibXML::XML::SaxParser.string(xml)
+    parser.callbacks = CharactersCallbacks.new
+    parser.parse
+    assert_operator(parser.callbacks.chars.length, :>, 6)
+
+    parser = LibXML::XML::SaxParser.string(xml)
+    parser.callbacks = CharactersCallbacks.new
+    refute(parser.coalesce_characters?)
+    parser.coalesce_characters = true
+    assert(parser.coalesce_characters?)
+    parser.parse
+    assert_equal(['a & b © c', 'd', 'e', 'f', 'h'], parser.callbacks.chars)
+  end
+
+  def test_coalesce_characters_push
+    context = LibXML::XML::Parser::Context.push
+    parser = LibXML::XML::SaxParser.new(context)
+    parser.callbacks = CharactersCallbacks.new
+    parser.coalesce_characters = true
+
+    ['<root>some', ' text ', 'in pieces</root>'].each do |chunk|
+      context.feed(chunk)
+    end
+    context.finish
+
+    assert_equal(['some text in pieces'], parser.callbacks.chars)
+  end
+
+  def test_coalesce_characters_batch
+    parser = LibXML::XML::SaxParser.string('<root>a &amp; b<a/>c</root>')
+    parser.callbacks = BatchCallbacks.new
+    parser.coalesce_characters = true
+    parser.parse
+
+    events = parser.callbacks.batches.flatten(1).each_slice(4).to_a
+    assert_equal([[:characters, nil, nil, 'a & b'], [:characters, nil, nil, 'c']],
+                 events.select { |event| event.first == :characters })
+  end
+
+  class FilterCallbacks
+    include LibXML::XML::SaxParser::Callbacks
+
+    attr_reader :result
+
+    def initialize
+      @result = Array.new
+    end
+
+    def on_start_document
+      @result << :start_document
+    end
+
+    def on_start_element_ns(name, attributes, prefix, uri, namespaces)
+      @result << "<#{name}>"
+    end
+
+    def on_end_element_ns(name, prefix, uri)
+      @result << "</#{name}>"
+    end
+
+    def on_characters(chars)
+      @result << chars
+    end
+
+    def on_comment(msg)
+      @result << "<!--#{msg}-->"
+    end
+  end
+
+  def test_parse_only
+    xml = <<~EOS
+      <feed><title>feed</title><!--skipped-->
+      <entry><id>1</id><title>one</title><item><price>10</price></item></entry>
+      <entry><id>2</id><title>two</title><price>20<!--kept--></price></entry>
+      </feed>
+    EOS
+
+    parser = LibXML::XML::SaxParser.string(xml)
+    parser.callbacks = FilterCallbacks.new
+    parser.parse(:only => ['/feed/entry/id', '//price'])
+
+    assert_equal([:start_document,
+                  '<id>', '1', '</id>', '<price>', '10', '</price>',
+                  '<id>', '2', '</id>', '<price>', '20', '<!--kept-->', '</price>'],
+                 parser.callbacks.result)
+  end
+
+  def test_parse_only_namespaces
+    parser = LibXML::XML::SaxParser.file(saxtest_file)
+    parser.callbacks = FilterCallbacks.new
+    parser.parse(:only => '/atom:feed/atom:entry//xhtml:p',
+                 :namespaces => {'atom' => 'http://www.w3.org/2005/Atom',
+                                 'xhtml' => 'http://www.w3.org/1999/xhtml'})
+
+    assert_equal([:start_document, '<p>', 'hi there', '</p>'], parser.callbacks.result)
+
+    # Unprefixed names only match elements without a namespace
+    parser = LibXML::XML::SaxParser.file(saxtest_file)
+    parser.callbacks = FilterCallbacks.new
+    parser.parse(:only => '/feed/entry')
+    assert_equal([:start_document], parser.callbacks.result)
+  end
+
+  def test_parse_only_batch
+    parser = LibXML::XML::SaxParser.string('<root><a>1</a><b>2</b><a><b>3</b></a></root>')
+    parser.callbacks = BatchCallbacks.new
+    parser.parse(:only => '//b')
+
+    events = parser.callbacks.batches.flatten(1).each_slice(4).map { |type, name, attributes, value| [type, name || value] }
+    assert_equal([[:start_document, nil],
+                  [:start_element, 'b'], [:characters, '2'], [:end_element, 'b'],
+                  [:start_element, 'b'], [:characters, '3'], [:end_element, 'b'],
+                  [:end_document, nil]],
+                 events)
+  end
+
+  def test_parse_only_invalid
+    parser = LibXML::XML::SaxParser.string('<root/>')
+    parser.callbacks = FilterCallbacks.new
+
+    assert_raises(ArgumentError) do
+      parser.parse(:only => '/root[')
+    end
+
+    context = LibXML::XML::Parser::Context.push
+    parser = LibXML::XML::SaxParser.new(context)
+    assert_raises(ArgumentError) do
+      parser.parse(:only => '/root')
+    end
+  end
+
+  def test_lazy_attributes
+    handler = Class.new do
+      include LibXML::XML::SaxParser::Callbacks
+
+      attr_reader :results, :views
+
+      def initialize
+        @results = Array.new
+        @views = Array.new
+      end
+
+      def on_start_element_ns(name, attributes, prefix, uri, namespaces)
+        @views << attributes
+        @results << [name, attributes['id'], attributes.key?('b'), attributes.length, attributes.to_h, attributes.map { |key, value| key }]
+      end
+    end.new
+
+    parser = LibXML::XML::SaxParser.string('<root xmlns:x="urn:x" id="1" x:b="2"><a/></root>')
+    parser.callbacks = handler
+    refute(parser.lazy_attributes?)
+    parser.lazy_attributes = true
+    assert(parser.lazy_attributes?)
+    parser.parse
+
+    assert_instance_of(LibXML::XML::SaxParser::Attributes, handler.views.first)
+    assert_equal([['root', '1', true, 2, {'id' => '1', 'b' => '2'}, %w(id b)],
+                  ['a', nil, false, 0, {}, []]],
+                 handler.results)
+
+    assert_raises(RuntimeError) do
+      handler.views.first['id']
+    end
+  end
+
+  def test_lazy_attributes_exception
+    handler = Class.new do
+      attr_reader :attributes
+
+      def on_start_element_ns(name, attributes, prefix, uri, namespaces)
+        @attributes = attributes
+        raise(ArgumentError, 'stop')
+      end
+    end.new
+
+    parser = LibXML::XML::SaxParser.string('<root id="1"/>')
+    parser.callbacks = handler
+    parser.lazy_attributes = true
+
+    assert_raises(ArgumentError) do
+      parser.parse
+    end
+
+    assert_raises(RuntimeError) do
+      handler.attributes.to_h
+    end
+  end
+
+  def test_memory_limit
+    # Each distinct name is stored in the parser's dictionary
+    context = LibXML::XML::Parser::Context.string("<items>#{(1..10_000).map { |i| "<item#{i}/>" }.join}</items>")
+    context.memory_limit = 10_000
+    parser = LibXML::XML::SaxParser.new(context)
+    parser.callbacks = TestCaseCallbacks.new
+
+    error = assert_raises(LibXML::XML::Error) do
+      parser.parse
+    end
+    assert_equal(LibXML::XML::Error::NO_MEMORY, error.code)
+  end
+
+  def test_memory_limit_handler
+    # Handlers may allocate libxml memory without it counting against the
+    # limit of the parse that calls them
+    handler = Class.new do
+      attr_reader :sizes
+
+      def initialize
+        @sizes = []
+      end
+
+      def on_start_element(name, attributes)
+        xml = "<items>#{'<item>text</item>' * 5_000}</items>"
+        @sizes << LibXML::XML::Parser.string(xml).parse.root.children.size
+      end
+    end
+
+    context = LibXML::XML::Parser::Context.push
+    context.memory_limit = 200_000
+    parser = LibXML::XML::SaxParser.new(context)
+    parser.callbacks = handler.new
+    context.feed('<root><a/><b/>')
+    context.feed('</root>')
+    assert_equal(true, parser.parse)
+    assert_equal([5_000] * 3, parser.callbacks.sizes)
+
+    context = LibXML::XML::Parser::Context.string('<root><a/><b/></root>')
+    context.memory_limit = 200_000
+    parser = LibXML::XML::SaxParser.new(context)
+    parser.callbacks = handler.new
+    assert_equal(true, parser.parse)
+    assert_equal([5_000] * 3, parser.callbacks.sizes)
+  end
 end
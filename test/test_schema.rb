@@ -94,6 +94,76 @@ class TestSchema < Minitest::Test
     assert_equal('invalid', error.node.name)
   end
 
+  def test_doc_valid_nogvl
+    assert(@doc.validate_schema(@schema, :nogvl => true))
+  end
+
+  def test_doc_invalid_nogvl
+    new_node = LibXML::XML::Node.new('invalid', 'this will mess up validation')
+    @doc.root << new_node
+
+    error = assert_raises(LibXML::XML::Error) do
+      @doc.validate_schema(@schema, :nogvl => true)
+    end
+
+    check_error(error)
+    assert_equal('invalid', error.node.name)
+  end
+
+  def test_validate_many
+    invalid_doc = LibXML::XML::Document.string(@doc.to_s)
+    invalid_doc.root << LibXML::XML::Node.new('invalid', 'this will mess up validation')
+
+    docs = [@doc, invalid_doc] * 10
+    results = @schema.validate_many(docs, threads: 3)
+
+    assert_equal(20, results.size)
+    results.each_slice(2) do |valid, invalid|
+      assert_equal([], valid)
+      assert_equal(1, invalid.size)
+      check_error(invalid.first)
+      assert_equal('invalid', invalid.first.node.name)
+    end
+  end
+
+  def test_validate_many_same_document
+    schema = LibXML::XML::Schema.from_string(<<~XSD)
+      <xs:schema xmlns:xs="http://www.w3.org/2001/XMLSchema">
+        <xs:element name="items">
+          <xs:complexType>
+            <xs:sequence>
+              <xs:element name="item" maxOccurs="unbounded">
+                <xs:complexType>
+                  <xs:attribute name="id" type="xs:ID"/>
+                </xs:complexType>
+              </xs:element>
+            </xs:sequence>
+          </xs:complexType>
+        </xs:element>
+      </xs:schema>
+    XSD
+    xml = "<items>#{(1..1000).map { |i| %(<item id="n#{i}"/>) }.join}</items>"
+
+    # Validation adds the IDs to the document, which must not happen on
+    # several threads at once
+    10.times do
+      doc = LibXML::XML::Document.string(xml)
+      assert_equal(0, doc.find('id("n2")').size)
+
+      results = schema.validate_many([doc] * 8, threads: 8)
+      assert_equal([[]] * 8, results)
+      assert_equal(1, doc.find('id("n2")').size)
+    end
+  end
+
+  def test_validate_many_invalid
+    assert_equal([], @schema.validate_many([]))
+
+    assert_raises(TypeError) do
+      @schema.validate_many([@doc, 'not a document'])
+    end
+  end
+
   def test_reader_valid
     reader = LibXML::XML::Reader.string(@doc.to_s)
     assert(reader.schema_validate(@schema))
@@ -9,6 +9,20 @@ class TestXml < Minitest::Test
     assert(LibXML::XML.check_lib_versions)
   end
 
+  def test_allocation_stats
+    before = LibXML::XML.allocation_stats
+    assert(before[:tracking])
+
+    doc = LibXML::XML::Document.string("<items>#{'<item>text</item>' * 100}</items>")
+    after = LibXML::XML.allocation_stats
+
+    assert_operator(after[:allocations], :>, before[:allocations])
+    assert_operator(after[:total_bytes], :>, before[:total_bytes] + 100 * 100)
+    assert_operator(after[:thread][:total_bytes], :>, before[:thread][:total_bytes] + 100 * 100)
+    assert_equal(after[:bytes], LibXML::XML.memory_used)
+    refute_nil(doc)
+  end
+
   def test_default_compression
     return unless LibXML::XML.default_compression
 
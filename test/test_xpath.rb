@@ -1,6 +1,7 @@
 # encoding: UTF-8
 
 require_relative './test_helper'
+require 'objspace'
 require 'tempfile'
 
 class TestXPath < Minitest::Test
@@ -128,7 +129,7 @@ class TestXPath < Minitest::Test
     # Since we are searching on the node, don't have to register namespace
     nodes = node.find('ns1:name')
     assert_equal(1, nodes.length)
-		refute_equal(nodes.first.object_id, nodes.last.object_id)
+    assert_same(nodes.first, nodes.last)
     assert_equal('name', nodes.first.name)
     assert_equal('man1', nodes.first.content)
   end
@@ -203,6 +204,12 @@ class TestXPath < Minitest::Test
 		refute_nil nodes
 	end
 
+  def test_memsize
+    doc = LibXML::XML::Document.string("<nums>#{'<num/>' * 100}</nums>")
+    nodes = doc.find('//num')
+    assert_operator(ObjectSpace.memsize_of(nodes), :>, 100 * 8)
+  end
+
   def test_invalid_expression
     xml = LibXML::XML::Document.string('<a></a>')
 
@@ -241,4 +248,49 @@ class TestXPath < Minitest::Test
     assert_equal(1, nodes.length)
     assert_equal(nodes[0].content, ' my comment ')
   end
+
+  def test_find_nogvl
+    nodes = @doc.find('//ns1:IdAndName', 'ns1:http://domain.somewhere.com', :nogvl => true)
+    assert_equal(3, nodes.length)
+
+    node = @doc.root.find_first('soap:Body', nil, :nogvl => true)
+    assert_equal('Body', node.name)
+
+    assert_equal(3.0, @doc.find('count(//ns1:IdAndName)', 'ns1:http://domain.somewhere.com', :nogvl => true))
+
+    expression = LibXML::XML::XPath::Expression.new('//ns1:IdAndName')
+    nodes = @doc.find(expression, 'ns1:http://domain.somewhere.com', :nogvl => true)
+    assert_equal(3, nodes.length)
+  end
+
+  def test_find_nogvl_invalid_expression
+    error = assert_raises(LibXML::XML::Error) do
+      @doc.find('//a/', nil, :nogvl => true)
+    end
+    assert_equal("Error: Invalid expression.", error.to_s)
+  end
+
+  def test_find_nogvl_keyword
+    nodes = @doc.find("//*[local-name()='IdAndName']", nogvl: true)
+    assert_equal(3, nodes.length)
+
+    node = @doc.root.find_first('soap:Body', nogvl: true)
+    assert_equal('Body', node.name)
+
+    nodes = @doc.find('//ns1:IdAndName', 'ns1:http://domain.somewhere.com', nogvl: true)
+    assert_equal(3, nodes.length)
+
+    # Other hashes are still namespaces
+    nodes = @doc.find('//ns:IdAndName', :ns => 'http://domain.somewhere.com')
+    assert_equal(3, nodes.length)
+  end
+
+  def test_find_threads
+    threads = 4.times.map do
+      Thread.new do
+        @doc.find('//ns1:IdAndName', 'ns1:http://domain.somewhere.com', nogvl: true).length
+      end
+    end
+    assert_equal([3, 3, 3, 3], threads.map(&:value))
+  end
 end